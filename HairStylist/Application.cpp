@@ -7,18 +7,66 @@
 #include <glm/glm.hpp>
 #include "Texture.h"
 #include "math.h"
+#include "canvasops.h"
+#include "file.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
 
-Application::Application(const std::string& title, int width, int height)
+const size_t Application::TRANSITION_READBACK_SLOT;
+
+Application::Application(const std::string& title, int width, int height, uint32_t canvasSize)
     :m_title(title)
 {
     m_window = std::make_unique<Window>(width, height);
     m_window->setTitle(title);
+    GLState::setCurrent(&m_glState);
 
-    m_painterFBO = std::make_unique<Framebuffer>(1024, 1024, true);
+    m_painterFBO = std::make_unique<Framebuffer>(canvasSize, canvasSize, true);
     resize(width, height);
 
     m_saveHairstyleManager = std::make_unique<HairstyleManager>("hairstyle", "Save", "save.info");
-    m_presetHairstyleManager = std::make_unique<HairstyleManager>("preset", "Presets", "preset.info");
+    m_saveHairstyleManager->setResolution(canvasSize, canvasSize);
+    m_autosave = std::make_unique<AutosaveJournal>("Save/autosave", canvasSize, canvasSize);
+
+    init(canvasSize);
+}
+
+Application::Application(HeadlessContext::Backend backend, int width, int height, uint32_t canvasSize)
+{
+    m_headlessContext = std::make_unique<HeadlessContext>(backend);
+    if (!m_headlessContext->isValid())
+        return;
+    GLState::setCurrent(&m_glState);
+
+    m_painterFBO = std::make_unique<Framebuffer>(canvasSize, canvasSize, true);
+    m_offscreenFBO = std::make_unique<Framebuffer>(width, height, true, true);
+
+    // The model view covers the whole offscreen framebuffer
+    m_modelCamera.setPerspective(45.0f, float(width), float(height), 0.1f, 100.f);
+    m_modelCamera.setViewport(0.f, 0.f, float(width), float(height));
+
+    init(canvasSize);
+    loadAssets();
+}
+
+Application::Application()
+    :Application("Hello World", 1000, 500)
+{
+}
+
+Application::~Application()
+{
+}
+
+void Application::init(uint32_t canvasSize)
+{
+    // Shipped libraries come as a single pack, the directory is used while authoring presets
+    if (file::exists("Presets/presets.hspack"))
+        m_presetHairstyleManager = std::make_unique<HairstyleManager>("Presets/presets.hspack");
+    else
+        m_presetHairstyleManager = std::make_unique<HairstyleManager>("preset", "Presets", "preset.info");
+    m_presetHairstyleManager->setResolution(canvasSize, canvasSize);
 
     m_dirLight.ambient = glm::vec3(0.f);
     m_dirLight.diffuse = glm::vec3(1.f);
@@ -32,43 +80,97 @@ Application::Application(const std::string& title, int width, int height)
     m_hairMaterial.specular = glm::vec4(0.5f, 0.5f, 0.5f, 64.0f);
 }
 
-Application::Application()
-    :Application("Hello World", 1000, 500)
+void Application::loadAssets()
 {
+    Timer timer;
+
+    Shader::enableParallelCompile();
+    m_programCache = std::make_unique<ProgramCache>("Save/shadercache");
+    for (Shader* shader : getShaders())
+        shader->setProgramCache(m_programCache.get());
+
+    m_galleryModelShader.setDefines(Gallery::getShaderDefines());
+    m_galleryHairShader.setDefines(Gallery::getShaderDefines());
+    beginLoadShaders();
+
+    // The driver compiles and the texture threads decode and compress while the meshes load
+    Texture::setCacheDirectory("Save/texturecache");
+    m_modelTexture.beginLoad("Assets/Textures/AngelinaFaceDiffuse.png");
+    m_brushTexture.beginLoad("Assets/Textures/Brush.png");
+    m_quadMesh.loadQuad();
+    m_modelMesh.load("Assets/Mesh/AngelinaHeadVB.raw", "Assets/Mesh/AngelinaHeadIB.raw", Mesh::VertexFormat::Compact);
+
+    m_modelTexture.finishLoad();
+    m_brushTexture.finishLoad();
+    for (Shader* shader : getShaders())
+        shader->finishLoad();
+
+    LOG("Loaded assets in " << timer.tick() * 1000.0f << "ms");
+
+    m_painterCamera.setPosition(0.f, 0.f, 1.0f);
+
+    m_modelCamera.setPosition(0.f, 0.0f, 10.f);
+    m_modelCamera.lookAt(glm::vec3(0.f, 0.f, 0.f));
 }
 
-Application::~Application()
+std::vector<Shader*> Application::getShaders()
+{
+    return { &m_modelShader, &m_painterOverlayShader, &m_quadShader, &m_hairShader, &m_galleryModelShader, &m_galleryHairShader };
+}
+
+void Application::beginLoadShaders()
 {
+    m_modelShader.beginLoad("Assets/Shaders/model.vert", "Assets/Shaders/model.frag");
+    m_painterOverlayShader.beginLoad("Assets/Shaders/painterOverlay.vert", "Assets/Shaders/painterOverlay.frag");
+    m_quadShader.beginLoad("Assets/Shaders/quad.vert", "Assets/Shaders/quad.frag");
+    m_hairShader.beginLoad("Assets/Shaders/hair.vert", "Assets/Shaders/hair.frag", "Assets/Shaders/hair.geom");
+    m_galleryModelShader.beginLoad("Assets/Shaders/model.vert", "Assets/Shaders/model.frag");
+    m_galleryHairShader.beginLoad("Assets/Shaders/hair.vert", "Assets/Shaders/hair.frag", "Assets/Shaders/hair.geom");
+}
+
+void Application::watchAssets()
+{
+    m_hotReloader = std::make_unique<HotReloader>();
+    m_hotReloader->addShader(m_modelShader, "Assets/Shaders/model.vert", "Assets/Shaders/model.frag");
+    m_hotReloader->addShader(m_painterOverlayShader, "Assets/Shaders/painterOverlay.vert", "Assets/Shaders/painterOverlay.frag");
+    m_hotReloader->addShader(m_quadShader, "Assets/Shaders/quad.vert", "Assets/Shaders/quad.frag");
+    m_hotReloader->addShader(m_hairShader, "Assets/Shaders/hair.vert", "Assets/Shaders/hair.frag", "Assets/Shaders/hair.geom");
+    m_hotReloader->addShader(m_galleryModelShader, "Assets/Shaders/model.vert", "Assets/Shaders/model.frag");
+    m_hotReloader->addShader(m_galleryHairShader, "Assets/Shaders/hair.vert", "Assets/Shaders/hair.frag", "Assets/Shaders/hair.geom");
+    m_hotReloader->addTexture(m_modelTexture, "Assets/Textures/AngelinaFaceDiffuse.png");
+    m_hotReloader->addTexture(m_brushTexture, "Assets/Textures/Brush.png");
+    m_hotReloader->addMesh(m_modelMesh, "Assets/Mesh/AngelinaHeadVB.raw", "Assets/Mesh/AngelinaHeadIB.raw", Mesh::VertexFormat::Compact);
 }
 
 void Application::run()
 {
+    Profiler::setThreadName("Main");
     Input::subscribe(this);
- 
-    m_modelShader.load("Assets/Shaders/model.vert", "Assets/Shaders/model.frag");
-    m_painterOverlayShader.load("Assets/Shaders/painterOverlay.vert", "Assets/Shaders/painterOverlay.frag");
-    m_quadShader.load("Assets/Shaders/quad.vert", "Assets/Shaders/quad.frag");
-    m_hairShader.load("Assets/Shaders/hair.vert", "Assets/Shaders/hair.frag", "Assets/Shaders/hair.geom");
-
-    m_quadMesh.loadQuad();
-    m_modelTexture.load("Assets/Textures/AngelinaFaceDiffuse.png");
-    m_brushTexture.load("Assets/Textures/Brush.png");
-    m_modelMesh.load("Assets/Mesh/AngelinaHeadVB.raw", "Assets/Mesh/AngelinaHeadIB.raw");
 
-    m_painterCamera.setPosition(0.f, 0.f, 1.0f);
+    loadAssets();
 
-    m_modelCamera.setPosition(0.f, 0.0f, 10.f);
-    m_modelCamera.lookAt(glm::vec3(0.f, 0.f, 0.f));
+#ifdef DEVELOP
+    watchAssets();
+#endif
 
-    glEnable(GL_SCISSOR_TEST);
+    m_glState.enable(GL_SCISSOR_TEST);
 
     clear();
 
+    if (m_autosave->recover(m_canvas, m_activeHairstyle))
+        m_painterFBO->writeRenderTexture(m_canvas);
+
+    // The first autosave of a session captures the whole canvas
+    m_autosave->markAllDirty();
+
     while (m_running)
     {
+        waitForFrame();
+
+        // The clock runs before the events, so that animations started by them begin at the current time
         m_paintingAllowed = false;
-        Input::update(m_window->getHeight(), true);
         Time::update();
+        Input::update(m_window->getHeight(), true);
 
         if (m_paused)
             continue;
@@ -77,16 +179,169 @@ void Application::run()
         m_modelCamera.updateViewMatrix();
 
 #ifdef DEVELOP
-        showFPS();
+        if (m_hotReloader->update())
+            requestRedraw();
+#endif
+
+        updateTransition();
+        updateModelRotation();
+        if (m_paintingAllowed)
+            paint();
+
+        renderFrame();
+
+        m_autosave->update(*m_painterFBO, m_activeHairstyle);
+    }
+
+    m_autosave->flush(*m_painterFBO, m_activeHairstyle);
+}
+    
+void Application::waitForFrame()
+{
+    // A minimized window shows nothing until it is restored
+    if (m_paused)
+    {
+        Input::waitEvent();
+        return;
+    }
+
+    // Running transitions animate every frame. Otherwise the loop wakes up now and then for the autosave and hot reload.
+    if (!m_continuousRendering && !m_transitionActive && m_dirtyViews == 0 && !m_presentPending)
+        Input::waitEvent(m_idleWakeInterval);
+}
+
+void Application::renderFrame()
+{
+    if (m_continuousRendering)
+        requestRedraw();
+
+    if (m_dirtyViews == 0 && !m_presentPending)
+        return;
+
+    m_gpuProfiler.update();
+    PROFILE_ZONE("Frame");
+    GPU_PROFILE_ZONE(m_gpuProfiler, "Frame");
+
+    m_glState.beginFrame();
+    m_quality.beginFrame();
+
+    // Profiling shows its breakdown in the title bar in all builds
+    bool showStats = Profiler::isEnabled();
+#ifdef DEVELOP
+    showStats = true;
 #endif
+    if (showStats)
+        showFPS();
 
+    // Views that did not change keep their pixels from an earlier frame
+    m_windowFBO->begin();
+    if (m_dirtyViews & VIEW_PAINTER)
         updatePainterView();
+    if (m_dirtyViews & VIEW_MODEL)
         updateModelView();
+    m_windowFBO->end();
 
+    {
+        GPU_PROFILE_ZONE(m_gpuProfiler, "Composite");
+        m_windowFBO->blit();
+    }
+    bool qualityChanged = m_quality.endFrame();
+
+    {
+        PROFILE_ZONE("Swap");
         m_window->flip();
     }
+
+    m_dirtyViews = 0;
+    m_presentPending = false;
+
+    // Show the new quality even if nothing else changes
+    if (qualityChanged)
+        requestRedraw();
 }
-    
+
+bool Application::setQuality(const std::string& profileName)
+{
+    if (profileName == "auto")
+    {
+        m_quality.setAdaptive(true);
+        return true;
+    }
+
+    int level = QualityGovernor::findProfile(profileName);
+    if (level < 0)
+        return false;
+
+    m_quality.setAdaptive(false);
+    m_quality.setLevel(size_t(level));
+    return true;
+}
+
+size_t Application::renderPresets(size_t first, size_t step, const std::string& outDir)
+{
+    assert(m_offscreenFBO && step > 0);
+
+    size_t written = 0;
+    for (size_t i = first; i < m_presetHairstyleManager->getCount(); i += step)
+    {
+        if (!m_presetHairstyleManager->load(i, m_canvas, m_activeHairstyle))
+            continue;
+
+        m_painterFBO->writeRenderTexture(m_canvas);
+        renderOffscreen();
+
+        const std::string& name = m_presetHairstyleManager->getFilename(i);
+        if (m_offscreenFBO->saveRenderTextureImage(outDir + "/" + name.substr(0, name.rfind('.')) + ".png"))
+            ++written;
+    }
+
+    return written;
+}
+
+float Application::benchmark(uint32_t frames)
+{
+    assert(m_offscreenFBO);
+
+    if (m_presetHairstyleManager->load(0, m_canvas, m_activeHairstyle))
+        m_painterFBO->writeRenderTexture(m_canvas);
+
+    // The first frame includes driver warm-up such as compiling shader variants
+    renderOffscreen();
+    glFinish();
+
+    Timer timer;
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        m_modelRotation = glm::angleAxis(glm::two_pi<float>() * i / frames, glm::vec3(0.f, 1.f, 0.f));
+        renderOffscreen();
+    }
+    glFinish();
+
+    float seconds = timer.tick();
+
+    m_glState.beginFrame();
+    const GLState::Stats& stats = m_glState.getFrameStats();
+    LOG("GL calls per frame: " << stats.getIssuedCalls() << " (" << stats.stateCalls << " state, " << stats.uniformCalls << " uniform, "
+        << stats.drawCalls << " draw), " << stats.skippedCalls << " redundant calls skipped");
+
+    return seconds > 0.f ? frames / seconds : 0.f;
+}
+
+void Application::renderOffscreen()
+{
+    m_gpuProfiler.update();
+    PROFILE_ZONE("Frame");
+    GPU_PROFILE_ZONE(m_gpuProfiler, "Frame");
+
+    m_glState.beginFrame();
+    m_modelCamera.updateViewMatrix();
+
+    m_offscreenFBO->begin();
+    m_glState.enable(GL_SCISSOR_TEST);
+    updateModelView();
+    m_offscreenFBO->end();
+}
+
 void Application::onQuit()
 {
     m_running = false;
@@ -95,6 +350,7 @@ void Application::onQuit()
 void Application::onMousewheel(float delta)
 {
     onViewFocus();
+    requestRedraw(m_painterFocus ? VIEW_PAINTER : VIEW_MODEL);
 
     if (m_painterFocus)
         m_brushIntensity = math::clamp(m_brushIntensity + delta * m_brushIntensityInc, 0.0f, 1.0f);
@@ -109,6 +365,13 @@ void Application::onMousewheel(float delta)
 
 void Application::onKeyDown(SDL_Keycode keyCode)
 {
+    // Edits and loads start from the final state of a running transition
+    finishTransition();
+    requestRedraw();
+
+    if (keyCode != SDLK_f)
+        m_similarPresets.clear();
+
     switch (keyCode)
     {
     case SDLK_0:
@@ -152,17 +415,41 @@ void Application::onKeyDown(SDL_Keycode keyCode)
         break;
     case SDLK_F1:
 #ifdef DEVELOP
-        m_hairShader.load("Assets/Shaders/hair.vert", "Assets/Shaders/hair.frag", "Assets/Shaders/hair.geom");
-        m_modelShader.load("Assets/Shaders/model.vert", "Assets/Shaders/model.frag");
+        m_hotReloader->reloadAll();
 #endif
         break;
+    case SDLK_F2:
+#ifdef DEVELOP
+        benchmarkGallery();
+#endif
+        break;
+    case SDLK_g:
+        openGallery();
+        m_galleryActive = !m_galleryActive;
+        break;
+    case SDLK_PAGEUP:
+        if (m_galleryActive)
+            m_galleryHeadCount = std::min(m_maxGalleryHeads, m_galleryHeadCount * 2);
+        break;
+    case SDLK_PAGEDOWN:
+        if (m_galleryActive)
+            m_galleryHeadCount = std::max(1u, m_galleryHeadCount / 2);
+        break;
     case SDLK_F5:
     case SDLK_s:
-        m_saveHairstyleManager->save(m_activeHairstyle, *m_painterFBO.get());
+        save();
         break;
     case SDLK_F9:
     case SDLK_x:
-        m_saveHairstyleManager->loadRecent(*m_painterFBO.get(), m_activeHairstyle);
+        if (m_saveHairstyleManager->loadRecent(m_canvas, m_activeHairstyle))
+            onCanvasLoaded();
+        break;
+    case SDLK_DELETE:
+        // Deleting cannot be undone, a plain Delete only tells how to do it
+        if (!Input::isKeyDown(SDL_SCANCODE_LCTRL) && !Input::isKeyDown(SDL_SCANCODE_RCTRL))
+            LOG("Press Ctrl+Delete to delete the saved hairstyle on the canvas.");
+        else if (!m_saveHairstyleManager->removeCurrent())
+            LOG("The canvas does not show a saved hairstyle, nothing was deleted.");
         break;
     case SDLK_KP_PLUS:
     case SDLK_PLUS:
@@ -191,17 +478,26 @@ void Application::onKeyDown(SDL_Keycode keyCode)
             m_showOverlay = !m_showOverlay;
         break;
     case SDLK_LEFT:
-        m_presetHairstyleManager->loadPrev(*m_painterFBO.get(), m_activeHairstyle);
+        beginTransition();
+        if (m_presetHairstyleManager->loadPrev(m_canvas, m_activeHairstyle))
+            startTransition();
         break;
     case SDLK_n:
     case SDLK_RIGHT:
-        m_presetHairstyleManager->loadNext(*m_painterFBO.get(), m_activeHairstyle);
+        beginTransition();
+        if (m_presetHairstyleManager->loadNext(m_canvas, m_activeHairstyle))
+            startTransition();
+        break;
+    case SDLK_f:
+        loadSimilarPreset();
         break;
     case SDLK_UP:
-        m_saveHairstyleManager->loadNext(*m_painterFBO.get(), m_activeHairstyle);
+        if (m_saveHairstyleManager->loadNext(m_canvas, m_activeHairstyle))
+            onCanvasLoaded();
         break;
     case SDLK_DOWN:
-        m_saveHairstyleManager->loadPrev(*m_painterFBO.get(), m_activeHairstyle);
+        if (m_saveHairstyleManager->loadPrev(m_canvas, m_activeHairstyle))
+            onCanvasLoaded();
         break;
     default:
         break;
@@ -220,6 +516,10 @@ void Application::onWindowEvent(const SDL_WindowEvent& windowEvent)
         break;
     case SDL_WINDOWEVENT_RESTORED:
         m_paused = false;
+        m_presentPending = true;
+        break;
+    case SDL_WINDOWEVENT_EXPOSED:
+        m_presentPending = true;
         break;
     }
 }
@@ -230,11 +530,22 @@ void Application::onMouseDown(const SDL_MouseButtonEvent& e)
 
     if (e.button == SDL_BUTTON_LEFT || e.button == SDL_BUTTON_RIGHT)
         m_paintingAllowed = true;
+
+    // The brush shows whether it erases
+    requestRedraw(VIEW_PAINTER);
+}
+
+void Application::onMouseUp(const SDL_MouseButtonEvent& e)
+{
+    requestRedraw(VIEW_PAINTER);
 }
 
 void Application::onMouseMotion(const SDL_MouseMotionEvent& e)
 {
     m_paintingAllowed = Input::isDragging();
+
+    // The brush follows the mouse
+    requestRedraw(VIEW_PAINTER);
 }
 
 void Application::resize(int width, int height)
@@ -246,20 +557,34 @@ void Application::resize(int width, int height)
     m_modelCamera.setViewport(width * 0.5f, 0.f, width * 0.5f, float(height));
 
     m_window->resize(width, height);
+
+    if (m_windowFBO)
+        m_windowFBO->resizeRenderTexture(width, height);
+    else
+        m_windowFBO = std::make_unique<Framebuffer>(width, height, true, true);
+    requestRedraw();
 }
 
 void Application::showFPS()
 {
-    static float left = 0.f;
+    // Frames are only rendered when something changed, the clock keeps running in between
+    static float nextUpdate = 0.f;
     static uint32_t fps = 0;
-    left -= Time::deltaTime;
 
-    if (left <= 0.f)
+    if (Time::totalTime >= nextUpdate)
     {
         float frameTime = 1000.f / fps;
-        m_window->setTitle(m_title + " FPS: " + std::to_string(fps) + " Frame time: " + std::to_string(frameTime) + "ms/frame");
-
-        left = 1.f;
+        uint32_t calls = m_glState.getFrameStats().getIssuedCalls();
+        std::string title = m_title + " FPS: " + std::to_string(fps) + " Frame time: " + std::to_string(frameTime) + "ms/frame" +
+                            " GL calls: " + std::to_string(calls) + "/" + std::to_string(m_glCallBudget) +
+                            " Quality: " + m_quality.getProfile().name + (m_quality.isAdaptive() ? " (auto)" : "");
+        if (Profiler::isEnabled())
+            title += " | ms/frame " + Profiler::getBreakdown("Frame", 1.0f);
+        m_window->setTitle(title);
+        if (calls > m_glCallBudget)
+            LOG("Frame issued " << calls << " GL calls, the budget is " << m_glCallBudget);
+
+        nextUpdate = Time::totalTime + 1.f;
         fps = 0;
     }
 
@@ -268,61 +593,125 @@ void Application::showFPS()
 
 void Application::updatePainterView()
 {
-    glDisable(GL_DEPTH_TEST);
-
-    if (m_paintingAllowed)
-        paint();
+    PROFILE_ZONE("Painter view");
+    GPU_PROFILE_ZONE(m_gpuProfiler, "Painter view");
 
     setViewport(m_painterCamera.getViewport());
 
-    renderColorLayers();
+    m_painterCommands.reset();
+    recordColorLayers(m_painterCommands);
 
     // Do not render the brush if the user is rotating the model 
     // and ends up in the painter view with the mouse
     if (m_painterFocus || !Input::isDragging())
-        renderBrush();
+        recordBrush(m_painterCommands);
 
     if (m_showOverlay)
-        renderPainterOverlay();
+        recordPainterOverlay(m_painterCommands);
+
+    m_painterCommands.submit(m_glState);
 }
 
 void Application::updateModelView()
 {
-    updateModelRotation();
+    PROFILE_ZONE("Model view");
+    GPU_PROFILE_ZONE(m_gpuProfiler, "Model view");
 
-    setViewport(m_modelCamera.getViewport());
+    const QualityProfile& quality = m_quality.getProfile();
+    const Rect& viewport = m_modelCamera.getViewport();
 
-    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Reduced resolutions render into their own framebuffer that is scaled into the view
+    GLuint target = m_glState.getFramebuffer(GL_DRAW_FRAMEBUFFER);
+    bool scaled = quality.renderScale < 1.0f;
+    if (scaled)
+    {
+        GLsizei width = std::max(1, GLsizei(viewport.width() * quality.renderScale));
+        GLsizei height = std::max(1, GLsizei(viewport.height() * quality.renderScale));
+        if (!m_modelFBO)
+            m_modelFBO = std::make_unique<Framebuffer>(width, height, true, true);
+        else if (m_modelFBO->getWidth() != width || m_modelFBO->getHeight() != height)
+            m_modelFBO->resizeRenderTexture(width, height);
+
+        m_modelFBO->begin();
+    }
+    else
+        setViewport(viewport);
+
+    // The clear is masked like the last draw
+    m_glState.colorMask(true, true, true, true);
+    m_glState.clearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    m_glState.clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    m_frameUniforms.update(m_modelCamera.view(), m_modelCamera.proj(), m_dirLight);
+
+    if (m_galleryActive)
+    {
+        uint64_t strandBudget = m_galleryStrandBudget * quality.strandsPerTriangle / Gallery::STRANDS_PER_TRIANGLE;
+        renderGallery(m_galleryHeadCount, strandBudget, quality.renderScale);
+    }
+    else
+        renderModel(quality);
 
-    glEnable(GL_DEPTH_TEST);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    if (scaled)
+    {
+        m_modelFBO->blit(target, GLint(viewport.minX()), GLint(viewport.minY()), GLsizei(viewport.width()), GLsizei(viewport.height()));
+        m_glState.bindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+}
 
-    // Render model
-    m_modelShader.bind();
+void Application::renderModel(const QualityProfile& quality)
+{
     glm::mat4 view = m_modelCamera.view();
     glm::mat4 proj = m_modelCamera.proj();
-    m_modelShader.bind();
-    m_modelShader.setCamera(view, proj);
-    m_modelShader.setModel(glm::toMat4(m_modelRotation));
-    m_modelShader.setDirLight(m_dirLight, view);
-    m_modelShader.setMaterial(m_modelMaterial);
-    m_modelShader.bindTexture2D(m_modelTexture, "u_hairTexture");
-    m_modelShader.bindTexture2D(m_painterFBO->getRenderTexture(), "u_hairTexture", 1);
-    m_modelMesh.render();
-
-    // Hair pass
-    glLineWidth(m_activeHairstyle.width);
-    m_hairShader.bind();
-    m_hairShader.setFloat("u_hairLength", m_activeHairstyle.length);
-    m_hairShader.setVec3("u_hairColor", m_activeHairstyle.color);
-    m_hairShader.setCamera(view, proj);
-    m_hairShader.setDirLight(m_dirLight, view);
-    m_hairShader.setMaterial(m_hairMaterial);
-    m_hairShader.setModel(glm::toMat4(m_modelRotation));
-    m_hairShader.bindTexture2D(m_painterFBO->getRenderTexture(), "u_hairTexture");
-    m_modelMesh.render();
-    glLineWidth(1.0f);
+
+    m_modelCommands.reset();
+
+    RenderState modelState;
+    modelState.depthTest = true;
+
+    // Small viewports draw a simplified head from the mesh cache, the full head skips meshlets facing away
+    glm::mat4 model = glm::toMat4(m_modelRotation);
+    glm::mat4 modelView = view * model;
+    size_t lod = m_modelMesh.selectLod(modelView, proj, m_modelCamera.getViewport().height() * quality.renderScale);
+    CommandList::Packet& head = m_modelCommands.draw(m_modelShader, m_modelMesh, modelState)
+        .setModel(model)
+        .setVertexFormat(m_modelMesh)
+        .setMaterial(m_modelMaterial)
+        .bindTexture(0, GL_TEXTURE_2D, m_modelTexture, "u_hairTexture")
+        .bindTexture(1, GL_TEXTURE_2D, m_painterFBO->getRenderTexture(), "u_hairTexture");
+    if (lod == 0)
+        head.visible(modelView, proj);
+    else
+        head.lod(lod);
+
+    // Hair roots lie on the head surface, the hair goes into the next layer so that the head wins ties of the depth test.
+    // hair.geom grows hair on every triangle, so the full mesh keeps the root density independent of the model LOD.
+    // Meshlet bounds grow by the hair length, hair of roots facing away can still stick out over the silhouette.
+    // Lines keep their width on screen when the view is scaled up.
+    RenderState hairState = modelState;
+    hairState.lineWidth = std::max(1.0f, m_activeHairstyle.width * quality.renderScale);
+    m_modelCommands.draw(m_hairShader, m_modelMesh, hairState, 1)
+        .setFloat("u_hairLength", m_activeHairstyle.length)
+        .setVec3("u_hairColor", m_activeHairstyle.color)
+        .setInt("u_strandsPerTriangle", int(quality.strandsPerTriangle))
+        .setInt("u_hairSegments", int(quality.hairSegments))
+        .setMaterial(m_hairMaterial)
+        .setModel(model)
+        .setVertexFormat(m_modelMesh)
+        .bindTexture(0, GL_TEXTURE_2D, m_painterFBO->getRenderTexture(), "u_hairTexture")
+        .visible(modelView, proj, m_activeHairstyle.length);
+
+    {
+        PROFILE_ZONE("Model pass");
+        GPU_PROFILE_ZONE(m_gpuProfiler, "Model pass");
+        m_modelCommands.submit(m_glState, 0, 0);
+    }
+
+    {
+        PROFILE_ZONE("Hair pass");
+        GPU_PROFILE_ZONE(m_gpuProfiler, "Hair pass");
+        m_modelCommands.submit(m_glState, 1, 1);
+    }
 }
 
 void Application::updateModelRotation()
@@ -345,9 +734,136 @@ void Application::updateModelRotation()
     glm::vec3 toStart = computeArcballVector(ndcStart);
     glm::vec3 toEnd = computeArcballVector(ndcEnd);
 
-    float angle = 2.0f * std::acosf(std::min(1.0f, glm::dot(toStart, toEnd)));
+    float angle = 2.0f * std::acos(std::min(1.0f, glm::dot(toStart, toEnd)));
     glm::vec3 rotationAxis = glm::normalize(glm::cross(toStart, toEnd));
     m_modelRotation = glm::angleAxis(angle, rotationAxis) * m_modelRotationBeforeDrag;
+    requestRedraw(VIEW_MODEL);
+}
+
+void Application::openGallery()
+{
+    if (m_gallery.getLayerCount() > 0)
+        return;
+
+    // Thumbnails are enough for heads that share the model view
+    uint32_t layerCount = uint32_t(std::min<size_t>(m_presetHairstyleManager->getCount(), m_maxGalleryPresets)) + 1;
+    m_gallery.init(m_galleryLayerSize, layerCount);
+    m_galleryHairstyles.assign(layerCount, m_activeHairstyle);
+
+    Canvas preview;
+    for (uint32_t layer = 1; layer < layerCount; ++layer)
+    {
+        if (m_presetHairstyleManager->loadPreview(layer - 1, m_galleryLayerSize, preview))
+        {
+            m_gallery.setLayer(layer, preview);
+            m_galleryHairstyles[layer] = m_presetHairstyleManager->getHairstyle(layer - 1);
+        }
+    }
+}
+
+void Application::renderGallery(uint32_t headCount, uint64_t strandBudget, float renderScale)
+{
+    PROFILE_ZONE("Gallery");
+    GPU_PROFILE_ZONE(m_gpuProfiler, "Gallery");
+
+    // Layer 0 follows the painter, including strokes that are not saved yet
+    m_gallery.copyLayer(0, *m_painterFBO);
+    m_galleryHairstyles[0] = m_activeHairstyle;
+
+    glm::mat4 view = m_modelCamera.view();
+    glm::mat4 proj = m_modelCamera.proj();
+
+    // Grid in the plane through the origin facing the camera. A single head keeps the size of the normal model view.
+    uint32_t columns = uint32_t(std::ceil(std::sqrt(float(headCount))));
+    uint32_t rows = (headCount + columns - 1) / columns;
+    float distance = glm::length(m_modelCamera.getPosition());
+    float halfWidth = distance / proj[0][0];
+    float halfHeight = distance / proj[1][1];
+    float scale = std::min(halfWidth / columns, halfHeight / rows) / halfHeight;
+    glm::mat4 invView = glm::inverse(view);
+    glm::vec3 right = glm::vec3(invView[0]);
+    glm::vec3 up = glm::vec3(invView[1]);
+
+    m_gallery.clearInstances();
+    for (uint32_t i = 0; i < headCount; ++i)
+    {
+        float x = -halfWidth + (i % columns + 0.5f) * 2.0f * halfWidth / columns;
+        float y = halfHeight - (i / columns + 0.5f) * 2.0f * halfHeight / rows;
+
+        // Heads look slightly different ways, all of them follow the arcball rotation
+        float yaw = std::sin(float(i) * 1.7f) * 0.6f;
+        glm::mat4 model = glm::translate(right * x + up * y) * glm::scale(glm::vec3(scale)) *
+                          glm::toMat4(m_modelRotation) * glm::rotate(yaw, glm::vec3(0.f, 1.f, 0.f));
+
+        uint32_t layer = i % m_gallery.getLayerCount();
+        m_gallery.addInstance(model, layer, m_galleryHairstyles[layer]);
+    }
+
+    // Heads shrink with the grid, so the model can use coarser levels. The hair level only depends on the budget.
+    size_t modelLod = m_modelMesh.selectLod(view * glm::toMat4(m_modelRotation), proj, m_modelCamera.getViewport().height() * scale * renderScale);
+    size_t hairLod = Gallery::selectHairLod(m_modelMesh, headCount, strandBudget);
+
+    m_modelCommands.reset();
+
+    RenderState modelState;
+    modelState.depthTest = true;
+    m_gallery.record(m_modelCommands, m_galleryModelShader, m_modelMesh, modelLod, modelState, 0, 1, [this](CommandList::Packet& packet)
+    {
+        packet.setVertexFormat(m_modelMesh)
+              .setMaterial(m_modelMaterial)
+              .bindTexture(0, GL_TEXTURE_2D, m_modelTexture, "u_textureDiffuse");
+    });
+
+    // Lines keep their width on screen when the view is scaled up, like in renderModel()
+    RenderState hairState = modelState;
+    hairState.lineWidth = std::max(1.0f, m_activeHairstyle.width * renderScale);
+    m_gallery.record(m_modelCommands, m_galleryHairShader, m_modelMesh, hairLod, hairState, 1, 0, [this](CommandList::Packet& packet)
+    {
+        packet.setVertexFormat(m_modelMesh)
+              .setMaterial(m_hairMaterial);
+    });
+
+    m_modelCommands.submit(m_glState);
+}
+
+void Application::benchmarkGallery()
+{
+    openGallery();
+
+    const uint64_t strandBudgets[] = { 500000, 2000000, 8000000 };
+    const int framesPerRun = 20;
+    const float frameBudget = 1000.0f / 60.0f;
+
+    setViewport(m_modelCamera.getViewport());
+    m_glState.colorMask(true, true, true, true);
+    m_glState.clearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    m_frameUniforms.update(m_modelCamera.view(), m_modelCamera.proj(), m_dirLight);
+
+    for (uint64_t strandBudget : strandBudgets)
+    {
+        uint32_t headsPerFrame = 0;
+        for (uint32_t headCount = 1; headCount <= m_maxGalleryHeads; headCount *= 2)
+        {
+            glFinish();
+            Timer timer;
+            for (int i = 0; i < framesPerRun; ++i)
+            {
+                m_glState.clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                renderGallery(headCount, strandBudget);
+            }
+            glFinish();
+            float frameTime = timer.tick() * 1000.0f / framesPerRun;
+
+            LOG("Gallery: " << headCount << " heads, " << strandBudget << " strands, hair LOD "
+                << Gallery::selectHairLod(m_modelMesh, headCount, strandBudget) << ": " << frameTime << "ms/frame");
+
+            if (frameTime > frameBudget)
+                break;
+            headsPerFrame = headCount;
+        }
+
+        LOG("Gallery: " << headsPerFrame << " heads per 60 Hz frame at " << strandBudget << " strands");
+    }
 }
 
 glm::vec3 Application::computeArcballVector(glm::vec3 ndcPos)
@@ -360,25 +876,24 @@ glm::vec3 Application::computeArcballVector(glm::vec3 ndcPos)
     v.z = 0.0f;
     float sq = v.x * v.x + v.y * v.y;
     if (sq <= r * r)
-        v.z = std::sqrtf(r * r - sq);
+        v.z = std::sqrt(r * r - sq);
 
     return glm::normalize(v);
 }
 
-void Application::renderPainterOverlay()
+void Application::recordPainterOverlay(CommandList& commands)
 {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    m_painterOverlayShader.bind();
-    m_modelMesh.bindAndRender();
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glDisable(GL_BLEND);
+    RenderState state;
+    state.blend = true;
+    state.blendSrc = GL_ONE;
+    state.blendDst = GL_ONE;
+    state.polygonMode = GL_LINE;
+    commands.draw(m_painterOverlayShader, m_modelMesh, state, 2)
+        .lod(m_quality.getProfile().overlayLod);
 }
 
-void Application::renderBrush()
+void Application::recordBrush(CommandList& commands, uint8_t colorMask)
 {
-    glEnable(GL_BLEND);
     // Invert intensity if holding left shift
     float intensity = (Input::isKeyDown(SDL_SCANCODE_LSHIFT) || Input::isKeyDown(SDL_SCANCODE_RSHIFT)) ? 1.0f - m_brushIntensity : m_brushIntensity;
 
@@ -386,28 +901,26 @@ void Application::renderBrush()
     if (Input::rightDrag().isDragging())
         intensity = m_activeColor == 0 ? 0.0f : 0.5f;
 
-    glBlendColor(0.f, 0.f, 0.0f, intensity);
-    glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_SRC_COLOR);
+    RenderState state;
+    state.blend = true;
+    state.blendSrc = GL_CONSTANT_ALPHA;
+    state.blendDst = GL_ONE_MINUS_SRC_COLOR;
+    state.blendColor = glm::vec4(0.f, 0.f, 0.f, intensity);
+    state.colorMask = colorMask;
 
-    m_quadShader.bind();
     glm::vec3 brushPos = m_painterCamera.viewportToWorldPoint(m_painterCamera.screenToViewportPoint(Input::mousePosition));
     glm::mat4 model = glm::translate(brushPos) * glm::scale(glm::vec3(m_brushScale));
-    m_quadShader.setMVP(m_painterCamera.viewProj() * model);
-
-    m_quadShader.bindTexture2D(m_brushTexture, "u_textureDiffuse");
-    m_quadMesh.bindAndRender();
-    glDisable(GL_BLEND);
+    commands.draw(m_quadShader, m_quadMesh, state, 1)
+        .setMVP(m_painterCamera.viewProj() * model)
+        .bindTexture(0, GL_TEXTURE_2D, m_brushTexture, "u_textureDiffuse");
 }
 
-void Application::renderColorLayers()
+void Application::recordColorLayers(CommandList& commands)
 {
-    m_quadShader.bind();
     glm::mat4 model = glm::translate(glm::vec3(0.5f, 0.5f, 0.0f));
-    m_quadShader.setMVP(m_painterCamera.viewProj() * model);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_painterFBO->getRenderTexture());
-    m_quadMesh.bindAndRender();
+    commands.draw(m_quadShader, m_quadMesh, RenderState())
+        .setMVP(m_painterCamera.viewProj() * model)
+        .bindTexture(0, GL_TEXTURE_2D, m_painterFBO->getRenderTexture(), "u_textureDiffuse");
 }
 
 void Application::paint()
@@ -415,28 +928,164 @@ void Application::paint()
     if (!m_painterFocus)
         return;
 
+    PROFILE_ZONE("Paint");
+    GPU_PROFILE_ZONE(m_gpuProfiler, "Paint");
+
+    finishTransition();
+    m_similarPresets.clear();
+
+    glm::vec3 brushPos = m_painterCamera.viewportToWorldPoint(m_painterCamera.screenToViewportPoint(Input::mousePosition));
+    float halfBrushSize = m_brushScale * 0.5f;
+    m_autosave->markDirty(int((brushPos.x - halfBrushSize) * m_painterFBO->getWidth()) - 1,
+                          int((brushPos.y - halfBrushSize) * m_painterFBO->getHeight()) - 1,
+                          int((brushPos.x + halfBrushSize) * m_painterFBO->getWidth()) + 2,
+                          int((brushPos.y + halfBrushSize) * m_painterFBO->getHeight()) + 2);
+
+    m_strokeCommands.reset();
+    recordBrush(m_strokeCommands, uint8_t(1 << m_activeColor | 8));
+
     m_painterFBO->begin();
-    glColorMask(m_activeColor == 0, m_activeColor == 1, m_activeColor == 2, true);
-    renderBrush();
-    glColorMask(true, true, true, true);
+    m_strokeCommands.submit(m_glState);
     m_painterFBO->end();
+
+    // The model view shows the canvas as well
+    requestRedraw();
+}
+
+void Application::save()
+{
+    m_painterFBO->readRenderTexture(m_canvas);
+    m_saveHairstyleManager->save(m_activeHairstyle, m_canvas);
+}
+
+void Application::onCanvasLoaded()
+{
+    m_painterFBO->writeRenderTexture(m_canvas);
+    m_autosave->markAllDirty();
+    requestRedraw();
+}
+
+void Application::beginTransition()
+{
+    // Blend from what is on screen, including unsaved strokes. The copy does not stall the GPU,
+    // a readback left over from a preset that failed to load is dropped.
+    m_painterFBO->cancelReadback(TRANSITION_READBACK_SLOT);
+    m_painterFBO->beginReadback(TRANSITION_READBACK_SLOT);
+    m_transitionFromHairstyle = m_activeHairstyle;
+}
+
+void Application::startTransition()
+{
+    // Transitions load presets, the canvas no longer shows the current saved style
+    m_saveHairstyleManager->clearCurrent();
+
+    if (!m_painterFBO->isReadbackPending(TRANSITION_READBACK_SLOT) || GLsizei(m_canvas.getWidth()) != m_painterFBO->getWidth() ||
+        GLsizei(m_canvas.getHeight()) != m_painterFBO->getHeight() || m_canvas.getChannels() != 3)
+    {
+        m_painterFBO->cancelReadback(TRANSITION_READBACK_SLOT);
+        onCanvasLoaded();
+        return;
+    }
+
+    m_transitionToHairstyle = m_activeHairstyle;
+    m_activeHairstyle = m_transitionFromHairstyle;
+    m_transitionStart = Time::totalTime;
+    m_transitionActive = true;
+}
+
+void Application::updateTransition()
+{
+    if (!m_transitionActive)
+        return;
+
+    if (m_painterFBO->isReadbackPending(TRANSITION_READBACK_SLOT))
+    {
+        // The screen keeps showing the previous canvas until its copy arrived, the animation starts then
+        if (!m_painterFBO->isReadbackReady(TRANSITION_READBACK_SLOT))
+            return;
+
+        m_transitionFrom.resize(uint32_t(m_painterFBO->getWidth()), uint32_t(m_painterFBO->getHeight()), 3);
+        const uint8_t* pixels = m_painterFBO->mapReadback(TRANSITION_READBACK_SLOT);
+        if (pixels)
+            std::copy(pixels, pixels + m_transitionFrom.getSize(), m_transitionFrom.data());
+        m_painterFBO->endReadback(TRANSITION_READBACK_SLOT);
+
+        if (!pixels)
+        {
+            finishTransition();
+            return;
+        }
+
+        m_transitionStart = Time::totalTime;
+    }
+
+    float elapsed = Time::totalTime - m_transitionStart;
+    if (elapsed >= m_transitionDuration)
+    {
+        finishTransition();
+        return;
+    }
+
+    float t = elapsed / m_transitionDuration;
+    t = t * t * (3.f - 2.f * t);
+
+    std::vector<canvasops::BlendLayer> layers(1, canvasops::BlendLayer(&m_canvas, t));
+    canvasops::blend(m_transitionFrom, layers, m_transitionCanvas);
+    m_painterFBO->writeRenderTexture(m_transitionCanvas);
+    m_activeHairstyle = mix(m_transitionFromHairstyle, m_transitionToHairstyle, t);
+    requestRedraw();
+}
+
+void Application::finishTransition()
+{
+    if (!m_transitionActive)
+        return;
+
+    m_transitionActive = false;
+    m_painterFBO->cancelReadback(TRANSITION_READBACK_SLOT);
+    m_activeHairstyle = m_transitionToHairstyle;
+    onCanvasLoaded();
+}
+
+void Application::loadSimilarPreset()
+{
+    if (m_similarPresets.empty())
+    {
+        m_painterFBO->readRenderTexture(m_canvas);
+        m_presetHairstyleManager->findSimilar(m_canvas, 8, m_similarPresets);
+        m_similarPresetPos = 0;
+    }
+
+    if (m_similarPresets.empty())
+        return;
+
+    size_t idx = m_similarPresets[m_similarPresetPos];
+    m_similarPresetPos = (m_similarPresetPos + 1) % m_similarPresets.size();
+
+    beginTransition();
+    if (m_presetHairstyleManager->load(idx, m_canvas, m_activeHairstyle))
+        startTransition();
 }
 
 void Application::clear(bool red, bool green, bool blue, bool alpha)
 {
+    m_autosave->markAllDirty();
+
     m_painterFBO->begin();
-    glColorMask(red, green, blue, alpha);
-    glClearColor(0.f, 0.5f, 0.5f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glColorMask(true, true, true, true);
+    m_glState.colorMask(red, green, blue, alpha);
+    m_glState.clearColor(0.f, 0.5f, 0.5f, 1.0f);
+    m_glState.clear(GL_COLOR_BUFFER_BIT);
+    m_glState.colorMask(true, true, true, true);
     m_painterFBO->end();
+
+    requestRedraw();
 }
 
 void Application::setViewport(const Rect& rect, bool scissor)
 {
-    glViewport(GLint(rect.minX()), GLint(rect.minY()), GLsizei(rect.width()), GLsizei(rect.height()));
+    m_glState.viewport(GLint(rect.minX()), GLint(rect.minY()), GLsizei(rect.width()), GLsizei(rect.height()));
     if (scissor)
-        glScissor(GLint(rect.minX()), GLint(rect.minY()), GLsizei(rect.width()), GLsizei(rect.height()));
+        m_glState.scissor(GLint(rect.minX()), GLint(rect.minY()), GLsizei(rect.width()), GLsizei(rect.height()));
 }
 
 void Application::onViewFocus()
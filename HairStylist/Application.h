@@ -15,17 +15,69 @@
 #include "Framebuffer.h"
 #include "HairstyleManager.h"
 #include "Hairstyle.h"
+#include "AutosaveJournal.h"
+#include "Gallery.h"
+#include "FrameUniforms.h"
+#include "GLState.h"
+#include "CommandList.h"
+#include "ProgramCache.h"
+#include "HotReloader.h"
+#include "QualityGovernor.h"
+#include "Profiler.h"
+#include "HeadlessContext.h"
 
 class Application : public InputHandler
 {
     friend HairstyleManager;
 public:
     Application();
-    Application(const std::string& title, int width, int height);
+    /**
+    * canvasSize is the resolution of the painter canvas. Styles saved at other resolutions are resampled when loaded,
+    * so low-end machines can work at a reduced resolution.
+    */
+    Application(const std::string& title, int width, int height, uint32_t canvasSize = 1024);
+
+    /**
+    * Application without window and input (see HeadlessContext) that renders the model view at width x height
+    * into an offscreen framebuffer, e.g. on render servers. Use renderPresets() and benchmark() instead of run().
+    * Every thread can run its own headless application.
+    */
+    Application(HeadlessContext::Backend backend, int width, int height, uint32_t canvasSize = 1024);
     ~Application();
 
+    /**
+    * Runs until the window is closed. The loop sleeps until something happens and only redraws the views
+    * whose inputs changed (see requestRedraw()), unless continuous rendering is on.
+    */
     void run();
 
+    /**
+    * Redraws every frame, e.g. to measure frame times.
+    */
+    void setContinuousRendering(bool continuous) { m_continuousRendering = continuous; }
+
+    /**
+    * "auto" lets the quality governor hold the frame time budget, a profile name (see QualityGovernor::getProfiles())
+    * renders at that quality. Returns false if there is no such profile.
+    */
+    bool setQuality(const std::string& profileName);
+
+    /**
+    * False if a headless application failed to create its context.
+    */
+    bool isValid() const { return !m_headlessContext || m_headlessContext->isValid(); }
+
+    /**
+    * Headless only: renders the presets first, first + step, ... to <outDir>/<style name>.png.
+    * Returns the number of written images.
+    */
+    size_t renderPresets(size_t first, size_t step, const std::string& outDir);
+
+    /**
+    * Headless only: renders frames of the first preset on a turning head and returns the frames per second.
+    */
+    float benchmark(uint32_t frames);
+
 protected:
     void onQuit() override;
     void onMousewheel(float delta) override;
@@ -33,21 +85,90 @@ protected:
     void onWindowEvent(const SDL_WindowEvent& windowEvent) override;
 
     void onMouseDown(const SDL_MouseButtonEvent& e) override;
+    void onMouseUp(const SDL_MouseButtonEvent& e) override;
     void onMouseMotion(const SDL_MouseMotionEvent& e) override;
 private:
+    enum View : uint8_t
+    {
+        VIEW_PAINTER = 1,
+        VIEW_MODEL = 2,
+        VIEW_ALL = VIEW_PAINTER | VIEW_MODEL
+    };
+
+    void init(uint32_t canvasSize);
+    void loadAssets();
+
+    /**
+    * Starts loading all shaders, finish them with Shader::finishLoad() (see getShaders()).
+    * Shaders whose sources did not change come from the program cache.
+    */
+    void beginLoadShaders();
+    std::vector<Shader*> getShaders();
+
+    /**
+    * Reloads assets when their files change (DEVELOP builds).
+    */
+    void watchAssets();
+
+    void renderOffscreen();
     void resize(int width, int height);
 
+    /**
+    * Marks views to be redrawn in the next frame. Call it whenever something a view shows changes.
+    */
+    void requestRedraw(uint8_t views = VIEW_ALL) { m_dirtyViews |= views; }
+
+    /**
+    * Sleeps until an event arrives if no frame is due.
+    */
+    void waitForFrame();
+
+    /**
+    * Renders the dirty views into the window framebuffer and shows it.
+    */
+    void renderFrame();
+
     void showFPS();
 
     void updatePainterView();
+
+    /**
+    * Renders the model view, at a reduced resolution if the quality profile asks for it.
+    */
     void updateModelView();
+    void renderModel(const QualityProfile& quality);
 
     void updateModelRotation();
 
-    void renderPainterOverlay();
-    void renderBrush();
-    void renderColorLayers();
+    void openGallery();
+
+    /**
+    * Renders headCount heads in a grid over the model view. The hair of all heads together
+    * is grown from at most strandBudget strands (see Gallery::selectHairLod()). renderScale is the
+    * resolution of the target relative to the model view, like QualityProfile::renderScale.
+    */
+    void renderGallery(uint32_t headCount, uint64_t strandBudget, float renderScale = 1.0f);
+
+    /**
+    * Logs how many gallery heads fit into a 60 Hz frame at a few strand budgets.
+    */
+    void benchmarkGallery();
+
+    void recordPainterOverlay(CommandList& commands);
+
+    /**
+    * colorMask selects the rgba channels the brush paints into.
+    */
+    void recordBrush(CommandList& commands, uint8_t colorMask = 0xF);
+    void recordColorLayers(CommandList& commands);
     void paint();
+    void save();
+    void onCanvasLoaded();
+    void beginTransition();
+    void startTransition();
+    void updateTransition();
+    void finishTransition();
+    void loadSimilarPreset();
     void clear(bool red = true, bool green = true, bool blue = true, bool alpha = true);
 
     void setViewport(const Rect& rect, bool scissor = true);
@@ -57,14 +178,32 @@ private:
     glm::vec3 computeArcballVector(glm::vec3 ndcPos);
 private:
     std::unique_ptr<Window> m_window;
+    std::unique_ptr<HeadlessContext> m_headlessContext;
+    GLState m_glState; // of the window's or the headless context, outlives all GL objects below
+    std::unique_ptr<Framebuffer> m_offscreenFBO; // headless render target
     std::unique_ptr<HairstyleManager> m_saveHairstyleManager;
     std::unique_ptr<HairstyleManager> m_presetHairstyleManager;
+    std::unique_ptr<AutosaveJournal> m_autosave;
     bool m_running{ true };
     bool m_paused{ false };
+    bool m_continuousRendering{ false };
+    uint8_t m_dirtyViews{ VIEW_ALL };
+    bool m_presentPending{ false }; // the window lost its contents, show the unchanged views again
+    int m_idleWakeInterval{ 250 };  // ms, longest sleep while autosave or hot reload may have work
+    std::unique_ptr<Framebuffer> m_windowFBO; // the views, kept between frames so that unchanged views are not redrawn
+    std::unique_ptr<Framebuffer> m_modelFBO;  // model view rendered below the window resolution
+    QualityGovernor m_quality;
+    GpuProfiler m_gpuProfiler; // GPU side of the profiler zones (see Profiler)
     bool m_painterFocus{ true };
     bool m_paintingAllowed{ false };
     bool m_showOverlay{ true };
     DirectionalLight m_dirLight;
+    FrameUniforms m_frameUniforms; // camera and light shared by all shaders
+    std::unique_ptr<ProgramCache> m_programCache;
+    std::unique_ptr<HotReloader> m_hotReloader; // DEVELOP builds only
+    CommandList m_painterCommands; // draws of the views, recorded and submitted every frame
+    CommandList m_modelCommands;
+    CommandList m_strokeCommands;  // brush stroke into the painter canvas
     Material m_hairMaterial;
     Material m_modelMaterial;
 
@@ -90,10 +229,38 @@ private:
     // 0 = Red, 1 = Green, 2 = Blue
     uint8_t m_activeColor{0};
     std::unique_ptr<Framebuffer> m_painterFBO;
+    Canvas m_canvas; // CPU copy used to load and save the painter canvas
     float m_hairLengthInc{ 0.1f };
     float m_hairWidthInc{ 1.0f };
     Hairstyle m_activeHairstyle;
 
+    // Animated blend from the previous canvas to a newly loaded preset (m_canvas). The previous canvas is
+    // read back through its own slot of the painter buffer, the blend starts once it arrived.
+    static const size_t TRANSITION_READBACK_SLOT = 1;
+    bool m_transitionActive{ false };
+    float m_transitionStart{ 0.f };
+    float m_transitionDuration{ 0.3f };
+    Canvas m_transitionFrom;
+    Canvas m_transitionCanvas;
+    Hairstyle m_transitionFromHairstyle;
+    Hairstyle m_transitionToHairstyle;
+
+    // Presets similar to the canvas at the time of the first search, cycled through by repeated searches
+    std::vector<size_t> m_similarPresets;
+    size_t m_similarPresetPos{ 0 };
+
+    // Gallery mode shows a grid of heads wearing the painted style and the first presets
+    Gallery m_gallery;
+    Shader m_galleryModelShader;
+    Shader m_galleryHairShader;
+    std::vector<Hairstyle> m_galleryHairstyles; // per style layer, layer 0 is the painter canvas
+    bool m_galleryActive{ false };
+    uint32_t m_galleryHeadCount{ 16 };
+    uint32_t m_maxGalleryHeads{ 4096 };
+    uint32_t m_maxGalleryPresets{ 15 };
+    uint32_t m_galleryLayerSize{ 256 };
+    uint64_t m_galleryStrandBudget{ 2000000 };
+
     float m_zoomInc{ 0.1f };
 
     float m_brushScale{ 0.1f };
@@ -101,4 +268,7 @@ private:
     float m_minBrushScale{ 0.01f };
     float m_brushIntensity{ 1.0f };
     float m_brushIntensityInc{ 0.1f };
+
+    // API calls a frame should stay within, exceeding frames are reported in DEVELOP builds (see showFPS())
+    uint32_t m_glCallBudget{ 100 };
 };
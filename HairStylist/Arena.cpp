@@ -0,0 +1,59 @@
+#include "Arena.h"
+#include <cassert>
+#include <algorithm>
+
+const size_t Arena::DEFAULT_ALIGNMENT;
+
+Arena::Arena(size_t blockSize)
+    :m_blockSize(blockSize)
+{
+}
+
+void* Arena::allocate(size_t size, size_t align)
+{
+    assert(align > 0 && (align & (align - 1)) == 0);
+
+    if (m_block < m_blocks.size())
+    {
+        Block& block = m_blocks[m_block];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+        size_t offset = ((base + m_offset + align - 1) & ~uintptr_t(align - 1)) - base;
+        if (offset + size <= block.size)
+        {
+            m_offset = offset + size;
+            m_used += size;
+            return block.data.get() + offset;
+        }
+
+        ++m_block;
+    }
+
+    // Continue in the next kept block, or insert one that fits. The padding covers any alignment.
+    size_t required = size + align - 1;
+    if (m_block >= m_blocks.size() || m_blocks[m_block].size < required)
+    {
+        Block block;
+        block.size = std::max(m_blockSize, required);
+        block.data.reset(new uint8_t[block.size]);
+        m_blocks.insert(m_blocks.begin() + m_block, std::move(block));
+    }
+
+    m_offset = 0;
+    return allocate(size, align);
+}
+
+void Arena::reset()
+{
+    m_block = 0;
+    m_offset = 0;
+    m_used = 0;
+}
+
+size_t Arena::getCapacity() const
+{
+    size_t capacity = 0;
+    for (const Block& block : m_blocks)
+        capacity += block.size;
+
+    return capacity;
+}
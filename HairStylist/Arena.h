@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+/**
+* Linear allocator for short-lived data such as the commands of a frame. Allocations are pointer bumps
+* in blocks that are kept across reset(), so a steady frame allocates no memory from the system.
+* Objects are never destroyed, only trivially destructible types can be created.
+*/
+class Arena
+{
+public:
+    /**
+    * Alignment of allocate() without an explicit one, enough for SIMD and glm types.
+    */
+    static const size_t DEFAULT_ALIGNMENT = 16;
+
+    explicit Arena(size_t blockSize = 64 * 1024);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+    * Returns size bytes aligned to align (a power of two). Allocations larger than the block size get their own block.
+    */
+    void* allocate(size_t size, size_t align = DEFAULT_ALIGNMENT);
+
+    /**
+    * Allocates and constructs a T.
+    */
+    template <class T, class... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        return new (allocate(sizeof(T), std::alignment_of<T>::value)) T(std::forward<Args>(args)...);
+    }
+
+    /**
+    * Frees all allocations at once and keeps the blocks for reuse.
+    */
+    void reset();
+
+    /**
+    * Bytes handed out since the last reset() and bytes reserved from the system.
+    */
+    size_t getUsedBytes() const { return m_used; }
+    size_t getCapacity() const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    size_t m_blockSize;
+    std::vector<Block> m_blocks;
+    size_t m_block{ 0 };  // block allocations are taken from
+    size_t m_offset{ 0 }; // into m_blocks[m_block]
+    size_t m_used{ 0 };
+};
@@ -22,11 +22,18 @@ struct Material
     vec4 specular; // w = specular power
 };
 
+// Camera and light of the frame (see FrameUniforms)
+layout(std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_proj;
+    DirectionalLight u_dirLight;
+};
+
 in vec3 v_direction;
 in vec3 v_viewPos;
 in vec3 v_color;
 
-uniform DirectionalLight u_dirLight;
 uniform Material u_material;
 
 BlinnPhongOut blinnPhongShading(DirectionalLight dirLight,
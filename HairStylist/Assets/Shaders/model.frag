@@ -22,6 +22,14 @@ struct Material
     vec4 specular; // w = specular power
 };
 
+// Camera and light of the frame (see FrameUniforms)
+layout(std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_proj;
+    DirectionalLight u_dirLight;
+};
+
 in vec2 v_texCoords;
 in vec3 v_viewPosition;
 in vec3 v_viewNormal;
@@ -29,8 +37,12 @@ in vec3 v_viewTangent;
 in vec3 v_viewBitangent;
 
 uniform sampler2D u_textureDiffuse;
+#ifdef INSTANCED
+uniform sampler2DArray u_styleLayers;
+flat in float v_styleLayer;
+#else
 uniform sampler2D u_hairTexture;
-uniform DirectionalLight u_dirLight;
+#endif
 uniform Material u_material;
 
 layout(location = 0) out vec4 out_color;
@@ -61,6 +73,10 @@ void main()
                      vec4(result.specular, 0.0);
 
     // Make the area where hair grows dark
+#ifdef INSTANCED
+    vec4 hairSample = texture(u_styleLayers, vec3(v_texCoords, v_styleLayer));
+#else
     vec4 hairSample = texture2D(u_hairTexture, v_texCoords);
+#endif
     out_color.rgb *= clamp(1.0 - hairSample.r, 0.0, 1.0);
 }
@@ -1,16 +1,52 @@
 #version 330
 precision mediump float;
 
-layout(location = 0) in vec3 in_pos;
+layout(location = 0) in vec4 in_pos;
 layout(location = 1) in vec2 in_uv; 
 layout(location = 2) in vec3 in_normal;
 layout(location = 3) in vec3 in_tangent;
 layout(location = 4) in vec3 in_bitangent;
 
-uniform mat4 u_proj;
-uniform mat4 u_view;
+struct DirectionalLight 
+{
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	vec3 viewDirection; // light direction in view space
+};
+
+// Camera and light of the frame (see FrameUniforms)
+layout(std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_proj;
+    DirectionalLight u_dirLight;
+};
 uniform mat4 u_model;
 
+// Compact vertices (see Mesh::VertexFormat): normalized positions, octahedral normals, tangents
+// and bitangents. Positions have w = 1 in both formats, float vertices are used as they are.
+uniform bool u_compactVertices;
+uniform vec3 u_positionScale;
+uniform vec3 u_positionOffset;
+
+#ifdef INSTANCED
+// Gallery heads (see Gallery), indexed by gl_InstanceID
+struct Instance
+{
+    mat4 model;
+    vec4 hairColor; // w = hair length
+    vec4 params;    // x = style layer
+};
+
+layout(std140) uniform Instances
+{
+    Instance u_instances[MAX_BATCH_INSTANCES];
+};
+
+flat out float v_styleLayer;
+#endif
+
 out vec2 v_texCoords;
 
 out vec3 v_viewPosition;
@@ -18,14 +54,41 @@ out vec3 v_viewNormal;
 out vec3 v_viewTangent;
 out vec3 v_viewBitangent;
 
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+
 void main()
 {
-    mat4 MV = u_view * u_model;
-    v_viewNormal    = (MV * vec4(in_normal, 0.0)).xyz;
-    v_viewTangent   = (MV * vec4(in_tangent, 0.0)).xyz;
-    v_viewBitangent = (MV * vec4(in_bitangent, 0.0)).xyz;
-    v_viewPosition  = (MV * vec4(in_pos, 1.0)).xyz;
+    vec3 pos = in_pos.xyz;
+    vec3 normal = in_normal;
+    vec3 tangent = in_tangent;
+    vec3 bitangent = in_bitangent;
+    if (u_compactVertices)
+    {
+        pos = in_pos.xyz * u_positionScale + u_positionOffset;
+        normal = decodeOctahedral(in_normal.xy);
+        tangent = decodeOctahedral(in_tangent.xy);
+        bitangent = decodeOctahedral(in_bitangent.xy);
+    }
+
+#ifdef INSTANCED
+    mat4 model = u_instances[gl_InstanceID].model;
+    v_styleLayer = u_instances[gl_InstanceID].params.x;
+#else
+    mat4 model = u_model;
+#endif
+
+    mat4 MV = u_view * model;
+    v_viewNormal    = (MV * vec4(normal, 0.0)).xyz;
+    v_viewTangent   = (MV * vec4(tangent, 0.0)).xyz;
+    v_viewBitangent = (MV * vec4(bitangent, 0.0)).xyz;
+    v_viewPosition  = (MV * vec4(pos, 1.0)).xyz;
     
-    gl_Position = u_proj * MV * vec4(in_pos, 1.0);
+    gl_Position = u_proj * MV * vec4(pos, 1.0);
     v_texCoords = in_uv;
 }
@@ -0,0 +1,419 @@
+#include "AutosaveJournal.h"
+#include <algorithm>
+#include <cstring>
+#include <SDL.h>
+#include "Framebuffer.h"
+#include "StyleFile.h"
+#include "canvasops.h"
+#include "Timer.h"
+#include "file.h"
+#include "hash.h"
+#include "Logger.h"
+#include "Profiler.h"
+
+namespace
+{
+    // "HSJL" in little-endian byte order
+    const uint32_t JOURNAL_MAGIC = 0x4C4A5348;
+    const uint32_t JOURNAL_VERSION = 1;
+
+    struct JournalHeader
+    {
+        uint32_t magic{ JOURNAL_MAGIC };
+        uint32_t version{ JOURNAL_VERSION };
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        uint32_t tileSize{ 0 };
+    };
+
+    // Every record is prefixed with its payload size and hash to detect records torn by a crash
+    struct RecordHeader
+    {
+        uint32_t payloadSize;
+        uint32_t padding;
+        uint64_t payloadHash;
+    };
+
+    template <class T>
+    void append(std::vector<uint8_t>& buffer, const T& value)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+        buffer.insert(buffer.end(), p, p + sizeof(T));
+    }
+
+    template <class T>
+    bool consume(const uint8_t*& p, const uint8_t* end, T& outValue)
+    {
+        if (size_t(end - p) < sizeof(T))
+            return false;
+
+        memcpy(&outValue, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+}
+
+const uint32_t AutosaveJournal::TILE_SIZE;
+
+AutosaveJournal::AutosaveJournal(const std::string& path, uint32_t canvasWidth, uint32_t canvasHeight)
+    :m_path(path), m_width(canvasWidth), m_height(canvasHeight), m_mirror(canvasWidth, canvasHeight)
+{
+    m_tilesX = style::tileCount(m_width, TILE_SIZE);
+    m_tilesY = style::tileCount(m_height, TILE_SIZE);
+    m_dirtyTiles.resize(m_tilesX * m_tilesY, false);
+
+    size_t parentEnd = m_path.find_last_of("/\\");
+    if (parentEnd != std::string::npos)
+        file::createDirectory(m_path.substr(0, parentEnd));
+
+    m_thread = std::thread(&AutosaveJournal::run, this);
+}
+
+AutosaveJournal::~AutosaveJournal()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void AutosaveJournal::markDirty(int minX, int minY, int maxX, int maxY)
+{
+    minX = std::max(minX, 0);
+    minY = std::max(minY, 0);
+    maxX = std::min(maxX, int(m_width));
+    maxY = std::min(maxY, int(m_height));
+
+    if (minX >= maxX || minY >= maxY)
+        return;
+
+    for (int ty = minY / int(TILE_SIZE); ty <= (maxY - 1) / int(TILE_SIZE); ++ty)
+        for (int tx = minX / int(TILE_SIZE); tx <= (maxX - 1) / int(TILE_SIZE); ++tx)
+            m_dirtyTiles[ty * m_tilesX + tx] = true;
+}
+
+void AutosaveJournal::markAllDirty()
+{
+    std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), true);
+}
+
+void AutosaveJournal::update(Framebuffer& framebuffer, const Hairstyle& hairstyle)
+{
+    PROFILE_ZONE("Autosave");
+
+    if (m_readbackPending)
+    {
+        if (!framebuffer.isReadbackReady())
+            return;
+
+        // Only the dirty tiles are copied on the main thread, everything else happens in the background
+        Batch batch;
+        batch.hairstyle = hairstyle;
+        collectTiles(framebuffer.mapReadback(), m_readbackTiles, batch.tiles);
+        framebuffer.endReadback();
+        m_readbackPending = false;
+
+        submit(std::move(batch));
+        return;
+    }
+
+    m_timeUntilSave -= Time::deltaTime;
+    if (m_timeUntilSave > 0.0f)
+        return;
+
+    m_timeUntilSave = m_saveInterval;
+
+    bool hasDirtyTiles = std::find(m_dirtyTiles.begin(), m_dirtyTiles.end(), true) != m_dirtyTiles.end();
+    if (hasDirtyTiles)
+    {
+        m_readbackTiles = m_dirtyTiles;
+        std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), false);
+        framebuffer.beginReadback();
+        m_readbackPending = true;
+    }
+    else if (!m_hasSavedHairstyle || memcmp(&hairstyle, &m_savedHairstyle, sizeof(Hairstyle)) != 0)
+    {
+        Batch batch;
+        batch.hairstyle = hairstyle;
+        submit(std::move(batch));
+    }
+}
+
+void AutosaveJournal::flush(Framebuffer& framebuffer, const Hairstyle& hairstyle)
+{
+    if (m_readbackPending)
+    {
+        // Tiles of the pending readback are captured again below
+        framebuffer.mapReadback();
+        framebuffer.endReadback();
+        m_readbackPending = false;
+
+        for (size_t i = 0; i < m_dirtyTiles.size(); ++i)
+            m_dirtyTiles[i] = m_dirtyTiles[i] || m_readbackTiles[i];
+    }
+
+    Canvas canvas;
+    framebuffer.readRenderTexture(canvas);
+    if (canvas.getWidth() != m_width || canvas.getHeight() != m_height)
+        return;
+
+    Batch batch;
+    batch.hairstyle = hairstyle;
+    collectTiles(canvas.data(), m_dirtyTiles, batch.tiles);
+    std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), false);
+    submit(std::move(batch));
+}
+
+bool AutosaveJournal::recover(Canvas& outCanvas, Hairstyle& outHairstyle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    bool recovered = false;
+
+    std::string journalPath = m_path + ".journal";
+    std::vector<uint8_t> journal(file::getSize(journalPath));
+    if (!journal.empty())
+        std::ifstream(journalPath, std::ios::binary).read(reinterpret_cast<char*>(journal.data()), journal.size());
+
+    const uint8_t* p = journal.data();
+    const uint8_t* end = p + journal.size();
+
+    JournalHeader header;
+    bool validJournal = consume(p, end, header) && header.magic == JOURNAL_MAGIC && header.version == JOURNAL_VERSION &&
+                        header.tileSize == TILE_SIZE && header.width > 0 && header.height > 0;
+
+    // The last session may have used another canvas resolution - replay at that resolution and resample afterwards
+    Canvas snapshot;
+    bool validSnapshot = file::exists(m_path + ".style") && style::read(m_path + ".style", snapshot) && snapshot.getChannels() == 3;
+    uint32_t width = validJournal ? header.width : validSnapshot ? snapshot.getWidth() : m_width;
+    uint32_t height = validJournal ? header.height : validSnapshot ? snapshot.getHeight() : m_height;
+
+    Canvas canvas(width, height);
+    if (validSnapshot && snapshot.getWidth() == width && snapshot.getHeight() == height)
+    {
+        canvas = snapshot;
+        recovered = true;
+    }
+
+    if (validJournal)
+    {
+        uint32_t tilesX = style::tileCount(width, TILE_SIZE);
+        uint32_t tilesY = style::tileCount(height, TILE_SIZE);
+
+        RecordHeader record;
+        while (consume(p, end, record) && size_t(end - p) >= record.payloadSize &&
+               hash::compute(p, record.payloadSize) == record.payloadHash)
+        {
+            const uint8_t* payload = p;
+            const uint8_t* payloadEnd = p + record.payloadSize;
+            p = payloadEnd;
+
+            Hairstyle hs;
+            uint32_t tileCount = 0;
+            if (!consume(payload, payloadEnd, hs.color) || !consume(payload, payloadEnd, hs.length) ||
+                !consume(payload, payloadEnd, hs.width) || !consume(payload, payloadEnd, tileCount))
+                break;
+
+            for (uint32_t i = 0; i < tileCount; ++i)
+            {
+                uint16_t tx, ty;
+                if (!consume(payload, payloadEnd, tx) || !consume(payload, payloadEnd, ty) || tx >= tilesX || ty >= tilesY)
+                    break;
+
+                uint32_t x = tx * TILE_SIZE, y = ty * TILE_SIZE;
+                uint32_t w = std::min(TILE_SIZE, width - x), h = std::min(TILE_SIZE, height - y);
+                if (size_t(payloadEnd - payload) < size_t(w) * h * 3)
+                    break;
+
+                canvas.writeRect(x, y, w, h, payload);
+                payload += size_t(w) * h * 3;
+            }
+
+            outHairstyle = hs;
+            recovered = true;
+        }
+    }
+
+    if (width != m_width || height != m_height)
+    {
+        outCanvas.resize(m_width, m_height);
+        if (recovered)
+            canvasops::resample(canvas, outCanvas, canvasops::Filter::Bicubic);
+    }
+    else
+        std::swap(outCanvas, canvas);
+
+    if (recovered)
+    {
+        std::lock_guard<std::mutex> mirrorLock(m_mirrorMutex);
+        m_mirror = outCanvas;
+        m_mirrorHairstyle = outHairstyle;
+        m_savedHairstyle = outHairstyle;
+        m_hasSavedHairstyle = true;
+        LOG("Recovered the last session from " << journalPath);
+    }
+
+    return recovered;
+}
+
+void AutosaveJournal::collectTiles(const uint8_t* pixels, const std::vector<bool>& tiles, std::vector<TileRecord>& outRecords) const
+{
+    size_t rowSize = size_t(m_width) * 3;
+
+    for (uint32_t ty = 0; ty < m_tilesY; ++ty)
+    {
+        for (uint32_t tx = 0; tx < m_tilesX; ++tx)
+        {
+            if (!tiles[ty * m_tilesX + tx])
+                continue;
+
+            uint32_t x = tx * TILE_SIZE, y = ty * TILE_SIZE;
+            uint32_t w = std::min(TILE_SIZE, m_width - x), h = std::min(TILE_SIZE, m_height - y);
+
+            TileRecord record;
+            record.tileX = uint16_t(tx);
+            record.tileY = uint16_t(ty);
+            record.pixels.resize(size_t(w) * h * 3);
+            for (uint32_t row = 0; row < h; ++row)
+                memcpy(&record.pixels[row * w * 3], pixels + (y + row) * rowSize + x * 3, w * 3);
+
+            outRecords.push_back(std::move(record));
+        }
+    }
+}
+
+void AutosaveJournal::submit(Batch&& batch)
+{
+    m_savedHairstyle = batch.hairstyle;
+    m_hasSavedHairstyle = true;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(batch));
+    }
+
+    m_condition.notify_one();
+}
+
+void AutosaveJournal::run()
+{
+    // Never compete with the render thread
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+    Profiler::setThreadName("Autosave");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_condition.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty())
+            break;
+
+        Batch batch = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        lock.unlock();
+        write(batch);
+        lock.lock();
+    }
+}
+
+void AutosaveJournal::write(const Batch& batch)
+{
+    PROFILE_ZONE("Write autosave");
+
+    // recover() may replace the mirror on the main thread
+    std::lock_guard<std::mutex> mirrorLock(m_mirrorMutex);
+
+    for (auto& tile : batch.tiles)
+    {
+        uint32_t x = tile.tileX * TILE_SIZE, y = tile.tileY * TILE_SIZE;
+        m_mirror.writeRect(x, y, std::min(TILE_SIZE, m_width - x), std::min(TILE_SIZE, m_height - y), tile.pixels.data());
+    }
+
+    m_mirrorHairstyle = batch.hairstyle;
+
+    // Every session starts with a compaction so records are never appended to a journal with a torn tail
+    if (!m_journal.is_open() || m_journalSize > m_maxJournalSize)
+        compact();
+    else
+        append(batch);
+}
+
+void AutosaveJournal::append(const Batch& batch)
+{
+    std::vector<uint8_t> payload;
+    ::append(payload, batch.hairstyle.color);
+    ::append(payload, batch.hairstyle.length);
+    ::append(payload, batch.hairstyle.width);
+    ::append(payload, uint32_t(batch.tiles.size()));
+
+    for (auto& tile : batch.tiles)
+    {
+        ::append(payload, tile.tileX);
+        ::append(payload, tile.tileY);
+        payload.insert(payload.end(), tile.pixels.begin(), tile.pixels.end());
+    }
+
+    RecordHeader record;
+    record.payloadSize = uint32_t(payload.size());
+    record.padding = 0;
+    record.payloadHash = hash::compute(payload.data(), payload.size());
+
+    m_journal.write(reinterpret_cast<const char*>(&record), sizeof(RecordHeader));
+    m_journal.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    m_journal.flush();
+    m_journalSize += sizeof(RecordHeader) + payload.size();
+
+    // The mirror holds the changes, the next write compacts it into a new snapshot and journal
+    if (!m_journal)
+    {
+        ERROR("Could not append to the autosave journal " << m_path << ".journal");
+        m_journal.close();
+    }
+}
+
+void AutosaveJournal::compact()
+{
+    // Replaying the old journal over the new snapshot yields the same canvas,
+    // so a crash between writing the snapshot and truncating the journal is harmless
+    std::string tmpPath = m_path + ".style.tmp";
+    if (!style::write(tmpPath, m_mirror))
+    {
+        file::remove(tmpPath);
+        return;
+    }
+
+    if (!file::replace(tmpPath, m_path + ".style"))
+    {
+        ERROR("Could not compact the autosave journal into " << m_path << ".style");
+        file::remove(tmpPath);
+        return;
+    }
+
+    JournalHeader header;
+    header.width = m_width;
+    header.height = m_height;
+    header.tileSize = TILE_SIZE;
+
+    m_journal.close();
+    m_journal.clear();
+    m_journal.open(m_path + ".journal", std::ios::binary | std::ios::trunc);
+    m_journal.write(reinterpret_cast<const char*>(&header), sizeof(JournalHeader));
+    m_journalSize = sizeof(JournalHeader);
+
+    // A closed journal makes the next write try the compaction again
+    if (!m_journal)
+    {
+        ERROR("Could not open the autosave journal " << m_path << ".journal");
+        m_journal.close();
+        return;
+    }
+
+    // The snapshot only holds the canvas - keep the hairstyle parameters in the journal
+    Batch hairstyleOnly;
+    hairstyleOnly.hairstyle = m_mirrorHairstyle;
+    append(hairstyleOnly);
+}
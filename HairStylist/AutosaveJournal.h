@@ -0,0 +1,113 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <stdint.h>
+#include "Hairstyle.h"
+#include "Canvas.h"
+
+class Framebuffer;
+
+/**
+* Incremental autosave of the painter canvas.
+* Changed tiles are tracked with markDirty() and periodically read back from the GPU
+* without stalling (see Framebuffer::beginReadback()). A low priority background thread
+* appends them to <path>.journal. Once the journal grows beyond a limit it is compacted
+* into the style file <path>.style and truncated.
+* recover() reconstructs the last session from the style file and the journal.
+* Failed writes are reported and retried with a compaction at the next save, the pending
+* changes are kept in memory until then.
+*/
+class AutosaveJournal
+{
+    struct TileRecord
+    {
+        uint16_t tileX;
+        uint16_t tileY;
+        std::vector<uint8_t> pixels;
+    };
+
+    struct Batch
+    {
+        Hairstyle hairstyle;
+        std::vector<TileRecord> tiles;
+    };
+
+public:
+    static const uint32_t TILE_SIZE = 64;
+
+    AutosaveJournal(const std::string& path, uint32_t canvasWidth, uint32_t canvasHeight);
+    ~AutosaveJournal();
+
+    /**
+    * Marks the canvas pixels in the rectangle [minX, maxX) x [minY, maxY) as changed.
+    * The rectangle is clamped to the canvas.
+    */
+    void markDirty(int minX, int minY, int maxX, int maxY);
+    void markAllDirty();
+
+    /**
+    * Call once per frame. Starts a readback of the dirty tiles every saveInterval seconds
+    * and hands finished readbacks to the background thread.
+    */
+    void update(Framebuffer& framebuffer, const Hairstyle& hairstyle);
+
+    /**
+    * Synchronously captures all pending changes. Use before shutting down.
+    */
+    void flush(Framebuffer& framebuffer, const Hairstyle& hairstyle);
+
+    /**
+    * Reconstructs the canvas and hairstyle of the last session.
+    * Returns false if there is nothing to recover.
+    */
+    bool recover(Canvas& outCanvas, Hairstyle& outHairstyle);
+
+    void setSaveInterval(float seconds) { m_saveInterval = seconds; }
+
+private:
+    void collectTiles(const uint8_t* pixels, const std::vector<bool>& tiles, std::vector<TileRecord>& outRecords) const;
+    void submit(Batch&& batch);
+
+    // Background thread
+    void run();
+    void write(const Batch& batch);
+    void append(const Batch& batch);
+    void compact();
+
+private:
+    std::string m_path;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_tilesX;
+    uint32_t m_tilesY;
+
+    float m_saveInterval{ 3.0f };
+    float m_timeUntilSave{ 3.0f };
+    std::vector<bool> m_dirtyTiles;
+    std::vector<bool> m_readbackTiles;
+    bool m_readbackPending{ false };
+    Hairstyle m_savedHairstyle;
+    bool m_hasSavedHairstyle{ false };
+
+    // Shared with the background thread
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<Batch> m_queue;
+    bool m_stop{ false };
+
+    // Owned by the background thread
+    std::ofstream m_journal;
+    size_t m_journalSize{ 0 };
+    size_t m_maxJournalSize{ 32 * 1024 * 1024 };
+
+    // Written by the background thread and by recover(). Locked after m_mutex, never the other way around.
+    std::mutex m_mirrorMutex;
+    Canvas m_mirror;
+    Hairstyle m_mirrorHairstyle;
+    std::thread m_thread;
+};
@@ -0,0 +1,34 @@
+#include "Canvas.h"
+#include <cassert>
+#include <cstring>
+
+Canvas::Canvas(uint32_t width, uint32_t height, uint32_t channels)
+{
+    resize(width, height, channels);
+}
+
+void Canvas::resize(uint32_t width, uint32_t height, uint32_t channels)
+{
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
+    m_pixels.resize(size_t(width) * height * channels);
+}
+
+void Canvas::readRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint8_t* outPixels) const
+{
+    assert(x + width <= m_width && y + height <= m_height);
+
+    size_t rowSize = size_t(width) * m_channels;
+    for (uint32_t row = 0; row < height; ++row)
+        memcpy(outPixels + row * rowSize, pixel(x, y + row), rowSize);
+}
+
+void Canvas::writeRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t* pixels)
+{
+    assert(x + width <= m_width && y + height <= m_height);
+
+    size_t rowSize = size_t(width) * m_channels;
+    for (uint32_t row = 0; row < height; ++row)
+        memcpy(pixel(x, y + row), pixels + row * rowSize, rowSize);
+}
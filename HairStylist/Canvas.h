@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <cstddef>
+
+/**
+* CPU-side copy of a painted hair canvas.
+* Pixels are 8 bit per channel, interleaved and tightly packed (no row padding).
+* Rows are stored in the same order as glGetTexImage returns them.
+*/
+class Canvas
+{
+public:
+    Canvas() {}
+    Canvas(uint32_t width, uint32_t height, uint32_t channels = 3);
+
+    /**
+    * Reallocates the pixel storage. Existing content is not preserved.
+    */
+    void resize(uint32_t width, uint32_t height, uint32_t channels = 3);
+
+    uint32_t getWidth() const { return m_width; }
+    uint32_t getHeight() const { return m_height; }
+    uint32_t getChannels() const { return m_channels; }
+    size_t getRowSize() const { return size_t(m_width) * m_channels; }
+    size_t getSize() const { return m_pixels.size(); }
+    bool empty() const { return m_pixels.empty(); }
+
+    uint8_t* data() { return m_pixels.data(); }
+    const uint8_t* data() const { return m_pixels.data(); }
+
+    uint8_t* pixel(uint32_t x, uint32_t y) { return &m_pixels[(size_t(y) * m_width + x) * m_channels]; }
+    const uint8_t* pixel(uint32_t x, uint32_t y) const { return &m_pixels[(size_t(y) * m_width + x) * m_channels]; }
+
+    /**
+    * Copies the rectangle (x, y, width, height) into a tightly packed buffer.
+    * The rectangle is expected to be inside the canvas.
+    */
+    void readRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint8_t* outPixels) const;
+
+    /**
+    * Copies a tightly packed buffer into the rectangle (x, y, width, height).
+    * The rectangle is expected to be inside the canvas.
+    */
+    void writeRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t* pixels);
+
+private:
+    uint32_t m_width{ 0 };
+    uint32_t m_height{ 0 };
+    uint32_t m_channels{ 3 };
+    std::vector<uint8_t> m_pixels;
+};
@@ -0,0 +1,302 @@
+#include "CommandList.h"
+#include "GLState.h"
+#include "Mesh.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+const size_t CommandList::Packet::MAX_TEXTURES;
+const size_t CommandList::Packet::MAX_BUFFERS;
+
+uint32_t RenderState::getSortBits() const
+{
+    uint32_t bits = uint32_t(blend) | uint32_t(depthTest) << 1 | uint32_t(polygonMode != GL_FILL) << 2 | uint32_t(colorMask != 0xF) << 3;
+    if (blend)
+        bits |= ((blendSrc * 31 + blendDst) & 0xF) << 4;
+
+    return bits;
+}
+
+CommandList::Packet::Packet(Arena& arena, Shader& shader, Mesh& mesh, const RenderState& state, uint8_t layer, uint32_t sequence)
+    :m_arena(arena)
+    ,m_shader(&shader)
+    ,m_mesh(&mesh)
+    ,m_state(state)
+    ,m_layer(layer)
+    ,m_sequence(sequence)
+{
+}
+
+CommandList::Packet::Uniform* CommandList::Packet::addUniform(UniformType type, const char* name)
+{
+    Uniform* uniform = m_arena.create<Uniform>();
+    uniform->next = nullptr;
+    uniform->name = name;
+    uniform->mesh = nullptr;
+    uniform->type = type;
+
+    if (m_lastUniform)
+        m_lastUniform->next = uniform;
+    else
+        m_firstUniform = uniform;
+    m_lastUniform = uniform;
+
+    return uniform;
+}
+
+CommandList::Packet& CommandList::Packet::setInt(const char* uniformName, int v)
+{
+    addUniform(UniformType::Int, uniformName)->values[0] = float(v);
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setFloat(const char* uniformName, float v)
+{
+    addUniform(UniformType::Float, uniformName)->values[0] = v;
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setVec3(const char* uniformName, const glm::vec3& v)
+{
+    memcpy(addUniform(UniformType::Vec3, uniformName)->values, &v[0], sizeof(v));
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setVec4(const char* uniformName, const glm::vec4& v)
+{
+    memcpy(addUniform(UniformType::Vec4, uniformName)->values, &v[0], sizeof(v));
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setMat4(const char* uniformName, const glm::mat4& m)
+{
+    memcpy(addUniform(UniformType::Mat4, uniformName)->values, &m[0][0], sizeof(m));
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setModel(const glm::mat4& model)
+{
+    memcpy(addUniform(UniformType::Model, nullptr)->values, &model[0][0], sizeof(model));
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setMVP(const glm::mat4& mvp)
+{
+    memcpy(addUniform(UniformType::MVP, nullptr)->values, &mvp[0][0], sizeof(mvp));
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setVertexFormat(const Mesh& mesh)
+{
+    addUniform(UniformType::VertexFormat, nullptr)->mesh = &mesh;
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::setMaterial(const Material& material)
+{
+    Uniform* uniform = addUniform(UniformType::Material, nullptr);
+    memcpy(uniform->values, &material.diffuse[0], sizeof(material.diffuse));
+    memcpy(uniform->values + 3, &material.specular[0], sizeof(material.specular));
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::bindTexture(GLuint unit, GLenum target, GLuint texture, const char* samplerName)
+{
+    if (m_textureCount == MAX_TEXTURES)
+    {
+        ERROR("A packet binds at most " << MAX_TEXTURES << " textures.");
+        return *this;
+    }
+
+    TextureBinding& binding = m_textures[m_textureCount++];
+    binding.unit = unit;
+    binding.target = target;
+    binding.texture = texture;
+
+    if (samplerName)
+        addUniform(UniformType::Int, samplerName)->values[0] = float(unit);
+
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::bindUniformBuffer(GLuint bindingPoint, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    if (m_bufferCount == MAX_BUFFERS)
+    {
+        ERROR("A packet binds at most " << MAX_BUFFERS << " uniform buffers.");
+        return *this;
+    }
+
+    BufferBinding& binding = m_buffers[m_bufferCount++];
+    binding.bindingPoint = bindingPoint;
+    binding.buffer = buffer;
+    binding.offset = offset;
+    binding.size = size;
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::lod(size_t lod)
+{
+    m_drawType = DrawType::Lod;
+    m_lod = lod;
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::visible(const glm::mat4& modelView, const glm::mat4& proj, float padding)
+{
+    m_drawType = DrawType::Visible;
+    m_modelView = modelView;
+    m_proj = proj;
+    m_padding = padding;
+    return *this;
+}
+
+CommandList::Packet& CommandList::Packet::instanced(size_t lod, GLsizei instanceCount)
+{
+    m_drawType = DrawType::Instanced;
+    m_lod = lod;
+    m_instanceCount = instanceCount;
+    return *this;
+}
+
+uint64_t CommandList::Packet::computeSortKey() const
+{
+    uint64_t texture = m_textureCount > 0 ? m_textures[0].texture : 0;
+    return uint64_t(m_layer) << 56 |
+           uint64_t(m_shader->getProgram() & 0xFFFF) << 40 |
+           uint64_t(m_state.getSortBits() & 0xFF) << 32 |
+           (texture & 0xFFFF) << 16 |
+           uint64_t(m_mesh->getVAO() & 0xFFFF);
+}
+
+void CommandList::Packet::submit(GLState& state) const
+{
+    state.enable(GL_BLEND, m_state.blend);
+    if (m_state.blend)
+    {
+        state.blendFunc(m_state.blendSrc, m_state.blendDst);
+        state.blendColor(m_state.blendColor.r, m_state.blendColor.g, m_state.blendColor.b, m_state.blendColor.a);
+    }
+    state.enable(GL_DEPTH_TEST, m_state.depthTest);
+    state.polygonMode(m_state.polygonMode);
+    state.colorMask((m_state.colorMask & 1) != 0, (m_state.colorMask & 2) != 0, (m_state.colorMask & 4) != 0, (m_state.colorMask & 8) != 0);
+    state.lineWidth(m_state.lineWidth);
+
+    m_shader->bind();
+
+    for (uint8_t i = 0; i < m_textureCount; ++i)
+        state.bindTexture(m_textures[i].unit, m_textures[i].target, m_textures[i].texture);
+
+    for (uint8_t i = 0; i < m_bufferCount; ++i)
+    {
+        const BufferBinding& binding = m_buffers[i];
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding.bindingPoint, binding.buffer, binding.offset, binding.size);
+        state.countStateCalls();
+    }
+
+    for (const Uniform* uniform = m_firstUniform; uniform; uniform = uniform->next)
+    {
+        const float* v = uniform->values;
+        switch (uniform->type)
+        {
+        case UniformType::Int:
+            m_shader->setInt(uniform->name, int(v[0]));
+            break;
+        case UniformType::Float:
+            m_shader->setFloat(uniform->name, v[0]);
+            break;
+        case UniformType::Vec3:
+            m_shader->setVec3(uniform->name, v[0], v[1], v[2]);
+            break;
+        case UniformType::Vec4:
+            m_shader->setVec4(uniform->name, v[0], v[1], v[2], v[3]);
+            break;
+        case UniformType::Mat4:
+            m_shader->setMat4(uniform->name, *reinterpret_cast<const glm::mat4*>(v));
+            break;
+        case UniformType::Model:
+            m_shader->setModel(*reinterpret_cast<const glm::mat4*>(v));
+            break;
+        case UniformType::MVP:
+            m_shader->setMVP(*reinterpret_cast<const glm::mat4*>(v));
+            break;
+        case UniformType::VertexFormat:
+            m_shader->setVertexFormat(*uniform->mesh);
+            break;
+        case UniformType::Material:
+        {
+            Material material;
+            material.diffuse = glm::vec3(v[0], v[1], v[2]);
+            material.specular = glm::vec4(v[3], v[4], v[5], v[6]);
+            m_shader->setMaterial(material);
+            break;
+        }
+        }
+    }
+
+    m_mesh->bind();
+    switch (m_drawType)
+    {
+    case DrawType::Lod:
+        m_mesh->render(m_lod);
+        break;
+    case DrawType::Visible:
+        m_mesh->renderVisible(m_modelView, m_proj, m_padding);
+        break;
+    case DrawType::Instanced:
+        m_mesh->renderInstanced(m_lod, m_instanceCount);
+        break;
+    }
+}
+
+CommandList::Packet& CommandList::draw(Shader& shader, Mesh& mesh, const RenderState& state, uint8_t layer)
+{
+    // Packet is trivially destructible and only constructible by the list, so it is placed by hand
+    void* memory = m_arena.allocate(sizeof(Packet), std::alignment_of<Packet>::value);
+    Packet* packet = new (memory) Packet(m_arena, shader, mesh, state, layer, uint32_t(m_packets.size()));
+    m_packets.push_back(packet);
+    m_sorted = false;
+    return *packet;
+}
+
+void CommandList::submit(GLState& state)
+{
+    sort();
+
+    for (const Packet* packet : m_packets)
+        packet->submit(state);
+}
+
+void CommandList::submit(GLState& state, uint8_t firstLayer, uint8_t lastLayer)
+{
+    sort();
+
+    for (const Packet* packet : m_packets)
+    {
+        if (packet->m_layer >= firstLayer && packet->m_layer <= lastLayer)
+            packet->submit(state);
+    }
+}
+
+void CommandList::sort()
+{
+    if (m_sorted)
+        return;
+
+    for (Packet* packet : m_packets)
+        packet->m_sortKey = packet->computeSortKey();
+
+    std::sort(m_packets.begin(), m_packets.end(), [](const Packet* a, const Packet* b)
+    {
+        return a->m_sortKey != b->m_sortKey ? a->m_sortKey < b->m_sortKey : a->m_sequence < b->m_sequence;
+    });
+    m_sorted = true;
+}
+
+void CommandList::reset()
+{
+    m_packets.clear();
+    m_arena.reset();
+    m_sorted = false;
+}
@@ -0,0 +1,207 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+#include "Arena.h"
+#include "Shader.h"
+
+class Mesh;
+class GLState;
+
+/**
+* Fixed function state of a draw.
+*/
+struct RenderState
+{
+    bool blend{ false };
+    GLenum blendSrc{ GL_ONE };
+    GLenum blendDst{ GL_ZERO };
+    glm::vec4 blendColor;
+    bool depthTest{ false };
+    GLenum polygonMode{ GL_FILL };
+    uint8_t colorMask{ 0xF }; // rgba bits
+    float lineWidth{ 1.0f };
+
+    /**
+    * Small number that identifies equal states for sorting.
+    */
+    uint32_t getSortBits() const;
+};
+
+/**
+* Draws of a pass, recorded into an arena and submitted at once. Recording only stores values, so it does not need
+* the GL context - the GL calls are issued by submit().
+*
+* Packets of the same layer may be reordered: they are sorted by program, state, first texture and mesh, so
+* consecutive packets share most of their bindings. Draws whose order matters (blending) go into increasing layers.
+* The render target, viewport and clears are set by the caller before submit().
+*/
+class CommandList
+{
+public:
+    /**
+    * A recorded draw. Values passed to the setters are copied into the arena.
+    * Names have to outlive the list, e.g. string literals.
+    */
+    class Packet
+    {
+        friend CommandList;
+    public:
+        Packet& setInt(const char* uniformName, int v);
+        Packet& setFloat(const char* uniformName, float v);
+        Packet& setVec3(const char* uniformName, const glm::vec3& v);
+        Packet& setVec4(const char* uniformName, const glm::vec4& v);
+        Packet& setMat4(const char* uniformName, const glm::mat4& m);
+
+        /**
+        * See Shader::setModel(), Shader::setMVP(), Shader::setVertexFormat() and Shader::setMaterial().
+        */
+        Packet& setModel(const glm::mat4& model);
+        Packet& setMVP(const glm::mat4& mvp);
+        Packet& setVertexFormat(const Mesh& mesh);
+        Packet& setMaterial(const Material& material);
+
+        /**
+        * Binds a GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY texture to a unit and sets the sampler samplerName to it.
+        * A null samplerName keeps the sampler (units default to 0).
+        */
+        Packet& bindTexture(GLuint unit, GLenum target, GLuint texture, const char* samplerName = nullptr);
+
+        /**
+        * Binds a range of a uniform buffer to a binding point for this draw (see glBindBufferRange()).
+        */
+        Packet& bindUniformBuffer(GLuint bindingPoint, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+        /**
+        * The mesh draws a level of detail (see Mesh::render()).
+        */
+        Packet& lod(size_t lod);
+
+        /**
+        * The mesh draws the meshlets that are visible at submission (see Mesh::renderVisible()).
+        */
+        Packet& visible(const glm::mat4& modelView, const glm::mat4& proj, float padding = 0.0f);
+
+        /**
+        * The mesh draws a level of detail instanceCount times (see Mesh::renderInstanced()).
+        */
+        Packet& instanced(size_t lod, GLsizei instanceCount);
+
+    private:
+        enum class DrawType : uint8_t
+        {
+            Lod,
+            Visible,
+            Instanced
+        };
+
+        enum class UniformType : uint8_t
+        {
+            Int,
+            Float,
+            Vec3,
+            Vec4,
+            Mat4,
+            Model,
+            MVP,
+            VertexFormat,
+            Material
+        };
+
+        struct Uniform
+        {
+            Uniform* next;
+            const char* name;
+            const Mesh* mesh;
+            UniformType type;
+            float values[16];
+        };
+
+        struct TextureBinding
+        {
+            GLuint unit;
+            GLenum target;
+            GLuint texture;
+        };
+
+        struct BufferBinding
+        {
+            GLuint bindingPoint;
+            GLuint buffer;
+            GLintptr offset;
+            GLsizeiptr size;
+        };
+
+        static const size_t MAX_TEXTURES = 4;
+        static const size_t MAX_BUFFERS = 2;
+
+        Packet(Arena& arena, Shader& shader, Mesh& mesh, const RenderState& state, uint8_t layer, uint32_t sequence);
+
+        Uniform* addUniform(UniformType type, const char* name);
+
+        /**
+        * layer (8 bits) | program (16) | state (8) | first texture (16) | vertex array (16)
+        */
+        uint64_t computeSortKey() const;
+        void submit(GLState& state) const;
+
+    private:
+        Arena& m_arena;
+        Shader* m_shader;
+        Mesh* m_mesh;
+        RenderState m_state;
+        uint8_t m_layer;
+        uint32_t m_sequence; // keeps the recorded order of equal keys
+        uint64_t m_sortKey{ 0 };
+
+        Uniform* m_firstUniform{ nullptr };
+        Uniform* m_lastUniform{ nullptr };
+        TextureBinding m_textures[MAX_TEXTURES];
+        uint8_t m_textureCount{ 0 };
+        BufferBinding m_buffers[MAX_BUFFERS];
+        uint8_t m_bufferCount{ 0 };
+
+        DrawType m_drawType{ DrawType::Lod };
+        size_t m_lod{ 0 };
+        GLsizei m_instanceCount{ 1 };
+        glm::mat4 m_modelView;
+        glm::mat4 m_proj;
+        float m_padding{ 0.0f };
+    };
+
+    CommandList() {}
+
+    CommandList(const CommandList&) = delete;
+    CommandList& operator=(const CommandList&) = delete;
+
+    /**
+    * Records a draw of mesh with shader. Lower layers are submitted first.
+    * Configure the returned packet before the next draw() call.
+    */
+    Packet& draw(Shader& shader, Mesh& mesh, const RenderState& state, uint8_t layer = 0);
+
+    /**
+    * Sorts the packets and issues them through state. The list stays recorded and can be submitted again.
+    */
+    void submit(GLState& state);
+
+    /**
+    * Submits only the packets of the layers firstLayer to lastLayer, e.g. to time passes on their own.
+    */
+    void submit(GLState& state, uint8_t firstLayer, uint8_t lastLayer);
+
+    /**
+    * Drops all packets, the arena memory is reused by the next recording.
+    */
+    void reset();
+
+    size_t getPacketCount() const { return m_packets.size(); }
+
+private:
+    void sort();
+
+    Arena m_arena;
+    std::vector<Packet*> m_packets;
+    bool m_sorted{ false };
+};
@@ -0,0 +1,105 @@
+#include "CompactMesh.h"
+#include <cmath>
+#include <algorithm>
+#include "RawMesh.h"
+
+namespace
+{
+    uint16_t quantizeUnorm(float v)
+    {
+        return uint16_t(std::min(1.0f, std::max(0.0f, v)) * 65535.0f + 0.5f);
+    }
+
+    int16_t quantizeSnorm(float v)
+    {
+        return int16_t(std::floor(std::min(1.0f, std::max(-1.0f, v)) * 32767.0f + 0.5f));
+    }
+
+    float signNotZero(float v)
+    {
+        return v >= 0.0f ? 1.0f : -1.0f;
+    }
+}
+
+bool CompactMesh::build(const RawMesh& mesh)
+{
+    const float* vertices = mesh.getVertices();
+    size_t vertexCount = mesh.getVertexCount();
+
+    // RawMesh guarantees at least one vertex
+    glm::vec3 minPos(vertices[0], vertices[1], vertices[2]);
+    glm::vec3 maxPos = minPos;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        const float* v = vertices + i * RawMesh::VERTEX_FLOATS;
+        if (v[3] < 0.0f || v[3] > 1.0f || v[4] < 0.0f || v[4] > 1.0f)
+            return false;
+
+        glm::vec3 pos(v[0], v[1], v[2]);
+        minPos = glm::min(minPos, pos);
+        maxPos = glm::max(maxPos, pos);
+    }
+
+    m_positionOffset = minPos;
+    m_positionScale = glm::max(maxPos - minPos, glm::vec3(1e-20f));
+
+    m_vertices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        const float* v = vertices + i * RawMesh::VERTEX_FLOATS;
+        glm::vec3 normal = glm::normalize(glm::vec3(v[5], v[6], v[7]));
+        glm::vec3 tangent(v[8], v[9], v[10]);
+        glm::vec3 bitangent(v[11], v[12], v[13]);
+
+        // Octahedral encoding needs a direction, degenerate vectors get a frame around the normal
+        if (glm::dot(tangent, tangent) < 1e-12f)
+            tangent = std::abs(normal.x) < 0.9f ? glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(normal, glm::vec3(0.0f, 1.0f, 0.0f));
+        if (glm::dot(bitangent, bitangent) < 1e-12f)
+            bitangent = glm::cross(normal, tangent);
+
+        CompactVertex& out = m_vertices[i];
+        glm::vec3 pos = (glm::vec3(v[0], v[1], v[2]) - m_positionOffset) / m_positionScale;
+        out.position[0] = quantizeUnorm(pos.x);
+        out.position[1] = quantizeUnorm(pos.y);
+        out.position[2] = quantizeUnorm(pos.z);
+        out.position[3] = 65535;
+        out.uv[0] = quantizeUnorm(v[3]);
+        out.uv[1] = quantizeUnorm(v[4]);
+        encodeOctahedral(normal, out.normal);
+        encodeOctahedral(tangent, out.tangent);
+        encodeOctahedral(bitangent, out.bitangent);
+    }
+
+    m_shortIndices.clear();
+    if (vertexCount <= 65536)
+        m_shortIndices.assign(mesh.getIndices(), mesh.getIndices() + mesh.getIndexCount());
+
+    return true;
+}
+
+glm::vec3 CompactMesh::decodePosition(const CompactVertex& vertex) const
+{
+    return glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]) / 65535.0f * m_positionScale + m_positionOffset;
+}
+
+void CompactMesh::encodeOctahedral(const glm::vec3& v, int16_t* outEncoded)
+{
+    // Project onto the octahedron and fold the lower hemisphere over the diagonals
+    glm::vec3 p = v / (std::abs(v.x) + std::abs(v.y) + std::abs(v.z));
+    glm::vec2 e(p.x, p.y);
+    if (p.z < 0.0f)
+        e = glm::vec2((1.0f - std::abs(p.y)) * signNotZero(p.x), (1.0f - std::abs(p.x)) * signNotZero(p.y));
+
+    outEncoded[0] = quantizeSnorm(e.x);
+    outEncoded[1] = quantizeSnorm(e.y);
+}
+
+glm::vec3 CompactMesh::decodeOctahedral(const int16_t* encoded)
+{
+    glm::vec2 e(std::max(-1.0f, encoded[0] / 32767.0f), std::max(-1.0f, encoded[1] / 32767.0f));
+    glm::vec3 v(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    if (v.z < 0.0f)
+        v = glm::vec3((1.0f - std::abs(e.y)) * signNotZero(e.x), (1.0f - std::abs(e.x)) * signNotZero(e.y), v.z);
+
+    return glm::normalize(v);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+class RawMesh;
+
+/**
+* 24 byte vertex layout (instead of 56 bytes for 14 floats):
+* - Position:            4 x uint16 normalized, xyz relative to the mesh bounds, w = 65535 (padding, decodes to 1)
+* - Texture Coordinates: 2 x uint16 normalized
+* - Normal:              2 x int16 normalized, octahedral encoding
+* - Tangent:             2 x int16 normalized, octahedral encoding
+* - Bitangent:           2 x int16 normalized, octahedral encoding
+* The tangent frame of the mesh files is not orthogonal and hair.geom orients the strands with it,
+* so the bitangent is stored instead of being reconstructed from the normal and the tangent.
+*/
+struct CompactVertex
+{
+    uint16_t position[4];
+    uint16_t uv[2];
+    int16_t normal[2];
+    int16_t tangent[2];
+    int16_t bitangent[2];
+};
+
+/**
+* Quantizes a RawMesh into CompactVertex layout and 16 bit indices where possible.
+*/
+class CompactMesh
+{
+public:
+    /**
+    * Returns false if texture coordinates lie outside of [0, 1] and cannot be stored as normalized uint16.
+    */
+    bool build(const RawMesh& mesh);
+
+    const std::vector<CompactVertex>& getVertices() const { return m_vertices; }
+
+    /**
+    * Empty if the mesh has more than 65536 vertices and needs 32 bit indices.
+    */
+    const std::vector<uint16_t>& getShortIndices() const { return m_shortIndices; }
+
+    /**
+    * position = quantized position / 65535 * scale + offset
+    */
+    const glm::vec3& getPositionScale() const { return m_positionScale; }
+    const glm::vec3& getPositionOffset() const { return m_positionOffset; }
+
+    glm::vec3 decodePosition(const CompactVertex& vertex) const;
+
+    static void encodeOctahedral(const glm::vec3& v, int16_t* outEncoded);
+    static glm::vec3 decodeOctahedral(const int16_t* encoded);
+
+private:
+    std::vector<CompactVertex> m_vertices;
+    std::vector<uint16_t> m_shortIndices;
+    glm::vec3 m_positionScale{ 1.0f };
+    glm::vec3 m_positionOffset{ 0.0f };
+};
@@ -0,0 +1,157 @@
+#include "FileWatcher.h"
+#include <chrono>
+#include "Logger.h"
+#include "file.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // How long the background thread sleeps before it looks at m_stop again
+    const int POLL_INTERVAL_MS = 250;
+}
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0)
+        ERROR("Could not initialize inotify, files are not watched.");
+#endif
+
+    m_thread = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_thread.join();
+
+#ifdef __linux__
+    if (m_inotify >= 0)
+        close(m_inotify);
+#endif
+}
+
+bool FileWatcher::watch(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+#ifdef __linux__
+    // Editors either rewrite a file or replace it with a renamed copy
+    int wd = m_inotify >= 0 ? inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) : -1;
+    if (wd < 0)
+    {
+        ERROR("Could not watch " << directory);
+        return false;
+    }
+
+    m_watches[wd] = directory;
+#else
+    if (!file::isDirectory(directory))
+    {
+        ERROR("Could not watch " << directory);
+        return false;
+    }
+#endif
+
+    m_directories.push_back(directory);
+    return true;
+}
+
+std::vector<std::string> FileWatcher::takeChanges()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> changes(m_changes.begin(), m_changes.end());
+    m_changes.clear();
+    return changes;
+}
+
+void FileWatcher::run()
+{
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop)
+                return;
+        }
+
+        poll();
+    }
+}
+
+#ifdef __linux__
+
+void FileWatcher::poll()
+{
+    if (m_inotify < 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+        return;
+    }
+
+    pollfd fd = { m_inotify, POLLIN, 0 };
+    if (::poll(&fd, 1, POLL_INTERVAL_MS) <= 0)
+        return;
+
+    alignas(inotify_event) char buffer[4096];
+    for (;;)
+    {
+        ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+        if (length <= 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            auto it = m_watches.find(event->wd);
+            if (event->len > 0 && it != m_watches.end())
+                m_changes.insert(it->second + "/" + event->name);
+
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+#else
+
+void FileWatcher::poll()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+
+    std::vector<std::string> directories;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        directories = m_directories;
+    }
+
+    // The first scan of a directory only remembers the times
+    for (const std::string& directory : directories)
+    {
+        for (const std::string& name : file::listFiles(directory))
+        {
+            std::string path = directory + "/" + name;
+            int64_t time = file::getModificationTime(path);
+            auto it = m_modificationTimes.find(path);
+            if (it == m_modificationTimes.end())
+                m_modificationTimes[path] = time;
+            else if (it->second != time)
+            {
+                it->second = time;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_changes.insert(path);
+            }
+        }
+    }
+}
+
+#endif
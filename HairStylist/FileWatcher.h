@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <stdint.h>
+
+/**
+* Reports files that were written in watched directories. A background thread waits for the changes
+* (inotify on Linux, other systems compare modification times a few times per second),
+* the renderer collects them with takeChanges() without blocking.
+* Subdirectories are not watched.
+*/
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /**
+    * Starts watching a directory. Returns false (with an error message) if it cannot be watched.
+    */
+    bool watch(const std::string& directory);
+
+    /**
+    * Paths (directory/name) of the files written or replaced since the last call, each path once.
+    */
+    std::vector<std::string> takeChanges();
+
+private:
+    // Background thread
+    void run();
+    void poll();
+
+private:
+    std::mutex m_mutex;
+    std::set<std::string> m_changes;
+    std::vector<std::string> m_directories;
+    bool m_stop{ false };
+
+#ifdef __linux__
+    int m_inotify{ -1 };
+    std::map<int, std::string> m_watches; // watch descriptor -> directory
+#else
+    std::map<std::string, int64_t> m_modificationTimes; // owned by the background thread
+#endif
+
+    std::thread m_thread;
+};
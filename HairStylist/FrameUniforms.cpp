@@ -0,0 +1,44 @@
+#include "FrameUniforms.h"
+#include "Logger.h"
+#include <cstring>
+
+const GLuint FrameUniforms::BINDING_POINT;
+
+FrameUniforms::~FrameUniforms()
+{
+    if (m_ubo)
+        glDeleteBuffers(1, &m_ubo);
+}
+
+void FrameUniforms::update(const glm::mat4& view, const glm::mat4& proj, const DirectionalLight& dirLight)
+{
+    FrameData data;
+    data.view = view;
+    data.proj = proj;
+    data.lightAmbient = glm::vec4(dirLight.ambient, 0.0f);
+    data.lightDiffuse = glm::vec4(dirLight.diffuse, 0.0f);
+    data.lightSpecular = glm::vec4(dirLight.specular, 0.0f);
+    data.lightViewDirection = view * glm::vec4(dirLight.direction, 0.0f);
+
+    if (m_ubo == 0)
+    {
+        glGenBuffers(1, &m_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), &data, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    else if (memcmp(&data, &m_data, sizeof(FrameData)) != 0)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        GLState::current().countStateCalls(3);
+    }
+    m_data = data;
+
+    // Other buffers may have been bound to the binding point since the last frame
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_POINT, m_ubo);
+    GLState::current().countStateCalls();
+
+    GL_ERROR_CHECK();
+}
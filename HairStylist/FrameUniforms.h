@@ -0,0 +1,51 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+/**
+* Data that is the same for every draw of a frame: camera and light. It is written into a uniform buffer
+* once per frame and read by all shaders through the uniform block "Frame" (see Shader::load()):
+*
+* layout(std140) uniform Frame
+* {
+*     mat4 u_view;
+*     mat4 u_proj;
+*     DirectionalLight u_dirLight;
+* };
+*/
+class FrameUniforms
+{
+public:
+    /**
+    * GL_UNIFORM_BUFFER binding point of the block. Gallery uses binding point 0 for its instances.
+    */
+    static const GLuint BINDING_POINT = 1;
+
+    FrameUniforms() {}
+    ~FrameUniforms();
+
+    /**
+    * Uploads the camera and the light and binds the buffer to BINDING_POINT.
+    * The upload is skipped if nothing changed since the last frame.
+    */
+    void update(const glm::mat4& view, const glm::mat4& proj, const DirectionalLight& dirLight);
+
+private:
+    /**
+    * Same layout as the block "Frame" in the shaders (std140, vec3 are padded to vec4).
+    */
+    struct FrameData
+    {
+        glm::mat4 view;
+        glm::mat4 proj;
+        glm::vec4 lightAmbient;
+        glm::vec4 lightDiffuse;
+        glm::vec4 lightSpecular;
+        glm::vec4 lightViewDirection;
+    };
+
+private:
+    GLuint m_ubo{ 0 };
+    FrameData m_data;
+};
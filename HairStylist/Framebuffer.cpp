@@ -1,21 +1,32 @@
 #include "Framebuffer.h"
 #include "Logger.h"
-#include <fstream>
 #include "file.h"
+#include "Canvas.h"
+#include "StyleFile.h"
+#include "canvasops.h"
+#include "GLState.h"
+#include <cassert>
+#include <algorithm>
+#include <SOIL2.h>
 
-Framebuffer::Framebuffer(GLsizei width, GLsizei height, bool hasRenderTexture)
+const size_t Framebuffer::READBACK_SLOTS;
+
+Framebuffer::Framebuffer(GLsizei width, GLsizei height, bool hasRenderTexture, bool hasDepthBuffer)
 {
     m_width = width;
     m_height = height;
     m_hasRenderTexture = hasRenderTexture;
+    std::fill(m_readbackPBO, m_readbackPBO + READBACK_SLOTS, 0);
+    std::fill(m_readbackFence, m_readbackFence + READBACK_SLOTS, nullptr);
 
     glGenFramebuffers(1, &m_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    GLState& state = GLState::current();
+    state.bindFramebuffer(GL_FRAMEBUFFER, m_fbo);
 
     if (hasRenderTexture)
     {
         glGenTextures(1, &m_renderTexture);
-        glBindTexture(GL_TEXTURE_2D, m_renderTexture);
+        state.bindTexture(GL_TEXTURE_2D, m_renderTexture);
         glTexImage2D(GL_TEXTURE_2D, 0, m_format, width, height, 0, m_format, GL_UNSIGNED_BYTE, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -27,32 +38,55 @@ Framebuffer::Framebuffer(GLsizei width, GLsizei height, bool hasRenderTexture)
         GLenum drawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
         glDrawBuffers(1, drawBuffers);
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+        state.bindTexture(GL_TEXTURE_2D, 0);
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (hasDepthBuffer)
+    {
+        glGenRenderbuffers(1, &m_depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    state.bindFramebuffer(GL_FRAMEBUFFER, 0);
     GL_ERROR_CHECK();
 }
 
 
 Framebuffer::~Framebuffer()
 {
+    GLState& state = GLState::current();
     if (m_hasRenderTexture)
-        glDeleteTextures(1, &m_renderTexture);
+        state.deleteTexture(m_renderTexture);
+
+    if (m_depthBuffer)
+        glDeleteRenderbuffers(1, &m_depthBuffer);
 
-    glDeleteFramebuffers(1, &m_fbo);
+    for (size_t slot = 0; slot < READBACK_SLOTS; ++slot)
+    {
+        if (m_readbackFence[slot])
+            glDeleteSync(m_readbackFence[slot]);
+
+        if (m_readbackPBO[slot])
+            glDeleteBuffers(1, &m_readbackPBO[slot]);
+    }
+
+    state.deleteFramebuffer(m_fbo);
 }
 
 void Framebuffer::begin()
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-    glViewport(0, 0, m_width, m_height);
-    glScissor(0, 0, m_width, m_height);
+    GLState& state = GLState::current();
+    state.bindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    state.viewport(0, 0, m_width, m_height);
+    state.scissor(0, 0, m_width, m_height);
 }
 
 void Framebuffer::end()
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::current().bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void Framebuffer::resizeRenderTexture(GLsizei width, GLsizei height)
@@ -60,25 +94,175 @@ void Framebuffer::resizeRenderTexture(GLsizei width, GLsizei height)
     if (!m_hasRenderTexture)
         return;
 
-    glBindTexture(GL_TEXTURE_2D, m_renderTexture);
+    GLState::current().bindTexture(GL_TEXTURE_2D, m_renderTexture);
     glTexImage2D(GL_TEXTURE_2D, 0, m_format, width, height, 0, m_format, GL_UNSIGNED_BYTE, nullptr);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::current().bindTexture(GL_TEXTURE_2D, 0);
+
+    if (m_depthBuffer)
+    {
+        glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
     m_width = width;
     m_height = height;
 }
 
+void Framebuffer::blit(GLuint targetFBO)
+{
+    blit(targetFBO, 0, 0, m_width, m_height);
+}
+
+void Framebuffer::blit(GLuint targetFBO, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    GLState& state = GLState::current();
+    state.bindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFBO);
+
+    // The scissor test clips blits as well
+    state.scissor(x, y, width, height);
+    GLenum filter = width == m_width && height == m_height ? GL_NEAREST : GL_LINEAR;
+    glBlitFramebuffer(0, 0, m_width, m_height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, filter);
+    state.countDrawCalls();
+
+    state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Framebuffer::readRenderTexture(Canvas& outCanvas)
+{
+    if (!m_hasRenderTexture)
+        return;
+
+    outCanvas.resize(m_width, m_height, 3);
+
+    GLState::current().bindTexture(GL_TEXTURE_2D, m_renderTexture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, m_format, GL_UNSIGNED_BYTE, outCanvas.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    GLState::current().bindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Framebuffer::writeRenderTexture(const Canvas& canvas)
+{
+    if (!m_hasRenderTexture)
+        return;
+
+    if (canvas.getChannels() != 3)
+    {
+        ERROR("Canvas with " << canvas.getChannels() << " channels does not match the RGB render texture.");
+        return;
+    }
+
+    const Canvas* pixels = &canvas;
+    Canvas resampled;
+    if (GLsizei(canvas.getWidth()) != m_width || GLsizei(canvas.getHeight()) != m_height)
+    {
+        resampled.resize(m_width, m_height, 3);
+        canvasops::resample(canvas, resampled, canvasops::Filter::Bicubic);
+        pixels = &resampled;
+    }
+
+    GLState::current().bindTexture(GL_TEXTURE_2D, m_renderTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, m_format, GL_UNSIGNED_BYTE, pixels->data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    GLState::current().bindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Framebuffer::beginReadback(size_t slot)
+{
+    assert(slot < READBACK_SLOTS);
+    if (!m_hasRenderTexture || m_readbackFence[slot])
+        return;
+
+    size_t size = size_t(m_width) * m_height * 3;
+    if (!m_readbackPBO[slot])
+    {
+        glGenBuffers(1, &m_readbackPBO[slot]);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPBO[slot]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+    else
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPBO[slot]);
+
+    GLState::current().bindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, m_format, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    GLState::current().bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_readbackFence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GL_ERROR_CHECK();
+}
+
+bool Framebuffer::isReadbackReady(size_t slot)
+{
+    if (!m_readbackFence[slot])
+        return false;
+
+    GLenum status = glClientWaitSync(m_readbackFence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+const uint8_t* Framebuffer::mapReadback(size_t slot)
+{
+    assert(m_readbackFence[slot]);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPBO[slot]);
+    return static_cast<const uint8_t*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+}
+
+void Framebuffer::endReadback(size_t slot)
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPBO[slot]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    cancelReadback(slot);
+}
+
+void Framebuffer::cancelReadback(size_t slot)
+{
+    if (!m_readbackFence[slot])
+        return;
+
+    glDeleteSync(m_readbackFence[slot]);
+    m_readbackFence[slot] = nullptr;
+}
+
 void Framebuffer::saveRenderTexture(const std::string& filename)
 {
     if (!m_hasRenderTexture)
         return;
 
-    glBindTexture(GL_TEXTURE_2D, m_renderTexture);
-    size_t size = m_width * m_height * 3;
-    char* pixels = new char[size];
-    glGetTexImage(GL_TEXTURE_2D, 0, m_format, GL_UNSIGNED_BYTE, pixels);
+    Canvas canvas;
+    readRenderTexture(canvas);
+    style::write(filename, canvas);
+}
 
-    std::ofstream(filename, std::ios::binary).write(pixels, size);
-    delete[] pixels;
+bool Framebuffer::saveRenderTextureImage(const std::string& filename)
+{
+    if (!m_hasRenderTexture)
+        return false;
+
+    Canvas canvas;
+    readRenderTexture(canvas);
+
+    // OpenGL stores the bottom row first
+    size_t rowSize = size_t(canvas.getWidth()) * canvas.getChannels();
+    for (uint32_t y = 0; y < canvas.getHeight() / 2; ++y)
+        std::swap_ranges(canvas.pixel(0, y), canvas.pixel(0, y) + rowSize, canvas.pixel(0, canvas.getHeight() - 1 - y));
+
+    if (!SOIL_save_image(filename.c_str(), SOIL_SAVE_TYPE_PNG, canvas.getWidth(), canvas.getHeight(), canvas.getChannels(), canvas.data()))
+    {
+        ERROR("Failed to save " << filename << ": " << SOIL_last_result());
+        return false;
+    }
+
+    return true;
 }
 
 void Framebuffer::loadRenderTexture(const std::string& filename)
@@ -92,11 +276,7 @@ void Framebuffer::loadRenderTexture(const std::string& filename)
         return;
     }
 
-    size_t size = file::getSize(filename);
-    char* pixels = new char[size];
-    std::ifstream(filename, std::ios::binary).read(pixels, size);
-
-    glBindTexture(GL_TEXTURE_2D, m_renderTexture);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, m_format, GL_UNSIGNED_BYTE, pixels);
-    delete[] pixels;
+    Canvas canvas;
+    if (style::readResampled(filename, m_width, m_height, canvas))
+        writeRenderTexture(canvas);
 }
@@ -1,11 +1,17 @@
 #pragma once
 #include <GL/glew.h>
 #include <string>
+#include <stdint.h>
+
+class Canvas;
 
 class Framebuffer
 {
 public:
-    Framebuffer(GLsizei width, GLsizei height, bool hasRenderTexture);
+    /**
+    * hasDepthBuffer attaches a depth renderbuffer, e.g. to render the model off screen.
+    */
+    Framebuffer(GLsizei width, GLsizei height, bool hasRenderTexture, bool hasDepthBuffer = false);
     ~Framebuffer();
 
     /**
@@ -22,18 +28,77 @@ public:
     void end();
 
     GLuint getRenderTexture() const { return m_renderTexture; }
+    GLuint getFBO() const { return m_fbo; }
 
     void resizeRenderTexture(GLsizei width, GLsizei height);
 
     /**
-    * Saves the render texture of this buffer to the given file in binary format.
+    * Copies the render texture to the same rectangle of the framebuffer targetFBO, 0 is the window.
+    */
+    void blit(GLuint targetFBO = 0);
+
+    /**
+    * Copies the render texture into the rectangle x, y, width, height of targetFBO, scaled with linear filtering.
+    */
+    void blit(GLuint targetFBO, GLint x, GLint y, GLsizei width, GLsizei height);
+
+    GLsizei getWidth() const { return m_width; }
+    GLsizei getHeight() const { return m_height; }
+
+    /**
+    * Copies the render texture into outCanvas. The canvas is resized to the size of this buffer.
+    */
+    void readRenderTexture(Canvas& outCanvas);
+
+    /**
+    * Uploads the canvas into the render texture. Canvases of another size are resampled to the size of this buffer.
+    */
+    void writeRenderTexture(const Canvas& canvas);
+
+    /**
+    * Readbacks go through independent slots, every user (e.g. the autosave and preset transitions) keeps
+    * its own slot so their copies do not wait for each other.
+    */
+    static const size_t READBACK_SLOTS = 2;
+
+    /**
+    * Starts an asynchronous copy of the render texture into a pixel buffer object.
+    * The copy does not stall the pipeline - poll isReadbackReady() in later frames.
+    * Does nothing if the slot still has a readback pending.
+    */
+    void beginReadback(size_t slot = 0);
+
+    /**
+    * Returns true if a readback was started and the GPU finished it.
+    */
+    bool isReadbackReady(size_t slot = 0);
+    bool isReadbackPending(size_t slot = 0) const { return m_readbackFence[slot] != nullptr; }
+
+    /**
+    * Maps the finished readback. Rows are tightly packed RGB in the same layout as readRenderTexture().
+    * The pointer is valid until endReadback() is called.
+    */
+    const uint8_t* mapReadback(size_t slot = 0);
+    void endReadback(size_t slot = 0);
+
+    /**
+    * Drops a pending readback without mapping it.
+    */
+    void cancelReadback(size_t slot = 0);
+
+    /**
+    * Saves the render texture of this buffer to the given file as inline style (see style::write()).
     * If the filename does not exist then a new file will be created.
     */
     void saveRenderTexture(const std::string& filename);
 
     /**
-    * Loads the render texture from the specified filename in binary format.
-    * A new file will be created if it does not exist.
+    * Saves the render texture as PNG image, top row first. Returns false if writing failed.
+    */
+    bool saveRenderTextureImage(const std::string& filename);
+
+    /**
+    * Loads the render texture from the specified inline style file at the resolution of this buffer.
     */
     void loadRenderTexture(const std::string& filename);
 private:
@@ -43,5 +108,9 @@ private:
     GLuint m_fbo{0};
     GLuint m_renderTexture{0};
     bool m_hasRenderTexture{ false };
+    GLuint m_depthBuffer{ 0 };
+
+    GLuint m_readbackPBO[READBACK_SLOTS];
+    GLsync m_readbackFence[READBACK_SLOTS];
 };
 
@@ -0,0 +1,375 @@
+#include "GLState.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cassert>
+
+// VS2013 has no thread_local, its __declspec(thread) works for the pointer
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define GLSTATE_THREAD_LOCAL __declspec(thread)
+#else
+#define GLSTATE_THREAD_LOCAL thread_local
+#endif
+
+const GLuint GLState::MAX_TEXTURE_UNITS;
+const GLuint GLState::UNKNOWN;
+
+namespace
+{
+    GLSTATE_THREAD_LOCAL GLState* g_current = nullptr;
+
+    int capabilityIndex(GLenum cap)
+    {
+        switch (cap)
+        {
+        case GL_BLEND:
+            return 0;
+        case GL_DEPTH_TEST:
+            return 1;
+        case GL_SCISSOR_TEST:
+            return 2;
+        default:
+            return -1;
+        }
+    }
+
+    int targetIndex(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_2D_ARRAY:
+            return 1;
+        default:
+            return -1;
+        }
+    }
+
+    bool equal4(const float* a, float b0, float b1, float b2, float b3)
+    {
+        return a[0] == b0 && a[1] == b1 && a[2] == b2 && a[3] == b3;
+    }
+
+    bool equal4(const GLint* a, GLint b0, GLint b1, GLint b2, GLint b3)
+    {
+        return a[0] == b0 && a[1] == b1 && a[2] == b2 && a[3] == b3;
+    }
+}
+
+GLState& GLState::current()
+{
+    assert(g_current && "No GLState is current on this thread");
+    return *g_current;
+}
+
+bool GLState::hasCurrent()
+{
+    return g_current != nullptr;
+}
+
+void GLState::setCurrent(GLState* state)
+{
+    g_current = state;
+}
+
+GLState::GLState()
+{
+    invalidate();
+}
+
+GLState::~GLState()
+{
+    if (g_current == this)
+        g_current = nullptr;
+}
+
+void GLState::invalidate()
+{
+    std::fill(m_capabilities, m_capabilities + CAP_COUNT, int8_t(-1));
+    m_blendSrc = UNKNOWN;
+    m_blendDst = UNKNOWN;
+    m_blendColorKnown = false;
+    m_polygonMode = UNKNOWN;
+    m_colorMask = UNKNOWN;
+    m_lineWidth = -1.0f;
+    m_clearColorKnown = false;
+    m_viewportKnown = false;
+    m_scissorKnown = false;
+
+    m_program = UNKNOWN;
+    m_vao = UNKNOWN;
+    m_drawFramebuffer = UNKNOWN;
+    m_readFramebuffer = UNKNOWN;
+    m_activeUnit = UNKNOWN;
+    invalidateTextures();
+}
+
+void GLState::invalidateTextures()
+{
+    for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+        std::fill(m_textures[unit], m_textures[unit] + TARGET_COUNT, UNKNOWN);
+    m_activeUnit = UNKNOWN;
+}
+
+void GLState::beginFrame()
+{
+    m_lastFrame = m_frame;
+    m_frame = Stats();
+}
+
+bool GLState::change(bool changed)
+{
+    if (changed)
+        ++m_frame.stateCalls;
+    else
+        ++m_frame.skippedCalls;
+
+    return changed;
+}
+
+void GLState::enable(GLenum cap, bool enabled)
+{
+    int idx = capabilityIndex(cap);
+    if (idx >= 0)
+    {
+        if (!change(m_capabilities[idx] != int8_t(enabled)))
+            return;
+        m_capabilities[idx] = int8_t(enabled);
+    }
+    else
+        ++m_frame.stateCalls;
+
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+bool GLState::isEnabled(GLenum cap)
+{
+    int idx = capabilityIndex(cap);
+    if (idx < 0)
+        return glIsEnabled(cap) == GL_TRUE;
+
+    if (m_capabilities[idx] < 0)
+        m_capabilities[idx] = int8_t(glIsEnabled(cap) == GL_TRUE);
+
+    return m_capabilities[idx] == 1;
+}
+
+void GLState::blendFunc(GLenum srcFactor, GLenum dstFactor)
+{
+    if (!change(m_blendSrc != srcFactor || m_blendDst != dstFactor))
+        return;
+
+    m_blendSrc = srcFactor;
+    m_blendDst = dstFactor;
+    glBlendFunc(srcFactor, dstFactor);
+}
+
+void GLState::blendColor(float r, float g, float b, float a)
+{
+    if (!change(!m_blendColorKnown || !equal4(m_blendColor, r, g, b, a)))
+        return;
+
+    m_blendColor[0] = r;
+    m_blendColor[1] = g;
+    m_blendColor[2] = b;
+    m_blendColor[3] = a;
+    m_blendColorKnown = true;
+    glBlendColor(r, g, b, a);
+}
+
+void GLState::polygonMode(GLenum mode)
+{
+    if (!change(m_polygonMode != mode))
+        return;
+
+    m_polygonMode = mode;
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLState::colorMask(bool r, bool g, bool b, bool a)
+{
+    uint32_t mask = uint32_t(r) | uint32_t(g) << 1 | uint32_t(b) << 2 | uint32_t(a) << 3;
+    if (!change(m_colorMask != mask))
+        return;
+
+    m_colorMask = mask;
+    glColorMask(r, g, b, a);
+}
+
+void GLState::lineWidth(float width)
+{
+    if (!change(m_lineWidth != width))
+        return;
+
+    m_lineWidth = width;
+    glLineWidth(width);
+}
+
+void GLState::clearColor(float r, float g, float b, float a)
+{
+    if (!change(!m_clearColorKnown || !equal4(m_clearColor, r, g, b, a)))
+        return;
+
+    m_clearColor[0] = r;
+    m_clearColor[1] = g;
+    m_clearColor[2] = b;
+    m_clearColor[3] = a;
+    m_clearColorKnown = true;
+    glClearColor(r, g, b, a);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (!change(!m_viewportKnown || !equal4(m_viewport, x, y, width, height)))
+        return;
+
+    m_viewport[0] = x;
+    m_viewport[1] = y;
+    m_viewport[2] = width;
+    m_viewport[3] = height;
+    m_viewportKnown = true;
+    glViewport(x, y, width, height);
+}
+
+void GLState::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (!change(!m_scissorKnown || !equal4(m_scissor, x, y, width, height)))
+        return;
+
+    m_scissor[0] = x;
+    m_scissor[1] = y;
+    m_scissor[2] = width;
+    m_scissor[3] = height;
+    m_scissorKnown = true;
+    glScissor(x, y, width, height);
+}
+
+void GLState::useProgram(GLuint program)
+{
+    if (!change(m_program != program))
+        return;
+
+    m_program = program;
+    glUseProgram(program);
+}
+
+void GLState::bindVertexArray(GLuint vao)
+{
+    if (!change(m_vao != vao))
+        return;
+
+    m_vao = vao;
+    glBindVertexArray(vao);
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint fbo)
+{
+    bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    if (!change((draw && m_drawFramebuffer != fbo) || (read && m_readFramebuffer != fbo)))
+        return;
+
+    if (draw)
+        m_drawFramebuffer = fbo;
+    if (read)
+        m_readFramebuffer = fbo;
+    glBindFramebuffer(target, fbo);
+}
+
+GLuint GLState::getFramebuffer(GLenum target)
+{
+    GLuint& fbo = target == GL_READ_FRAMEBUFFER ? m_readFramebuffer : m_drawFramebuffer;
+    if (fbo == UNKNOWN)
+    {
+        GLint binding = 0;
+        glGetIntegerv(target == GL_READ_FRAMEBUFFER ? GL_READ_FRAMEBUFFER_BINDING : GL_DRAW_FRAMEBUFFER_BINDING, &binding);
+        fbo = GLuint(binding);
+    }
+
+    return fbo;
+}
+
+void GLState::activeTexture(GLuint unit)
+{
+    if (!change(m_activeUnit != unit))
+        return;
+
+    m_activeUnit = unit;
+    glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    int idx = targetIndex(target);
+    if (unit >= MAX_TEXTURE_UNITS || idx < 0)
+    {
+        ERROR("Texture unit " << unit << " or target 0x" << std::hex << target << std::dec << " is not tracked.");
+        return;
+    }
+
+    // Skipped binds leave the active unit alone
+    if (m_textures[unit][idx] == texture)
+    {
+        ++m_frame.skippedCalls;
+        return;
+    }
+
+    activeTexture(unit);
+    m_textures[unit][idx] = texture;
+    glBindTexture(target, texture);
+    ++m_frame.stateCalls;
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    bindTexture(m_activeUnit == UNKNOWN ? 0 : m_activeUnit, target, texture);
+}
+
+void GLState::deleteTexture(GLuint texture)
+{
+    if (texture == 0)
+        return;
+
+    for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+        for (GLuint& bound : m_textures[unit])
+            if (bound == texture)
+                bound = 0;
+
+    glDeleteTextures(1, &texture);
+    ++m_frame.stateCalls;
+}
+
+void GLState::deleteVertexArray(GLuint vao)
+{
+    if (vao == 0)
+        return;
+
+    if (m_vao == vao)
+        m_vao = 0;
+
+    glDeleteVertexArrays(1, &vao);
+    ++m_frame.stateCalls;
+}
+
+void GLState::deleteFramebuffer(GLuint fbo)
+{
+    if (fbo == 0)
+        return;
+
+    if (m_drawFramebuffer == fbo)
+        m_drawFramebuffer = 0;
+    if (m_readFramebuffer == fbo)
+        m_readFramebuffer = 0;
+
+    glDeleteFramebuffers(1, &fbo);
+    ++m_frame.stateCalls;
+}
+
+void GLState::clear(GLbitfield mask)
+{
+    glClear(mask);
+    ++m_frame.drawCalls;
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <GL/glew.h>
+#include <stdint.h>
+
+/**
+* Cache of the OpenGL state of one context. Binds and toggles that would not change anything are skipped,
+* so passes can set the state they need without knowing what the previous pass left behind.
+* Every issued call is counted, getFrameStats() shows what a frame costs.
+*
+* All code that renders with a context has to change the tracked state through its GLState,
+* otherwise the cache goes stale. Call invalidate() after code that binds behind its back (e.g. SOIL).
+* Each thread renders with one context, GLState::current() is the state of the calling thread.
+*/
+class GLState
+{
+public:
+    /**
+    * API calls of a frame.
+    */
+    struct Stats
+    {
+        uint32_t stateCalls{ 0 };   // binds, toggles and buffer updates that were issued
+        uint32_t skippedCalls{ 0 }; // redundant calls that were not issued
+        uint32_t uniformCalls{ 0 };
+        uint32_t drawCalls{ 0 };    // draws and clears
+
+        uint32_t getIssuedCalls() const { return stateCalls + uniformCalls + drawCalls; }
+    };
+
+    /**
+    * Texture units whose bindings are tracked. GL 3.3 guarantees 16 per shader stage.
+    */
+    static const GLuint MAX_TEXTURE_UNITS = 16;
+
+    /**
+    * The state of the context of the calling thread (see setCurrent()).
+    */
+    static GLState& current();
+    static bool hasCurrent();
+
+    /**
+    * Makes state the state of the calling thread. Call it after making its context current.
+    */
+    static void setCurrent(GLState* state);
+
+    GLState();
+    ~GLState();
+
+    /**
+    * Forgets everything, the next call of every kind is issued.
+    */
+    void invalidate();
+
+    /**
+    * Forgets the texture bindings of all units.
+    */
+    void invalidateTextures();
+
+    /**
+    * Ends the frame: getFrameStats() returns the calls since the last beginFrame().
+    */
+    void beginFrame();
+    const Stats& getFrameStats() const { return m_lastFrame; }
+
+    /**
+    * GL_BLEND, GL_DEPTH_TEST and GL_SCISSOR_TEST are tracked, other capabilities are always set.
+    */
+    void enable(GLenum cap, bool enabled = true);
+    void disable(GLenum cap) { enable(cap, false); }
+    bool isEnabled(GLenum cap);
+
+    void blendFunc(GLenum srcFactor, GLenum dstFactor);
+    void blendColor(float r, float g, float b, float a);
+    void polygonMode(GLenum mode);
+    void colorMask(bool r, bool g, bool b, bool a);
+    void lineWidth(float width);
+    void clearColor(float r, float g, float b, float a);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+
+    /**
+    * GL_FRAMEBUFFER binds both the draw and the read framebuffer.
+    */
+    void bindFramebuffer(GLenum target, GLuint fbo);
+    GLuint getFramebuffer(GLenum target);
+
+    /**
+    * Binds a GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY texture to a unit. The active unit only changes if it has to.
+    */
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    /**
+    * Binds a texture to the active unit, e.g. to upload it.
+    */
+    void bindTexture(GLenum target, GLuint texture);
+
+    /**
+    * Delete objects and drop them from the cache, GL unbinds deleted objects. 0 is ignored.
+    */
+    void deleteTexture(GLuint texture);
+    void deleteVertexArray(GLuint vao);
+    void deleteFramebuffer(GLuint fbo);
+
+    /**
+    * Issues glClear() and counts it as a draw.
+    */
+    void clear(GLbitfield mask);
+
+    /**
+    * Count calls that are issued without the cache.
+    */
+    void countStateCalls(uint32_t count = 1) { m_frame.stateCalls += count; }
+    void countUniformCalls(uint32_t count = 1) { m_frame.uniformCalls += count; }
+    void countDrawCalls(uint32_t count = 1) { m_frame.drawCalls += count; }
+
+private:
+    enum Capability
+    {
+        CAP_BLEND,
+        CAP_DEPTH_TEST,
+        CAP_SCISSOR_TEST,
+        CAP_COUNT
+    };
+
+    enum TextureTarget
+    {
+        TARGET_2D,
+        TARGET_2D_ARRAY,
+        TARGET_COUNT
+    };
+
+    // Marks state that is not known, e.g. right after invalidate()
+    static const GLuint UNKNOWN = ~0u;
+
+    void activeTexture(GLuint unit);
+
+    /**
+    * Returns true if the call has to be issued, counts it as issued or skipped.
+    */
+    bool change(bool changed);
+
+private:
+    Stats m_frame;
+    Stats m_lastFrame;
+
+    int8_t m_capabilities[CAP_COUNT]; // 0 = disabled, 1 = enabled, -1 = unknown
+    GLenum m_blendSrc;
+    GLenum m_blendDst;
+    float m_blendColor[4];
+    bool m_blendColorKnown;
+    GLenum m_polygonMode;
+    uint32_t m_colorMask; // rgba bits, UNKNOWN if not known
+    float m_lineWidth;
+    float m_clearColor[4];
+    bool m_clearColorKnown;
+    GLint m_viewport[4];
+    bool m_viewportKnown;
+    GLint m_scissor[4];
+    bool m_scissorKnown;
+
+    GLuint m_program;
+    GLuint m_vao;
+    GLuint m_drawFramebuffer;
+    GLuint m_readFramebuffer;
+    GLuint m_activeUnit;
+    GLuint m_textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+};
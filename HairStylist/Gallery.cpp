@@ -0,0 +1,159 @@
+#include "Gallery.h"
+#include "Logger.h"
+#include "Canvas.h"
+#include "canvasops.h"
+#include "Framebuffer.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cassert>
+
+const uint32_t Gallery::MAX_BATCH_INSTANCES;
+const uint32_t Gallery::STRANDS_PER_TRIANGLE;
+
+std::string Gallery::getShaderDefines()
+{
+    return "#define INSTANCED\n#define MAX_BATCH_INSTANCES " + std::to_string(MAX_BATCH_INSTANCES) + "\n";
+}
+
+size_t Gallery::selectHairLod(const Mesh& mesh, size_t headCount, uint64_t strandBudget)
+{
+    for (size_t lod = 0; lod + 1 < mesh.getLodCount(); ++lod)
+    {
+        uint64_t strands = uint64_t(headCount) * (mesh.getLodIndexCount(lod) / 3) * STRANDS_PER_TRIANGLE;
+        if (strands <= strandBudget)
+            return lod;
+    }
+
+    return mesh.getLodCount() > 0 ? mesh.getLodCount() - 1 : 0;
+}
+
+Gallery::~Gallery()
+{
+    if (m_layers == 0)
+        return;
+
+    GLState& state = GLState::current();
+    state.deleteTexture(m_layers);
+    state.deleteFramebuffer(m_copyFBO);
+    glDeleteBuffers(1, &m_instanceUBO);
+}
+
+void Gallery::init(uint32_t size, uint32_t layerCount)
+{
+    if (m_layers == 0)
+        glGenTextures(1, &m_layers);
+
+    m_size = size;
+    m_layerCount = layerCount;
+
+    // Zeroed layers have hair length 0, so instances of unset layers are bald
+    std::vector<uint8_t> zeros(size_t(size) * size * 3 * layerCount, 0);
+
+    GLState::current().bindTexture(GL_TEXTURE_2D_ARRAY, m_layers);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, size, size, layerCount, 0, GL_RGB, GL_UNSIGNED_BYTE, zeros.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLState::current().bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    GL_ERROR_CHECK();
+}
+
+void Gallery::setLayer(uint32_t layer, const Canvas& canvas)
+{
+    assert(layer < m_layerCount);
+
+    if (canvas.getChannels() != 3)
+    {
+        ERROR("Canvas with " << canvas.getChannels() << " channels does not match the RGB style layers.");
+        return;
+    }
+
+    const Canvas* pixels = &canvas;
+    Canvas resampled;
+    if (canvas.getWidth() != m_size || canvas.getHeight() != m_size)
+    {
+        resampled.resize(m_size, m_size, 3);
+        canvasops::resample(canvas, resampled, canvasops::Filter::Bilinear);
+        pixels = &resampled;
+    }
+
+    GLState::current().bindTexture(GL_TEXTURE_2D_ARRAY, m_layers);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, m_size, m_size, 1, GL_RGB, GL_UNSIGNED_BYTE, pixels->data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    GLState::current().bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    GL_ERROR_CHECK();
+}
+
+void Gallery::copyLayer(uint32_t layer, const Framebuffer& framebuffer)
+{
+    assert(layer < m_layerCount);
+
+    if (m_copyFBO == 0)
+        glGenFramebuffers(1, &m_copyFBO);
+
+    // Blits are clipped by the scissor box. The caller may be rendering into a framebuffer object itself.
+    GLState& state = GLState::current();
+    bool scissor = state.isEnabled(GL_SCISSOR_TEST);
+    GLuint readFBO = state.getFramebuffer(GL_READ_FRAMEBUFFER);
+    GLuint drawFBO = state.getFramebuffer(GL_DRAW_FRAMEBUFFER);
+    state.disable(GL_SCISSOR_TEST);
+
+    state.bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.getFBO());
+    state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, m_copyFBO);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_layers, 0, layer);
+    glBlitFramebuffer(0, 0, framebuffer.getWidth(), framebuffer.getHeight(), 0, 0, m_size, m_size, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    state.countStateCalls();
+    state.countDrawCalls();
+    state.bindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFBO);
+    state.enable(GL_SCISSOR_TEST, scissor);
+
+    GL_ERROR_CHECK();
+}
+
+void Gallery::addInstance(const glm::mat4& model, uint32_t layer, const Hairstyle& hairstyle)
+{
+    assert(layer < m_layerCount);
+
+    // hair.geom grows hair in view space, so the length has to include the scale of the instance
+    float scale = glm::length(glm::vec3(model[0]));
+
+    InstanceData instance;
+    instance.model = model;
+    instance.hairColor = glm::vec4(hairstyle.color, hairstyle.length * scale);
+    instance.params = glm::vec4(float(layer), 0.0f, 0.0f, 0.0f);
+    m_instances.push_back(instance);
+    m_uploaded = false;
+}
+
+void Gallery::upload()
+{
+    if (m_instanceUBO == 0)
+        glGenBuffers(1, &m_instanceUBO);
+
+    // Every batch binds a whole block, so the buffer is padded to full batches.
+    // A batch is 12 KB, a multiple of any GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT seen in practice (<= 256).
+    size_t batchCount = (m_instances.size() + MAX_BATCH_INSTANCES - 1) / MAX_BATCH_INSTANCES;
+    size_t size = batchCount * MAX_BATCH_INSTANCES * sizeof(InstanceData);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_instanceUBO);
+    if (size > m_uboCapacity)
+    {
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        m_uboCapacity = size;
+    }
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, m_instances.size() * sizeof(InstanceData), m_instances.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLState::current().countStateCalls(3);
+
+    m_uploaded = true;
+    GL_ERROR_CHECK();
+}
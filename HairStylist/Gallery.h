@@ -0,0 +1,131 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include "Hairstyle.h"
+#include "CommandList.h"
+
+class Canvas;
+class Framebuffer;
+class Mesh;
+
+/**
+* Renders many styled heads with instanced draws. Every instance has its own model matrix, hairstyle
+* and style layer in a texture array, so a pass over all heads costs one draw call per MAX_BATCH_INSTANCES heads.
+* Shaders loaded with getShaderDefines() read the instances from the uniform block "Instances"
+* and the style layers from "u_styleLayers".
+*/
+class Gallery
+{
+public:
+    /**
+    * Instances per draw call. The instance block has to fit into the 16 KB that GL 3.3 guarantees for uniform blocks.
+    */
+    static const uint32_t MAX_BATCH_INSTANCES = 128;
+
+    /**
+    * Hair strands that hair.geom grows on every triangle.
+    */
+    static const uint32_t STRANDS_PER_TRIANGLE = 7;
+
+    /**
+    * Preprocessor definitions of the instanced model and hair shaders (see Shader::setDefines()).
+    */
+    static std::string getShaderDefines();
+
+    /**
+    * Picks the finest level of detail of mesh whose hair for headCount heads stays within strandBudget strands.
+    * Returns the coarsest level if none does.
+    */
+    static size_t selectHairLod(const Mesh& mesh, size_t headCount, uint64_t strandBudget);
+
+    Gallery() {}
+    ~Gallery();
+
+    /**
+    * Allocates layerCount RGB style layers of size x size pixels. Layers start out without hair.
+    */
+    void init(uint32_t size, uint32_t layerCount);
+
+    /**
+    * Uploads a style canvas into a layer. Canvases of another size are resampled.
+    */
+    void setLayer(uint32_t layer, const Canvas& canvas);
+
+    /**
+    * Copies the render texture of a framebuffer into a layer without a round trip through the CPU,
+    * e.g. to show the painter canvas while it is edited.
+    */
+    void copyLayer(uint32_t layer, const Framebuffer& framebuffer);
+
+    uint32_t getLayerCount() const { return m_layerCount; }
+
+    void clearInstances() { m_instances.clear(); m_uploaded = false; }
+
+    /**
+    * Adds a head. model may scale uniformly, the hair length is scaled along with it.
+    */
+    void addInstance(const glm::mat4& model, uint32_t layer, const Hairstyle& hairstyle);
+    size_t getInstanceCount() const { return m_instances.size(); }
+
+    /**
+    * Uploads the instances and records one instanced draw of a level of detail of mesh per batch into a layer of commands.
+    * setup(CommandList::Packet&) adds the other uniforms of the shader to each batch.
+    * The style layers are bound to textureUnit.
+    */
+    template <class Setup>
+    void record(CommandList& commands, Shader& shader, Mesh& mesh, size_t lod, const RenderState& state, uint8_t layer,
+                GLuint textureUnit, Setup setup);
+
+private:
+    /**
+    * Same layout as struct Instance in the shaders (std140).
+    */
+    struct InstanceData
+    {
+        glm::mat4 model;
+        glm::vec4 hairColor; // w = hair length
+        glm::vec4 params;    // x = style layer
+    };
+
+    void upload();
+
+private:
+    GLuint m_layers{ 0 };
+    GLuint m_copyFBO{ 0 };
+    GLuint m_instanceUBO{ 0 };
+    size_t m_uboCapacity{ 0 };
+    bool m_uploaded{ false };
+
+    uint32_t m_size{ 0 };
+    uint32_t m_layerCount{ 0 };
+
+    std::vector<InstanceData> m_instances;
+};
+
+template <class Setup>
+void Gallery::record(CommandList& commands, Shader& shader, Mesh& mesh, size_t lod, const RenderState& state, uint8_t layer,
+                     GLuint textureUnit, Setup setup)
+{
+    if (m_instances.empty())
+        return;
+
+    if (!m_uploaded)
+        upload();
+
+    shader.bindUniformBlock("Instances", 0);
+
+    const size_t batchSize = MAX_BATCH_INSTANCES * sizeof(InstanceData);
+    for (size_t first = 0; first < m_instances.size(); first += MAX_BATCH_INSTANCES)
+    {
+        size_t count = std::min<size_t>(MAX_BATCH_INSTANCES, m_instances.size() - first);
+        CommandList::Packet& packet = commands.draw(shader, mesh, state, layer);
+        setup(packet);
+        packet.bindTexture(textureUnit, GL_TEXTURE_2D_ARRAY, m_layers, "u_styleLayers")
+              .bindUniformBuffer(0, m_instanceUBO, first * sizeof(InstanceData), batchSize)
+              .instanced(lod, GLsizei(count));
+    }
+}
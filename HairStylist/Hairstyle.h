@@ -7,3 +7,15 @@ struct Hairstyle
     float length{ 1.0f };
     float width{ 1.0f };
 };
+
+/**
+* Interpolates all hairstyle parameters. t = 0 returns a, t = 1 returns b.
+*/
+inline Hairstyle mix(const Hairstyle& a, const Hairstyle& b, float t)
+{
+    Hairstyle result;
+    result.color = glm::mix(a.color, b.color, t);
+    result.length = glm::mix(a.length, b.length, t);
+    result.width = glm::mix(a.width, b.width, t);
+    return result;
+}
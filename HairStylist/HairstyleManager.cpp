@@ -1,10 +1,19 @@
 #include "HairstyleManager.h"
 #include <fstream>
+#include <cassert>
+#include <algorithm>
 #include "file.h"
-#include "Framebuffer.h"
+#include "Canvas.h"
+#include "StyleFile.h"
+#include "StylePack.h"
+#include "Logger.h"
+#include "parallel.h"
+
+const size_t HairstyleManager::NO_STYLE;
 
 HairstyleManager::HairstyleManager(const std::string& hairstyleName, const std::string& basePath, const std::string& infoFilename)
-    :m_hairstyleName(hairstyleName), m_basePath(basePath), m_infoFilename(infoFilename)
+    :m_hairstyleName(hairstyleName), m_basePath(basePath), m_infoFilename(infoFilename),
+     m_tileStore(basePath + "/Tiles"), m_similarityIndex(basePath + "/similarity.index")
 {
     std::ifstream info(m_basePath + "/" + m_infoFilename);
 
@@ -18,55 +27,245 @@ HairstyleManager::HairstyleManager(const std::string& hairstyleName, const std::
             m_hairstyles.push_back(hairstyleInfo);
 }
 
-void HairstyleManager::loadNext(Framebuffer& framebuffer, Hairstyle& outHairstyle)
+HairstyleManager::HairstyleManager(const std::string& packPath)
+    :m_basePath(packPath), m_tileStore(packPath + ".tiles"), m_similarityIndex(packPath + ".similarity"),
+     m_pack(std::make_unique<StylePack>())
 {
-    if (m_hairstyles.size() == 0)
+    // Only the index is read, style pages are faulted in when a style is loaded
+    if (!m_pack->open(packPath))
         return;
 
-    m_curStyleIndex = (m_curStyleIndex + 1) % m_hairstyles.size();
-    load(m_curStyleIndex, framebuffer, outHairstyle);
+    m_hairstyles.reserve(m_pack->getCount());
+    for (size_t i = 0; i < m_pack->getCount(); ++i)
+        m_hairstyles.push_back(HairstyleInfo(m_pack->getName(i), m_pack->getHairstyle(i)));
+}
+
+HairstyleManager::~HairstyleManager()
+{
 }
 
-void HairstyleManager::loadPrev(Framebuffer& framebuffer, Hairstyle& outHairstyle)
+bool HairstyleManager::loadNext(Canvas& outCanvas, Hairstyle& outHairstyle)
 {
     if (m_hairstyles.size() == 0)
-        return;
+        return false;
 
-    m_curStyleIndex = (m_curStyleIndex - 1 + m_hairstyles.size()) % m_hairstyles.size();
-    load(m_curStyleIndex, framebuffer, outHairstyle);
+    m_curStyleIndex = m_curStyleIndex == NO_STYLE ? 0 : (m_curStyleIndex + 1) % m_hairstyles.size();
+    return load(m_curStyleIndex, outCanvas, outHairstyle);
 }
 
-void HairstyleManager::load(size_t idx, Framebuffer& framebuffer, Hairstyle& outHairstyle)
+bool HairstyleManager::loadPrev(Canvas& outCanvas, Hairstyle& outHairstyle)
+{
+    if (m_hairstyles.size() == 0)
+        return false;
+
+    m_curStyleIndex = m_curStyleIndex == NO_STYLE ? m_hairstyles.size() - 1 : (m_curStyleIndex - 1 + m_hairstyles.size()) % m_hairstyles.size();
+    return load(m_curStyleIndex, outCanvas, outHairstyle);
+}
+
+bool HairstyleManager::load(size_t idx, Canvas& outCanvas, Hairstyle& outHairstyle)
 {
     assert(idx < m_hairstyles.size());
-    framebuffer.loadRenderTexture(m_basePath + "/" + m_hairstyles[idx].filename);
+
+    Canvas canvas;
+    if (!readStyle(idx, canvas))
+        return false;
+
+    std::swap(outCanvas, canvas);
     outHairstyle = m_hairstyles[idx].hairstyle;
+    m_curStyleIndex = idx;
+    return true;
+}
+
+bool HairstyleManager::loadPreview(size_t idx, uint32_t minSize, Canvas& outCanvas)
+{
+    assert(idx < m_hairstyles.size());
+    return readStyleMip(idx, minSize, outCanvas);
 }
 
-void HairstyleManager::loadRecent(Framebuffer& framebuffer, Hairstyle& outHairstyle)
+bool HairstyleManager::loadRecent(Canvas& outCanvas, Hairstyle& outHairstyle)
 {
     if (m_hairstyles.size() == 0)
+        return false;
+
+    return load(m_hairstyles.size() - 1, outCanvas, outHairstyle);
+}
+
+void HairstyleManager::save(const Hairstyle& hairstyle, const Canvas& canvas)
+{
+    std::string filename = reserveFilename();
+    SimilarityIndex::Signature signature;
+    if (!writeStyle(filename, canvas, signature))
         return;
 
-    load(m_hairstyles.size() - 1, framebuffer, outHairstyle);
+    addSaved(filename, hairstyle, signature);
+    m_curStyleIndex = m_hairstyles.size() - 1;
+    saveLibrary();
+}
+
+std::string HairstyleManager::reserveFilename()
+{
+    return m_hairstyleName + std::to_string(m_hairstyleCounter++) + ".style";
+}
+
+bool HairstyleManager::writeStyle(const std::string& filename, const Canvas& canvas, SimilarityIndex::Signature& outSignature)
+{
+    if (m_pack)
+    {
+        ERROR("Cannot save to the read-only style pack " << m_basePath);
+        return false;
+    }
+
+    // Only tiles that differ from previously saved hairstyles are written
+    if (!style::writeTiled(m_basePath + "/" + filename, canvas, m_tileStore))
+        return false;
+
+    SimilarityIndex::computeSignature(canvas, outSignature);
+    return true;
 }
 
-void HairstyleManager::save(const Hairstyle& hairstyle, Framebuffer& framebuffer)
+void HairstyleManager::addSaved(const std::string& filename, const Hairstyle& hairstyle, const SimilarityIndex::Signature& signature)
 {
-    std::string filename = m_hairstyleName + std::to_string(m_hairstyleCounter++) + ".style";
+    m_similarityIndex.add(filename, signature);
     m_hairstyles.push_back(HairstyleInfo(filename, hairstyle));
-    framebuffer.saveRenderTexture(m_basePath + "/" + filename);
-    saveInfo();
 }
 
-void HairstyleManager::saveInfo()
+bool HairstyleManager::saveLibrary()
 {
-    std::ofstream info(m_basePath + "/" + m_infoFilename);
+    bool refsSaved = m_tileStore.saveRefs();
+    return saveInfo() && refsSaved;
+}
+
+bool HairstyleManager::removeCurrent()
+{
+    if (m_curStyleIndex >= m_hairstyles.size())
+        return false;
+
+    if (m_pack)
+    {
+        ERROR("Cannot remove styles from the read-only style pack " << m_basePath);
+        return false;
+    }
+
+    std::string path = m_basePath + "/" + m_hairstyles[m_curStyleIndex].filename;
+
+    std::vector<uint64_t> tileHashes;
+    style::readTileHashes(path, tileHashes);
+    for (uint64_t hash : tileHashes)
+        m_tileStore.release(hash);
+
+    file::remove(path);
+    m_similarityIndex.remove(m_hairstyles[m_curStyleIndex].filename);
+    m_hairstyles.erase(m_hairstyles.begin() + m_curStyleIndex);
+    m_curStyleIndex = NO_STYLE;
+
+    size_t numDeleted = m_tileStore.collectGarbage();
+    LOG("Removed " << path << " - deleted " << numDeleted << " unreferenced tiles.");
+
+    saveLibrary();
+    return true;
+}
+
+size_t HairstyleManager::updateSimilarityIndex(size_t numThreads)
+{
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < m_hairstyles.size(); ++i)
+        if (!m_similarityIndex.contains(m_hairstyles[i].filename))
+            missing.push_back(i);
+
+    std::vector<SimilarityIndex::Signature> signatures(missing.size());
+    std::vector<char> valid(missing.size(), 0);
+    parallel::forEach(missing.size(), [&](size_t i)
+    {
+        Canvas canvas;
+        if (readStyleMip(missing[i], SimilarityIndex::SOURCE_SIZE, canvas))
+        {
+            SimilarityIndex::computeSignature(canvas, signatures[i]);
+            valid[i] = 1;
+        }
+    }, numThreads);
+
+    size_t numAdded = 0;
+    for (size_t i = 0; i < missing.size(); ++i)
+    {
+        if (valid[i])
+        {
+            m_similarityIndex.add(m_hairstyles[missing[i]].filename, signatures[i]);
+            ++numAdded;
+        }
+    }
+
+    return numAdded;
+}
+
+void HairstyleManager::findSimilar(const Canvas& canvas, size_t k, std::vector<size_t>& outIndices)
+{
+    outIndices.clear();
+    updateSimilarityIndex();
+
+    SimilarityIndex::Signature signature;
+    SimilarityIndex::computeSignature(canvas, signature);
+
+    // One extra result in case the canvas itself is part of the library
+    std::vector<SimilarityIndex::Result> results;
+    m_similarityIndex.query(signature, k + 1, results);
+
+    for (auto& result : results)
+    {
+        if (result.distance == 0 || outIndices.size() == k)
+            continue;
+
+        auto it = std::find_if(m_hairstyles.begin(), m_hairstyles.end(),
+                               [&result](const HairstyleInfo& info) { return info.filename == result.filename; });
+        if (it != m_hairstyles.end())
+            outIndices.push_back(size_t(it - m_hairstyles.begin()));
+    }
+}
+
+bool HairstyleManager::readStyle(size_t idx, Canvas& outCanvas)
+{
+    bool resample = m_width > 0 && m_height > 0;
+    if (m_pack)
+        return resample ? style::readResampled(m_pack->getData(idx), m_pack->getSize(idx), m_width, m_height, outCanvas, &m_tileStore) :
+                          style::read(m_pack->getData(idx), m_pack->getSize(idx), outCanvas, &m_tileStore);
+
+    return resample ? style::readResampled(getPath(idx), m_width, m_height, outCanvas, &m_tileStore) :
+                      style::read(getPath(idx), outCanvas, &m_tileStore);
+}
+
+bool HairstyleManager::readStyleMip(size_t idx, uint32_t minSize, Canvas& outCanvas)
+{
+    if (m_pack)
+        return style::readMip(m_pack->getData(idx), m_pack->getSize(idx), minSize, outCanvas, &m_tileStore);
+
+    return style::readMip(getPath(idx), minSize, outCanvas, &m_tileStore);
+}
+
+bool HairstyleManager::saveInfo()
+{
+    std::string path = m_basePath + "/" + m_infoFilename;
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream info(tmpPath);
+
+        // Save hairstyle counter
+        info << m_hairstyleCounter << "\n";
+
+        // Save hairstyle information
+        for (auto& hs : m_hairstyles)
+            info << hs << "\n";
+
+        if (!info)
+        {
+            ERROR("Could not write " << tmpPath);
+            return false;
+        }
+    }
 
-    // Save hairstyle counter
-    info << m_hairstyleCounter << "\n";
+    if (!file::replace(tmpPath, path))
+    {
+        ERROR("Could not replace " << path);
+        return false;
+    }
 
-    // Save hairstyle information
-    for (auto& hs : m_hairstyles)
-        info << hs << "\n";
+    return true;
 }
@@ -1,9 +1,14 @@
 #pragma once
 #include <string>
+#include <iostream>
 #include "Hairstyle.h"
 #include <vector>
+#include <memory>
+#include "TileStore.h"
+#include "SimilarityIndex.h"
 
-class Framebuffer;
+class Canvas;
+class StylePack;
 
 class HairstyleManager
 {
@@ -36,24 +41,109 @@ class HairstyleManager
     }
 
 public:
+    // Index of the current style when no style is current
+    static const size_t NO_STYLE = ~size_t(0);
+
     HairstyleManager(const std::string& hairstyleName, const std::string& basePath, const std::string& infoFilename);
 
-    void loadNext(Framebuffer& framebuffer, Hairstyle& outHairstyle);
-    void loadPrev(Framebuffer& framebuffer, Hairstyle& outHairstyle);
-    void load(size_t idx, Framebuffer& framebuffer, Hairstyle& outHairstyle);
-    void loadRecent(Framebuffer& framebuffer, Hairstyle& outHairstyle);
-    void save(const Hairstyle& hairstyle, Framebuffer& framebuffer);
+    /**
+    * Opens a style pack (see StylePack) as a read-only library.
+    * save() and removeCurrent() are not available, the similarity index is kept next to the pack.
+    */
+    explicit HairstyleManager(const std::string& packPath);
+    ~HairstyleManager();
+
+    /**
+    * The load functions return false if there is no hairstyle or if reading it failed.
+    * In that case outCanvas and outHairstyle are left unchanged.
+    */
+    bool loadNext(Canvas& outCanvas, Hairstyle& outHairstyle);
+    bool loadPrev(Canvas& outCanvas, Hairstyle& outHairstyle);
+    bool load(size_t idx, Canvas& outCanvas, Hairstyle& outHairstyle);
+    bool loadRecent(Canvas& outCanvas, Hairstyle& outHairstyle);
+    void save(const Hairstyle& hairstyle, const Canvas& canvas);
+
+    /**
+    * Saving in bulk, e.g. from batch tools. reserveFilename() hands out the names of new styles in order,
+    * writeStyle() writes a style file and may run on several threads at once, addSaved() registers a written
+    * style. saveLibrary() writes the info file and the tile references once at the end.
+    */
+    std::string reserveFilename();
+    bool writeStyle(const std::string& filename, const Canvas& canvas, SimilarityIndex::Signature& outSignature);
+    void addSaved(const std::string& filename, const Hairstyle& hairstyle, const SimilarityIndex::Signature& signature);
+    bool saveLibrary();
+
+    /**
+    * Reads the smallest stored mip of a style that is at least minSize pixels wide and high (see style::readMip()),
+    * e.g. for thumbnails. Neither the resolution set with setResolution() nor the current style are affected.
+    */
+    bool loadPreview(size_t idx, uint32_t minSize, Canvas& outCanvas);
+
+    /**
+    * Loaded canvases are resampled to this resolution if the style was saved at another one.
+    * 0 x 0 (default) loads styles at their stored resolution.
+    */
+    void setResolution(uint32_t width, uint32_t height) { m_width = width; m_height = height; }
+
+    /**
+    * Deletes the current hairstyle (the one loaded or saved last) and releases its tiles.
+    * Tiles that are not referenced by any other hairstyle are deleted. No style is current afterwards.
+    * Returns false if no style is current.
+    */
+    bool removeCurrent();
+
+    /**
+    * Forgets the current style, e.g. once the canvas shows a style of another library.
+    */
+    void clearCurrent() { m_curStyleIndex = NO_STYLE; }
+    bool hasCurrent() const { return m_curStyleIndex != NO_STYLE; }
+
+    /**
+    * Computes the signatures of all hairstyles that are not in the similarity index yet
+    * (e.g. libraries saved by older versions). Returns the number of added signatures.
+    */
+    size_t updateSimilarityIndex(size_t numThreads = 0);
+
+    /**
+    * Finds the k hairstyles that look most like the canvas, most similar first.
+    * Hairstyles with the exact same signature as the canvas are skipped.
+    */
+    void findSimilar(const Canvas& canvas, size_t k, std::vector<size_t>& outIndices);
+
+    size_t getCount() const { return m_hairstyles.size(); }
+    const std::string& getFilename(size_t idx) const { return m_hairstyles[idx].filename; }
+    const Hairstyle& getHairstyle(size_t idx) const { return m_hairstyles[idx].hairstyle; }
+    bool isReadOnly() const { return m_pack != nullptr; }
+
+    /**
+    * Path of a style file. For packs this is the pack itself.
+    */
+    std::string getPath(size_t idx) const { return m_pack ? m_basePath : m_basePath + "/" + m_hairstyles[idx].filename; }
+    const std::string& getBasePath() const { return m_basePath; }
+    TileStore& getTileStore() { return m_tileStore; }
+    SimilarityIndex& getSimilarityIndex() { return m_similarityIndex; }
 
 private:
-    void saveInfo();
+    bool saveInfo();
+    bool readStyle(size_t idx, Canvas& outCanvas);
+    bool readStyleMip(size_t idx, uint32_t minSize, Canvas& outCanvas);
 
 private:
     std::vector<HairstyleInfo> m_hairstyles;
 
-    size_t m_curStyleIndex{ 0 };
+    size_t m_curStyleIndex{ NO_STYLE };
     size_t m_hairstyleCounter{ 0 };
 
+    uint32_t m_width{ 0 };
+    uint32_t m_height{ 0 };
+
     std::string m_hairstyleName;
     std::string m_basePath;
     std::string m_infoFilename;
+
+    TileStore m_tileStore;
+    SimilarityIndex m_similarityIndex;
+
+    // Only set for read-only pack libraries
+    std::unique_ptr<StylePack> m_pack;
 };
@@ -0,0 +1,235 @@
+#include "HeadlessContext.h"
+#include "Logger.h"
+#include <GL/glew.h>
+#include <mutex>
+
+#ifdef HAIRSTYLIST_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef HAIRSTYLIST_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+namespace
+{
+    // GLEW keeps its function pointers in globals, and all contexts of a display share the display
+    std::mutex g_initMutex;
+    int g_eglContextCount = 0;
+}
+
+bool HeadlessContext::parseBackend(const std::string& name, Backend& outBackend)
+{
+    if (name == "egl")
+        outBackend = Backend::EGL;
+    else if (name == "osmesa")
+        outBackend = Backend::OSMesa;
+    else
+        return false;
+
+    return true;
+}
+
+bool HeadlessContext::isAvailable(Backend backend)
+{
+    switch (backend)
+    {
+#ifdef HAIRSTYLIST_EGL
+    case Backend::EGL:
+        return true;
+#endif
+#ifdef HAIRSTYLIST_OSMESA
+    case Backend::OSMesa:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+HeadlessContext::HeadlessContext(Backend backend)
+    :m_backend(backend)
+{
+    if (!isAvailable(backend))
+    {
+        ERROR("The " << (backend == Backend::EGL ? "EGL" : "OSMesa") << " backend is not compiled in.");
+        return;
+    }
+
+    bool created = backend == Backend::EGL ? initEGL() : initOSMesa();
+    m_valid = created && initGLEW();
+}
+
+HeadlessContext::~HeadlessContext()
+{
+#ifdef HAIRSTYLIST_EGL
+    if (m_eglContext)
+    {
+        std::lock_guard<std::mutex> lock(g_initMutex);
+        eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_eglDisplay, m_eglContext);
+
+        // Terminating the display destroys the contexts of other threads as well
+        if (--g_eglContextCount == 0)
+            eglTerminate(m_eglDisplay);
+    }
+#endif
+
+#ifdef HAIRSTYLIST_OSMESA
+    if (m_osmesaContext)
+        OSMesaDestroyContext(static_cast<OSMesaContext>(m_osmesaContext));
+#endif
+}
+
+bool HeadlessContext::makeCurrent()
+{
+#ifdef HAIRSTYLIST_EGL
+    if (m_eglContext)
+        return eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext) == EGL_TRUE;
+#endif
+
+#ifdef HAIRSTYLIST_OSMESA
+    if (m_osmesaContext)
+        return OSMesaMakeCurrent(static_cast<OSMesaContext>(m_osmesaContext), m_osmesaBuffer, GL_UNSIGNED_BYTE, 1, 1) == GL_TRUE;
+#endif
+
+    return false;
+}
+
+bool HeadlessContext::initEGL()
+{
+#ifdef HAIRSTYLIST_EGL
+    std::lock_guard<std::mutex> lock(g_initMutex);
+
+    // The surfaceless platform needs neither a window system nor a GPU. Older drivers only have the default display.
+    EGLDisplay display = EGL_NO_DISPLAY;
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        ERROR("Failed to initialize an EGL display: 0x" << std::hex << eglGetError() << std::dec);
+        return false;
+    }
+
+    // The display is shared by all contexts, it is only released if no other context uses it
+    auto releaseDisplay = [display]()
+    {
+        if (g_eglContextCount == 0)
+            eglTerminate(display);
+    };
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        ERROR("The EGL display does not support desktop OpenGL.");
+        releaseDisplay();
+        return false;
+    }
+
+    const EGLint configAttribs[] =
+    {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+    {
+        ERROR("No EGL config supports OpenGL.");
+        releaseDisplay();
+        return false;
+    }
+
+    const EGLint contextAttribs[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        ERROR("Failed to create an OpenGL 3.3 context with EGL: 0x" << std::hex << eglGetError() << std::dec);
+        releaseDisplay();
+        return false;
+    }
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        ERROR("The EGL driver does not support contexts without surfaces (EGL_KHR_surfaceless_context).");
+        eglDestroyContext(display, context);
+        releaseDisplay();
+        return false;
+    }
+
+    m_eglDisplay = display;
+    m_eglContext = context;
+    ++g_eglContextCount;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HeadlessContext::initOSMesa()
+{
+#ifdef HAIRSTYLIST_OSMESA
+    const int attribs[] =
+    {
+        OSMESA_FORMAT, OSMESA_RGBA,
+        OSMESA_DEPTH_BITS, 24,
+        OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+        OSMESA_CONTEXT_MAJOR_VERSION, 3,
+        OSMESA_CONTEXT_MINOR_VERSION, 3,
+        0
+    };
+
+    OSMesaContext context = OSMesaCreateContextAttribs(attribs, nullptr);
+    if (!context)
+    {
+        ERROR("Failed to create an OpenGL 3.3 context with OSMesa.");
+        return false;
+    }
+    m_osmesaContext = context;
+
+    // Nothing is drawn into the default framebuffer, so it only needs a single pixel
+    if (!makeCurrent())
+    {
+        ERROR("Failed to make the OSMesa context current.");
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HeadlessContext::initGLEW()
+{
+    std::lock_guard<std::mutex> lock(g_initMutex);
+
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+    if (err != GLEW_OK)
+    {
+        ERROR("Error " << err << " occured when initializing glew: \n" << glewGetErrorString(err));
+        return false;
+    }
+
+    // OpenGL 3.2+ might mistakenly report an invalid enum error. Ignore it:
+    glGetError();
+
+    LOG("Headless OpenGL " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER));
+    return true;
+}
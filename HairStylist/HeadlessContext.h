@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+
+/**
+* OpenGL 3.3 core context without a window, for machines without a display.
+* There is no default framebuffer to draw into - render into a Framebuffer and read it back.
+*
+* Backends are compiled in with preprocessor flags:
+* HAIRSTYLIST_EGL:    Surfaceless EGL (EGL_MESA_platform_surfaceless), e.g. Mesa llvmpipe or a GPU driver
+*                     on a render node. Link libEGL and a GLEW that resolves functions of EGL contexts.
+* HAIRSTYLIST_OSMESA: Off-screen Mesa software rendering. Link OSMesa and a GLEW built with GLEW_OSMESA.
+*
+* Contexts do not share objects. Each thread can create and use its own context at the same time.
+*/
+class HeadlessContext
+{
+public:
+    enum class Backend
+    {
+        EGL,
+        OSMesa
+    };
+
+    /**
+    * Parses "egl" or "osmesa". Returns false for other names.
+    */
+    static bool parseBackend(const std::string& name, Backend& outBackend);
+
+    /**
+    * Returns true if the backend was compiled in.
+    */
+    static bool isAvailable(Backend backend);
+
+    /**
+    * Creates the context and makes it current on the calling thread.
+    * Failures are logged and leave the context invalid.
+    */
+    explicit HeadlessContext(Backend backend);
+    ~HeadlessContext();
+
+    bool isValid() const { return m_valid; }
+    Backend getBackend() const { return m_backend; }
+
+    /**
+    * Makes the context current on the calling thread.
+    */
+    bool makeCurrent();
+
+private:
+    bool initEGL();
+    bool initOSMesa();
+    bool initGLEW();
+
+private:
+    Backend m_backend;
+    bool m_valid{ false };
+
+    // EGLDisplay and EGLContext
+    void* m_eglDisplay{ nullptr };
+    void* m_eglContext{ nullptr };
+
+    // OSMesaContext and the color buffer it requires
+    void* m_osmesaContext{ nullptr };
+    unsigned char m_osmesaBuffer[4];
+};
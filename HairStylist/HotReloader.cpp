@@ -0,0 +1,216 @@
+#include "HotReloader.h"
+#include "Logger.h"
+#include "Profiler.h"
+#include "RawMesh.h"
+
+HotReloader::HotReloader()
+{
+    m_thread = std::thread(&HotReloader::run, this);
+}
+
+HotReloader::~HotReloader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void HotReloader::watchDirectoryOf(const std::string& path)
+{
+    size_t nameStart = path.find_last_of("/\\");
+    std::string directory = nameStart != std::string::npos ? path.substr(0, nameStart) : ".";
+    if (m_watchedDirectories.insert(directory).second)
+        m_watcher.watch(directory);
+}
+
+void HotReloader::addShader(Shader& shader, const std::string& vsPath, const std::string& fsPath, const std::string& gsPath)
+{
+    ShaderEntry entry = { &shader, vsPath, fsPath, gsPath, false };
+    m_shaders.push_back(entry);
+
+    watchDirectoryOf(vsPath);
+    watchDirectoryOf(fsPath);
+    if (!gsPath.empty())
+        watchDirectoryOf(gsPath);
+}
+
+void HotReloader::addTexture(Texture& texture, const std::string& path)
+{
+    TextureEntry entry = { &texture, path };
+    m_textures.push_back(entry);
+    watchDirectoryOf(path);
+}
+
+void HotReloader::addMesh(Mesh& mesh, const std::string& vbPath, const std::string& ibPath, Mesh::VertexFormat format)
+{
+    MeshEntry entry = { &mesh, vbPath, ibPath, format };
+    m_meshes.push_back(entry);
+    watchDirectoryOf(vbPath);
+    watchDirectoryOf(ibPath);
+}
+
+void HotReloader::reloadAll()
+{
+    for (auto& entry : m_shaders)
+        entry.changed = true;
+
+    for (size_t i = 0; i < m_textures.size(); ++i)
+        reloadTexture(i);
+
+    for (size_t i = 0; i < m_meshes.size(); ++i)
+        reloadMesh(i);
+}
+
+void HotReloader::onChanged(const std::string& path)
+{
+    for (auto& entry : m_shaders)
+        if (path == entry.vsPath || path == entry.fsPath || path == entry.gsPath)
+            entry.changed = true;
+
+    for (size_t i = 0; i < m_textures.size(); ++i)
+        if (path == m_textures[i].path)
+            reloadTexture(i);
+
+    // A new mesh cache replaces the buffers as well
+    for (size_t i = 0; i < m_meshes.size(); ++i)
+        if (path == m_meshes[i].vbPath || path == m_meshes[i].ibPath || path == RawMesh::getCachePath(m_meshes[i].vbPath))
+            reloadMesh(i);
+}
+
+void HotReloader::reloadTexture(size_t entry)
+{
+    Job job;
+    job.isMesh = false;
+    job.entry = entry;
+    job.path = m_textures[entry].path;
+    job.format = Mesh::VertexFormat::Float;
+    submit(job);
+}
+
+void HotReloader::reloadMesh(size_t entry)
+{
+    Job job;
+    job.isMesh = true;
+    job.entry = entry;
+    job.path = m_meshes[entry].vbPath;
+    job.ibPath = m_meshes[entry].ibPath;
+    job.format = m_meshes[entry].format;
+    submit(job);
+}
+
+void HotReloader::submit(const Job& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+
+    m_condition.notify_one();
+}
+
+bool HotReloader::update()
+{
+    PROFILE_ZONE("Hot reload");
+
+    for (const std::string& path : m_watcher.takeChanges())
+        onChanged(path);
+
+    bool swapped = updateShaders();
+
+    std::deque<std::unique_ptr<Result>> results;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        results.swap(m_results);
+    }
+
+    for (auto& result : results)
+    {
+        if (!result->valid)
+            continue;
+
+        swapped = true;
+        if (result->isMesh)
+        {
+            m_meshes[result->entry].mesh->upload(result->mesh);
+            LOG("Reloaded " << m_meshes[result->entry].vbPath);
+        }
+        else
+        {
+            m_textures[result->entry].texture->upload(result->image);
+            LOG("Reloaded " << m_textures[result->entry].path);
+        }
+    }
+
+    return swapped;
+}
+
+bool HotReloader::updateShaders()
+{
+    bool swapped = false;
+    for (auto& entry : m_shaders)
+    {
+        Shader& shader = *entry.shader;
+        if (shader.isLoading())
+        {
+            if (!shader.isLoadReady())
+                continue;
+
+            if (shader.finishLoad())
+            {
+                swapped = true;
+                LOG("Reloaded " << entry.vsPath << " " << entry.fsPath << " " << entry.gsPath);
+            }
+            else
+                LOG("Keeping the previous program of " << entry.vsPath << " " << entry.fsPath << " " << entry.gsPath);
+        }
+
+        // Changes during a load start another one in the next frame
+        if (entry.changed && !shader.isLoading())
+        {
+            shader.beginLoad(entry.vsPath, entry.fsPath, entry.gsPath);
+            entry.changed = false;
+        }
+    }
+
+    return swapped;
+}
+
+void HotReloader::run()
+{
+    Profiler::setThreadName("Hot reload");
+
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+            if (m_stop)
+                return;
+
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        std::unique_ptr<Result> result = std::make_unique<Result>();
+        result->isMesh = job.isMesh;
+        result->entry = job.entry;
+        if (job.isMesh)
+        {
+            PROFILE_ZONE("Prepare mesh");
+            result->valid = Mesh::prepare(job.path, job.ibPath, job.format, result->mesh);
+        }
+        else
+        {
+            PROFILE_ZONE("Prepare texture");
+            result->valid = Texture::prepare(job.path, result->image);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results.push_back(std::move(result));
+    }
+}
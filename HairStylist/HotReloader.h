@@ -0,0 +1,117 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "FileWatcher.h"
+#include "Shader.h"
+#include "Texture.h"
+#include "Mesh.h"
+
+/**
+* Reloads shaders, textures and meshes when their files change without stalling the renderer.
+* The driver compiles shaders in the background (see Shader::beginLoad()), a worker thread decodes images
+* and meshes. update() swaps finished assets in between two frames. An asset that fails to load keeps
+* the version in use, so a typo in a shader does not break the running application.
+*/
+class HotReloader
+{
+public:
+    HotReloader();
+    ~HotReloader();
+
+    HotReloader(const HotReloader&) = delete;
+    HotReloader& operator=(const HotReloader&) = delete;
+
+    /**
+    * Watches the files of a loaded asset. The asset has to outlive the reloader.
+    */
+    void addShader(Shader& shader, const std::string& vsPath, const std::string& fsPath, const std::string& gsPath = "");
+    void addTexture(Texture& texture, const std::string& path);
+    void addMesh(Mesh& mesh, const std::string& vbPath, const std::string& ibPath, Mesh::VertexFormat format);
+
+    /**
+    * Reloads every asset as if all files had changed.
+    */
+    void reloadAll();
+
+    /**
+    * Call between frames on the thread that renders. Starts reloads of changed files and swaps in finished ones.
+    * Returns true if an asset was swapped in, the views have to be redrawn.
+    */
+    bool update();
+
+private:
+    struct ShaderEntry
+    {
+        Shader* shader;
+        std::string vsPath;
+        std::string fsPath;
+        std::string gsPath;
+        bool changed;
+    };
+
+    struct TextureEntry
+    {
+        Texture* texture;
+        std::string path;
+    };
+
+    struct MeshEntry
+    {
+        Mesh* mesh;
+        std::string vbPath;
+        std::string ibPath;
+        Mesh::VertexFormat format;
+    };
+
+    // Decoding on the worker, results refer to their entry by index
+    struct Job
+    {
+        bool isMesh;
+        size_t entry;
+        std::string path;
+        std::string ibPath;
+        Mesh::VertexFormat format;
+    };
+
+    struct Result
+    {
+        bool isMesh;
+        size_t entry;
+        bool valid;
+        Texture::Image image;
+        Mesh::Source mesh;
+    };
+
+    void watchDirectoryOf(const std::string& path);
+    void onChanged(const std::string& path);
+    void reloadTexture(size_t entry);
+    void reloadMesh(size_t entry);
+    bool updateShaders();
+    void submit(const Job& job);
+
+    // Worker thread
+    void run();
+
+private:
+    FileWatcher m_watcher;
+    std::set<std::string> m_watchedDirectories;
+
+    std::vector<ShaderEntry> m_shaders;
+    std::vector<TextureEntry> m_textures;
+    std::vector<MeshEntry> m_meshes;
+
+    // Shared with the worker thread
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<Job> m_jobs;
+    std::deque<std::unique_ptr<Result>> m_results;
+    bool m_stop{ false };
+
+    std::thread m_thread;
+};
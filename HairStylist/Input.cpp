@@ -1,4 +1,5 @@
 #include "Input.h"
+#include "Profiler.h"
 #include <SDL.h>
 #include <algorithm>
 
@@ -48,6 +49,8 @@ bool DragState::getDragInput(int* x, int* y)
 
 void Input::update(int screenHeight, bool flipMouseY)
 {
+    PROFILE_ZONE("Input");
+
     assert(flipMouseY ? screenHeight > 0 : true);
 
     // Need to poll events first to provide correct mouse information (position, drag info)
@@ -92,6 +95,14 @@ void Input::update(int screenHeight, bool flipMouseY)
     }
 }
 
+void Input::waitEvent(int timeoutMs)
+{
+    if (timeoutMs < 0)
+        SDL_WaitEvent(nullptr);
+    else
+        SDL_WaitEventTimeout(nullptr, timeoutMs);
+}
+
 void Input::subscribe(InputHandler* inputHandler)
 {
     m_inputHandlers.push_back(inputHandler);
@@ -64,6 +64,12 @@ class Input
 public:
     static void update(int screenHeight = 0.f, bool flipMouseY = false);
 
+    /**
+    * Blocks until an event is queued or timeoutMs passed, a negative timeout waits for the next event.
+    * The event stays queued for update().
+    */
+    static void waitEvent(int timeoutMs = -1);
+
     static const DragState& rightDrag() { return m_rightDragState; }
     static const DragState& leftDrag() { return m_leftDragState; }
     static bool isDragging() { return m_leftDragState.isDragging() || m_rightDragState.isDragging(); }
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+#include <cstddef>
+
+/**
+* Read-only memory mapping of a whole file.
+* Pages are loaded by the OS on first access, so only the parts of the file that are actually read cost I/O.
+*/
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    /**
+    * Maps the file. Returns false (with an error message) if the file does not exist or cannot be mapped.
+    * An already opened mapping is closed first.
+    */
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+private:
+    const uint8_t* m_data{ nullptr };
+    size_t m_size{ 0 };
+
+#ifdef _WIN32
+    void* m_file{ nullptr };
+    void* m_mapping{ nullptr };
+#endif
+};
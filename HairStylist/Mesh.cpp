@@ -2,7 +2,9 @@
 #include "Logger.h"
 #include <fstream>
 #include "convert.h"
-#include "file.h"
+#include "RawMesh.h"
+#include "CompactMesh.h"
+#include <algorithm>
 
 void Mesh::Builder::reset()
 {
@@ -39,8 +41,13 @@ Mesh::Builder& Mesh::Builder::attribute(GLint size, GLenum type, const void* off
 
 void Mesh::Builder::finalize(Mesh& mesh)
 {
+    GLState& state = GLState::current();
     glGenVertexArrays(1, &m_vao);
-    glBindVertexArray(m_vao);
+    state.bindVertexArray(m_vao);
+
+    // The vertex array keeps the index buffer, so binding the mesh is a single call
+    if (m_ibo != 0)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
     GL_ERROR_CHECK();
 
     size_t stride = 0;
@@ -74,14 +81,14 @@ void Mesh::Builder::finalize(Mesh& mesh)
 
     // Unbind all
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    state.bindVertexArray(0);
     GL_ERROR_CHECK();
 
     mesh.m_vbo = m_vbo;
     mesh.m_ibo = m_ibo;
     mesh.m_vao = m_vao;
     mesh.m_indexCount = m_indexCount;
+    mesh.m_indexType = m_indexType;
     mesh.m_vertexCount = m_vboSize / stride;
 }
 
@@ -89,7 +96,7 @@ Mesh::~Mesh()
 {
     if (m_vertexCount > 0)
     {
-        glDeleteVertexArrays(1, &m_vao);
+        GLState::current().deleteVertexArray(m_vao);
         glDeleteBuffers(1, &m_vbo);
 
         if (m_indexCount > 0)
@@ -97,30 +104,116 @@ Mesh::~Mesh()
     }
 }
 
-void Mesh::load(const std::string& vbPath, const std::string& ibPath)
+void Mesh::load(const std::string& vbPath, const std::string& ibPath, VertexFormat format)
 {
     // Do not call load multiple times
     assert(m_vertexCount == 0);
 
-    std::vector<char> vertices;
-    uint32_t floatCount;
-    file::loadRawBuffer(vbPath, vertices, floatCount);
+    Source source;
+    if (prepare(vbPath, ibPath, format, source))
+        upload(source);
+}
 
-    std::vector<char> indices;
-    uint32_t numIndices;
-    file::loadRawBuffer(ibPath, indices, numIndices);
+bool Mesh::prepare(const std::string& vbPath, const std::string& ibPath, VertexFormat format, Source& outSource)
+{
+    // Uploads straight from the mapping, the driver's copy is the only one
+    outSource.rawMesh = std::make_unique<RawMesh>();
+    if (!outSource.rawMesh->open(vbPath, ibPath))
+        return false;
 
-    Builder builder;
-    builder.createVBO(floatCount * sizeof(float), &vertices[4])
-        .attribute(3, GL_FLOAT)
-        .attribute(2, GL_FLOAT)
-        .attribute(3, GL_FLOAT)
-        .attribute(3, GL_FLOAT)
-        .attribute(3, GL_FLOAT)
-        .createIBO<GLuint>(numIndices, &indices[4])
-        .finalize(*this);
+    // Prefer the triangle and vertex order optimized offline (see meshops and hairstylist-tool meshcache)
+    outSource.cachedMesh = std::make_unique<RawMesh>();
+    if (!outSource.cachedMesh->openCache(RawMesh::getCachePath(vbPath), outSource.rawMesh->computeHash()))
+        outSource.cachedMesh.reset();
+
+    if (format == VertexFormat::Compact && !outSource.compactMesh.build(outSource.getMesh()))
+    {
+        LOG(vbPath << " has texture coordinates outside of [0, 1] and is loaded with float vertices.");
+        format = VertexFormat::Float;
+    }
+
+    outSource.format = format;
+    return true;
+}
+
+void Mesh::upload(const Source& source)
+{
+    const RawMesh& mesh = source.getMesh();
+
+    // Draws keep using the old buffers until the new ones are complete
+    GLuint oldVAO = m_vao;
+    GLuint oldVBO = m_vbo;
+    GLuint oldIBO = m_ibo;
+    bool replace = m_vertexCount > 0;
 
     m_renderMode = GL_TRIANGLES;
+
+    m_lods.clear();
+    for (size_t i = 0; i < mesh.getLodCount(); ++i)
+    {
+        Lod lod = { mesh.getLod(i).firstIndex, mesh.getLod(i).indexCount, mesh.getLod(i).error };
+        m_lods.push_back(lod);
+    }
+
+    glm::vec3 minPosition(mesh.getVertices()[0], mesh.getVertices()[1], mesh.getVertices()[2]);
+    glm::vec3 maxPosition = minPosition;
+    for (size_t v = 0; v < mesh.getVertexCount(); ++v)
+    {
+        const float* position = mesh.getVertices() + v * RawMesh::VERTEX_FLOATS;
+        minPosition = glm::min(minPosition, glm::vec3(position[0], position[1], position[2]));
+        maxPosition = glm::max(maxPosition, glm::vec3(position[0], position[1], position[2]));
+    }
+    m_center = (minPosition + maxPosition) * 0.5f;
+    m_culler.setMeshlets(mesh.getMeshlets().data(), mesh.getMeshlets().size());
+
+    if (source.format == VertexFormat::Compact)
+    {
+        const CompactMesh& compactMesh = source.compactMesh;
+        auto& vertices = compactMesh.getVertices();
+        auto& shortIndices = compactMesh.getShortIndices();
+
+        Builder builder;
+        // Typed arguments, a literal 0 and GL_TRUE pick the overload with offset and stride
+        builder.createVBO(vertices.size() * sizeof(CompactVertex), vertices.data())
+            .attribute(4, GL_UNSIGNED_SHORT, GLuint(0), GLboolean(GL_TRUE))
+            .attribute(2, GL_UNSIGNED_SHORT, GLuint(0), GLboolean(GL_TRUE))
+            .attribute(2, GL_SHORT, GLuint(0), GLboolean(GL_TRUE))
+            .attribute(2, GL_SHORT, GLuint(0), GLboolean(GL_TRUE))
+            .attribute(2, GL_SHORT, GLuint(0), GLboolean(GL_TRUE));
+
+        if (!shortIndices.empty())
+            builder.createIBO<GLushort>(shortIndices.size(), shortIndices.data());
+        else
+            builder.createIBO<GLuint>(mesh.getIndexCount(), mesh.getIndices());
+
+        builder.finalize(*this);
+        m_vertexFormat = VertexFormat::Compact;
+        m_positionScale = compactMesh.getPositionScale();
+        m_positionOffset = compactMesh.getPositionOffset();
+    }
+    else
+    {
+        Builder builder;
+        builder.createVBO(mesh.getFloatCount() * sizeof(float), mesh.getVertices())
+            .attribute(3, GL_FLOAT)
+            .attribute(2, GL_FLOAT)
+            .attribute(3, GL_FLOAT)
+            .attribute(3, GL_FLOAT)
+            .attribute(3, GL_FLOAT)
+            .createIBO<GLuint>(mesh.getIndexCount(), mesh.getIndices())
+            .finalize(*this);
+        m_vertexFormat = VertexFormat::Float;
+        m_positionScale = glm::vec3(1.0f);
+        m_positionOffset = glm::vec3(0.0f);
+    }
+
+    if (replace)
+    {
+        GLState::current().deleteVertexArray(oldVAO);
+        glDeleteBuffers(1, &oldVBO);
+        if (oldIBO != 0)
+            glDeleteBuffers(1, &oldIBO);
+    }
 }
 
 void Mesh::loadQuad()
@@ -144,20 +237,85 @@ void Mesh::loadQuad()
 
 void Mesh::bind()
 {
-    glBindVertexArray(m_vao);
-
-    if (m_indexCount > 0)
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    GLState::current().bindVertexArray(m_vao);
 }
 
 void Mesh::render()
 {
-    if (m_indexCount > 0)
-        glDrawElements(m_renderMode, GLsizei(m_indexCount), GL_UNSIGNED_INT, nullptr);
+    render(0);
+}
+
+void Mesh::render(size_t lod)
+{
+    GLState::current().countDrawCalls();
+    if (!m_lods.empty())
+    {
+        const Lod& range = m_lods[std::min(lod, m_lods.size() - 1)];
+        size_t offset = range.firstIndex * convert::sizeFromGLType(m_indexType);
+        glDrawElements(m_renderMode, GLsizei(range.indexCount), m_indexType, reinterpret_cast<void*>(offset));
+    }
+    else if (m_indexCount > 0)
+        glDrawElements(m_renderMode, GLsizei(m_indexCount), m_indexType, nullptr);
     else
         glDrawArrays(m_renderMode, 0, GLsizei(m_vertexCount));
 }
 
+void Mesh::renderVisible(const glm::mat4& modelView, const glm::mat4& proj, float padding)
+{
+    if (m_culler.getMeshletCount() == 0)
+    {
+        render(0);
+        return;
+    }
+
+    m_culler.cull(modelView, proj, padding, m_visibleFirstIndices, m_visibleIndexCounts);
+    if (m_visibleIndexCounts.empty())
+        return;
+
+    size_t indexSize = convert::sizeFromGLType(m_indexType);
+    m_drawCounts.resize(m_visibleIndexCounts.size());
+    m_drawOffsets.resize(m_visibleIndexCounts.size());
+    for (size_t i = 0; i < m_visibleIndexCounts.size(); ++i)
+    {
+        m_drawCounts[i] = GLsizei(m_visibleIndexCounts[i]);
+        m_drawOffsets[i] = reinterpret_cast<const void*>(m_visibleFirstIndices[i] * indexSize);
+    }
+
+    GLState::current().countDrawCalls();
+    glMultiDrawElements(m_renderMode, m_drawCounts.data(), m_indexType, m_drawOffsets.data(), GLsizei(m_drawCounts.size()));
+}
+
+size_t Mesh::selectLod(const glm::mat4& modelView, const glm::mat4& proj, float viewportHeight, float maxPixelError) const
+{
+    // Clip w is the view depth for perspective projections and 1 for orthographic ones
+    float w = (proj * modelView * glm::vec4(m_center, 1.0f)).w;
+    float pixelsPerUnit = proj[1][1] * 0.5f * viewportHeight / std::max(w, 1e-6f);
+
+    for (size_t lod = m_lods.size(); lod > 1; --lod)
+        if (m_lods[lod - 1].error * pixelsPerUnit <= maxPixelError)
+            return lod - 1;
+
+    return 0;
+}
+
+void Mesh::renderInstanced(size_t lod, GLsizei instanceCount)
+{
+    if (instanceCount <= 0)
+        return;
+
+    GLState::current().countDrawCalls();
+    if (!m_lods.empty())
+    {
+        const Lod& range = m_lods[std::min(lod, m_lods.size() - 1)];
+        size_t offset = range.firstIndex * convert::sizeFromGLType(m_indexType);
+        glDrawElementsInstanced(m_renderMode, GLsizei(range.indexCount), m_indexType, reinterpret_cast<void*>(offset), instanceCount);
+    }
+    else if (m_indexCount > 0)
+        glDrawElementsInstanced(m_renderMode, GLsizei(m_indexCount), m_indexType, nullptr, instanceCount);
+    else
+        glDrawArraysInstanced(m_renderMode, 0, GLsizei(m_vertexCount), instanceCount);
+}
+
 void Mesh::bindAndRender()
 {
     bind();
@@ -1,8 +1,14 @@
 #pragma once
 #include <GL/glew.h>
+#include "GLState.h"
 #include <string>
 #include "Logger.h"
 #include <vector>
+#include <memory>
+#include <glm/glm.hpp>
+#include "MeshletCuller.h"
+#include "RawMesh.h"
+#include "CompactMesh.h"
 
 class Mesh
 {
@@ -70,6 +76,7 @@ public:
 
         size_t m_indexCount{ 0 };
         size_t m_vertexCount{ 0 };
+        GLenum m_indexType{ GL_UNSIGNED_INT };
         bool m_deducedOffset{ true };
         size_t m_vboSize;
         std::vector<Attr> m_attributes;
@@ -77,6 +84,32 @@ public:
 
     friend Builder;
 
+    /**
+    * Vertex layout of meshes loaded with load().
+    * Float:   14 floats per vertex as stored in the files.
+    * Compact: 24 bytes per vertex (see CompactVertex). Vertex shaders decode it
+    *          with the uniforms set by Shader::setVertexFormat().
+    */
+    enum class VertexFormat
+    {
+        Float,
+        Compact
+    };
+
+    /**
+    * CPU side of load(): the validated files and the compact vertices. It is built on any thread with prepare(),
+    * upload() creates the buffers from it.
+    */
+    struct Source
+    {
+        std::unique_ptr<RawMesh> rawMesh;
+        std::unique_ptr<RawMesh> cachedMesh; // optimized rawMesh if a mesh cache exists
+        CompactMesh compactMesh;
+        VertexFormat format{ VertexFormat::Float };
+
+        const RawMesh& getMesh() const { return cachedMesh ? *cachedMesh : *rawMesh; }
+    };
+
     Mesh() {}
     ~Mesh();
 
@@ -92,8 +125,23 @@ public:
     * - Normal:              3 floats
     * - Tangent:             3 floats
     * - Bitangent:           3 floats
+    * The files are memory-mapped and validated (see RawMesh). Invalid files are reported and leave the mesh empty.
+    * If a mesh cache built from these files exists next to the vertex buffer (see RawMesh::getCachePath()),
+    * its optimized buffers and levels of detail are used instead.
+    * The compact format falls back to floats if the mesh cannot be quantized. Indices are 16 bit
+    * in the compact format if the vertex count allows it.
     */
-    void load(const std::string& vbPath, const std::string& ibPath);
+    void load(const std::string& vbPath, const std::string& ibPath, VertexFormat format = VertexFormat::Float);
+
+    /**
+    * The first part of load(), it does not touch GL. Returns false if the files are invalid.
+    */
+    static bool prepare(const std::string& vbPath, const std::string& ibPath, VertexFormat format, Source& outSource);
+
+    /**
+    * The second part of load(). A loaded mesh is replaced, its old buffers are deleted once the new ones exist.
+    */
+    void upload(const Source& source);
 
     /**
     * Loads a quad with a position attribute.
@@ -104,9 +152,56 @@ public:
     void loadQuad();
 
     void bind();
+
+    /**
+    * Renders the full mesh (level of detail 0).
+    */
     void render();
+
+    /**
+    * Renders a level of detail, clamped to the available ones. All levels share the vertex buffer.
+    */
+    void render(size_t lod);
+
+    /**
+    * Renders the meshlets of the full mesh that pass frustum and back-face cone culling (see MeshletCuller)
+    * with one glMultiDrawElements() call. padding grows the meshlet bounds, e.g. by the hair length.
+    * Meshes without meshlets are rendered completely.
+    */
+    void renderVisible(const glm::mat4& modelView, const glm::mat4& proj, float padding = 0.0f);
+
+    /**
+    * Renders instanceCount instances of a level of detail with one glDrawElementsInstanced() call.
+    * Shaders tell the instances apart by gl_InstanceID.
+    */
+    void renderInstanced(size_t lod, GLsizei instanceCount);
     void bindAndRender();
 
+    /**
+    * Picks the coarsest level of detail whose simplification error projects to at most maxPixelError pixels
+    * at the center of the mesh. modelView must not scale.
+    */
+    size_t selectLod(const glm::mat4& modelView, const glm::mat4& proj, float viewportHeight, float maxPixelError = 1.0f) const;
+    size_t getLodCount() const { return m_lods.size(); }
+    size_t getLodIndexCount(size_t lod) const { return m_lods[lod].indexCount; }
+
+    VertexFormat getVertexFormat() const { return m_vertexFormat; }
+    GLuint getVAO() const { return m_vao; }
+
+    /**
+    * Decoding of compact positions: position = normalized position * scale + offset
+    */
+    const glm::vec3& getPositionScale() const { return m_positionScale; }
+    const glm::vec3& getPositionOffset() const { return m_positionOffset; }
+
+private:
+    struct Lod
+    {
+        size_t firstIndex;
+        size_t indexCount;
+        float error;
+    };
+
 private:
     GLuint m_vbo{ 0 };
     GLuint m_ibo{ 0 };
@@ -114,14 +209,33 @@ private:
 
     size_t m_indexCount{ 0 };
     size_t m_vertexCount{ 0 };
+    GLenum m_indexType{ GL_UNSIGNED_INT };
     GLenum m_renderMode{ 0 };
+
+    // Only set for meshes loaded with load()
+    std::vector<Lod> m_lods;
+    glm::vec3 m_center{ 0.0f };
+
+    MeshletCuller m_culler;
+    std::vector<uint32_t> m_visibleFirstIndices;
+    std::vector<uint32_t> m_visibleIndexCounts;
+    std::vector<GLsizei> m_drawCounts;
+    std::vector<const void*> m_drawOffsets;
+
+    VertexFormat m_vertexFormat{ VertexFormat::Float };
+    glm::vec3 m_positionScale{ 1.0f };
+    glm::vec3 m_positionOffset{ 0.0f };
 };
 
 template <class TIndexType>
 Mesh::Builder& Mesh::Builder::createIBO(size_t indexCount, const void* data, GLenum usage)
 {
     m_indexCount = indexCount;
+    m_indexType = sizeof(TIndexType) == 1 ? GL_UNSIGNED_BYTE : sizeof(TIndexType) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
     glGenBuffers(1, &m_ibo);
+
+    // The index buffer binding belongs to the bound vertex array, finalize() adds the buffer to the mesh's own
+    GLState::current().bindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(TIndexType), data, usage);
 
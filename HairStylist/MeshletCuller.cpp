@@ -0,0 +1,110 @@
+#include "MeshletCuller.h"
+#include <cmath>
+#include <emmintrin.h>
+
+void MeshletCuller::setMeshlets(const meshops::Meshlet* meshlets, size_t count)
+{
+    size_t padded = (count + 3) & ~size_t(3);
+    m_firstIndices.resize(count);
+    m_indexCounts.resize(count);
+
+    // Padding lanes have a negative radius, which no frustum plane test passes
+    m_centerX.assign(padded, 0.0f);
+    m_centerY.assign(padded, 0.0f);
+    m_centerZ.assign(padded, 0.0f);
+    m_radius.assign(padded, -1e30f);
+    m_axisX.assign(padded, 0.0f);
+    m_axisY.assign(padded, 0.0f);
+    m_axisZ.assign(padded, 0.0f);
+    m_cutoff.assign(padded, 1.0f);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const meshops::Meshlet& meshlet = meshlets[i];
+        m_firstIndices[i] = meshlet.firstIndex;
+        m_indexCounts[i] = meshlet.indexCount;
+        m_centerX[i] = meshlet.center[0];
+        m_centerY[i] = meshlet.center[1];
+        m_centerZ[i] = meshlet.center[2];
+        m_radius[i] = meshlet.radius;
+        m_axisX[i] = meshlet.coneAxis[0];
+        m_axisY[i] = meshlet.coneAxis[1];
+        m_axisZ[i] = meshlet.coneAxis[2];
+        m_cutoff[i] = meshlet.coneCutoff;
+    }
+}
+
+size_t MeshletCuller::cull(const glm::mat4& modelView, const glm::mat4& proj, float padding,
+                           std::vector<uint32_t>& outFirstIndices, std::vector<uint32_t>& outIndexCounts) const
+{
+    outFirstIndices.clear();
+    outIndexCounts.clear();
+
+    // Frustum planes in model space (Gribb & Hartmann): row 3 +- rows 0, 1, 2 of the model view projection matrix
+    glm::mat4 mvp = proj * modelView;
+    glm::vec4 planes[6];
+    for (int row = 0; row < 3; ++row)
+    {
+        glm::vec4 r(mvp[0][row], mvp[1][row], mvp[2][row], mvp[3][row]);
+        glm::vec4 w(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+        planes[row * 2 + 0] = w + r;
+        planes[row * 2 + 1] = w - r;
+    }
+
+    for (auto& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    glm::vec3 camera = glm::vec3(glm::inverse(modelView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    const __m128 cameraX = _mm_set1_ps(camera.x);
+    const __m128 cameraY = _mm_set1_ps(camera.y);
+    const __m128 cameraZ = _mm_set1_ps(camera.z);
+    const __m128 pad = _mm_set1_ps(padding);
+
+    size_t visibleIndices = 0;
+    for (size_t i = 0; i < m_centerX.size(); i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&m_centerX[i]);
+        __m128 y = _mm_loadu_ps(&m_centerY[i]);
+        __m128 z = _mm_loadu_ps(&m_centerZ[i]);
+        __m128 radius = _mm_add_ps(_mm_loadu_ps(&m_radius[i]), pad);
+
+        // Inside or intersecting all planes: distance > -radius
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+        for (auto& plane : planes)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            visible = _mm_and_ps(visible, _mm_cmpgt_ps(distance, negativeRadius));
+        }
+
+        // Back facing: dot(center - camera, axis) >= cutoff * length(center - camera) + radius
+        __m128 dx = _mm_sub_ps(x, cameraX);
+        __m128 dy = _mm_sub_ps(y, cameraY);
+        __m128 dz = _mm_sub_ps(z, cameraZ);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 alignment = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&m_axisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&m_axisY[i]))),
+                                      _mm_mul_ps(dz, _mm_loadu_ps(&m_axisZ[i])));
+        __m128 backFacing = _mm_cmpge_ps(alignment, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m_cutoff[i]), length), radius));
+        visible = _mm_andnot_ps(backFacing, visible);
+
+        int mask = _mm_movemask_ps(visible);
+        for (size_t lane = 0; mask != 0; ++lane, mask >>= 1)
+        {
+            if (!(mask & 1))
+                continue;
+
+            size_t meshlet = i + lane;
+            if (!outFirstIndices.empty() && outFirstIndices.back() + outIndexCounts.back() == m_firstIndices[meshlet])
+                outIndexCounts.back() += m_indexCounts[meshlet];
+            else
+            {
+                outFirstIndices.push_back(m_firstIndices[meshlet]);
+                outIndexCounts.push_back(m_indexCounts[meshlet]);
+            }
+            visibleIndices += m_indexCounts[meshlet];
+        }
+    }
+
+    return visibleIndices;
+}
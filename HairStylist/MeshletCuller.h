@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include "meshops.h"
+
+/**
+* Culls meshlets (see meshops::buildMeshlets()) against the view frustum and their normal cones on the CPU.
+* The bounds are kept as structure of arrays and tested four meshlets at a time with SSE.
+* The visible index ranges are merged where they are adjacent, ready for glMultiDrawElements().
+*/
+class MeshletCuller
+{
+public:
+    void setMeshlets(const meshops::Meshlet* meshlets, size_t count);
+    size_t getMeshletCount() const { return m_firstIndices.size(); }
+
+    /**
+    * Collects the index ranges of the meshlets that may be visible with the given model view and projection matrices.
+    * modelView must not scale. padding grows all bounds, e.g. by the length of geometry that is generated on the GPU.
+    * Returns the number of visible indices.
+    */
+    size_t cull(const glm::mat4& modelView, const glm::mat4& proj, float padding,
+                std::vector<uint32_t>& outFirstIndices, std::vector<uint32_t>& outIndexCounts) const;
+
+private:
+    std::vector<uint32_t> m_firstIndices;
+    std::vector<uint32_t> m_indexCounts;
+
+    // Padded to a multiple of 4
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_radius;
+    std::vector<float> m_axisX;
+    std::vector<float> m_axisY;
+    std::vector<float> m_axisZ;
+    std::vector<float> m_cutoff;
+};
@@ -0,0 +1,365 @@
+#include "Profiler.h"
+#include "GLState.h"
+#include "Logger.h"
+#include <SDL.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+// VS2013 has no thread_local, its __declspec(thread) works for the pointer
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL thread_local
+#endif
+
+struct Profiler::Track
+{
+    struct Event
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    /**
+    * An event in the ring. The fields are atomics (relaxed, plain moves on x86) because the owner may
+    * overwrite a slot while another thread copies it.
+    */
+    struct Slot
+    {
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> start;
+        std::atomic<uint64_t> end;
+    };
+
+    // Events per track, a power of two. About 10 seconds of a busy frame loop.
+    static const uint64_t CAPACITY = 1 << 15;
+
+    Track(const std::string& name, bool isGpu, uint32_t id)
+        :name(name), isGpu(isGpu), id(id), events(new Slot[CAPACITY]), written(0)
+    {
+    }
+
+    /**
+    * Copies the events that are in the ring without blocking the owner. The owner may record meanwhile,
+    * events it overwrote (or is overwriting) are dropped.
+    */
+    void read(std::vector<Event>& outEvents) const
+    {
+        uint64_t end = written.load(std::memory_order_acquire);
+        uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+
+        std::vector<Event> copy;
+        copy.reserve(size_t(end - begin));
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            const Slot& slot = events[i & (CAPACITY - 1)];
+            Event event = { slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                            slot.end.load(std::memory_order_relaxed) };
+            copy.push_back(event);
+        }
+
+        // Pairs with the fence in record(): if the copy saw a write of the owner, the count below includes the
+        // event the owner had finished before it. The owner may be writing event written2 into the slot of
+        // event written2 - CAPACITY, so that one is dropped as well.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t written2 = written.load(std::memory_order_relaxed);
+        uint64_t overwritten = written2 + 1 > CAPACITY ? written2 + 1 - CAPACITY : 0;
+        for (uint64_t i = std::max(begin, overwritten); i < end; ++i)
+            outEvents.push_back(copy[size_t(i - begin)]);
+    }
+
+    std::string name;
+    bool isGpu;
+    uint32_t id;
+    std::unique_ptr<Slot[]> events;
+    std::atomic<uint64_t> written; // events recorded since the start, the next one goes to written % CAPACITY
+};
+
+namespace
+{
+    std::atomic<bool> g_enabled(false);
+
+    // Tracks are never deleted, threads that ended can still be exported
+    std::mutex g_tracksMutex;
+    std::vector<std::unique_ptr<Profiler::Track>> g_tracks;
+
+    PROFILER_THREAD_LOCAL Profiler::Track* g_threadTrack = nullptr;
+
+    uint64_t g_startCount = SDL_GetPerformanceCounter();
+
+    void writeJsonString(std::ostream& out, const std::string& s)
+    {
+        out << '"';
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+}
+
+void Profiler::enable(bool enabled)
+{
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::isEnabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t Profiler::now()
+{
+    double counts = double(SDL_GetPerformanceCounter() - g_startCount);
+    return uint64_t(counts * 1000000.0 / double(SDL_GetPerformanceFrequency()));
+}
+
+Profiler::Track* Profiler::getThreadTrack()
+{
+    if (!g_threadTrack)
+    {
+        std::lock_guard<std::mutex> lock(g_tracksMutex);
+        g_tracks.push_back(std::make_unique<Track>("Thread " + std::to_string(g_tracks.size()), false, uint32_t(g_tracks.size())));
+        g_threadTrack = g_tracks.back().get();
+    }
+
+    return g_threadTrack;
+}
+
+Profiler::Track* Profiler::createTrack(const std::string& name, bool isGpu)
+{
+    std::lock_guard<std::mutex> lock(g_tracksMutex);
+    g_tracks.push_back(std::make_unique<Track>(name, isGpu, uint32_t(g_tracks.size())));
+    return g_tracks.back().get();
+}
+
+void Profiler::setThreadName(const std::string& name)
+{
+    Track* track = getThreadTrack();
+
+    std::lock_guard<std::mutex> lock(g_tracksMutex);
+    track->name = name;
+}
+
+void Profiler::record(Track* track, const char* name, uint64_t start, uint64_t end)
+{
+    // Only the owner writes. The fence orders the count of the previous event before the writes to the slot
+    // (see Track::read()), the release makes the event visible before the new count.
+    uint64_t index = track->written.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Track::Slot& slot = track->events[index & (Track::CAPACITY - 1)];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    track->written.store(index + 1, std::memory_order_release);
+}
+
+bool Profiler::writeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        ERROR("Could not write the trace " << path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_tracksMutex);
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    std::vector<Track::Event> events;
+    for (auto& track : g_tracks)
+    {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track->id << ",\"args\":{\"name\":";
+        writeJsonString(file, track->name);
+        file << "}}";
+        first = false;
+
+        events.clear();
+        track->read(events);
+        for (const Track::Event& event : events)
+        {
+            file << ",\n{\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"cat\":\"" << (track->isGpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"ts\":" << event.start
+                 << ",\"dur\":" << (event.end > event.start ? event.end - event.start : 0) << ",\"pid\":1,\"tid\":" << track->id << "}";
+        }
+    }
+    file << "\n]}\n";
+
+    if (!file)
+    {
+        ERROR("Could not write the trace " << path);
+        return false;
+    }
+
+    LOG("Wrote the trace " << path);
+    return true;
+}
+
+std::string Profiler::getBreakdown(const char* frameZone, float seconds)
+{
+    uint64_t from = now();
+    from = from > uint64_t(seconds * 1000000.0f) ? from - uint64_t(seconds * 1000000.0f) : 0;
+
+    // Zones in the order they first appear, CPU before GPU
+    struct Total
+    {
+        std::string name;
+        uint64_t duration;
+    };
+    std::vector<Total> totals[2];
+    uint32_t frames = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(g_tracksMutex);
+
+        std::vector<Track::Event> events;
+        for (auto& track : g_tracks)
+        {
+            events.clear();
+            track->read(events);
+
+            std::vector<Total>& trackTotals = totals[track->isGpu ? 1 : 0];
+            for (const Track::Event& event : events)
+            {
+                if (event.start < from)
+                    continue;
+
+                if (!track->isGpu && strcmp(event.name, frameZone) == 0)
+                    ++frames;
+
+                auto it = std::find_if(trackTotals.begin(), trackTotals.end(), [&](const Total& t) { return t.name == event.name; });
+                if (it == trackTotals.end())
+                {
+                    trackTotals.push_back({ event.name, 0 });
+                    it = trackTotals.end() - 1;
+                }
+                it->duration += event.end > event.start ? event.end - event.start : 0;
+            }
+        }
+    }
+
+    if (frames == 0)
+        return "";
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    const char* labels[2] = { "CPU", "GPU" };
+    for (int i = 0; i < 2; ++i)
+    {
+        if (totals[i].empty())
+            continue;
+
+        ss << (i > 0 ? " | " : "") << labels[i];
+        for (const Total& total : totals[i])
+            ss << " " << total.name << " " << total.duration / 1000.0 / frames;
+    }
+
+    return ss.str();
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    if (!m_queries.empty())
+        glDeleteQueries(GLsizei(m_queries.size()), m_queries.data());
+}
+
+GLuint GpuProfiler::acquireQuery()
+{
+    if (m_freeQueries.empty())
+    {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        m_queries.push_back(query);
+        return query;
+    }
+
+    GLuint query = m_freeQueries.back();
+    m_freeQueries.pop_back();
+    return query;
+}
+
+void GpuProfiler::begin(const char* name)
+{
+    Zone zone;
+    zone.name = name;
+    zone.beginQuery = acquireQuery();
+    zone.endQuery = 0;
+    glQueryCounter(zone.beginQuery, GL_TIMESTAMP);
+    GLState::current().countStateCalls();
+
+    m_openZones.push_back(zone);
+}
+
+void GpuProfiler::end()
+{
+    if (m_openZones.empty())
+        return;
+
+    Zone zone = m_openZones.back();
+    m_openZones.pop_back();
+
+    zone.endQuery = acquireQuery();
+    glQueryCounter(zone.endQuery, GL_TIMESTAMP);
+    GLState::current().countStateCalls();
+
+    m_pendingZones.push_back(zone);
+}
+
+void GpuProfiler::update()
+{
+    if (!m_track)
+        m_track = Profiler::createTrack("GPU", true);
+
+    // The clocks drift apart slowly, matching them now and then is enough
+    if (!m_calibrated || ++m_updatesSinceCalibration >= 300)
+        calibrate();
+
+    GLState& state = GLState::current();
+    while (!m_pendingZones.empty())
+    {
+        const Zone& zone = m_pendingZones.front();
+
+        GLint available = 0;
+        glGetQueryObjectiv(zone.endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        state.countStateCalls();
+        if (!available)
+            break;
+
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(zone.beginQuery, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(zone.endQuery, GL_QUERY_RESULT, &end);
+        state.countStateCalls(2);
+
+        int64_t start = int64_t(begin / 1000) + m_gpuToCpuOffset;
+        int64_t finish = int64_t(end / 1000) + m_gpuToCpuOffset;
+        Profiler::record(m_track, zone.name, uint64_t(std::max<int64_t>(0, start)), uint64_t(std::max<int64_t>(0, finish)));
+
+        m_freeQueries.push_back(zone.beginQuery);
+        m_freeQueries.push_back(zone.endQuery);
+        m_pendingZones.pop_front();
+    }
+}
+
+void GpuProfiler::calibrate()
+{
+    // GL_TIMESTAMP is the GPU time at which the commands issued so far reached the GPU
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    GLState::current().countStateCalls();
+
+    m_gpuToCpuOffset = int64_t(Profiler::now()) - gpuNow / 1000;
+    m_updatesSinceCalibration = 0;
+    m_calibrated = true;
+}
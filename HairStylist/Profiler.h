@@ -0,0 +1,160 @@
+#pragma once
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdint.h>
+
+/**
+* Frame profiler. CPU zones (PROFILE_ZONE) time a scope with the performance counter. GPU zones (GPU_PROFILE_ZONE)
+* put GL timestamp queries around the commands of a scope, GpuProfiler::update() reads them once the GPU got there.
+*
+* Every thread records into its own ring buffer without locks, the GPU zones of a context go into a track of their own.
+* The rings keep the last events, older ones are overwritten. writeTrace() exports them in the Chrome trace format
+* (chrome://tracing or ui.perfetto.dev), getBreakdown() averages the zones of the last frames.
+*
+* Profiling is off until enable() is called, zones cost a branch until then.
+*/
+class Profiler
+{
+public:
+    /**
+    * Events of one thread, or of the GPU of one context.
+    */
+    struct Track;
+
+    static void enable(bool enabled = true);
+    static bool isEnabled();
+
+    /**
+    * Microseconds since the start of the process.
+    */
+    static uint64_t now();
+
+    /**
+    * The track of the calling thread, it is created by the first zone of the thread.
+    */
+    static Track* getThreadTrack();
+    static Track* createTrack(const std::string& name, bool isGpu);
+
+    /**
+    * Names the track of the calling thread in traces.
+    */
+    static void setThreadName(const std::string& name);
+
+    /**
+    * Adds a zone to a track, only the thread that owns the track may record into it.
+    * Names have to outlive the profiler, e.g. string literals.
+    */
+    static void record(Track* track, const char* name, uint64_t start, uint64_t end);
+
+    /**
+    * Writes all events that are still in the rings as Chrome trace JSON. Returns false if writing failed.
+    */
+    static bool writeTrace(const std::string& path);
+
+    /**
+    * Milliseconds per frame of every zone over the last seconds, e.g. "CPU Frame 2.10 Paint 0.31 | GPU Frame 1.20".
+    * Frames are counted by the CPU zones called frameZone.
+    */
+    static std::string getBreakdown(const char* frameZone, float seconds);
+};
+
+/**
+* Times the GPU side of zones of one context. Use it on the thread that renders with the context.
+*/
+class GpuProfiler
+{
+public:
+    GpuProfiler() {}
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    /**
+    * Zones nest, end() closes the last open zone.
+    */
+    void begin(const char* name);
+    void end();
+
+    /**
+    * Records the zones the GPU finished. Call it once per frame.
+    */
+    void update();
+
+private:
+    struct Zone
+    {
+        const char* name;
+        GLuint beginQuery;
+        GLuint endQuery;
+    };
+
+    GLuint acquireQuery();
+
+    /**
+    * Matches GPU timestamps with the CPU clock.
+    */
+    void calibrate();
+
+private:
+    Profiler::Track* m_track{ nullptr };
+    std::vector<GLuint> m_queries;   // all queries, deleted with the profiler
+    std::vector<GLuint> m_freeQueries;
+    std::vector<Zone> m_openZones;
+    std::deque<Zone> m_pendingZones; // ended, in the order the GPU finishes them
+    int64_t m_gpuToCpuOffset{ 0 };   // microseconds
+    uint32_t m_updatesSinceCalibration{ 0 };
+    bool m_calibrated{ false };
+};
+
+/**
+* Records a CPU zone from construction to destruction.
+*/
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name)
+        :m_name(Profiler::isEnabled() ? name : nullptr), m_start(m_name ? Profiler::now() : 0)
+    {
+    }
+
+    ~ProfileZone()
+    {
+        if (m_name)
+            Profiler::record(Profiler::getThreadTrack(), m_name, m_start, Profiler::now());
+    }
+
+private:
+    const char* m_name;
+    uint64_t m_start;
+};
+
+/**
+* Records a GPU zone from construction to destruction.
+*/
+class GpuProfileZone
+{
+public:
+    GpuProfileZone(GpuProfiler& profiler, const char* name)
+        :m_profiler(Profiler::isEnabled() ? &profiler : nullptr)
+    {
+        if (m_profiler)
+            m_profiler->begin(name);
+    }
+
+    ~GpuProfileZone()
+    {
+        if (m_profiler)
+            m_profiler->end();
+    }
+
+private:
+    GpuProfiler* m_profiler;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define GPU_PROFILE_ZONE(profiler, name) GpuProfileZone PROFILE_CONCAT(gpuProfileZone, __LINE__)(profiler, name)
@@ -0,0 +1,153 @@
+#include "ProgramCache.h"
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "Logger.h"
+#include "file.h"
+#include "hash.h"
+
+const uint32_t ProgramCache::MAGIC;
+const uint32_t ProgramCache::VERSION;
+
+namespace
+{
+    uint64_t hashString(const GLubyte* str, uint64_t seed)
+    {
+        const char* s = str ? reinterpret_cast<const char*>(str) : "";
+        return hash::compute(s, strlen(s), seed);
+    }
+}
+
+ProgramCache::ProgramCache(const std::string& directory)
+    :m_directory(directory)
+{
+    GLint formatCount = 0;
+    if (GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+
+    if (formatCount <= 0)
+    {
+        LOG("The driver cannot save shader programs, they are compiled at every launch.");
+        return;
+    }
+
+    if (!file::createDirectory(directory))
+    {
+        ERROR("Could not create the shader cache directory " << directory);
+        return;
+    }
+
+    m_driverHash = hashString(glGetString(GL_VENDOR), 0);
+    m_driverHash = hashString(glGetString(GL_RENDERER), m_driverHash);
+    m_driverHash = hashString(glGetString(GL_VERSION), m_driverHash);
+    m_enabled = true;
+}
+
+std::string ProgramCache::getPath(uint64_t sourceHash) const
+{
+    return m_directory + "/" + hash::toHex(sourceHash) + ".program";
+}
+
+GLuint ProgramCache::load(uint64_t sourceHash) const
+{
+    if (!m_enabled)
+        return 0;
+
+    std::string path = getPath(sourceHash);
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+        return 0;
+
+    Header header;
+    input.read(reinterpret_cast<char*>(&header), sizeof(Header));
+    if (!input || header.magic != MAGIC || header.version != VERSION || header.sourceHash != sourceHash)
+    {
+        LOG(path << " is not a valid program binary and is ignored.");
+        return 0;
+    }
+
+    // Driver updates invalidate all binaries
+    if (header.driverHash != m_driverHash)
+        return 0;
+
+    // The size comes from the file, check it against the file before allocating
+    if (header.size == 0 || file::getSize(path) != sizeof(Header) + size_t(header.size))
+    {
+        LOG(path << " is truncated and is ignored.");
+        return 0;
+    }
+
+    std::vector<char> binary(header.size);
+    input.read(binary.data(), binary.size());
+    if (!input || input.peek() != std::ifstream::traits_type::eof())
+    {
+        LOG(path << " is truncated and is ignored.");
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), GLsizei(binary.size()));
+
+    // Drivers may reject binaries of the same version string, e.g. after a change of the hardware setup
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+void ProgramCache::prepare(GLuint program) const
+{
+    if (m_enabled)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ProgramCache::store(uint64_t sourceHash, GLuint program) const
+{
+    if (!m_enabled)
+        return false;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    Header header;
+    header.driverHash = m_driverHash;
+    header.sourceHash = sourceHash;
+
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &header.format, binary.data());
+    header.size = uint32_t(written);
+
+    // Written next to the cache entry and moved over it, a crash during the write keeps the previous binary
+    std::string path = getPath(sourceHash);
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream output(tmpPath, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        output.write(binary.data(), written);
+
+        if (!output)
+        {
+            ERROR("Could not write program binary " << tmpPath);
+            output.close();
+            file::remove(tmpPath);
+            return false;
+        }
+    }
+
+    if (!file::replace(tmpPath, path))
+    {
+        ERROR("Could not replace program binary " << path);
+        file::remove(tmpPath);
+        return false;
+    }
+
+    return true;
+}
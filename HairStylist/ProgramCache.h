@@ -0,0 +1,62 @@
+#pragma once
+#include <GL/glew.h>
+#include <string>
+#include <stdint.h>
+
+/**
+* Linked shader programs on disk (see glGetProgramBinary()), so that a launch with unchanged shaders
+* does not compile them again. Entries are named after the hash of the program's final sources and
+* remember the driver (vendor, renderer and version) that built them. Binaries of another driver,
+* corrupt files and binaries the driver rejects are ignored, the program is then built from source
+* and stored again.
+*
+* Binaries are only exchanged with drivers that support GL_ARB_get_program_binary and offer at least one format.
+*/
+class ProgramCache
+{
+public:
+    // "HSPB" in little-endian byte order
+    static const uint32_t MAGIC = 0x42505348;
+    static const uint32_t VERSION = 1;
+
+    // Followed by size bytes of the program binary
+    struct Header
+    {
+        uint32_t magic{ MAGIC };
+        uint32_t version{ VERSION };
+        uint64_t driverHash{ 0 };
+        uint64_t sourceHash{ 0 };
+        uint32_t format{ 0 };
+        uint32_t size{ 0 };
+    };
+
+    /**
+    * Needs the context the programs are built with to be current.
+    */
+    explicit ProgramCache(const std::string& directory);
+
+    bool isEnabled() const { return m_enabled; }
+
+    /**
+    * Returns a linked program created from the binary stored for sourceHash, or 0 if there is none that this driver accepts.
+    */
+    GLuint load(uint64_t sourceHash) const;
+
+    /**
+    * Asks the driver to keep the binary of a program that is about to be linked. Call it before glLinkProgram().
+    */
+    void prepare(GLuint program) const;
+
+    /**
+    * Stores the binary of a linked program.
+    */
+    bool store(uint64_t sourceHash, GLuint program) const;
+
+private:
+    std::string getPath(uint64_t sourceHash) const;
+
+private:
+    std::string m_directory;
+    uint64_t m_driverHash{ 0 };
+    bool m_enabled{ false };
+};
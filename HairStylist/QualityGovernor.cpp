@@ -0,0 +1,161 @@
+#include "QualityGovernor.h"
+#include "GLState.h"
+#include "Logger.h"
+#include <algorithm>
+
+const size_t QualityGovernor::QUERY_COUNT;
+
+QualityGovernor::~QualityGovernor()
+{
+    if (m_queriesCreated)
+        glDeleteQueries(GLsizei(QUERY_COUNT), m_queries);
+}
+
+const std::vector<QualityProfile>& QualityGovernor::getProfiles()
+{
+    // name, strands per triangle, hair segments, render scale, overlay LOD
+    static const std::vector<QualityProfile> profiles =
+    {
+        { "Ultra", 7, 5, 1.0f, 0 },
+        { "High", 7, 4, 1.0f, 1 },
+        { "Medium", 4, 3, 0.85f, 1 },
+        { "Low", 4, 2, 0.7f, 2 },
+        { "Minimum", 1, 2, 0.5f, 3 }
+    };
+
+    return profiles;
+}
+
+int QualityGovernor::findProfile(const std::string& name)
+{
+    const std::vector<QualityProfile>& profiles = getProfiles();
+    for (size_t i = 0; i < profiles.size(); ++i)
+    {
+        if (name == profiles[i].name)
+            return int(i);
+    }
+
+    return -1;
+}
+
+void QualityGovernor::setLevel(size_t level)
+{
+    changeLevel(std::min(level, getProfiles().size() - 1));
+    m_lastChangeWasUp = false;
+}
+
+void QualityGovernor::beginFrame()
+{
+    if (!m_queriesCreated)
+    {
+        glGenQueries(GLsizei(QUERY_COUNT), m_queries);
+        m_queriesCreated = true;
+    }
+
+    m_cpuTimer.start();
+
+    // All queries are in flight if the GPU is far behind, the frame is not measured then
+    m_queryActive = m_pendingQueries < QUERY_COUNT;
+    if (m_queryActive)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, m_queries[m_nextQuery]);
+        GLState::current().countStateCalls();
+    }
+}
+
+bool QualityGovernor::endFrame()
+{
+    float cpuTime = m_cpuTimer.tick() * 1000.0f;
+
+    GLState& state = GLState::current();
+    if (m_queryActive)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        state.countStateCalls();
+
+        m_cpuTimes[m_nextQuery] = cpuTime;
+        m_nextQuery = (m_nextQuery + 1) % QUERY_COUNT;
+        ++m_pendingQueries;
+        m_queryActive = false;
+    }
+
+    // Results arrive in the order the frames were submitted
+    bool changed = false;
+    while (m_pendingQueries > 0)
+    {
+        size_t oldest = (m_nextQuery + QUERY_COUNT - m_pendingQueries) % QUERY_COUNT;
+
+        GLint available = 0;
+        glGetQueryObjectiv(m_queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        state.countStateCalls();
+        if (!available)
+            break;
+
+        GLuint64 gpuTime = 0;
+        glGetQueryObjectui64v(m_queries[oldest], GL_QUERY_RESULT, &gpuTime);
+        state.countStateCalls();
+        --m_pendingQueries;
+
+        if (addSample(std::max(m_cpuTimes[oldest], float(gpuTime / 1000000.0))))
+            changed = true;
+    }
+
+    return changed;
+}
+
+bool QualityGovernor::addSample(float milliseconds)
+{
+    ++m_framesSinceChange;
+    if (m_framesSinceChange <= m_settleFrames)
+        return false;
+
+    m_averageFrameTime = m_averageFrameTime > 0.0f ? m_averageFrameTime + (milliseconds - m_averageFrameTime) * m_smoothing : milliseconds;
+    if (!m_adaptive)
+        return false;
+
+    // A step up that held for a while was right, the next one may come sooner again
+    if (m_lastChangeWasUp && m_framesSinceChange > m_upgradeFrames * 4)
+        m_upgradeFrames = m_minUpgradeFrames;
+
+    size_t lowest = getProfiles().size() - 1;
+    if (m_averageFrameTime > m_targetFrameTime)
+    {
+        m_fastFrames = 0;
+        if (++m_slowFrames < m_downgradeFrames || m_level == lowest)
+            return false;
+
+        // Backing out of a step up means the level above does not fit, try it less often
+        if (m_lastChangeWasUp && m_framesSinceChange < m_upgradeFrames * 4)
+            m_upgradeFrames = std::min(m_upgradeFrames * 2, m_maxUpgradeFrames);
+
+        changeLevel(m_level + 1);
+        m_lastChangeWasUp = false;
+        return true;
+    }
+
+    m_slowFrames = 0;
+    if (m_averageFrameTime < m_targetFrameTime * m_upgradeHeadroom)
+    {
+        if (++m_fastFrames < m_upgradeFrames || m_level == 0)
+            return false;
+
+        changeLevel(m_level - 1);
+        m_lastChangeWasUp = true;
+        return true;
+    }
+
+    m_fastFrames = 0;
+    return false;
+}
+
+void QualityGovernor::changeLevel(size_t level)
+{
+    if (level != m_level)
+        LOG("Quality " << getProfiles()[m_level].name << " -> " << getProfiles()[level].name << " at " << m_averageFrameTime << "ms/frame");
+
+    m_level = level;
+    m_slowFrames = 0;
+    m_fastFrames = 0;
+    m_framesSinceChange = 0;
+    m_averageFrameTime = 0.0f;
+}
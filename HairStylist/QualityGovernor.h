@@ -0,0 +1,108 @@
+#pragma once
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "Timer.h"
+
+/**
+* Detail of the views at one quality level.
+*/
+struct QualityProfile
+{
+    const char* name;
+    uint32_t strandsPerTriangle; // hair strands grown per triangle, at most 7 (see hair.geom)
+    uint32_t hairSegments;       // line segments per strand, at most 5
+    float renderScale;           // resolution of the model view relative to the window
+    size_t overlayLod;           // mesh level of detail of the painter overlay wireframe
+};
+
+/**
+* Holds a frame time budget by moving between quality profiles. A frame costs the longer of its CPU time,
+* taken with the performance counter, and its GPU time, taken with a timer query that is read a few frames later
+* so that measuring does not stall the pipeline.
+*
+* The governor steps down once the average frame time stays over the budget for a few frames, but it only steps up
+* after a long stretch well below the budget. A step up that has to be taken back doubles the stretch the next one
+* needs, so the quality does not swing between two levels that are both close to the budget.
+*/
+class QualityGovernor
+{
+public:
+    QualityGovernor() {}
+    ~QualityGovernor();
+
+    QualityGovernor(const QualityGovernor&) = delete;
+    QualityGovernor& operator=(const QualityGovernor&) = delete;
+
+    /**
+    * Profiles from the highest quality to the lowest.
+    */
+    static const std::vector<QualityProfile>& getProfiles();
+
+    /**
+    * Returns the level of the profile called name, or -1 if there is none.
+    */
+    static int findProfile(const std::string& name);
+
+    /**
+    * Bracket the rendering of a frame, without the buffer swap (it waits for the display).
+    * endFrame() returns true if the governor changed the level.
+    */
+    void beginFrame();
+    bool endFrame();
+
+    /**
+    * Adaptive governors pick the level themselves, otherwise the level stays where setLevel() put it.
+    */
+    void setAdaptive(bool adaptive) { m_adaptive = adaptive; }
+    bool isAdaptive() const { return m_adaptive; }
+
+    void setLevel(size_t level);
+    size_t getLevel() const { return m_level; }
+    const QualityProfile& getProfile() const { return getProfiles()[m_level]; }
+
+    void setTargetFrameTime(float milliseconds) { m_targetFrameTime = milliseconds; }
+
+    /**
+    * Smoothed cost of the last frames in milliseconds.
+    */
+    float getAverageFrameTime() const { return m_averageFrameTime; }
+
+private:
+    /**
+    * Feeds the cost of a frame, returns true if the level changed.
+    */
+    bool addSample(float milliseconds);
+    void changeLevel(size_t level);
+
+private:
+    // Frames in flight on the GPU, their queries are read when the results are available
+    static const size_t QUERY_COUNT = 4;
+
+    GLuint m_queries[QUERY_COUNT];
+    float m_cpuTimes[QUERY_COUNT];
+    bool m_queriesCreated{ false };
+    size_t m_nextQuery{ 0 };
+    size_t m_pendingQueries{ 0 };
+    bool m_queryActive{ false };
+    Timer m_cpuTimer;
+
+    bool m_adaptive{ true };
+    size_t m_level{ 0 };
+    float m_targetFrameTime{ 1000.0f / 60.0f };
+    float m_averageFrameTime{ 0.0f };
+    float m_smoothing{ 0.1f };       // weight of a new sample in the average
+    float m_upgradeHeadroom{ 0.7f }; // the average has to stay below this part of the budget to step up
+    uint32_t m_downgradeFrames{ 10 };
+    uint32_t m_minUpgradeFrames{ 60 };
+    uint32_t m_maxUpgradeFrames{ 960 };
+    uint32_t m_upgradeFrames{ 60 };
+    uint32_t m_settleFrames{ 8 };    // samples ignored after a change, older frames still show the previous level
+
+    uint32_t m_slowFrames{ 0 };
+    uint32_t m_fastFrames{ 0 };
+    uint32_t m_framesSinceChange{ 0 };
+    bool m_lastChangeWasUp{ false };
+};
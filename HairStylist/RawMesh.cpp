@@ -0,0 +1,231 @@
+#include "RawMesh.h"
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include "Logger.h"
+#include "file.h"
+#include "hash.h"
+
+const uint32_t RawMesh::VERTEX_FLOATS;
+const uint32_t RawMesh::CACHE_MAGIC;
+const uint32_t RawMesh::CACHE_VERSION;
+
+namespace
+{
+    /**
+    * Maps a raw buffer file and checks that the count in the header matches the file size.
+    */
+    bool mapBuffer(const std::string& path, MappedFile& file, size_t& outCount)
+    {
+        if (!file.open(path))
+            return false;
+
+        uint32_t count = 0;
+        if (file.size() >= sizeof(uint32_t))
+            memcpy(&count, file.data(), sizeof(uint32_t));
+
+        if (file.size() < sizeof(uint32_t) || file.size() != sizeof(uint32_t) + size_t(count) * 4)
+        {
+            ERROR(path << " is corrupt: the header specifies " << count << " values but the file has " << file.size() << " bytes.");
+            file.close();
+            return false;
+        }
+
+        outCount = count;
+        return true;
+    }
+}
+
+bool RawMesh::open(const std::string& vbPath, const std::string& ibPath)
+{
+    close();
+
+    if (!mapBuffer(vbPath, m_vertexFile, m_floatCount) || !mapBuffer(ibPath, m_indexFile, m_indexCount))
+    {
+        close();
+        return false;
+    }
+
+    // Values start right after the 4 byte count, so they are 4 byte aligned in the page aligned mapping
+    m_vertices = reinterpret_cast<const float*>(m_vertexFile.data() + sizeof(uint32_t));
+    m_indices = reinterpret_cast<const uint32_t*>(m_indexFile.data() + sizeof(uint32_t));
+    if (!validate(vbPath, ibPath))
+        return false;
+
+    Lod lod;
+    lod.indexCount = uint32_t(m_indexCount);
+    m_lods.assign(1, lod);
+    return true;
+}
+
+bool RawMesh::openCache(const std::string& path, uint64_t sourceHash)
+{
+    close();
+
+    if (!file::exists(path) || !m_vertexFile.open(path))
+        return false;
+
+    CacheHeader header;
+    if (m_vertexFile.size() >= sizeof(CacheHeader))
+        memcpy(&header, m_vertexFile.data(), sizeof(CacheHeader));
+
+    if (m_vertexFile.size() >= sizeof(CacheHeader) && header.magic == CACHE_MAGIC && header.version != CACHE_VERSION)
+    {
+        LOG(path << " was built by another version and is ignored.");
+        close();
+        return false;
+    }
+
+    size_t meshletOffset = sizeof(CacheHeader) + size_t(header.lodCount) * sizeof(Lod);
+    size_t dataOffset = meshletOffset + size_t(header.meshletCount) * sizeof(meshops::Meshlet);
+    if (m_vertexFile.size() < sizeof(CacheHeader) || header.magic != CACHE_MAGIC || header.lodCount == 0 ||
+        m_vertexFile.size() != dataOffset + (size_t(header.floatCount) + header.indexCount) * 4)
+    {
+        ERROR(path << " is not a valid mesh cache.");
+        close();
+        return false;
+    }
+
+    if (header.sourceHash != sourceHash)
+    {
+        LOG(path << " was built from other mesh data and is ignored.");
+        close();
+        return false;
+    }
+
+    m_lods.resize(header.lodCount);
+    memcpy(m_lods.data(), m_vertexFile.data() + sizeof(CacheHeader), header.lodCount * sizeof(Lod));
+    for (auto& lod : m_lods)
+    {
+        if (lod.indexCount == 0 || lod.indexCount % 3 != 0 || size_t(lod.firstIndex) + lod.indexCount > header.indexCount)
+        {
+            ERROR(path << " has an invalid level of detail.");
+            close();
+            return false;
+        }
+    }
+
+    m_meshlets.resize(header.meshletCount);
+    if (header.meshletCount > 0)
+        memcpy(m_meshlets.data(), m_vertexFile.data() + meshletOffset, header.meshletCount * sizeof(meshops::Meshlet));
+
+    for (auto& meshlet : m_meshlets)
+    {
+        if (meshlet.indexCount % 3 != 0 || size_t(meshlet.firstIndex) + meshlet.indexCount > m_lods[0].indexCount)
+        {
+            ERROR(path << " has an invalid meshlet.");
+            close();
+            return false;
+        }
+    }
+
+    m_floatCount = header.floatCount;
+    m_indexCount = header.indexCount;
+    m_vertices = reinterpret_cast<const float*>(m_vertexFile.data() + dataOffset);
+    m_indices = reinterpret_cast<const uint32_t*>(m_vertexFile.data() + dataOffset + m_floatCount * sizeof(float));
+    return validate(path, path);
+}
+
+bool RawMesh::writeCache(const std::string& path, const float* vertices, size_t floatCount,
+                         const uint32_t* indices, size_t indexCount, const Lod* lods, size_t lodCount,
+                         const meshops::Meshlet* meshlets, size_t meshletCount, uint64_t sourceHash)
+{
+    CacheHeader header;
+    header.sourceHash = sourceHash;
+    header.floatCount = uint32_t(floatCount);
+    header.indexCount = uint32_t(indexCount);
+    header.lodCount = uint32_t(lodCount);
+    header.meshletCount = uint32_t(meshletCount);
+
+    // Written next to the cache and moved over it, a crash during the write keeps the previous cache
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream output(tmpPath, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+        output.write(reinterpret_cast<const char*>(lods), lodCount * sizeof(Lod));
+        output.write(reinterpret_cast<const char*>(meshlets), meshletCount * sizeof(meshops::Meshlet));
+        output.write(reinterpret_cast<const char*>(vertices), floatCount * sizeof(float));
+        output.write(reinterpret_cast<const char*>(indices), indexCount * sizeof(uint32_t));
+
+        if (!output)
+        {
+            ERROR("Could not write mesh cache " << tmpPath);
+            output.close();
+            file::remove(tmpPath);
+            return false;
+        }
+    }
+
+    if (!file::replace(tmpPath, path))
+    {
+        ERROR("Could not replace mesh cache " << path);
+        file::remove(tmpPath);
+        return false;
+    }
+
+    return true;
+}
+
+std::string RawMesh::getCachePath(const std::string& vbPath)
+{
+    size_t extension = vbPath.find_last_of('.');
+    size_t directory = vbPath.find_last_of("/\\");
+    if (extension == std::string::npos || (directory != std::string::npos && extension < directory))
+        return vbPath + ".meshcache";
+
+    return vbPath.substr(0, extension) + ".meshcache";
+}
+
+uint64_t RawMesh::computeHash() const
+{
+    return computeHash(m_vertices, m_floatCount, m_indices, m_indexCount);
+}
+
+uint64_t RawMesh::computeHash(const float* vertices, size_t floatCount, const uint32_t* indices, size_t indexCount)
+{
+    uint64_t vertexHash = hash::compute(vertices, floatCount * sizeof(float));
+    return hash::compute(indices, indexCount * sizeof(uint32_t), vertexHash);
+}
+
+bool RawMesh::validate(const std::string& vbName, const std::string& ibName)
+{
+    if (m_floatCount == 0 || m_floatCount % VERTEX_FLOATS != 0)
+    {
+        ERROR(vbName << " does not contain whole vertices of " << VERTEX_FLOATS << " floats.");
+        close();
+        return false;
+    }
+
+    if (m_indexCount % 3 != 0)
+    {
+        ERROR(ibName << " does not contain whole triangles.");
+        close();
+        return false;
+    }
+
+    // Out of range indices would make the GPU read outside of the vertex buffer
+    uint32_t maxIndex = 0;
+    for (size_t i = 0; i < m_indexCount; ++i)
+        maxIndex = std::max(maxIndex, m_indices[i]);
+
+    if (m_indexCount > 0 && maxIndex >= getVertexCount())
+    {
+        ERROR(ibName << " references vertex " << maxIndex << " but " << vbName << " only has " << getVertexCount() << " vertices.");
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void RawMesh::close()
+{
+    m_vertexFile.close();
+    m_indexFile.close();
+    m_vertices = nullptr;
+    m_indices = nullptr;
+    m_floatCount = 0;
+    m_indexCount = 0;
+    m_lods.clear();
+    m_meshlets.clear();
+}
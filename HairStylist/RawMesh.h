@@ -0,0 +1,115 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "MappedFile.h"
+#include "meshops.h"
+
+/**
+* Vertex and index buffer files (.raw) mapped into memory.
+* Both files start with a uint32_t count followed by count little-endian values:
+* floats for the vertex buffer (interleaved, VERTEX_FLOATS per vertex, see Mesh::load())
+* and uint32_t indices for the index buffer.
+* The data is not copied: pointers reference the mapping and stay valid until the RawMesh is closed or destroyed.
+*
+* A mesh cache (.meshcache, see writeCache()) holds both buffers of a preprocessed mesh in one file,
+* together with the hash of the source buffers it was built from, its levels of detail and the meshlets of the full mesh.
+*/
+class RawMesh
+{
+public:
+    // Position (3), texture coordinates (2), normal (3), tangent (3), bitangent (3)
+    static const uint32_t VERTEX_FLOATS = 14;
+
+    // "HSMC" in little-endian byte order
+    static const uint32_t CACHE_MAGIC = 0x434D5348;
+    static const uint32_t CACHE_VERSION = 3;
+
+    // Followed by lodCount Lod entries, meshletCount meshops::Meshlet entries, the vertices and the indices of all levels of detail
+    struct CacheHeader
+    {
+        uint32_t magic{ CACHE_MAGIC };
+        uint32_t version{ CACHE_VERSION };
+        uint64_t sourceHash{ 0 };
+        uint32_t floatCount{ 0 };
+        uint32_t indexCount{ 0 };
+        uint32_t lodCount{ 0 };
+        uint32_t meshletCount{ 0 };
+    };
+
+    /**
+    * A level of detail: a range of the index buffer that draws a simplified mesh with the same vertices
+    * (see meshops::simplify()). error is the simplification error in model units, 0 for the full mesh.
+    */
+    struct Lod
+    {
+        uint32_t firstIndex{ 0 };
+        uint32_t indexCount{ 0 };
+        float error{ 0.0f };
+    };
+
+    /**
+    * Maps both files and validates the header counts against the file sizes,
+    * the vertex layout, triangle lists and the index range. Returns false (with an error message) if invalid.
+    */
+    bool open(const std::string& vbPath, const std::string& ibPath);
+    void close();
+
+    /**
+    * Maps a mesh cache. Returns false without an error message if there is no cache or it was built
+    * from other source buffers (sourceHash, see computeHash()), and with an error message if it is corrupt.
+    */
+    bool openCache(const std::string& path, uint64_t sourceHash);
+
+    /**
+    * Writes vertex and index buffers (e.g. optimized with meshops) as mesh cache.
+    * The levels of detail are ranges of the index buffer, the first one is the full mesh.
+    * Meshlets split the first level of detail (see meshops::buildMeshlets()).
+    */
+    static bool writeCache(const std::string& path, const float* vertices, size_t floatCount,
+                           const uint32_t* indices, size_t indexCount, const Lod* lods, size_t lodCount,
+                           const meshops::Meshlet* meshlets, size_t meshletCount, uint64_t sourceHash);
+
+    /**
+    * The cache path of a mesh: the vertex buffer path with the extension .meshcache.
+    */
+    static std::string getCachePath(const std::string& vbPath);
+
+    /**
+    * Hash of the vertex and index data.
+    */
+    uint64_t computeHash() const;
+    static uint64_t computeHash(const float* vertices, size_t floatCount, const uint32_t* indices, size_t indexCount);
+
+    const float* getVertices() const { return m_vertices; }
+    const uint32_t* getIndices() const { return m_indices; }
+    size_t getFloatCount() const { return m_floatCount; }
+    size_t getVertexCount() const { return m_floatCount / VERTEX_FLOATS; }
+    size_t getIndexCount() const { return m_indexCount; }
+
+    /**
+    * Meshes opened from .raw files have a single level of detail with all indices.
+    */
+    size_t getLodCount() const { return m_lods.size(); }
+    const Lod& getLod(size_t lod) const { return m_lods[lod]; }
+
+    /**
+    * Only mesh caches have meshlets.
+    */
+    const std::vector<meshops::Meshlet>& getMeshlets() const { return m_meshlets; }
+
+private:
+    bool validate(const std::string& vbName, const std::string& ibName);
+
+private:
+    // Mesh caches only use the vertex file mapping
+    MappedFile m_vertexFile;
+    MappedFile m_indexFile;
+
+    const float* m_vertices{ nullptr };
+    const uint32_t* m_indices{ nullptr };
+    size_t m_floatCount{ 0 };
+    size_t m_indexCount{ 0 };
+    std::vector<Lod> m_lods;
+    std::vector<meshops::Meshlet> m_meshlets;
+};
@@ -4,10 +4,32 @@
 #include "file.h"
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 #include <vector>
 #include "Logger.h"
+#include "Mesh.h"
+#include "FrameUniforms.h"
+#include "ProgramCache.h"
+#include "hash.h"
 
-void Shader::shaderErrorCheck(GLuint shader, const std::string& shaderPath)
+namespace
+{
+    // Indexed by Shader::BuiltinUniform
+    const char* const BUILTIN_UNIFORM_NAMES[] =
+    {
+        "u_model",
+        "u_modelIT",
+        "u_modelViewProj",
+        "u_color",
+        "u_compactVertices",
+        "u_positionScale",
+        "u_positionOffset",
+        "u_material.diffuse",
+        "u_material.specular"
+    };
+}
+
+bool Shader::shaderErrorCheck(GLuint shader, const std::string& shaderPath)
 {
     GLint result = GL_FALSE;
     GLint infoLogLength;
@@ -21,9 +43,10 @@ void Shader::shaderErrorCheck(GLuint shader, const std::string& shaderPath)
         std::cout << "Shader comilation failed for " << shaderPath << std::endl;
 
     fprintf(stdout, "%s\n", &shaderLog[0]);
+    return result == GL_TRUE;
 }
 
-void Shader::programErrorCheck(GLuint program, std::initializer_list<std::string> shaderPaths)
+bool Shader::programErrorCheck(GLuint program, const std::vector<std::string>& shaderPaths)
 {
     GLint result = GL_FALSE;
     GLint infoLogLength;
@@ -42,134 +65,288 @@ void Shader::programErrorCheck(GLuint program, std::initializer_list<std::string
     }
 
     fprintf(stdout, "%s\n", &programLog[0]);
+    return result == GL_TRUE;
 }
 
 void Shader::load(const std::string& vsPath, const std::string& fsPath)
+{
+    beginLoad(vsPath, fsPath);
+    finishLoad();
+}
+
+Shader::Shader()
+{
+    std::fill(m_builtinLocations, m_builtinLocations + BUILTIN_UNIFORM_COUNT, -1);
+}
+
+Shader::Shader(const std::string& vsPath, const std::string& fsPath)
+    :Shader()
+{
+    load(vsPath, fsPath);
+}
+
+Shader::~Shader()
 {
     if (m_loadedProgram)
         glDeleteProgram(m_shaderProgram);
 
-    GLuint vsID = load(GL_VERTEX_SHADER, vsPath);
-    GLuint fsID = load(GL_FRAGMENT_SHADER, fsPath);
+    // A load that was never finished
+    for (GLuint stage : m_pendingStages)
+        glDeleteShader(stage);
+    if (m_pendingProgram != 0)
+        glDeleteProgram(m_pendingProgram);
+}
+
+void Shader::load(const std::string& vsPath, const std::string& fsPath, const std::string& gsPath)
+{
+    beginLoad(vsPath, fsPath, gsPath);
+    finishLoad();
+}
+
+void Shader::beginLoad(const std::string& vsPath, const std::string& fsPath, const std::string& gsPath)
+{
+    if (m_pendingProgram != 0)
+        finishLoad();
+
+    m_pendingPaths = { vsPath, fsPath };
+    std::vector<GLenum> stageTypes = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    if (!gsPath.empty())
+    {
+        m_pendingPaths.push_back(gsPath);
+        stageTypes.push_back(GL_GEOMETRY_SHADER);
+    }
+
+    // The key covers the defines, variants of the same files are different programs
+    std::vector<std::string> sources;
+    m_pendingHash = 0;
+    for (size_t i = 0; i < m_pendingPaths.size(); ++i)
+    {
+        sources.push_back(readSource(m_pendingPaths[i]));
+        m_pendingHash = hash::compute(&stageTypes[i], sizeof(GLenum), m_pendingHash);
+        m_pendingHash = hash::compute(sources[i].data(), sources[i].size(), m_pendingHash);
+    }
+
+    if (m_programCache)
+    {
+        m_pendingProgram = m_programCache->load(m_pendingHash);
+        if (m_pendingProgram != 0)
+            return;
+    }
 
     GLuint program = glCreateProgram();
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        GLuint stage = compile(stageTypes[i], sources[i]);
+        glAttachShader(program, stage);
+        m_pendingStages.push_back(stage);
+    }
 
-    glAttachShader(program, vsID);
-    glAttachShader(program, fsID);
+    if (m_programCache)
+        m_programCache->prepare(program);
 
     glLinkProgram(program);
+    m_pendingProgram = program;
+}
+
+bool Shader::finishLoad()
+{
+    if (m_pendingProgram == 0)
+        return false;
 
-    programErrorCheck(program, { vsPath, fsPath });
+    bool linked = true;
+    if (!m_pendingStages.empty())
+    {
+        for (size_t i = 0; i < m_pendingStages.size(); ++i)
+            shaderErrorCheck(m_pendingStages[i], m_pendingPaths[i]);
+
+        linked = programErrorCheck(m_pendingProgram, m_pendingPaths);
 
-    glDeleteShader(vsID);
-    glDeleteShader(fsID);
+        for (GLuint stage : m_pendingStages)
+            glDeleteShader(stage);
+
+        if (linked && m_programCache)
+            m_programCache->store(m_pendingHash, m_pendingProgram);
+    }
 
     GL_ERROR_CHECK();
 
-    m_shaderProgram = program;
-    m_loadedProgram = true;
+    // A shader that works stays in use while the broken one is being fixed
+    if (!linked && m_loadedProgram)
+        glDeleteProgram(m_pendingProgram);
+    else
+    {
+        if (m_loadedProgram)
+            glDeleteProgram(m_shaderProgram);
+
+        m_shaderProgram = m_pendingProgram;
+        m_loadedProgram = true;
+        cacheUniforms();
+    }
+
+    m_pendingProgram = 0;
+    m_pendingStages.clear();
+    return linked;
 }
 
-Shader::Shader(const std::string& vsPath, const std::string& fsPath)
+bool Shader::isLoadReady() const
 {
-    load(vsPath, fsPath);
+    if (m_pendingProgram == 0 || m_pendingStages.empty() || !GLEW_ARB_parallel_shader_compile)
+        return true;
+
+    GLint ready = GL_TRUE;
+    glGetProgramiv(m_pendingProgram, GL_COMPLETION_STATUS_ARB, &ready);
+    return ready == GL_TRUE;
 }
 
-Shader::~Shader()
+void Shader::enableParallelCompile()
 {
-    if (m_loadedProgram)
-        glDeleteProgram(m_shaderProgram);
+    if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 }
 
-void Shader::load(const std::string& vsPath, const std::string& fsPath, const std::string& gsPath)
+void Shader::setShaderProgram(ShaderProgram shaderProgram)
 {
-    if (m_loadedProgram)
-        glDeleteProgram(m_shaderProgram);
-
-    GLuint vsID = load(GL_VERTEX_SHADER, vsPath);
-    GLuint fsID = load(GL_FRAGMENT_SHADER, fsPath);
-    GLuint gsID = load(GL_GEOMETRY_SHADER, gsPath);
-
-    GLuint program = glCreateProgram();
+    m_shaderProgram = shaderProgram;
+    cacheUniforms();
+}
 
-    glAttachShader(program, vsID);
-    glAttachShader(program, fsID);
-    glAttachShader(program, gsID);
+void Shader::cacheUniforms()
+{
+    m_uniformLocations.clear();
+    std::fill(m_builtinLocations, m_builtinLocations + BUILTIN_UNIFORM_COUNT, -1);
+    if (m_shaderProgram == 0)
+        return;
+
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(m_shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(m_shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<char> name(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < uniformCount; ++i)
+    {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(m_shaderProgram, GLuint(i), GLsizei(name.size()), nullptr, &size, &type, name.data());
+
+        // Members of uniform blocks have no location
+        GLint location = glGetUniformLocation(m_shaderProgram, name.data());
+        if (location < 0)
+            continue;
+
+        // Arrays are reported as "name[0]", they can be set by either name
+        UniformLocation uniform = { name.data(), location };
+        m_uniformLocations.push_back(uniform);
+        if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0)
+        {
+            uniform.name.resize(uniform.name.size() - 3);
+            m_uniformLocations.push_back(uniform);
+        }
+    }
 
-    glLinkProgram(program);
+    std::sort(m_uniformLocations.begin(), m_uniformLocations.end(), [](const UniformLocation& a, const UniformLocation& b)
+    {
+        return a.name < b.name;
+    });
 
-    programErrorCheck(program, { vsPath, fsPath, gsPath });
+    for (int i = 0; i < BUILTIN_UNIFORM_COUNT; ++i)
+        m_builtinLocations[i] = findLocation(BUILTIN_UNIFORM_NAMES[i]);
 
-    glDeleteShader(vsID);
-    glDeleteShader(fsID);
-    glDeleteShader(gsID);
+    bindUniformBlock("Frame", FrameUniforms::BINDING_POINT);
 
     GL_ERROR_CHECK();
+}
+
+GLint Shader::findLocation(const char* uniformName) const
+{
+    auto it = std::lower_bound(m_uniformLocations.begin(), m_uniformLocations.end(), uniformName, [](const UniformLocation& uniform, const char* name)
+    {
+        return strcmp(uniform.name.c_str(), name) < 0;
+    });
 
-    m_shaderProgram = program;
-    m_loadedProgram = true;
+    return it != m_uniformLocations.end() && strcmp(it->name.c_str(), uniformName) == 0 ? it->location : -1;
 }
 
 void Shader::bindTexture2D(GLuint texId, const std::string& textureName, GLint textureUnit)
 {
-    glActiveTexture(GL_TEXTURE0 + textureUnit);
-    glBindTexture(GL_TEXTURE_2D, texId);
-    glUniform1i(glGetUniformLocation(m_shaderProgram, textureName.c_str()), textureUnit);
+    GLState::current().bindTexture(GLuint(textureUnit), GL_TEXTURE_2D, texId);
+    glUniform1i(getLocation(textureName.c_str()), textureUnit);
 }
 
-void Shader::setDirLight(const DirectionalLight& dirLight, const glm::mat4& view)
+void Shader::bindTexture2DArray(GLuint texId, const std::string& textureName, GLint textureUnit)
 {
-    setVec3("u_dirLight.ambient", dirLight.ambient);
-    setVec3("u_dirLight.diffuse", dirLight.diffuse);
-    setVec3("u_dirLight.specular", dirLight.specular);
-    setVec3("u_dirLight.viewDirection", glm::vec3(view * glm::vec4(dirLight.direction, 0.0f)));
+    GLState::current().bindTexture(GLuint(textureUnit), GL_TEXTURE_2D_ARRAY, texId);
+    glUniform1i(getLocation(textureName.c_str()), textureUnit);
+}
+
+void Shader::bindUniformBlock(const char* blockName, GLuint bindingPoint) const
+{
+    GLuint blockIndex = glGetUniformBlockIndex(m_shaderProgram, blockName);
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(m_shaderProgram, blockIndex, bindingPoint);
+    GLState::current().countUniformCalls(blockIndex != GL_INVALID_INDEX ? 2 : 1);
 }
 
 void Shader::setMaterial(const Material& material)
 {
-    setVec3("u_material.diffuse", material.diffuse);
-    setVec4("u_material.specular", material.specular);
+    glUniform3fv(getLocation(U_MATERIAL_DIFFUSE), 1, &material.diffuse[0]);
+    glUniform4fv(getLocation(U_MATERIAL_SPECULAR), 1, &material.specular[0]);
+}
+
+std::string Shader::readSource(const std::string& shaderPath) const
+{
+    std::string source = file::readAsString(shaderPath);
+
+    // #version has to stay the first statement
+    if (!m_defines.empty())
+    {
+        size_t versionEnd = source.find('\n', source.find("#version"));
+        if (versionEnd != std::string::npos)
+            source.insert(versionEnd + 1, m_defines);
+        else
+            ERROR("Cannot add defines to " << shaderPath << " without a #version line.");
+    }
+
+    return source;
 }
 
-GLuint Shader::load(GLenum shaderType, const std::string& shaderPath)
+GLuint Shader::compile(GLenum shaderType, const std::string& source)
 {
     GLuint id = glCreateShader(shaderType);
 
-    std::string source = file::readAsString(shaderPath);
     char const* vsSource = source.c_str();
     glShaderSource(id, 1, &vsSource, nullptr);
     glCompileShader(id);
 
-    shaderErrorCheck(id, shaderPath);
-
     return id;
 }
 
 void Shader::bind()
 {
-    glUseProgram(m_shaderProgram);
-}
-
-void Shader::setCamera(const glm::mat4& view, const glm::mat4& proj) const
-{
-    glUniformMatrix4fv(getLocation("u_view"), 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(getLocation("u_proj"), 1, GL_FALSE, &proj[0][0]);
+    GLState::current().useProgram(m_shaderProgram);
 }
 
 void Shader::setModel(const glm::mat4& modelMatrix, bool setInverseTranspose) const
 {
-    glUniformMatrix4fv(getLocation("u_model"), 1, GL_FALSE, &modelMatrix[0][0]);
+    glUniformMatrix4fv(getLocation(U_MODEL), 1, GL_FALSE, &modelMatrix[0][0]);
 
     if (setInverseTranspose)
     {
         glm::mat4 modelIT = glm::transpose(glm::inverse(modelMatrix));
-        glUniformMatrix4fv(getLocation("u_modelIT"), 1, GL_FALSE, &modelIT[0][0]);
+        glUniformMatrix4fv(getLocation(U_MODEL_IT), 1, GL_FALSE, &modelIT[0][0]);
     }
 }
 
+void Shader::setVertexFormat(const Mesh& mesh) const
+{
+    glUniform1i(getLocation(U_COMPACT_VERTICES), mesh.getVertexFormat() == Mesh::VertexFormat::Compact);
+    glUniform3fv(getLocation(U_POSITION_SCALE), 1, &mesh.getPositionScale()[0]);
+    glUniform3fv(getLocation(U_POSITION_OFFSET), 1, &mesh.getPositionOffset()[0]);
+}
+
 void Shader::setColor(float r, float g, float b, float a) const
 {
-    glUniform4f(getLocation("u_color"), r, g, b, a);
+    glUniform4f(getLocation(U_COLOR), r, g, b, a);
 }
 
 void Shader::setColor(glm::vec3 color) const
@@ -184,7 +361,12 @@ void Shader::setColor(float r, float g, float b) const
 
 void Shader::setMVP(const glm::mat4& mvp) const
 {
-    glUniformMatrix4fv(getLocation("u_modelViewProj"), 1, GL_FALSE, &mvp[0][0]);
+    glUniformMatrix4fv(getLocation(U_MODEL_VIEW_PROJ), 1, GL_FALSE, &mvp[0][0]);
+}
+
+void Shader::setInt(const char* uniformName, int v) const
+{
+    glUniform1i(getLocation(uniformName), v);
 }
 
 void Shader::setFloat(const char* uniformName, float v) const
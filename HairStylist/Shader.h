@@ -2,9 +2,14 @@
 #include <string>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <vector>
+#include "GLState.h"
 
 using ShaderProgram = GLuint;
 
+class Mesh;
+class ProgramCache;
+
 struct DirectionalLight
 {
     glm::vec3 ambient;
@@ -22,20 +27,50 @@ struct Material
 class Shader
 {
 public:
-    Shader() {}
+    Shader();
     Shader(const std::string& vsPath, const std::string& fsPath);
     ~Shader();
 
+    /**
+    * Builds the program from its stages and makes it the program of the shader.
+    */
     void load(const std::string& vsPath, const std::string& fsPath, const std::string& gsPath);
     void load(const std::string& vsPath, const std::string& fsPath);
-    ShaderProgram getProgram() const { return m_shaderProgram; }
 
-    void bind();
+    /**
+    * load() in two steps: beginLoad() submits compiling and linking, finishLoad() waits for the result,
+    * reports errors and replaces the program. Begin the loads of all shaders before finishing the first one,
+    * so that drivers that compile in the background build them in parallel.
+    * If linking fails, finishLoad() returns false and a loaded shader keeps its previous program.
+    */
+    void beginLoad(const std::string& vsPath, const std::string& fsPath, const std::string& gsPath = "");
+    bool finishLoad();
+
+    /**
+    * True if finishLoad() would not wait for the driver. Drivers without GL_ARB_parallel_shader_compile
+    * cannot tell, their loads are always reported as ready.
+    */
+    bool isLoadReady() const;
+    bool isLoading() const { return m_pendingProgram != 0; }
+
+    /**
+    * Lets the driver compile with as many threads as it likes (GL_ARB_parallel_shader_compile). Call it once per context.
+    */
+    static void enableParallelCompile();
+
+    /**
+    * Programs loaded with a cache are taken from it if their sources did not change, and stored in it otherwise.
+    */
+    void setProgramCache(ProgramCache* programCache) { m_programCache = programCache; }
 
     /**
-    * Sets the camera view and proj matrices "u_view" and "u_proj".
+    * Preprocessor definitions ("#define NAME value" lines) inserted after the #version line of every stage
+    * compiled by the following load() calls. Used to build variants of a shader from the same files.
     */
-    void setCamera(const glm::mat4& view, const glm::mat4& proj) const;
+    void setDefines(const std::string& defines) { m_defines = defines; }
+    ShaderProgram getProgram() const { return m_shaderProgram; }
+
+    void bind();
 
     /**
     * Sets the model matrix "u_model".
@@ -44,6 +79,12 @@ public:
     */
     void setModel(const glm::mat4& modelMatrix, bool setInverseTranspose = false) const;
 
+    /**
+    * Sets how the vertex shader decodes the vertices of the mesh (see Mesh::VertexFormat):
+    * "u_compactVertices", "u_positionScale" and "u_positionOffset".
+    */
+    void setVertexFormat(const Mesh& mesh) const;
+
     /**
     * Sets the color "u_color".
     */
@@ -64,10 +105,11 @@ public:
     */
     void setMVP(const glm::mat4& mvp) const;
 
-    void setShaderProgram(ShaderProgram shaderProgram) { m_shaderProgram = shaderProgram; }
+    void setShaderProgram(ShaderProgram shaderProgram);
 
     bool hasSameProgram(ShaderProgram shaderProgram) const { return m_shaderProgram == shaderProgram; }
 
+    void setInt(const char* uniformName, int v) const;
     void setFloat(const char* uniformName, float v) const;
     void setVec2(const char* uniformName, float v1, float v2) const;
     void setVec3(const char* uniformName, float v1, float v2, float v3) const;
@@ -86,13 +128,14 @@ public:
     void bindTexture2D(GLuint texId, const std::string& textureName, GLint textureUnit = 0);
 
     /**
-    * Sets the directional light "u_dirLight" with the following members:
-    * vec3 ambient;
-	* vec3 diffuse;
-	* vec3 specular;
-	* vec3 viewDirection;
+    * Same as bindTexture2D() for a GL_TEXTURE_2D_ARRAY texture.
+    */
+    void bindTexture2DArray(GLuint texId, const std::string& textureName, GLint textureUnit = 0);
+
+    /**
+    * Connects the uniform block blockName to a GL_UNIFORM_BUFFER binding point (see glBindBufferRange()).
     */
-    void setDirLight(const DirectionalLight& dirLight, const glm::mat4& view);
+    void bindUniformBlock(const char* blockName, GLuint bindingPoint) const;
 
     /**
     * Sets the material "u_material" with the following members:
@@ -101,16 +144,78 @@ public:
     */
     void setMaterial(const Material& material);
 private:
-    GLuint load(GLenum shaderType, const std::string& shaderPath);
-    void shaderErrorCheck(GLuint shader, const std::string& shaderPath);
-    void programErrorCheck(GLuint program, std::initializer_list<std::string> shaderPaths);
+    /**
+    * Reads a stage and inserts the defines.
+    */
+    std::string readSource(const std::string& shaderPath) const;
+    GLuint compile(GLenum shaderType, const std::string& source);
+    bool shaderErrorCheck(GLuint shader, const std::string& shaderPath);
+    bool programErrorCheck(GLuint program, const std::vector<std::string>& shaderPaths);
+
+    /**
+    * Uniforms set by the methods above, their locations are looked up without hashing the name.
+    */
+    enum BuiltinUniform
+    {
+        U_MODEL,
+        U_MODEL_IT,
+        U_MODEL_VIEW_PROJ,
+        U_COLOR,
+        U_COMPACT_VERTICES,
+        U_POSITION_SCALE,
+        U_POSITION_OFFSET,
+        U_MATERIAL_DIFFUSE,
+        U_MATERIAL_SPECULAR,
+        BUILTIN_UNIFORM_COUNT
+    };
+
+    /**
+    * Reads the locations of all active uniforms of the linked program and connects the block "Frame"
+    * to FrameUniforms::BINDING_POINT. Uniforms are never looked up with glGetUniformLocation() while rendering.
+    */
+    void cacheUniforms();
+
+    /**
+    * Every lookup is followed by one glUniform call, which is counted in the GLState.
+    */
+    GLint getLocation(BuiltinUniform uniform) const
+    {
+        GLState::current().countUniformCalls();
+        return m_builtinLocations[uniform];
+    }
 
+    /**
+    * Returns -1 for names that are not active uniforms of the program, setting them does nothing (like in GL).
+    */
     GLint getLocation(const char* uniformName) const
     {
-        return glGetUniformLocation(m_shaderProgram, uniformName);
+        GLState::current().countUniformCalls();
+        return findLocation(uniformName);
     }
+
+    /**
+    * Binary search over the sorted names, the name is neither copied into a string nor hashed.
+    */
+    GLint findLocation(const char* uniformName) const;
+
+    struct UniformLocation
+    {
+        std::string name;
+        GLint location;
+    };
 private:
     ShaderProgram m_shaderProgram = 0;
     bool m_loadedProgram = false;
+    std::string m_defines;
+    ProgramCache* m_programCache = nullptr;
+
+    // Load between beginLoad() and finishLoad(), no stages are compiled for programs from the cache
+    GLuint m_pendingProgram = 0;
+    std::vector<GLuint> m_pendingStages;
+    std::vector<std::string> m_pendingPaths;
+    uint64_t m_pendingHash = 0;
+
+    std::vector<UniformLocation> m_uniformLocations; // sorted by name
+    GLint m_builtinLocations[BUILTIN_UNIFORM_COUNT];
 };
 
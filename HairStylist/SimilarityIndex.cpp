@@ -0,0 +1,346 @@
+#include "SimilarityIndex.h"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include "Canvas.h"
+#include "canvasops.h"
+#include "parallel.h"
+#include "file.h"
+#include "Logger.h"
+
+const uint32_t SimilarityIndex::CHANNELS;
+const uint32_t SimilarityIndex::COARSE_GRID;
+const uint32_t SimilarityIndex::FINE_GRID;
+const uint32_t SimilarityIndex::HISTOGRAM_BINS;
+const uint32_t SimilarityIndex::SOURCE_SIZE;
+const size_t SimilarityIndex::COARSE_SIZE;
+const size_t SimilarityIndex::FINE_SIZE;
+const size_t SimilarityIndex::SIGNATURE_SIZE;
+
+namespace
+{
+    // "HSIX" in little-endian byte order
+    const uint32_t INDEX_MAGIC = 0x58495348;
+    const uint32_t INDEX_VERSION = 1;
+
+    // Number of coarse matches per requested result that are re-ranked with the full signature
+    const size_t RERANK_FACTOR = 16;
+    const size_t MIN_RERANK_CANDIDATES = 256;
+
+    struct IndexHeader
+    {
+        uint32_t magic{ INDEX_MAGIC };
+        uint32_t version{ INDEX_VERSION };
+        uint32_t signatureSize{ uint32_t(SimilarityIndex::SIGNATURE_SIZE) };
+    };
+
+    /**
+    * Sum of absolute differences. size has to be a multiple of 16.
+    */
+    inline uint32_t sad(const uint8_t* a, const uint8_t* b, size_t size)
+    {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t i = 0; i < size; i += 16)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+        }
+
+        return uint32_t(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+    }
+}
+
+SimilarityIndex::SimilarityIndex(const std::string& path)
+    :m_path(path)
+{
+    static_assert(COARSE_SIZE % 16 == 0 && FINE_SIZE % 16 == 0, "Signature parts have to be multiples of the SSE register size");
+    load();
+}
+
+void SimilarityIndex::computeSignature(const Canvas& source, Signature& outSignature)
+{
+    memset(outSignature.data, 0, sizeof(outSignature.data));
+
+    // Same downsampling chain as the embedded mip levels of style files
+    Canvas downsampled;
+    const Canvas* level = &source;
+    while (level->getWidth() / 2 >= SOURCE_SIZE && level->getHeight() / 2 >= SOURCE_SIZE)
+    {
+        Canvas next;
+        canvasops::downsample(*level, next);
+        std::swap(downsampled, next);
+        level = &downsampled;
+    }
+
+    const Canvas& canvas = *level;
+
+    uint32_t width = canvas.getWidth();
+    uint32_t height = canvas.getHeight();
+    uint32_t channels = std::min(canvas.getChannels(), CHANNELS);
+    if (width == 0 || height == 0)
+        return;
+
+    uint64_t sums[FINE_GRID][FINE_GRID][CHANNELS] = {};
+    uint64_t counts[FINE_GRID][FINE_GRID] = {};
+    uint64_t histograms[CHANNELS][HISTOGRAM_BINS] = {};
+
+    std::vector<uint32_t> cellX(width);
+    for (uint32_t x = 0; x < width; ++x)
+        cellX[x] = uint32_t(uint64_t(x) * FINE_GRID / width);
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint32_t cy = uint32_t(uint64_t(y) * FINE_GRID / height);
+        const uint8_t* p = canvas.pixel(0, y);
+        for (uint32_t x = 0; x < width; ++x, p += canvas.getChannels())
+        {
+            uint64_t* cell = sums[cy][cellX[x]];
+            ++counts[cy][cellX[x]];
+            for (uint32_t c = 0; c < channels; ++c)
+            {
+                cell[c] += p[c];
+                ++histograms[c][p[c] * HISTOGRAM_BINS / 256];
+            }
+        }
+    }
+
+    uint8_t* coarse = outSignature.data;
+    uint8_t* histogram = coarse + COARSE_GRID * COARSE_GRID * CHANNELS;
+    uint8_t* fine = outSignature.data + COARSE_SIZE;
+
+    const uint32_t factor = FINE_GRID / COARSE_GRID;
+    for (uint32_t cy = 0; cy < FINE_GRID; ++cy)
+    {
+        for (uint32_t cx = 0; cx < FINE_GRID; ++cx)
+        {
+            for (uint32_t c = 0; c < channels; ++c)
+            {
+                if (counts[cy][cx] > 0)
+                    fine[(cy * FINE_GRID + cx) * CHANNELS + c] = uint8_t(sums[cy][cx][c] / counts[cy][cx]);
+            }
+        }
+    }
+
+    for (uint32_t cy = 0; cy < COARSE_GRID; ++cy)
+    {
+        for (uint32_t cx = 0; cx < COARSE_GRID; ++cx)
+        {
+            for (uint32_t c = 0; c < channels; ++c)
+            {
+                uint64_t sum = 0, count = 0;
+                for (uint32_t y = cy * factor; y < (cy + 1) * factor; ++y)
+                {
+                    for (uint32_t x = cx * factor; x < (cx + 1) * factor; ++x)
+                    {
+                        sum += sums[y][x][c];
+                        count += counts[y][x];
+                    }
+                }
+
+                if (count > 0)
+                    coarse[(cy * COARSE_GRID + cx) * CHANNELS + c] = uint8_t(sum / count);
+            }
+        }
+    }
+
+    // Square roots emphasize small bins (e.g. a few long strands) which would otherwise round to 0
+    double numPixels = double(width) * height;
+    for (uint32_t c = 0; c < channels; ++c)
+        for (uint32_t bin = 0; bin < HISTOGRAM_BINS; ++bin)
+            histogram[c * HISTOGRAM_BINS + bin] = uint8_t(std::sqrt(histograms[c][bin] / numPixels) * 255.0 + 0.5);
+}
+
+void SimilarityIndex::add(const std::string& filename, const Signature& signature)
+{
+    auto it = m_lookup.find(filename);
+    size_t idx = it != m_lookup.end() ? it->second : m_filenames.size();
+    if (idx == m_filenames.size())
+    {
+        m_filenames.push_back(filename);
+        m_coarse.resize(m_filenames.size() * COARSE_SIZE);
+        m_fine.resize(m_filenames.size() * FINE_SIZE);
+        m_lookup[filename] = idx;
+    }
+
+    memcpy(&m_coarse[idx * COARSE_SIZE], signature.data, COARSE_SIZE);
+    memcpy(&m_fine[idx * FINE_SIZE], signature.data + COARSE_SIZE, FINE_SIZE);
+
+    bool exists = file::exists(m_path);
+    std::ofstream out(m_path, std::ios::binary | std::ios::app);
+    if (!exists)
+    {
+        IndexHeader header;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    uint32_t nameLength = uint32_t(filename.size());
+    out.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+    out.write(filename.data(), nameLength);
+    out.write(reinterpret_cast<const char*>(signature.data), SIGNATURE_SIZE);
+
+    if (!out)
+        ERROR("Could not write to similarity index " << m_path);
+}
+
+void SimilarityIndex::remove(const std::string& filename)
+{
+    auto it = m_lookup.find(filename);
+    if (it == m_lookup.end())
+        return;
+
+    // Move the last entry into the gap
+    size_t idx = it->second;
+    size_t last = m_filenames.size() - 1;
+    m_lookup.erase(it);
+    if (idx != last)
+    {
+        m_filenames[idx] = m_filenames[last];
+        memcpy(&m_coarse[idx * COARSE_SIZE], &m_coarse[last * COARSE_SIZE], COARSE_SIZE);
+        memcpy(&m_fine[idx * FINE_SIZE], &m_fine[last * FINE_SIZE], FINE_SIZE);
+        m_lookup[m_filenames[idx]] = idx;
+    }
+
+    m_filenames.pop_back();
+    m_coarse.resize(m_filenames.size() * COARSE_SIZE);
+    m_fine.resize(m_filenames.size() * FINE_SIZE);
+
+    save();
+}
+
+void SimilarityIndex::query(const Signature& signature, size_t k, std::vector<Result>& outResults, size_t numThreads) const
+{
+    outResults.clear();
+    size_t count = m_filenames.size();
+    if (count == 0 || k == 0)
+        return;
+
+    std::vector<uint32_t> distances(count);
+    parallel::forRange(count, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            distances[i] = sad(signature.data, &m_coarse[i * COARSE_SIZE], COARSE_SIZE);
+    }, numThreads);
+
+    std::vector<uint32_t> candidates(count);
+    for (size_t i = 0; i < count; ++i)
+        candidates[i] = uint32_t(i);
+
+    size_t numCandidates = std::min(count, std::max(k * RERANK_FACTOR, MIN_RERANK_CANDIDATES));
+    std::nth_element(candidates.begin(), candidates.begin() + (numCandidates - 1), candidates.end(),
+                     [&distances](uint32_t a, uint32_t b) { return distances[a] < distances[b]; });
+    candidates.resize(numCandidates);
+
+    for (uint32_t idx : candidates)
+        distances[idx] += sad(signature.data + COARSE_SIZE, &m_fine[idx * FINE_SIZE], FINE_SIZE);
+
+    size_t numResults = std::min(k, numCandidates);
+    std::partial_sort(candidates.begin(), candidates.begin() + numResults, candidates.end(),
+                      [&distances](uint32_t a, uint32_t b) { return distances[a] < distances[b]; });
+
+    for (size_t i = 0; i < numResults; ++i)
+    {
+        Result result;
+        result.filename = m_filenames[candidates[i]];
+        result.distance = distances[candidates[i]];
+        outResults.push_back(result);
+    }
+}
+
+void SimilarityIndex::load()
+{
+    std::ifstream in(m_path, std::ios::binary);
+    if (!in)
+        return;
+
+    IndexHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || header.magic != INDEX_MAGIC || header.version != INDEX_VERSION || header.signatureSize != SIGNATURE_SIZE)
+    {
+        // Rewritten empty, otherwise add() would append to a file that is never loaded
+        ERROR("Ignoring invalid or outdated similarity index " << m_path);
+        in.close();
+        save();
+        return;
+    }
+
+    std::vector<std::string> filenames;
+    std::vector<Signature> signatures;
+    std::unordered_map<std::string, size_t> lookup;
+
+    // A torn record at the end (crash during add()) is ignored
+    uint64_t validSize = sizeof(header);
+    uint32_t nameLength;
+    Signature signature;
+    while (in.read(reinterpret_cast<char*>(&nameLength), sizeof(nameLength)) && nameLength < 4096)
+    {
+        std::string filename(nameLength, '\0');
+        if (!in.read(&filename[0], nameLength) || !in.read(reinterpret_cast<char*>(signature.data), SIGNATURE_SIZE))
+            break;
+
+        validSize += sizeof(nameLength) + nameLength + SIGNATURE_SIZE;
+
+        auto it = lookup.find(filename);
+        if (it != lookup.end())
+            signatures[it->second] = signature;
+        else
+        {
+            lookup[filename] = filenames.size();
+            filenames.push_back(filename);
+            signatures.push_back(signature);
+        }
+    }
+
+    m_filenames.swap(filenames);
+    m_lookup.swap(lookup);
+    m_coarse.resize(m_filenames.size() * COARSE_SIZE);
+    m_fine.resize(m_filenames.size() * FINE_SIZE);
+    for (size_t i = 0; i < m_filenames.size(); ++i)
+    {
+        memcpy(&m_coarse[i * COARSE_SIZE], signatures[i].data, COARSE_SIZE);
+        memcpy(&m_fine[i * FINE_SIZE], signatures[i].data + COARSE_SIZE, FINE_SIZE);
+    }
+
+    // add() appends after the end of the file, records behind torn bytes would be misaligned
+    in.close();
+    if (validSize != file::getSize(m_path))
+    {
+        ERROR("Dropping a torn record at the end of similarity index " << m_path);
+        save();
+    }
+}
+
+bool SimilarityIndex::save() const
+{
+    std::string tmpPath = m_path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary);
+        IndexHeader header;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (size_t i = 0; i < m_filenames.size(); ++i)
+        {
+            uint32_t nameLength = uint32_t(m_filenames[i].size());
+            out.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+            out.write(m_filenames[i].data(), nameLength);
+            out.write(reinterpret_cast<const char*>(&m_coarse[i * COARSE_SIZE]), COARSE_SIZE);
+            out.write(reinterpret_cast<const char*>(&m_fine[i * FINE_SIZE]), FINE_SIZE);
+        }
+
+        if (!out)
+        {
+            ERROR("Could not write similarity index " << tmpPath);
+            return false;
+        }
+    }
+
+    if (!file::replace(tmpPath, m_path))
+    {
+        ERROR("Could not replace similarity index " << m_path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+class Canvas;
+
+/**
+* Index of compact style signatures for "find styles like this canvas" queries.
+* A signature consists of a coarse part (4x4 grid of channel averages and per channel histograms)
+* and a fine part (8x8 grid of channel averages). Queries scan the coarse parts of all entries
+* with SSE2 sum of absolute differences and re-rank the best candidates with the full signature,
+* so results are approximate but a query over 100k entries only touches ~10 MB.
+* The index is persisted in an append-only file: added entries are appended, later records of
+* the same filename replace earlier ones and remove() rewrites the file. A torn record at the end
+* (crash during add()) is dropped and the file is rewritten when it is loaded.
+* Not thread-safe.
+*/
+class SimilarityIndex
+{
+public:
+    static const uint32_t CHANNELS = 3;
+    static const uint32_t COARSE_GRID = 4;
+    static const uint32_t FINE_GRID = 8;
+    static const uint32_t HISTOGRAM_BINS = 16;
+
+    // Signatures are computed from the smallest mip level of at least this size (see style::readMip())
+    static const uint32_t SOURCE_SIZE = 64;
+
+    static const size_t COARSE_SIZE = COARSE_GRID * COARSE_GRID * CHANNELS + HISTOGRAM_BINS * CHANNELS;
+    static const size_t FINE_SIZE = FINE_GRID * FINE_GRID * CHANNELS;
+    static const size_t SIGNATURE_SIZE = COARSE_SIZE + FINE_SIZE;
+
+    struct Signature
+    {
+        uint8_t data[SIGNATURE_SIZE];
+    };
+
+    struct Result
+    {
+        std::string filename;
+        uint32_t distance;
+    };
+
+    SimilarityIndex(const std::string& path);
+
+    /**
+    * Computes the signature of a canvas. Only the first CHANNELS channels are used.
+    * Larger canvases are box filtered down to SOURCE_SIZE first, so passing the full canvas or
+    * its embedded mip level gives the same signature.
+    */
+    static void computeSignature(const Canvas& canvas, Signature& outSignature);
+
+    /**
+    * Adds the signature of a style or replaces the existing one and appends it to the index file.
+    */
+    void add(const std::string& filename, const Signature& signature);
+    void remove(const std::string& filename);
+    bool contains(const std::string& filename) const { return m_lookup.count(filename) > 0; }
+
+    /**
+    * Finds the k entries closest to the signature, sorted by ascending distance.
+    * The coarse scan is split over numThreads threads (0 = all cores).
+    */
+    void query(const Signature& signature, size_t k, std::vector<Result>& outResults, size_t numThreads = 0) const;
+
+    size_t getCount() const { return m_filenames.size(); }
+    const std::string& getPath() const { return m_path; }
+
+private:
+    void load();
+    bool save() const;
+
+private:
+    std::string m_path;
+    std::vector<std::string> m_filenames;
+
+    // Coarse and fine parts are stored separately so the coarse scan reads contiguous memory
+    std::vector<uint8_t> m_coarse;
+    std::vector<uint8_t> m_fine;
+    std::unordered_map<std::string, size_t> m_lookup;
+};
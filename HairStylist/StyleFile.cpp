@@ -0,0 +1,427 @@
+#include "StyleFile.h"
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include "Canvas.h"
+#include "canvasops.h"
+#include "TileStore.h"
+#include "file.h"
+#include "Logger.h"
+
+namespace
+{
+    size_t payloadSize(const style::Header& header)
+    {
+        if (header.storage == style::Storage::Tiled)
+            return size_t(header.tileCount) * sizeof(uint64_t);
+
+        return size_t(header.width) * header.height * header.channels;
+    }
+
+    /**
+    * Checks the fields of a header read from a file before they are used for allocations or loops.
+    */
+    bool isValid(const style::Header& header, size_t fileSize)
+    {
+        if (header.version > style::VERSION ||
+            header.width == 0 || header.width > style::MAX_SIZE ||
+            header.height == 0 || header.height > style::MAX_SIZE ||
+            header.channels < 1 || header.channels > 4)
+            return false;
+
+        if (header.storage == style::Storage::Tiled)
+        {
+            if (header.tileSize == 0 || header.tileSize > style::MAX_SIZE ||
+                uint64_t(header.tileCount) != uint64_t(style::tileCount(header.width, header.tileSize)) *
+                                              style::tileCount(header.height, header.tileSize))
+                return false;
+        }
+        else if (header.storage != style::Storage::Inline)
+            return false;
+
+        return payloadSize(header) <= fileSize - sizeof(style::Header);
+    }
+
+    bool readHeader(std::istream& input, size_t fileSize, style::Header& outHeader)
+    {
+        if (fileSize >= sizeof(style::Header) &&
+            input.read(reinterpret_cast<char*>(&outHeader), sizeof(style::Header)) &&
+            outHeader.magic == style::MAGIC)
+            return isValid(outHeader, fileSize);
+
+        // Raw pixel dump of a square RGB canvas
+        uint32_t size = uint32_t(std::sqrt(double(fileSize / 3)) + 0.5);
+        if (size == 0 || size_t(size) * size * 3 != fileSize)
+            return false;
+
+        outHeader = style::Header();
+        outHeader.version = 0;
+        outHeader.width = size;
+        outHeader.height = size;
+
+        input.clear();
+        input.seekg(0);
+        return true;
+    }
+
+    /**
+    * Writes the mip pyramid section. offset is the file position at which the section starts.
+    */
+    void writeMips(std::ostream& output, const Canvas& canvas, uint64_t offset)
+    {
+        // Reserved for any possible level count so the pointer to the previous level stays valid
+        std::vector<Canvas> levels;
+        levels.reserve(32);
+
+        const Canvas* level = &canvas;
+        while (std::min(level->getWidth(), level->getHeight()) > style::MIN_MIP_SIZE)
+        {
+            levels.push_back(Canvas());
+            canvasops::downsample(*level, levels.back());
+            level = &levels.back();
+        }
+
+        // Levels above the embedded range are only intermediate steps
+        auto first = std::find_if(levels.begin(), levels.end(), [](const Canvas& c)
+        {
+            return std::max(c.getWidth(), c.getHeight()) <= style::MAX_MIP_SIZE;
+        });
+
+        style::MipTable table;
+        table.mipCount = uint32_t(levels.end() - first);
+
+        uint64_t dataOffset = offset + sizeof(style::MipTable) + table.mipCount * sizeof(style::MipLevel);
+        std::vector<style::MipLevel> entries;
+        for (auto it = first; it != levels.end(); ++it)
+        {
+            style::MipLevel entry;
+            entry.width = it->getWidth();
+            entry.height = it->getHeight();
+            entry.offset = dataOffset;
+            entries.push_back(entry);
+            dataOffset += it->getSize();
+        }
+
+        output.write(reinterpret_cast<const char*>(&table), sizeof(table));
+        output.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(style::MipLevel));
+        for (auto it = first; it != levels.end(); ++it)
+            output.write(reinterpret_cast<const char*>(it->data()), it->getSize());
+    }
+
+    bool readMipLevels(std::istream& input, size_t fileSize, const style::Header& header, std::vector<style::MipLevel>& outLevels)
+    {
+        outLevels.clear();
+        if (header.version < 2)
+            return true;
+
+        style::MipTable table;
+        input.seekg(sizeof(style::Header) + payloadSize(header));
+        if (!input.read(reinterpret_cast<char*>(&table), sizeof(table)) || table.mipCount > 32)
+            return false;
+
+        outLevels.resize(table.mipCount);
+        if (!input.read(reinterpret_cast<char*>(outLevels.data()), outLevels.size() * sizeof(style::MipLevel)))
+            return false;
+
+        // The level pixels are read with the sizes and offsets from the table
+        return std::all_of(outLevels.begin(), outLevels.end(), [&](const style::MipLevel& level)
+        {
+            uint64_t levelSize = uint64_t(level.width) * level.height * header.channels;
+            return level.width > 0 && level.width <= style::MAX_MIP_SIZE &&
+                   level.height > 0 && level.height <= style::MAX_MIP_SIZE &&
+                   level.offset <= fileSize && levelSize <= fileSize - level.offset;
+        });
+    }
+
+    template <class Fn>
+    void forEachTile(uint32_t width, uint32_t height, uint32_t tileSize, Fn fn)
+    {
+        for (uint32_t y = 0; y < height; y += tileSize)
+            for (uint32_t x = 0; x < width; x += tileSize)
+                fn(x, y, std::min(tileSize, width - x), std::min(tileSize, height - y));
+    }
+
+    /**
+    * Read-only stream buffer over a memory block (e.g. a style inside a mapped pack) with seek support.
+    */
+    class MemoryBuffer : public std::streambuf
+    {
+    public:
+        MemoryBuffer(const uint8_t* data, size_t size)
+        {
+            char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+            setg(begin, begin, begin + size);
+        }
+
+    protected:
+        pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode) override
+        {
+            char* base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+            if (base + offset < eback() || base + offset > egptr())
+                return pos_type(off_type(-1));
+
+            setg(eback(), base + offset, egptr());
+            return pos_type(gptr() - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode mode) override
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, mode);
+        }
+    };
+
+    bool readCanvas(std::istream& input, size_t size, const std::string& name, Canvas& outCanvas, const TileStore* store)
+    {
+        style::Header header;
+        if (!readHeader(input, size, header))
+        {
+            ERROR("Could not read style " << name);
+            return false;
+        }
+
+        outCanvas.resize(header.width, header.height, header.channels);
+
+        if (header.storage == style::Storage::Inline)
+            return bool(input.read(reinterpret_cast<char*>(outCanvas.data()), outCanvas.getSize()));
+
+        if (!store)
+        {
+            ERROR("Cannot read the tiled style " << name << " without a tile store.");
+            return false;
+        }
+
+        std::vector<uint64_t> hashes(header.tileCount);
+        if (!input.read(reinterpret_cast<char*>(hashes.data()), hashes.size() * sizeof(uint64_t)))
+            return false;
+
+        bool success = true;
+        size_t tileIdx = 0;
+        std::vector<uint8_t> tile(header.tileSize * header.tileSize * header.channels);
+        forEachTile(header.width, header.height, header.tileSize, [&](uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+        {
+            if (success && tileIdx < hashes.size() && store->load(hashes[tileIdx], tile.data(), size_t(w) * h * header.channels))
+                outCanvas.writeRect(x, y, w, h, tile.data());
+            else
+                success = false;
+            ++tileIdx;
+        });
+
+        return success;
+    }
+
+    bool readMip(std::istream& input, size_t size, const std::string& name, uint32_t minSize, Canvas& outCanvas, const TileStore* store)
+    {
+        style::Header header;
+        std::vector<style::MipLevel> levels;
+        if (!readHeader(input, size, header) || !readMipLevels(input, size, header, levels))
+        {
+            ERROR("Could not read style " << name);
+            return false;
+        }
+
+        auto fits = [minSize](uint32_t width, uint32_t height) { return width >= minSize && height >= minSize; };
+
+        // Levels are sorted from large to small
+        const style::MipLevel* best = nullptr;
+        for (auto& level : levels)
+            if (fits(level.width, level.height))
+                best = &level;
+
+        if (best)
+        {
+            outCanvas.resize(best->width, best->height, header.channels);
+            input.seekg(best->offset);
+            return bool(input.read(reinterpret_cast<char*>(outCanvas.data()), outCanvas.getSize()));
+        }
+
+        // Older file or a level above MAX_MIP_SIZE
+        Canvas canvas;
+        input.clear();
+        input.seekg(0);
+        if (!readCanvas(input, size, name, canvas, store))
+            return false;
+
+        while (fits(canvas.getWidth() / 2, canvas.getHeight() / 2))
+        {
+            Canvas next;
+            canvasops::downsample(canvas, next);
+            std::swap(canvas, next);
+        }
+
+        std::swap(outCanvas, canvas);
+        return true;
+    }
+
+    bool readResampled(std::istream& input, size_t size, const std::string& name, uint32_t width, uint32_t height,
+                       Canvas& outCanvas, const TileStore* store)
+    {
+        Canvas canvas;
+        if (!readMip(input, size, name, std::max(width, height), canvas, store))
+            return false;
+
+        if (canvas.getWidth() == width && canvas.getHeight() == height)
+        {
+            std::swap(outCanvas, canvas);
+            return true;
+        }
+
+        outCanvas.resize(width, height, canvas.getChannels());
+        canvasops::resample(canvas, outCanvas, canvasops::Filter::Bicubic);
+        return true;
+    }
+}
+
+bool style::readHeader(const std::string& path, Header& outHeader)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input || !::readHeader(input, file::getSize(path), outHeader))
+    {
+        ERROR("Could not read the style header of " << path);
+        return false;
+    }
+
+    return true;
+}
+
+bool style::write(const std::string& path, const Canvas& canvas)
+{
+    std::ofstream output(path, std::ios::binary);
+    if (!write(output, canvas))
+    {
+        ERROR("Could not write style " << path);
+        return false;
+    }
+
+    return true;
+}
+
+bool style::write(std::ostream& output, const Canvas& canvas)
+{
+    Header header;
+    header.width = canvas.getWidth();
+    header.height = canvas.getHeight();
+    header.channels = canvas.getChannels();
+
+    // Mip offsets are relative to the start of the style
+    output.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    output.write(reinterpret_cast<const char*>(canvas.data()), canvas.getSize());
+    writeMips(output, canvas, sizeof(Header) + canvas.getSize());
+    return bool(output);
+}
+
+bool style::writeTiled(const std::string& path, const Canvas& canvas, TileStore& store)
+{
+    Header header;
+    header.width = canvas.getWidth();
+    header.height = canvas.getHeight();
+    header.channels = canvas.getChannels();
+    header.storage = Storage::Tiled;
+    header.tileSize = TileStore::TILE_SIZE;
+    header.tileCount = tileCount(header.width, header.tileSize) * tileCount(header.height, header.tileSize);
+
+    std::vector<uint64_t> hashes;
+    hashes.reserve(header.tileCount);
+
+    bool tilesWritten = true;
+    std::vector<uint8_t> tile(header.tileSize * header.tileSize * header.channels);
+    forEachTile(header.width, header.height, header.tileSize, [&](uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+    {
+        uint64_t hash = 0;
+        canvas.readRect(x, y, w, h, tile.data());
+        if (tilesWritten && store.add(tile.data(), size_t(w) * h * header.channels, hash))
+            hashes.push_back(hash);
+        else
+            tilesWritten = false;
+    });
+
+    if (!tilesWritten)
+    {
+        ERROR("Could not write the tiles of style " << path);
+        for (uint64_t hash : hashes)
+            store.release(hash);
+        return false;
+    }
+
+    std::ofstream output(path, std::ios::binary);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    output.write(reinterpret_cast<const char*>(hashes.data()), hashes.size() * sizeof(uint64_t));
+    writeMips(output, canvas, sizeof(Header) + hashes.size() * sizeof(uint64_t));
+
+    if (!output)
+    {
+        ERROR("Could not write style " << path);
+        for (uint64_t hash : hashes)
+            store.release(hash);
+        return false;
+    }
+
+    return true;
+}
+
+bool style::read(const std::string& path, Canvas& outCanvas, const TileStore* store)
+{
+    std::ifstream input(path, std::ios::binary);
+    return input && readCanvas(input, file::getSize(path), path, outCanvas, store);
+}
+
+bool style::read(const uint8_t* data, size_t size, Canvas& outCanvas, const TileStore* store)
+{
+    MemoryBuffer buffer(data, size);
+    std::istream input(&buffer);
+    return readCanvas(input, size, "<memory>", outCanvas, store);
+}
+
+bool style::readMipLevels(const std::string& path, std::vector<MipLevel>& outLevels)
+{
+    std::ifstream input(path, std::ios::binary);
+    Header header;
+    if (!input || !::readHeader(input, file::getSize(path), header) || !::readMipLevels(input, file::getSize(path), header, outLevels))
+    {
+        ERROR("Could not read the mip levels of " << path);
+        return false;
+    }
+
+    return true;
+}
+
+bool style::readMip(const std::string& path, uint32_t minSize, Canvas& outCanvas, const TileStore* store)
+{
+    std::ifstream input(path, std::ios::binary);
+    return input && ::readMip(input, file::getSize(path), path, minSize, outCanvas, store);
+}
+
+bool style::readMip(const uint8_t* data, size_t size, uint32_t minSize, Canvas& outCanvas, const TileStore* store)
+{
+    MemoryBuffer buffer(data, size);
+    std::istream input(&buffer);
+    return ::readMip(input, size, "<memory>", minSize, outCanvas, store);
+}
+
+bool style::readResampled(const std::string& path, uint32_t width, uint32_t height, Canvas& outCanvas, const TileStore* store)
+{
+    std::ifstream input(path, std::ios::binary);
+    return input && ::readResampled(input, file::getSize(path), path, width, height, outCanvas, store);
+}
+
+bool style::readResampled(const uint8_t* data, size_t size, uint32_t width, uint32_t height, Canvas& outCanvas, const TileStore* store)
+{
+    MemoryBuffer buffer(data, size);
+    std::istream input(&buffer);
+    return ::readResampled(input, size, "<memory>", width, height, outCanvas, store);
+}
+
+bool style::readTileHashes(const std::string& path, std::vector<uint64_t>& outHashes)
+{
+    outHashes.clear();
+
+    std::ifstream input(path, std::ios::binary);
+    Header header;
+    if (!input || !::readHeader(input, file::getSize(path), header))
+        return false;
+
+    if (header.storage != Storage::Tiled)
+        return true;
+
+    outHashes.resize(header.tileCount);
+    return bool(input.read(reinterpret_cast<char*>(outHashes.data()), outHashes.size() * sizeof(uint64_t)));
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <string>
+#include <iosfwd>
+#include <vector>
+#include <stdint.h>
+
+class Canvas;
+class TileStore;
+
+/**
+* Reading and writing of .style files.
+* A style file starts with a Header followed by the storage specific payload:
+* - Inline: width * height * channels bytes of raw pixel data
+* - Tiled:  tileCount uint64_t tile hashes referencing tiles in a TileStore (row-major tile order)
+* Since version 2 the payload is followed by a mip pyramid: a MipTable, mipCount MipLevel entries
+* and the inline pixel data of every level, so previews can be read without touching the full canvas.
+* Files without a header (raw pixel dumps of older versions) are still readable.
+*/
+namespace style
+{
+    // "HSTY" in little-endian byte order
+    const uint32_t MAGIC = 0x59545348;
+    const uint32_t VERSION = 2;
+
+    // Mip levels with a width or height in [MIN_MIP_SIZE, MAX_MIP_SIZE] are embedded
+    const uint32_t MAX_MIP_SIZE = 256;
+    const uint32_t MIN_MIP_SIZE = 8;
+
+    // Largest width or height accepted when reading, headers above it are treated as corrupt
+    const uint32_t MAX_SIZE = 16384;
+
+    enum class Storage : uint32_t
+    {
+        Inline = 0,
+        Tiled = 1
+    };
+
+    struct Header
+    {
+        uint32_t magic{ MAGIC };
+        uint32_t version{ VERSION };
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        uint32_t channels{ 3 };
+        Storage storage{ Storage::Inline };
+        uint32_t tileSize{ 0 };
+        uint32_t tileCount{ 0 };
+    };
+
+    struct MipTable
+    {
+        uint32_t mipCount{ 0 };
+        uint32_t reserved{ 0 };
+    };
+
+    struct MipLevel
+    {
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+
+        // Offset of the level's pixels (width * height * channels bytes) from the start of the style
+        uint64_t offset{ 0 };
+    };
+
+    /**
+    * Returns the number of tiles needed to cover the canvas in one dimension.
+    */
+    inline uint32_t tileCount(uint32_t size, uint32_t tileSize) { return (size + tileSize - 1) / tileSize; }
+
+    /**
+    * Reads the header of the given style file.
+    * A header is synthesized (version 0) for raw pixel dumps of older versions
+    * which are expected to be square RGB canvases.
+    * Fails for headers with out of range fields or a payload that does not fit into the file.
+    */
+    bool readHeader(const std::string& path, Header& outHeader);
+
+    /**
+    * Writes the canvas with inline pixel data.
+    */
+    bool write(const std::string& path, const Canvas& canvas);
+    bool write(std::ostream& output, const Canvas& canvas);
+
+    /**
+    * Writes the canvas as manifest of tile hashes. Tiles are added to the store (which increments their reference count).
+    * The store references are not persisted - call TileStore::saveRefs() afterwards.
+    */
+    bool writeTiled(const std::string& path, const Canvas& canvas, TileStore& store);
+
+    /**
+    * Reads the style into outCanvas which is resized to the resolution of the file.
+    * A store is required to read tiled styles.
+    */
+    bool read(const std::string& path, Canvas& outCanvas, const TileStore* store = nullptr);
+
+    /**
+    * Same as above for a style file image in memory (e.g. inside a mapped StylePack).
+    */
+    bool read(const uint8_t* data, size_t size, Canvas& outCanvas, const TileStore* store = nullptr);
+
+    /**
+    * Reads the table of embedded mip levels, largest first. outLevels is empty for files older than version 2.
+    */
+    bool readMipLevels(const std::string& path, std::vector<MipLevel>& outLevels);
+
+    /**
+    * Reads the smallest version of the style whose width and height are at least minSize
+    * (or the full style if it is smaller than that).
+    * Embedded levels are read directly. Otherwise the full canvas is read and downsampled.
+    */
+    bool readMip(const std::string& path, uint32_t minSize, Canvas& outCanvas, const TileStore* store = nullptr);
+    bool readMip(const uint8_t* data, size_t size, uint32_t minSize, Canvas& outCanvas, const TileStore* store = nullptr);
+
+    /**
+    * Reads the style at the given resolution. The smallest stored version that is at least as large
+    * is read (see readMip()) and resampled if its size differs.
+    */
+    bool readResampled(const std::string& path, uint32_t width, uint32_t height, Canvas& outCanvas,
+                       const TileStore* store = nullptr);
+    bool readResampled(const uint8_t* data, size_t size, uint32_t width, uint32_t height, Canvas& outCanvas,
+                       const TileStore* store = nullptr);
+
+    /**
+    * Reads the tile hashes of a tiled style. outHashes is empty for inline styles.
+    */
+    bool readTileHashes(const std::string& path, std::vector<uint64_t>& outHashes);
+}
@@ -0,0 +1,157 @@
+#include "StylePack.h"
+#include <algorithm>
+#include <cstring>
+#include "Logger.h"
+
+const uint32_t StylePack::MAGIC;
+const uint32_t StylePack::VERSION;
+const uint32_t StylePack::NAME_SIZE;
+const uint32_t StylePack::ALIGNMENT;
+
+bool StylePack::open(const std::string& path)
+{
+    m_path = path;
+    m_entries = nullptr;
+    m_entryCount = 0;
+
+    if (!m_file.open(path))
+        return false;
+
+    const uint8_t* data = m_file.data();
+    size_t size = m_file.size();
+
+    PackHeader header;
+    PackFooter footer;
+    if (size < sizeof(PackHeader) + sizeof(PackFooter))
+    {
+        ERROR(path << " is too small to be a style pack.");
+        m_file.close();
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+
+    size_t indexEnd = size - sizeof(PackFooter);
+    if (header.magic != MAGIC || header.version != VERSION || footer.magic != MAGIC || footer.indexOffset > indexEnd ||
+        footer.indexOffset % alignof(PackEntry) != 0 ||
+        (indexEnd - footer.indexOffset) / sizeof(PackEntry) < footer.entryCount)
+    {
+        ERROR(path << " is not a valid style pack or was not finished.");
+        m_file.close();
+        return false;
+    }
+
+    const PackEntry* entries = reinterpret_cast<const PackEntry*>(data + footer.indexOffset);
+    for (uint32_t i = 0; i < footer.entryCount; ++i)
+    {
+        if (entries[i].offset > footer.indexOffset || entries[i].size > footer.indexOffset - entries[i].offset ||
+            entries[i].nameLength > NAME_SIZE)
+        {
+            ERROR("Entry " << i << " of " << path << " is corrupt.");
+            m_file.close();
+            return false;
+        }
+    }
+
+    m_entries = entries;
+    m_entryCount = footer.entryCount;
+    return true;
+}
+
+std::string StylePack::getName(size_t idx) const
+{
+    return std::string(m_entries[idx].name, m_entries[idx].nameLength);
+}
+
+Hairstyle StylePack::getHairstyle(size_t idx) const
+{
+    const PackEntry& entry = m_entries[idx];
+
+    Hairstyle hairstyle;
+    hairstyle.color = glm::vec3(entry.color[0], entry.color[1], entry.color[2]);
+    hairstyle.length = entry.length;
+    hairstyle.width = entry.width;
+    return hairstyle;
+}
+
+bool StylePackWriter::open(const std::string& path)
+{
+    m_path = path;
+    m_entries.clear();
+    m_output.open(path, std::ios::binary | std::ios::trunc);
+
+    StylePack::PackHeader header;
+    m_output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_offset = sizeof(header);
+
+    if (!m_output)
+    {
+        ERROR("Could not create style pack " << path);
+        return false;
+    }
+
+    return true;
+}
+
+bool StylePackWriter::add(const std::string& name, const Hairstyle& hairstyle, const std::string& style)
+{
+    if (name.size() > StylePack::NAME_SIZE)
+    {
+        ERROR("Style name " << name << " is longer than " << StylePack::NAME_SIZE << " characters.");
+        return false;
+    }
+
+    // Page aligned styles never share a page, so viewing one style faults in only its own pages
+    static const char padding[StylePack::ALIGNMENT] = {};
+    uint64_t paddingSize = (StylePack::ALIGNMENT - m_offset % StylePack::ALIGNMENT) % StylePack::ALIGNMENT;
+    m_output.write(padding, std::streamsize(paddingSize));
+    m_offset += paddingSize;
+
+    StylePack::PackEntry entry;
+    memset(entry.name, 0, sizeof(entry.name));
+    entry.offset = m_offset;
+    entry.size = style.size();
+    entry.color[0] = hairstyle.color.r;
+    entry.color[1] = hairstyle.color.g;
+    entry.color[2] = hairstyle.color.b;
+    entry.length = hairstyle.length;
+    entry.width = hairstyle.width;
+    entry.nameLength = uint32_t(name.size());
+    memcpy(entry.name, name.data(), name.size());
+
+    m_output.write(style.data(), std::streamsize(style.size()));
+    m_offset += style.size();
+    m_entries.push_back(entry);
+
+    if (!m_output)
+    {
+        ERROR("Could not write to style pack " << m_path);
+        return false;
+    }
+
+    return true;
+}
+
+bool StylePackWriter::finish()
+{
+    uint64_t paddingSize = (alignof(StylePack::PackEntry) - m_offset % alignof(StylePack::PackEntry)) % alignof(StylePack::PackEntry);
+    m_output.write("\0\0\0\0\0\0\0\0", std::streamsize(paddingSize));
+    m_offset += paddingSize;
+
+    StylePack::PackFooter footer;
+    footer.indexOffset = m_offset;
+    footer.entryCount = uint32_t(m_entries.size());
+
+    m_output.write(reinterpret_cast<const char*>(m_entries.data()), m_entries.size() * sizeof(StylePack::PackEntry));
+    m_output.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    m_output.close();
+
+    if (!m_output)
+    {
+        ERROR("Could not finish style pack " << m_path);
+        return false;
+    }
+
+    return true;
+}
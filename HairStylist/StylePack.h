@@ -0,0 +1,100 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+#include "Hairstyle.h"
+#include "MappedFile.h"
+
+/**
+* A library of inline styles bundled into a single file (.hspack):
+* - PackHeader
+* - The styles as complete inline style file images (see style::write()), each aligned to PACK_ALIGNMENT
+* - PackEntry index with name, parameters and location of every style
+* - PackFooter pointing to the index
+* Readers map the pack, so opening it costs one open and browsing only faults in the pages of viewed styles.
+*/
+class StylePack
+{
+public:
+    // "HSPK" in little-endian byte order
+    static const uint32_t MAGIC = 0x4B505348;
+    static const uint32_t VERSION = 1;
+    static const uint32_t NAME_SIZE = 64;
+    static const uint32_t ALIGNMENT = 4096;
+
+    struct PackHeader
+    {
+        uint32_t magic{ MAGIC };
+        uint32_t version{ VERSION };
+        uint64_t reserved{ 0 };
+    };
+
+    struct PackEntry
+    {
+        uint64_t offset{ 0 };
+        uint64_t size{ 0 };
+        float color[3];
+        float length{ 1.0f };
+        float width{ 1.0f };
+        uint32_t nameLength{ 0 };
+        char name[NAME_SIZE];
+    };
+
+    struct PackFooter
+    {
+        uint64_t indexOffset{ 0 };
+        uint32_t entryCount{ 0 };
+        uint32_t magic{ MAGIC };
+    };
+
+    /**
+    * Maps the pack and reads its index. Returns false if the file is not a valid pack.
+    */
+    bool open(const std::string& path);
+
+    size_t getCount() const { return m_entryCount; }
+    std::string getName(size_t idx) const;
+    Hairstyle getHairstyle(size_t idx) const;
+
+    /**
+    * The style file image of the given entry inside the mapping. Pass it to style::read().
+    */
+    const uint8_t* getData(size_t idx) const { return m_file.data() + m_entries[idx].offset; }
+    size_t getSize(size_t idx) const { return size_t(m_entries[idx].size); }
+
+    const std::string& getPath() const { return m_path; }
+
+private:
+    std::string m_path;
+    MappedFile m_file;
+
+    // Points into the mapping
+    const PackEntry* m_entries{ nullptr };
+    size_t m_entryCount{ 0 };
+};
+
+/**
+* Writes a StylePack. Styles are appended in the order of add() calls.
+*/
+class StylePackWriter
+{
+public:
+    bool open(const std::string& path);
+
+    /**
+    * Appends a style file image (e.g. written with style::write() into a std::ostringstream).
+    */
+    bool add(const std::string& name, const Hairstyle& hairstyle, const std::string& style);
+
+    /**
+    * Writes the index and footer. The pack is incomplete (and unreadable) until finish() succeeded.
+    */
+    bool finish();
+
+private:
+    std::string m_path;
+    std::ofstream m_output;
+    uint64_t m_offset{ 0 };
+    std::vector<StylePack::PackEntry> m_entries;
+};
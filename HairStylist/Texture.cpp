@@ -1,28 +1,317 @@
 #include "Texture.h"
 #include <SOIL2.h>
+#include <fstream>
+#include <iterator>
 #include "Logger.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include "Canvas.h"
+#include "canvasops.h"
+#include "blockcompress.h"
+#include "file.h"
+#include "hash.h"
+
+const uint32_t Texture::CACHE_MAGIC;
+const uint32_t Texture::CACHE_VERSION;
+
+namespace
+{
+    std::string g_cacheDirectory;
+
+    bool isCompressed(GLenum internalFormat)
+    {
+        return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+            || internalFormat == GL_COMPRESSED_RED_RGTC1;
+    }
+
+    GLenum getPixelFormat(int channels)
+    {
+        const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+        return formats[channels - 1];
+    }
+
+    /**
+    * The format images with the given channel count are uploaded in. 1 channel images are compressed with RGTC,
+    * which is core since GL 3.0. 2 channel images have no matching format among the two, they stay pixels.
+    */
+    GLenum getInternalFormat(int channels, blockcompress::Format& outFormat)
+    {
+        switch (channels)
+        {
+        case 1:
+            outFormat = blockcompress::Format::BC4;
+            return GL_COMPRESSED_RED_RGTC1;
+        case 2:
+            outFormat = blockcompress::Format::BC4;
+            return GL_RG8;
+        case 3:
+            outFormat = blockcompress::Format::BC1;
+            return GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGB8;
+        default:
+            outFormat = blockcompress::Format::BC3;
+            return GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+        }
+    }
+}
 
 Texture::~Texture()
 {
-    glDeleteTextures(1, &m_glId);
+    if (m_loadThread.joinable())
+        m_loadThread.join();
+
+    if (m_loaded)
+        GLState::current().deleteTexture(m_glId);
 }
 
 void Texture::load(const std::string& path)
 {
-    if (m_loaded)
-        glDeleteTextures(1, &m_glId);
+    Image image;
+    if (prepare(path, image))
+        upload(image);
+}
+
+void Texture::beginLoad(const std::string& path)
+{
+    if (m_loadThread.joinable())
+        m_loadThread.join();
+
+    m_loadThread = std::thread([this, path]()
+    {
+        PROFILE_ZONE("Prepare texture");
+        m_pendingValid = prepare(path, m_pendingImage);
+    });
+}
+
+bool Texture::finishLoad()
+{
+    if (!m_loadThread.joinable())
+        return false;
+
+    m_loadThread.join();
+    if (m_pendingValid)
+        upload(m_pendingImage);
+
+    m_pendingImage = Image();
+    return m_pendingValid;
+}
+
+void Texture::setCacheDirectory(const std::string& directory)
+{
+    g_cacheDirectory = directory;
+    if (!directory.empty() && !file::createDirectory(directory))
+    {
+        ERROR("Could not create the texture cache directory " << directory);
+        g_cacheDirectory.clear();
+    }
+}
+
+bool Texture::prepare(const std::string& path, Image& outImage)
+{
+    std::ifstream input(path, std::ios::binary);
+    std::vector<uint8_t> encoded((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    if (!input.is_open() || encoded.empty())
+    {
+        ERROR("Could not read " << path);
+        return false;
+    }
+
+    // The same file is compressed differently on GPUs without S3TC
+    uint64_t sourceHash = hash::compute(encoded.data(), encoded.size(), GLEW_EXT_texture_compression_s3tc ? 1 : 0);
+    std::string cachePath = g_cacheDirectory.empty() ? "" : g_cacheDirectory + "/" + hash::toHex(sourceHash) + ".texture";
+    if (!cachePath.empty() && loadCache(cachePath, sourceHash, outImage))
+        return true;
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* data = SOIL_load_image_from_memory(encoded.data(), int(encoded.size()), &width, &height, &channels, SOIL_LOAD_AUTO);
+    if (!data)
+    {
+        ERROR("Could not decode " << path << ": " << SOIL_last_result());
+        return false;
+    }
+
+    build(data, width, height, channels, outImage);
+    SOIL_free_image_data(data);
+
+    if (!cachePath.empty())
+        storeCache(cachePath, sourceHash, outImage);
 
-    int channels;
-    auto imgData = SOIL_load_image(path.c_str(), &m_width, &m_height, &channels, SOIL_LOAD_AUTO);
+    return true;
+}
+
+void Texture::build(const uint8_t* pixels, int width, int height, int channels, Image& outImage)
+{
+    blockcompress::Format format;
+    outImage.channels = channels;
+    outImage.internalFormat = getInternalFormat(channels, format);
+
+    // Image files store the top row first, GL the bottom row
+    Canvas canvas(static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(channels));
+    for (uint32_t y = 0; y < canvas.getHeight(); ++y)
+    {
+        const uint8_t* row = pixels + (size_t(height) - 1 - y) * canvas.getRowSize();
+        std::copy(row, row + canvas.getRowSize(), canvas.pixel(0, y));
+    }
 
-    m_glId = SOIL_create_OGL_texture(
-        imgData,
-        &m_width, &m_height, channels,
-        SOIL_CREATE_NEW_ID,
-        SOIL_FLAG_INVERT_Y | SOIL_FLAG_MIPMAPS | SOIL_FLAG_COMPRESS_TO_DXT);
+    outImage.levels.clear();
+    Canvas smaller;
+    for (;;)
+    {
+        Level level;
+        level.width = canvas.getWidth();
+        level.height = canvas.getHeight();
+        if (isCompressed(outImage.internalFormat))
+            blockcompress::compress(canvas, format, level.data);
+        else
+            level.data.assign(canvas.data(), canvas.data() + canvas.getSize());
 
-    SOIL_free_image_data(imgData);
+        outImage.levels.push_back(std::move(level));
+        if (canvas.getWidth() == 1 && canvas.getHeight() == 1)
+            break;
+
+        canvasops::downsample(canvas, smaller);
+        std::swap(canvas, smaller);
+    }
+}
+
+bool Texture::loadCache(const std::string& path, uint64_t sourceHash, Image& outImage)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+        return false;
+
+    CacheHeader header;
+    input.read(reinterpret_cast<char*>(&header), sizeof(CacheHeader));
+    blockcompress::Format format;
+    if (!input || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.sourceHash != sourceHash
+        || header.channels < 1 || header.channels > 4 || header.levelCount == 0 || header.levelCount > 32
+        || header.internalFormat != getInternalFormat(int(header.channels), format))
+    {
+        LOG(path << " is not a valid texture cache and is ignored.");
+        return false;
+    }
+
+    // Every level has to be the next one of the mip chain build() generates, with the exact size of its format.
+    // Sizes come from the file, they are checked against what is left of it before anything is allocated.
+    size_t fileSize = file::getSize(path);
+    size_t remaining = fileSize > sizeof(CacheHeader) ? fileSize - sizeof(CacheHeader) : 0;
+    bool compressed = isCompressed(header.internalFormat);
+    bool valid = true;
+    outImage.internalFormat = header.internalFormat;
+    outImage.channels = int(header.channels);
+    outImage.levels.resize(header.levelCount);
+    for (size_t i = 0; i < outImage.levels.size() && valid; ++i)
+    {
+        CacheLevel info;
+        input.read(reinterpret_cast<char*>(&info), sizeof(CacheLevel));
+        remaining -= std::min(remaining, sizeof(CacheLevel));
+
+        uint32_t width = i == 0 ? info.width : std::max(1u, outImage.levels[i - 1].width / 2);
+        uint32_t height = i == 0 ? info.height : std::max(1u, outImage.levels[i - 1].height / 2);
+        size_t size = compressed ? blockcompress::getSize(format, width, height) : size_t(width) * height * header.channels;
+        valid = input && info.width == width && info.height == height && width > 0 && height > 0
+            && info.size == size && size <= remaining;
+        if (!valid)
+            break;
+
+        Level& level = outImage.levels[i];
+        level.width = width;
+        level.height = height;
+        level.data.resize(size);
+        input.read(reinterpret_cast<char*>(level.data.data()), level.data.size());
+        remaining -= size;
+    }
+
+    const Level& last = outImage.levels.back();
+    if (!valid || !input || last.width != 1 || last.height != 1 || input.peek() != std::ifstream::traits_type::eof())
+    {
+        LOG(path << " does not match its image and is ignored.");
+        outImage = Image();
+        return false;
+    }
+
+    return true;
+}
+
+void Texture::storeCache(const std::string& path, uint64_t sourceHash, const Image& image)
+{
+    CacheHeader header;
+    header.sourceHash = sourceHash;
+    header.internalFormat = image.internalFormat;
+    header.channels = uint32_t(image.channels);
+    header.levelCount = uint32_t(image.levels.size());
+
+    // Written next to the cache entry and moved over it, textures loading at the same time never see half a file
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream output(tmpPath, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+        for (const Level& level : image.levels)
+        {
+            CacheLevel info = { level.width, level.height, uint32_t(level.data.size()) };
+            output.write(reinterpret_cast<const char*>(&info), sizeof(CacheLevel));
+            output.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+        }
+
+        if (!output)
+        {
+            ERROR("Could not write texture cache " << tmpPath);
+            return;
+        }
+    }
+
+    if (!file::replace(tmpPath, path))
+    {
+        ERROR("Could not replace texture cache " << path);
+        file::remove(tmpPath);
+    }
+}
+
+void Texture::upload(const Image& image)
+{
+    if (image.levels.empty())
+    {
+        ERROR("Could not create a texture from an empty image");
+        return;
+    }
+
+    GLuint glId = 0;
+    glGenTextures(1, &glId);
+    GLState& state = GLState::current();
+    state.bindTexture(GL_TEXTURE_2D, glId);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size() - 1));
+
+    // Grey images sample as grey (and grey with alpha), like luminance textures did
+    if (image.channels <= 2)
+    {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, image.channels == 2 ? GL_GREEN : GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    bool compressed = isCompressed(image.internalFormat);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < image.levels.size(); ++i)
+    {
+        const Level& level = image.levels[i];
+        if (compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), image.internalFormat, level.width, level.height, 0, GLsizei(level.data.size()), level.data.data());
+        else
+            glTexImage2D(GL_TEXTURE_2D, GLint(i), image.internalFormat, level.width, level.height, 0, getPixelFormat(image.channels), GL_UNSIGNED_BYTE, level.data.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     GL_ERROR_CHECK();
 
+    if (m_loaded)
+        state.deleteTexture(m_glId);
+
+    m_glId = glId;
+    m_width = int(image.levels[0].width);
+    m_height = int(image.levels[0].height);
     m_loaded = true;
 }
@@ -1,23 +1,116 @@
 #pragma once
 #include <GL/glew.h>
 #include <string>
+#include <vector>
+#include <thread>
+#include <stdint.h>
 
+/**
+* A 2D texture with a full mip chain, loaded from an image file.
+*
+* Decoding, mip generation and block compression (see blockcompress) do not touch GL, they run on any thread
+* (see prepare() and beginLoad()) and only the upload is left to the GL thread. Prepared images are cached on
+* disk as ready-to-upload mip chains keyed by the content of the file, unchanged files skip decoding and
+* compression at the next load.
+*/
 class Texture
 {
 public:
+    static const uint32_t CACHE_MAGIC = 0x58545348;
+    static const uint32_t CACHE_VERSION = 1;
+
+    struct Level
+    {
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        std::vector<uint8_t> data;
+    };
+
+    /**
+    * A mip chain ready to upload, level 0 first and rows bottom up like GL expects them.
+    */
+    struct Image
+    {
+        std::vector<Level> levels;
+        GLenum internalFormat{ 0 }; // a compressed format, or GL_R8 to GL_RGBA8 if the levels are pixels
+        int channels{ 0 };
+    };
+
     Texture() {}
     ~Texture();
 
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+
     operator GLuint() const { return m_glId; }
 
     void load(const std::string& path);
 
+    /**
+    * load() in two steps: beginLoad() prepares the image on a thread, finishLoad() waits for it and uploads it.
+    * If the image cannot be prepared, finishLoad() returns false and a loaded texture keeps its previous image.
+    */
+    void beginLoad(const std::string& path);
+    bool finishLoad();
+    bool isLoading() const { return m_loadThread.joinable(); }
+
+    /**
+    * Decodes an image file and builds its compressed mip chain without touching GL, or takes it from the cache.
+    * Returns false (with an error message) if the file cannot be decoded.
+    */
+    static bool prepare(const std::string& path, Image& outImage);
+
+    /**
+    * Prepared images are stored in this directory, it is created if needed. Empty (the default) disables
+    * the cache. Set it before textures are loaded.
+    */
+    static void setCacheDirectory(const std::string& directory);
+
+    /**
+    * Creates the texture from a prepared image. A loaded texture is replaced, draws recorded before
+    * still use the old one (the GL name changes).
+    */
+    void upload(const Image& image);
+
     int getWidth() const { return m_width; }
     int getHeight() const { return m_height; }
+
+private:
+    struct CacheHeader
+    {
+        uint32_t magic{ CACHE_MAGIC };
+        uint32_t version{ CACHE_VERSION };
+        uint64_t sourceHash{ 0 }; // hash of the image file and of the compressed formats the GPU supports
+        uint32_t internalFormat{ 0 };
+        uint32_t channels{ 0 };
+        uint32_t levelCount{ 0 };
+        uint32_t reserved{ 0 };
+    };
+
+    struct CacheLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t size;
+    };
+
+    static bool loadCache(const std::string& path, uint64_t sourceHash, Image& outImage);
+    static void storeCache(const std::string& path, uint64_t sourceHash, const Image& image);
+
+    /**
+    * Generates the mips of the decoded pixels and compresses them if the GPU supports a format for them.
+    */
+    static void build(const uint8_t* pixels, int width, int height, int channels, Image& outImage);
+
 private:
     GLuint m_glId{ 0 };
     int m_width{ 0 };
     int m_height{ 0 };
 
     bool m_loaded{ false };
+
+    // Load between beginLoad() and finishLoad(), written by the load thread
+    std::thread m_loadThread;
+    Image m_pendingImage;
+    bool m_pendingValid{ false };
 };
@@ -0,0 +1,191 @@
+#include "TileStore.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <vector>
+#include "file.h"
+#include "hash.h"
+#include "Logger.h"
+
+namespace
+{
+    /**
+    * Parses a "<hex hash> <reference count>" line of refs.info.
+    */
+    bool parseRef(const std::string& line, uint64_t& outHash, uint32_t& outRefCount)
+    {
+        std::istringstream words(line);
+        std::string hex, count, extra;
+        if (!(words >> hex >> count) || (words >> extra) || !hash::fromHex(hex, outHash) ||
+            count.size() > 9 || count.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+
+        outRefCount = uint32_t(std::stoul(count));
+        return true;
+    }
+}
+
+TileStore::TileStore(const std::string& path)
+    :m_path(path)
+{
+    std::ifstream refs(m_path + "/refs.info");
+
+    // Tiles of skipped lines are unreferenced, they are kept on disk until collectGarbage() and rewritten by add()
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(refs, line))
+    {
+        ++lineNumber;
+        uint64_t hash;
+        uint32_t refCount;
+        if (parseRef(line, hash, refCount))
+            m_refCounts[hash] = refCount;
+        else if (line.find_first_not_of(" \t\r") != std::string::npos)
+            ERROR("Skipping invalid line " << lineNumber << " of " << m_path << "/refs.info: " << line);
+    }
+}
+
+bool TileStore::add(const uint8_t* data, size_t size, uint64_t& outHash)
+{
+    uint64_t hash = hash::compute(data, size);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The hash is only a key: on a collision with a different tile the next free key is used
+    auto it = m_refCounts.find(hash);
+    for (; it != m_refCounts.end(); it = m_refCounts.find(++hash))
+    {
+        if (isStored(hash, data, size))
+        {
+            ++it->second;
+            outHash = hash;
+            return true;
+        }
+    }
+
+    // The directory is created lazily so read-only users do not leave empty tile stores behind
+    if (m_refCounts.empty() && !file::createDirectory(m_path))
+        ERROR("Could not create tile store directory " << m_path);
+
+    // A tile is only referenced once it is complete on disk
+    std::string path = getTilePath(hash);
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream output(tmpPath, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(data), size);
+        if (!output)
+        {
+            output.close();
+            file::remove(tmpPath);
+            ERROR("Could not write tile " << path);
+            return false;
+        }
+    }
+
+    if (!file::replace(tmpPath, path))
+    {
+        file::remove(tmpPath);
+        ERROR("Could not write tile " << path);
+        return false;
+    }
+
+    m_refCounts[hash] = 1;
+    outHash = hash;
+    return true;
+}
+
+bool TileStore::load(uint64_t hash, uint8_t* outData, size_t size) const
+{
+    std::string path = getTilePath(hash);
+    if (file::getSize(path) != size)
+    {
+        ERROR("Tile " << path << " is missing or has an unexpected size.");
+        return false;
+    }
+
+    return bool(std::ifstream(path, std::ios::binary).read(reinterpret_cast<char*>(outData), size));
+}
+
+bool TileStore::isStored(uint64_t hash, const uint8_t* data, size_t size) const
+{
+    std::string path = getTilePath(hash);
+    if (file::getSize(path) != size)
+        return false;
+
+    std::vector<uint8_t> stored(size);
+    return std::ifstream(path, std::ios::binary).read(reinterpret_cast<char*>(stored.data()), size) &&
+           memcmp(stored.data(), data, size) == 0;
+}
+
+bool TileStore::contains(uint64_t hash) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_refCounts.count(hash) > 0;
+}
+
+size_t TileStore::getTileCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_refCounts.size();
+}
+
+void TileStore::release(uint64_t hash)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_refCounts.find(hash);
+    if (it != m_refCounts.end() && it->second > 0)
+        --it->second;
+}
+
+size_t TileStore::collectGarbage()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t numDeleted = 0;
+    for (auto it = m_refCounts.begin(); it != m_refCounts.end();)
+    {
+        if (it->second == 0)
+        {
+            file::remove(getTilePath(it->first));
+            it = m_refCounts.erase(it);
+            ++numDeleted;
+        }
+        else
+            ++it;
+    }
+
+    return numDeleted;
+}
+
+bool TileStore::saveRefs()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_refCounts.empty() && !file::exists(m_path))
+        return true;
+
+    std::string path = m_path + "/refs.info";
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream refs(tmpPath);
+        for (auto& ref : m_refCounts)
+            refs << hash::toHex(ref.first) << " " << ref.second << "\n";
+
+        if (!refs)
+        {
+            ERROR("Could not write tile references " << tmpPath);
+            return false;
+        }
+    }
+
+    if (!file::replace(tmpPath, path))
+    {
+        ERROR("Could not replace tile references " << path);
+        return false;
+    }
+
+    return true;
+}
+
+std::string TileStore::getTilePath(uint64_t hash) const
+{
+    return m_path + "/" + hash::toHex(hash) + ".tile";
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <stdint.h>
+
+/**
+* Content addressed storage for canvas tiles.
+* Every unique tile is stored exactly once as <path>/<hash>.tile and reference counted.
+* Saved styles reference tiles by hash (see style::writeTiled()) so saving a slightly
+* modified canvas only writes the tiles that actually changed.
+* Reference counts are persisted in <path>/refs.info - call saveRefs() after modifications.
+* All functions are thread-safe.
+*/
+class TileStore
+{
+public:
+    static const uint32_t TILE_SIZE = 64;
+
+    TileStore(const std::string& path);
+
+    /**
+    * Stores the tile if it is not known yet and increments its reference count.
+    * outHash is the key of the tile: its content hash, or the next unused value if a different tile
+    * with the same hash is stored already. Returns false (with an error message) if the tile could not be
+    * written, its reference count is unchanged then.
+    */
+    bool add(const uint8_t* data, size_t size, uint64_t& outHash);
+
+    /**
+    * Loads the tile with the given hash. Returns false if the tile does not exist
+    * or if its size does not match.
+    */
+    bool load(uint64_t hash, uint8_t* outData, size_t size) const;
+
+    bool contains(uint64_t hash) const;
+
+    /**
+    * Decrements the reference count. Unreferenced tiles stay on disk until collectGarbage() is called.
+    */
+    void release(uint64_t hash);
+
+    /**
+    * Deletes all tiles that are not referenced anymore.
+    * Returns the number of deleted tiles.
+    */
+    size_t collectGarbage();
+
+    /**
+    * Writes the reference counts. The previous counts are replaced in one step (see file::replace()),
+    * so a crash while saving keeps them intact. Returns false if writing failed.
+    */
+    bool saveRefs();
+
+    size_t getTileCount() const;
+    const std::string& getPath() const { return m_path; }
+
+private:
+    std::string getTilePath(uint64_t hash) const;
+
+    /**
+    * Returns true if the tile stored under hash has exactly the given content.
+    */
+    bool isStored(uint64_t hash, const uint8_t* data, size_t size) const;
+
+private:
+    std::string m_path;
+    std::unordered_map<uint64_t, uint32_t> m_refCounts;
+    mutable std::mutex m_mutex;
+};
@@ -6,14 +6,14 @@ float Time::deltaTime;
 float Time::totalTime;
 
 Timer::Timer()
-    :m_prevTime(SDL_GetTicks() / 1000.0f), m_deltaTime(0.f), m_totalTime(0.f)
+    :m_prevCount(SDL_GetPerformanceCounter()), m_deltaTime(0.f), m_totalTime(0.f)
 {
 
 }
 
 void Timer::start()
 {
-    m_prevTime = SDL_GetTicks() / 1000.0f;
+    m_prevCount = SDL_GetPerformanceCounter();
     m_deltaTime = 0.f;
     m_totalTime = 0.f;
 }
@@ -25,12 +25,12 @@ float Timer::totalTime()
 
 float Timer::tick()
 {
-    float curTime = SDL_GetTicks() / 1000.0f;
+    uint64_t curCount = SDL_GetPerformanceCounter();
 
-    m_deltaTime = curTime - m_prevTime;
+    m_deltaTime = float(double(curCount - m_prevCount) / double(SDL_GetPerformanceFrequency()));
     m_totalTime += m_deltaTime;
 
-    m_prevTime = curTime;
+    m_prevCount = curCount;
     return m_deltaTime;
 }
 
@@ -1,5 +1,9 @@
 #pragma once
+#include <stdint.h>
 
+/**
+* Measures time with the high-resolution performance counter.
+*/
 class Timer
 {
 public:
@@ -15,7 +19,7 @@ public:
     float deltaTime();
 
 private:
-    float m_prevTime;
+    uint64_t m_prevCount;
     float m_deltaTime;
     float m_totalTime;
 };
@@ -0,0 +1,221 @@
+#include "blockcompress.h"
+#include <cassert>
+#include <algorithm>
+#include <emmintrin.h>
+#include "Canvas.h"
+#include "parallel.h"
+
+namespace
+{
+    // Steps along the line from the second endpoint to the first, mapped to the index the GPU decodes to that color.
+    // BC1 decodes index 2 to 2/3 color0 + 1/3 color1 and index 3 to 1/3 color0 + 2/3 color1.
+    const uint8_t BC1_INDEX[4] = { 1, 3, 2, 0 };
+    // BC4 decodes index 2 to 6/7 alpha0 + 1/7 alpha1 ... index 7 to 1/7 alpha0 + 6/7 alpha1.
+    const uint8_t BC4_INDEX[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+    inline float horizontalMin(__m128 v)
+    {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    inline float horizontalMax(__m128 v)
+    {
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    void computeRange(const float* values, float& outMin, float& outMax)
+    {
+        __m128 minimum = _mm_loadu_ps(values);
+        __m128 maximum = minimum;
+        for (int i = 4; i < 16; i += 4)
+        {
+            __m128 v = _mm_loadu_ps(values + i);
+            minimum = _mm_min_ps(minimum, v);
+            maximum = _mm_max_ps(maximum, v);
+        }
+
+        outMin = horizontalMin(minimum);
+        outMax = horizontalMax(maximum);
+    }
+
+    uint16_t toRGB565(const float* color)
+    {
+        uint32_t r = uint32_t(color[0] * (31.0f / 255.0f) + 0.5f);
+        uint32_t g = uint32_t(color[1] * (63.0f / 255.0f) + 0.5f);
+        uint32_t b = uint32_t(color[2] * (31.0f / 255.0f) + 0.5f);
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    /**
+    * Expands the endpoint like the GPU does, the palette is interpolated between the expanded colors.
+    */
+    void fromRGB565(uint16_t color, float* outColor)
+    {
+        uint32_t r = (color >> 11) & 31;
+        uint32_t g = (color >> 5) & 63;
+        uint32_t b = color & 31;
+        outColor[0] = float((r << 3) | (r >> 2));
+        outColor[1] = float((g << 2) | (g >> 4));
+        outColor[2] = float((b << 3) | (b >> 2));
+    }
+
+    /**
+    * Gathers the 4x4 block at (x, y) into one plane of floats per channel.
+    */
+    void loadBlock(const Canvas& canvas, uint32_t x, uint32_t y, float outPlanes[4][16])
+    {
+        uint32_t channels = canvas.getChannels();
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            uint32_t py = std::min(y + row, canvas.getHeight() - 1);
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                const uint8_t* pixel = canvas.pixel(std::min(x + column, canvas.getWidth() - 1), py);
+                for (uint32_t c = 0; c < channels && c < 4; ++c)
+                    outPlanes[c][row * 4 + column] = pixel[c];
+            }
+        }
+    }
+}
+
+size_t blockcompress::getBlockSize(Format format)
+{
+    return format == Format::BC3 ? 16 : 8;
+}
+
+size_t blockcompress::getSize(Format format, uint32_t width, uint32_t height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+void blockcompress::compress(const Canvas& canvas, Format format, std::vector<uint8_t>& outData, size_t numThreads)
+{
+    assert(format == Format::BC4 || canvas.getChannels() >= (format == Format::BC3 ? 4u : 3u));
+
+    uint32_t blocksX = (canvas.getWidth() + 3) / 4;
+    uint32_t blocksY = (canvas.getHeight() + 3) / 4;
+    size_t blockSize = getBlockSize(format);
+    outData.resize(getSize(format, canvas.getWidth(), canvas.getHeight()));
+    if (canvas.empty())
+        return;
+
+    parallel::forRange(blocksY, [&](size_t begin, size_t end)
+    {
+        float planes[4][16];
+        for (size_t by = begin; by < end; ++by)
+        {
+            uint8_t* out = &outData[by * blocksX * blockSize];
+            for (uint32_t bx = 0; bx < blocksX; ++bx, out += blockSize)
+            {
+                loadBlock(canvas, bx * 4, uint32_t(by) * 4, planes);
+                switch (format)
+                {
+                case Format::BC1:
+                    encodeBC1(planes[0], planes[1], planes[2], out);
+                    break;
+                case Format::BC3:
+                    encodeBC4(planes[3], out);
+                    encodeBC1(planes[0], planes[1], planes[2], out + 8);
+                    break;
+                case Format::BC4:
+                    encodeBC4(planes[0], out);
+                    break;
+                }
+            }
+        }
+    }, numThreads);
+}
+
+void blockcompress::encodeBC1(const float* r, const float* g, const float* b, uint8_t* outBlock)
+{
+    // Endpoints from the bounding box, inset by 1/16 of its size so outliers pull them less
+    const float* planes[3] = { r, g, b };
+    float low[3], high[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        computeRange(planes[c], low[c], high[c]);
+        float inset = (high[c] - low[c]) / 16.0f;
+        low[c] += inset;
+        high[c] -= inset;
+    }
+
+    // Every channel of color0 is >= the one of color1, so color0 >= color1 and the block is in 4 color mode
+    // unless both are equal - then all indices are 0
+    uint16_t color0 = toRGB565(high);
+    uint16_t color1 = toRGB565(low);
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        float p0[3], p1[3];
+        fromRGB565(color0, p0);
+        fromRGB565(color1, p1);
+
+        float direction[3] = { p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2] };
+        float lengthSquared = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+
+        // Steps from color1 (0) to color0 (3) with SSE, 4 pixels at a time
+        const __m128 scale = _mm_set1_ps(3.0f / lengthSquared);
+        const __m128 maxStep = _mm_set1_ps(3.0f);
+        const __m128 zero = _mm_setzero_ps();
+        for (int i = 0; i < 16; i += 4)
+        {
+            __m128 dr = _mm_sub_ps(_mm_loadu_ps(r + i), _mm_set1_ps(p1[0]));
+            __m128 dg = _mm_sub_ps(_mm_loadu_ps(g + i), _mm_set1_ps(p1[1]));
+            __m128 db = _mm_sub_ps(_mm_loadu_ps(b + i), _mm_set1_ps(p1[2]));
+            __m128 t = _mm_mul_ps(dr, _mm_set1_ps(direction[0]));
+            t = _mm_add_ps(t, _mm_mul_ps(dg, _mm_set1_ps(direction[1])));
+            t = _mm_add_ps(t, _mm_mul_ps(db, _mm_set1_ps(direction[2])));
+            t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(t, scale), zero), maxStep);
+
+            int32_t steps[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(steps), _mm_cvtps_epi32(t));
+            for (int k = 0; k < 4; ++k)
+                indices |= uint32_t(BC1_INDEX[steps[k]]) << (2 * (i + k));
+        }
+    }
+
+    outBlock[0] = uint8_t(color0);
+    outBlock[1] = uint8_t(color0 >> 8);
+    outBlock[2] = uint8_t(color1);
+    outBlock[3] = uint8_t(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        outBlock[4 + i] = uint8_t(indices >> (8 * i));
+}
+
+void blockcompress::encodeBC4(const float* values, uint8_t* outBlock)
+{
+    // The exact range, alpha0 > alpha1 selects the mode with 6 interpolated values
+    float low, high;
+    computeRange(values, low, high);
+    uint8_t alpha0 = uint8_t(high + 0.5f);
+    uint8_t alpha1 = uint8_t(low + 0.5f);
+
+    uint64_t indices = 0;
+    if (alpha0 > alpha1)
+    {
+        const __m128 base = _mm_set1_ps(float(alpha1));
+        const __m128 scale = _mm_set1_ps(7.0f / float(alpha0 - alpha1));
+        const __m128 maxStep = _mm_set1_ps(7.0f);
+        const __m128 zero = _mm_setzero_ps();
+        for (int i = 0; i < 16; i += 4)
+        {
+            __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(values + i), base), scale);
+            t = _mm_min_ps(_mm_max_ps(t, zero), maxStep);
+
+            int32_t steps[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(steps), _mm_cvtps_epi32(t));
+            for (int k = 0; k < 4; ++k)
+                indices |= uint64_t(BC4_INDEX[steps[k]]) << (3 * (i + k));
+        }
+    }
+
+    outBlock[0] = alpha0;
+    outBlock[1] = alpha1;
+    for (int i = 0; i < 6; ++i)
+        outBlock[2 + i] = uint8_t(indices >> (8 * i));
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+class Canvas;
+
+/**
+* Block compression of canvases into the GPU formats of S3TC/RGTC. Every 4x4 block of pixels is encoded on its own,
+* blocks at the right and top edges of sizes that are not a multiple of 4 repeat the last column/row.
+*
+* The encoders fit the endpoints to the bounding box of the block (inset by 1/16 against outliers) and project
+* the pixels onto the line between them with SSE. That is far faster than a search for the best endpoints
+* and close in quality for photos and painted textures.
+*/
+namespace blockcompress
+{
+    enum class Format
+    {
+        BC1, // RGB, 8 bytes per block (DXT1)
+        BC3, // RGBA, a BC4 block for the alpha followed by a BC1 block for the color, 16 bytes per block (DXT5)
+        BC4  // the first channel, 8 bytes per block (RGTC1)
+    };
+
+    size_t getBlockSize(Format format);
+
+    /**
+    * Bytes of a compressed image of the given size.
+    */
+    size_t getSize(Format format, uint32_t width, uint32_t height);
+
+    /**
+    * Compresses the canvas into outData in block row order. BC1 needs 3 channels or more, BC3 needs 4.
+    * Block rows are split over numThreads threads (0 = all cores).
+    */
+    void compress(const Canvas& canvas, Format format, std::vector<uint8_t>& outData, size_t numThreads = 0);
+
+    /**
+    * Encode one block of 16 pixels given as planes of floats in [0, 255], row by row.
+    */
+    void encodeBC1(const float* r, const float* g, const float* b, uint8_t* outBlock);
+    void encodeBC4(const float* values, uint8_t* outBlock);
+}
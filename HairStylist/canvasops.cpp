@@ -0,0 +1,475 @@
+#include "canvasops.h"
+#include "Canvas.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+namespace
+{
+    // Fraction bits of the blend accumulator and the fixed point weight for 1.0
+    const int BLEND_SHIFT = 5;
+    const int BLEND_WEIGHT_ONE = 1 << 14;
+
+    // 48 bytes are a multiple of 16 (SSE register) and of every channel count up to 4,
+    // so the per byte weight pattern repeats every block
+    const size_t BLEND_BLOCK = 48;
+
+    struct PreparedLayer
+    {
+        const uint8_t* pixels;
+        const uint8_t* mask;
+        int16_t weights[BLEND_BLOCK];
+    };
+
+    /**
+    * Blends the bytes [begin, end) of the canvases. begin has to be a multiple of BLEND_BLOCK.
+    * The scalar tail uses the same arithmetic as the SSE2 loop so results do not depend on the range split.
+    */
+    void blendRange(const uint8_t* base, const std::vector<PreparedLayer>& layers, uint8_t* out, size_t begin, size_t end)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(1 << (BLEND_SHIFT - 1));
+
+        size_t i = begin;
+        for (; i + BLEND_BLOCK <= end; i += BLEND_BLOCK)
+        {
+            for (size_t v = 0; v < BLEND_BLOCK; v += 16)
+            {
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i + v));
+                __m128i baseLo = _mm_unpacklo_epi8(b, zero);
+                __m128i baseHi = _mm_unpackhi_epi8(b, zero);
+                __m128i accLo = _mm_slli_epi16(baseLo, BLEND_SHIFT);
+                __m128i accHi = _mm_slli_epi16(baseHi, BLEND_SHIFT);
+
+                for (const PreparedLayer& layer : layers)
+                {
+                    __m128i weightLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer.weights + v));
+                    __m128i weightHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer.weights + v + 8));
+                    if (layer.mask)
+                    {
+                        // Unpacking a byte with itself gives m * 257, so the high half of the product is ~weight * m / 255
+                        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer.mask + i + v));
+                        weightLo = _mm_mulhi_epu16(_mm_unpacklo_epi8(m, m), weightLo);
+                        weightHi = _mm_mulhi_epu16(_mm_unpackhi_epi8(m, m), weightHi);
+                    }
+
+                    // (delta << 7) * weight(1.0 = 1 << 14) >> 16 = delta * weight in BLEND_SHIFT fixed point
+                    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer.pixels + i + v));
+                    __m128i deltaLo = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(l, zero), baseLo), 7);
+                    __m128i deltaHi = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(l, zero), baseHi), 7);
+                    accLo = _mm_adds_epi16(accLo, _mm_mulhi_epi16(deltaLo, weightLo));
+                    accHi = _mm_adds_epi16(accHi, _mm_mulhi_epi16(deltaHi, weightHi));
+                }
+
+                accLo = _mm_srai_epi16(_mm_adds_epi16(accLo, round), BLEND_SHIFT);
+                accHi = _mm_srai_epi16(_mm_adds_epi16(accHi, round), BLEND_SHIFT);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + v), _mm_packus_epi16(accLo, accHi));
+            }
+        }
+
+        for (; i < end; ++i)
+        {
+            int acc = base[i] << BLEND_SHIFT;
+            for (const PreparedLayer& layer : layers)
+            {
+                int weight = layer.weights[i % BLEND_BLOCK];
+                if (layer.mask)
+                    weight = (layer.mask[i] * 257 * weight) >> 16;
+
+                acc += ((layer.pixels[i] - base[i]) * 128 * weight) >> 16;
+            }
+
+            out[i] = uint8_t(std::min(255, std::max(0, (acc + (1 << (BLEND_SHIFT - 1))) >> BLEND_SHIFT)));
+        }
+    }
+
+    /**
+    * blendRange() for a single layer, the common case of transitions and variations. The weights stay in
+    * registers and there is no loop over the layers. A single layer cannot saturate the accumulator, so the
+    * rounding is added up front with plain adds. Results are identical to blendRange().
+    */
+    template <bool MASKED>
+    void blendRangeSingle(const uint8_t* base, const PreparedLayer& layer, uint8_t* out, size_t begin, size_t end)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(1 << (BLEND_SHIFT - 1));
+
+        __m128i weights[BLEND_BLOCK / 8];
+        for (size_t k = 0; k < BLEND_BLOCK / 8; ++k)
+            weights[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer.weights + 8 * k));
+
+        size_t i = begin;
+        for (; i + BLEND_BLOCK <= end; i += BLEND_BLOCK)
+        {
+            for (size_t v = 0; v < BLEND_BLOCK / 16; ++v)
+            {
+                size_t offset = i + v * 16;
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + offset));
+                __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer.pixels + offset));
+                __m128i baseLo = _mm_unpacklo_epi8(b, zero);
+                __m128i baseHi = _mm_unpackhi_epi8(b, zero);
+
+                __m128i weightLo = weights[2 * v];
+                __m128i weightHi = weights[2 * v + 1];
+                if (MASKED)
+                {
+                    __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layer.mask + offset));
+                    weightLo = _mm_mulhi_epu16(_mm_unpacklo_epi8(m, m), weightLo);
+                    weightHi = _mm_mulhi_epu16(_mm_unpackhi_epi8(m, m), weightHi);
+                }
+
+                __m128i deltaLo = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(l, zero), baseLo), 7);
+                __m128i deltaHi = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(l, zero), baseHi), 7);
+                __m128i accLo = _mm_add_epi16(_mm_slli_epi16(baseLo, BLEND_SHIFT), round);
+                __m128i accHi = _mm_add_epi16(_mm_slli_epi16(baseHi, BLEND_SHIFT), round);
+                accLo = _mm_srai_epi16(_mm_add_epi16(accLo, _mm_mulhi_epi16(deltaLo, weightLo)), BLEND_SHIFT);
+                accHi = _mm_srai_epi16(_mm_add_epi16(accHi, _mm_mulhi_epi16(deltaHi, weightHi)), BLEND_SHIFT);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), _mm_packus_epi16(accLo, accHi));
+            }
+        }
+
+        if (i < end)
+            blendRange(base, std::vector<PreparedLayer>(1, layer), out, i, end);
+    }
+}
+
+namespace
+{
+    /**
+    * Source window and normalized weights of every destination pixel along one axis.
+    */
+    struct FilterTaps
+    {
+        int maxTaps{ 0 };
+        std::vector<int> start;
+        std::vector<int> count;
+        std::vector<float> weights;
+    };
+
+    float triangle(float x)
+    {
+        x = std::abs(x);
+        return x < 1.0f ? 1.0f - x : 0.0f;
+    }
+
+    // Catmull-Rom (a = -0.5)
+    float cubic(float x)
+    {
+        const float a = -0.5f;
+        x = std::abs(x);
+        if (x < 1.0f)
+            return ((a + 2.0f) * x - (a + 3.0f)) * x * x + 1.0f;
+        if (x < 2.0f)
+            return (((x - 5.0f) * x + 8.0f) * x - 4.0f) * a;
+        return 0.0f;
+    }
+
+    void computeTaps(uint32_t srcSize, uint32_t dstSize, canvasops::Filter filter, FilterTaps& outTaps)
+    {
+        float (*kernel)(float) = filter == canvasops::Filter::Bicubic ? cubic : triangle;
+        float kernelSupport = filter == canvasops::Filter::Bicubic ? 2.0f : 1.0f;
+
+        // Widen the kernel when shrinking so every source pixel contributes
+        float scale = float(srcSize) / dstSize;
+        float filterScale = std::max(1.0f, scale);
+        float support = kernelSupport * filterScale;
+
+        outTaps.maxTaps = int(std::ceil(support)) * 2 + 1;
+        outTaps.start.resize(dstSize);
+        outTaps.count.resize(dstSize);
+        outTaps.weights.assign(size_t(dstSize) * outTaps.maxTaps, 0.0f);
+
+        for (uint32_t i = 0; i < dstSize; ++i)
+        {
+            // Pixel centers
+            float center = (i + 0.5f) * scale;
+            int first = std::max(0, int(center - support + 0.5f));
+            int last = std::min(int(srcSize), int(center + support + 0.5f));
+            int count = std::min(outTaps.maxTaps, std::max(1, last - first));
+            first = std::min(first, int(srcSize) - count);
+
+            float* weights = &outTaps.weights[size_t(i) * outTaps.maxTaps];
+            float sum = 0.0f;
+            for (int k = 0; k < count; ++k)
+            {
+                weights[k] = kernel((first + k + 0.5f - center) / filterScale);
+                sum += weights[k];
+            }
+
+            for (int k = 0; k < count; ++k)
+                weights[k] = sum != 0.0f ? weights[k] / sum : (k == 0 ? 1.0f : 0.0f);
+
+            outTaps.start[i] = first;
+            outTaps.count[i] = count;
+        }
+    }
+}
+
+canvasops::BlendLayer::BlendLayer(const Canvas* canvas, float weight, const Canvas* mask)
+    :canvas(canvas), mask(mask)
+{
+    for (uint32_t c = 0; c < MAX_CHANNELS; ++c)
+        weights[c] = weight;
+}
+
+bool canvasops::blend(const Canvas& base, const std::vector<BlendLayer>& layers, Canvas& outCanvas, size_t numThreads)
+{
+    auto sameLayout = [&base](const Canvas& canvas)
+    {
+        return canvas.getWidth() == base.getWidth() && canvas.getHeight() == base.getHeight() &&
+               canvas.getChannels() == base.getChannels();
+    };
+
+    if (base.getChannels() > MAX_CHANNELS)
+        return false;
+
+    std::vector<PreparedLayer> prepared;
+    for (const BlendLayer& layer : layers)
+    {
+        if (!layer.canvas || !sameLayout(*layer.canvas) || (layer.mask && !sameLayout(*layer.mask)))
+            return false;
+
+        PreparedLayer p;
+        p.pixels = layer.canvas->data();
+        p.mask = layer.mask ? layer.mask->data() : nullptr;
+
+        bool anyWeight = false;
+        for (size_t i = 0; i < BLEND_BLOCK; ++i)
+        {
+            float weight = std::min(1.0f, std::max(0.0f, layer.weights[i % base.getChannels()]));
+            p.weights[i] = int16_t(weight * BLEND_WEIGHT_ONE + 0.5f);
+            anyWeight = anyWeight || p.weights[i] != 0;
+        }
+
+        if (anyWeight)
+            prepared.push_back(p);
+    }
+
+    if (&outCanvas != &base && !sameLayout(outCanvas))
+        outCanvas.resize(base.getWidth(), base.getHeight(), base.getChannels());
+
+    size_t size = base.getSize();
+    size_t numBlocks = size / BLEND_BLOCK;
+    if (numBlocks == 0)
+    {
+        blendRange(base.data(), prepared, outCanvas.data(), 0, size);
+        return true;
+    }
+
+    parallel::forRange(numBlocks, [&](size_t begin, size_t end)
+    {
+        size_t first = begin * BLEND_BLOCK;
+        size_t last = end == numBlocks ? size : end * BLEND_BLOCK;
+        if (prepared.size() != 1)
+            blendRange(base.data(), prepared, outCanvas.data(), first, last);
+        else if (prepared[0].mask)
+            blendRangeSingle<true>(base.data(), prepared[0], outCanvas.data(), first, last);
+        else
+            blendRangeSingle<false>(base.data(), prepared[0], outCanvas.data(), first, last);
+    }, numThreads);
+
+    return true;
+}
+
+void canvasops::downsample(const Canvas& src, Canvas& dst)
+{
+    uint32_t channels = src.getChannels();
+    uint32_t srcWidth = src.getWidth();
+    uint32_t srcHeight = src.getHeight();
+    dst.resize(std::max(1u, srcWidth / 2), std::max(1u, srcHeight / 2), channels);
+    if (src.empty())
+        return;
+
+    // Vertical pairs are summed with SSE2 into 16 bit row sums, horizontal pairs are combined per channel
+    size_t rowSize = src.getRowSize();
+    std::vector<uint16_t> rowSums(rowSize);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (uint32_t y = 0; y < dst.getHeight(); ++y)
+    {
+        const uint8_t* row0 = src.pixel(0, std::min(2 * y, srcHeight - 1));
+        const uint8_t* row1 = src.pixel(0, std::min(2 * y + 1, srcHeight - 1));
+
+        size_t i = 0;
+        for (; i + 16 <= rowSize; i += 16)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&rowSums[i]), _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&rowSums[i + 8]), _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+        }
+
+        for (; i < rowSize; ++i)
+            rowSums[i] = uint16_t(row0[i] + row1[i]);
+
+        uint8_t* out = dst.pixel(0, y);
+        for (uint32_t x = 0; x < dst.getWidth(); ++x, out += channels)
+        {
+            const uint16_t* sum0 = &rowSums[size_t(std::min(2 * x, srcWidth - 1)) * channels];
+            const uint16_t* sum1 = &rowSums[size_t(std::min(2 * x + 1, srcWidth - 1)) * channels];
+            for (uint32_t c = 0; c < channels; ++c)
+                out[c] = uint8_t((sum0[c] + sum1[c] + 2) >> 2);
+        }
+    }
+}
+
+void canvasops::resample(const Canvas& src, Canvas& dst, Filter filter, size_t numThreads)
+{
+    assert(src.getChannels() == dst.getChannels() && src.getChannels() <= MAX_CHANNELS);
+    if (src.empty() || dst.empty())
+        return;
+
+    uint32_t channels = src.getChannels();
+    FilterTaps columns, rows;
+    computeTaps(src.getWidth(), dst.getWidth(), filter, columns);
+    computeTaps(src.getHeight(), dst.getHeight(), filter, rows);
+
+    // Horizontal pass into float rows. Rows are padded so 4 floats can be loaded/stored at every pixel.
+    size_t srcRowFloats = src.getRowSize() + 4;
+    size_t dstRowFloats = dst.getRowSize() + 4;
+    std::vector<float> horizontal(src.getHeight() * dstRowFloats);
+
+    parallel::forRange(src.getHeight(), [&](size_t begin, size_t end)
+    {
+        std::vector<float> srcRow(srcRowFloats, 0.0f);
+        for (size_t y = begin; y < end; ++y)
+        {
+            const uint8_t* in = src.pixel(0, uint32_t(y));
+            for (size_t i = 0; i < src.getRowSize(); ++i)
+                srcRow[i] = in[i];
+
+            float* out = &horizontal[y * dstRowFloats];
+            for (uint32_t x = 0; x < dst.getWidth(); ++x)
+            {
+                const float* weights = &columns.weights[x * columns.maxTaps];
+                const float* pixel = &srcRow[size_t(columns.start[x]) * channels];
+
+                // All channels of a pixel at once - the lanes beyond the channel count are overwritten by the next pixel
+                __m128 acc = _mm_setzero_ps();
+                for (int k = 0; k < columns.count[x]; ++k, pixel += channels)
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(pixel), _mm_set1_ps(weights[k])));
+
+                _mm_storeu_ps(out + size_t(x) * channels, acc);
+            }
+        }
+    }, numThreads);
+
+    // Vertical pass: the same weights apply to a whole row, 16 bytes at a time
+    size_t rowSize = dst.getRowSize();
+    parallel::forRange(dst.getHeight(), [&](size_t begin, size_t end)
+    {
+        for (size_t y = begin; y < end; ++y)
+        {
+            const float* weights = &rows.weights[y * rows.maxTaps];
+            const float* first = &horizontal[size_t(rows.start[y]) * dstRowFloats];
+            uint8_t* out = dst.pixel(0, uint32_t(y));
+
+            size_t i = 0;
+            for (; i + 16 <= rowSize; i += 16)
+            {
+                __m128 acc[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+                const float* row = first + i;
+                for (int k = 0; k < rows.count[y]; ++k, row += dstRowFloats)
+                {
+                    __m128 weight = _mm_set1_ps(weights[k]);
+                    for (int v = 0; v < 4; ++v)
+                        acc[v] = _mm_add_ps(acc[v], _mm_mul_ps(_mm_loadu_ps(row + v * 4), weight));
+                }
+
+                __m128i lo = _mm_packs_epi32(_mm_cvtps_epi32(acc[0]), _mm_cvtps_epi32(acc[1]));
+                __m128i hi = _mm_packs_epi32(_mm_cvtps_epi32(acc[2]), _mm_cvtps_epi32(acc[3]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+            }
+
+            for (; i < rowSize; ++i)
+            {
+                float acc = 0.0f;
+                const float* row = first + i;
+                for (int k = 0; k < rows.count[y]; ++k, row += dstRowFloats)
+                    acc += *row * weights[k];
+
+                out[i] = uint8_t(std::min(255.0f, std::max(0.0f, acc + 0.5f)));
+            }
+        }
+    }, numThreads);
+}
+
+bool canvasops::diff(const Canvas& a, const Canvas& b, DiffResult& outResult)
+{
+    outResult = DiffResult();
+    memset(outResult.maxAbsDiff, 0, sizeof(outResult.maxAbsDiff));
+    memset(outResult.meanAbsDiff, 0, sizeof(outResult.meanAbsDiff));
+
+    if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight() || a.getChannels() != b.getChannels())
+        return false;
+
+    uint32_t channels = std::min(a.getChannels(), MAX_CHANNELS);
+    uint64_t sums[MAX_CHANNELS] = {};
+    size_t numPixels = size_t(a.getWidth()) * a.getHeight();
+    const uint8_t* pa = a.data();
+    const uint8_t* pb = b.data();
+
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+        bool different = false;
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            uint8_t d = uint8_t(std::abs(int(pa[c]) - int(pb[c])));
+            sums[c] += d;
+            outResult.maxAbsDiff[c] = std::max(outResult.maxAbsDiff[c], d);
+            different = different || d != 0;
+        }
+
+        if (different)
+            ++outResult.differentPixels;
+
+        pa += a.getChannels();
+        pb += b.getChannels();
+    }
+
+    for (uint32_t c = 0; c < channels; ++c)
+        outResult.meanAbsDiff[c] = numPixels > 0 ? double(sums[c]) / numPixels : 0.0;
+
+    return true;
+}
+
+void canvasops::computeStats(const Canvas& canvas, Stats& outStats)
+{
+    outStats = Stats();
+    outStats.channels = std::min(canvas.getChannels(), MAX_CHANNELS);
+
+    uint64_t histograms[MAX_CHANNELS][256] = {};
+    size_t numPixels = size_t(canvas.getWidth()) * canvas.getHeight();
+    const uint8_t* p = canvas.data();
+    for (size_t i = 0; i < numPixels; ++i, p += canvas.getChannels())
+        for (uint32_t c = 0; c < outStats.channels; ++c)
+            ++histograms[c][p[c]];
+
+    for (uint32_t c = 0; c < outStats.channels; ++c)
+    {
+        ChannelStats& stats = outStats.channel[c];
+        memset(stats.histogram, 0, sizeof(stats.histogram));
+
+        uint64_t sum = 0;
+        for (uint32_t v = 0; v < 256; ++v)
+        {
+            uint64_t count = histograms[c][v];
+            if (count == 0)
+                continue;
+
+            stats.min = std::min(stats.min, uint8_t(v));
+            stats.max = std::max(stats.max, uint8_t(v));
+            stats.histogram[v * HISTOGRAM_BINS / 256] += count;
+            sum += count * v;
+        }
+
+        if (numPixels > 0)
+        {
+            stats.mean = double(sum) / numPixels;
+            stats.coverage = double(numPixels - histograms[c][0]) / numPixels;
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+class Canvas;
+
+/**
+* CPU image operations on canvases.
+*/
+namespace canvasops
+{
+    const uint32_t HISTOGRAM_BINS = 16;
+    const uint32_t MAX_CHANNELS = 4;
+
+    enum class Filter
+    {
+        Bilinear,
+        Bicubic
+    };
+
+    struct ChannelStats
+    {
+        uint8_t min{ 255 };
+        uint8_t max{ 0 };
+        double mean{ 0.0 };
+
+        // Fraction of pixels with a value > 0 - for the red channel this is the area where hair grows
+        double coverage{ 0.0 };
+        uint64_t histogram[HISTOGRAM_BINS];
+    };
+
+    struct Stats
+    {
+        uint32_t channels{ 0 };
+        ChannelStats channel[MAX_CHANNELS];
+    };
+
+    struct DiffResult
+    {
+        size_t differentPixels{ 0 };
+        uint8_t maxAbsDiff[MAX_CHANNELS];
+        double meanAbsDiff[MAX_CHANNELS];
+    };
+
+    /**
+    * One input of blend(). The blend moves from the base canvas towards this canvas by weights[c] per channel.
+    * An optional mask with the same size and channel count as the canvas scales the weights per pixel and channel
+    * (255 = full weight), e.g. to morph only the hair length inside a painted region.
+    */
+    struct BlendLayer
+    {
+        BlendLayer(const Canvas* canvas = nullptr, float weight = 0.0f, const Canvas* mask = nullptr);
+
+        const Canvas* canvas;
+        const Canvas* mask;
+
+        // Clamped to [0, 1]
+        float weights[MAX_CHANNELS];
+    };
+
+    /**
+    * Computes out = base + sum(weight * mask * (layer - base)) over all layers with SSE2 in 8.5 fixed point.
+    * With weights summing up to at most 1 per channel this is a convex combination of the base and the layers.
+    * All canvases must have the same size and channel count (returns false otherwise). outCanvas is resized
+    * and may be the base canvas. Rows are split over numThreads threads (0 = all cores).
+    */
+    bool blend(const Canvas& base, const std::vector<BlendLayer>& layers, Canvas& outCanvas, size_t numThreads = 0);
+
+    /**
+    * Halves the canvas with a 2x2 box filter. dst is resized to max(1, width / 2) x max(1, height / 2),
+    * so the last row/column of odd sized canvases is dropped.
+    */
+    void downsample(const Canvas& src, Canvas& dst);
+
+    /**
+    * Resamples src to the size of dst. dst has to be allocated with the same channel count.
+    * The filter is separable and widened by the scale factor when shrinking, so downsampling does not alias.
+    * Both passes use SSE2 and rows are split over numThreads threads (0 = all cores).
+    */
+    void resample(const Canvas& src, Canvas& dst, Filter filter = Filter::Bilinear, size_t numThreads = 0);
+
+    /**
+    * Compares two canvases pixel by pixel. Returns false if their sizes differ.
+    */
+    bool diff(const Canvas& a, const Canvas& b, DiffResult& outResult);
+
+    void computeStats(const Canvas& canvas, Stats& outStats);
+}
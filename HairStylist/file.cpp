@@ -4,6 +4,16 @@
 #include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <cstdio>
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#endif
 
 std::string file::readAsString(const std::string& path)
 {
@@ -25,13 +35,6 @@ std::string file::readAsString(const std::string& path)
     return fileAsString;
 }
 
-void file::loadRawBuffer(const std::string& path, std::vector<char>& outBuffer, uint32_t& outNumValues)
-{
-    std::ifstream input(path, std::ios::binary);
-    outBuffer = { std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>() };
-    outNumValues = *reinterpret_cast<uint32_t*>(&outBuffer[0]);
-}
-
 bool file::exists(const std::string& filename)
 {
     struct stat buffer;
@@ -43,3 +46,84 @@ size_t file::getSize(const std::string& filename)
     struct stat buffer;
     return stat(filename.c_str(), &buffer) == 0 ? buffer.st_size : 0;
 }
+
+int64_t file::getModificationTime(const std::string& filename)
+{
+    struct stat buffer;
+    return stat(filename.c_str(), &buffer) == 0 ? int64_t(buffer.st_mtime) : 0;
+}
+
+bool file::createDirectory(const std::string& path)
+{
+    if (path.empty() || exists(path))
+        return true;
+
+    size_t parentEnd = path.find_last_of("/\\");
+    if (parentEnd != std::string::npos && parentEnd > 0)
+        createDirectory(path.substr(0, parentEnd));
+
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0;
+#else
+    return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+bool file::remove(const std::string& filename)
+{
+    return std::remove(filename.c_str()) == 0;
+}
+
+bool file::replace(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    // rename() fails on Windows if the target exists
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+std::vector<std::string> file::listFiles(const std::string& directory, const std::string& extension)
+{
+    std::vector<std::string> names;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE handle = FindFirstFileA((directory + "/*" + extension).c_str(), &findData);
+    if (handle != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                names.push_back(findData.cFileName);
+        } while (FindNextFileA(handle, &findData));
+
+        FindClose(handle);
+    }
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (dir)
+    {
+        while (dirent* entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name.size() >= extension.size() &&
+                name.compare(name.size() - extension.size(), extension.size(), extension) == 0 &&
+                !isDirectory(directory + "/" + name))
+                names.push_back(name);
+        }
+
+        closedir(dir);
+    }
+#endif
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+bool file::isDirectory(const std::string& path)
+{
+    struct stat buffer;
+    return stat(path.c_str(), &buffer) == 0 && (buffer.st_mode & S_IFMT) == S_IFDIR;
+}
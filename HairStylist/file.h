@@ -6,8 +6,34 @@
 namespace file
 {
     std::string readAsString(const std::string& path);
-    void loadRawBuffer(const std::string& path, std::vector<char>& outBuffer, uint32_t& outNumValues);
 
     bool exists(const std::string& filename);
     size_t getSize(const std::string& filename);
+
+    /**
+    * Seconds since the epoch of the last write, 0 if the file does not exist.
+    */
+    int64_t getModificationTime(const std::string& filename);
+
+    /**
+    * Creates the directory and missing parent directories.
+    * Returns true if the directory exists afterwards.
+    */
+    bool createDirectory(const std::string& path);
+
+    bool remove(const std::string& filename);
+
+    /**
+    * Renames from to to, replacing an existing file in one step. Readers see either the old or the new file,
+    * so writing a temporary file and replacing the target with it never leaves a half written target.
+    */
+    bool replace(const std::string& from, const std::string& to);
+
+    /**
+    * Returns the names (not paths) of all files in the directory ending with the given extension (e.g. ".style").
+    * The names are sorted alphabetically.
+    */
+    std::vector<std::string> listFiles(const std::string& directory, const std::string& extension = "");
+
+    bool isDirectory(const std::string& path);
 }
@@ -0,0 +1,99 @@
+#include "hash.h"
+#include <cstring>
+
+namespace
+{
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+    inline uint64_t rotl(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+
+    inline uint64_t mix(uint64_t h, uint64_t v)
+    {
+        h ^= rotl(v * PRIME2, 31) * PRIME1;
+        return rotl(h, 27) * PRIME1 + PRIME2;
+    }
+
+    // Final avalanche - see MurmurHash3 fmix64
+    inline uint64_t finalize(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+}
+
+uint64_t hash::compute(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+
+    // 4 independent lanes to keep the multipliers busy
+    uint64_t lanes[4] = { seed + PRIME1, seed + PRIME2, seed, seed - PRIME1 };
+    while (end - p >= 32)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            uint64_t v;
+            memcpy(&v, p + i * 8, 8);
+            lanes[i] = mix(lanes[i], v);
+        }
+        p += 32;
+    }
+
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + uint64_t(size);
+
+    while (end - p >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        h = mix(h, v);
+        p += 8;
+    }
+
+    while (p < end)
+        h = mix(h, *p++);
+
+    return finalize(h);
+}
+
+std::string hash::toHex(uint64_t hash)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result(16, '0');
+    for (int i = 15; i >= 0; --i)
+    {
+        result[i] = digits[hash & 0xF];
+        hash >>= 4;
+    }
+
+    return result;
+}
+
+bool hash::fromHex(const std::string& hex, uint64_t& outHash)
+{
+    if (hex.empty() || hex.size() > 16)
+        return false;
+
+    uint64_t result = 0;
+    for (char c : hex)
+    {
+        uint64_t digit;
+        if (c >= '0' && c <= '9')
+            digit = uint64_t(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            digit = uint64_t(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            digit = uint64_t(c - 'A' + 10);
+        else
+            return false;
+
+        result = (result << 4) | digit;
+    }
+
+    outHash = result;
+    return true;
+}
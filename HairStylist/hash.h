@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+
+namespace hash
+{
+    /**
+    * Fast non-cryptographic 64 bit hash.
+    * Used to content address data (e.g. canvas tiles), not suitable for security purposes.
+    */
+    uint64_t compute(const void* data, size_t size, uint64_t seed = 0);
+
+    /**
+    * Returns the hash as fixed width (16 digits) lowercase hex string.
+    */
+    std::string toHex(uint64_t hash);
+
+    /**
+    * Parses a string written by toHex(). Returns false unless it consists of 1 to 16 hex digits.
+    */
+    bool fromHex(const std::string& hex, uint64_t& outHash);
+}
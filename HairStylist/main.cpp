@@ -1,9 +1,140 @@
 #include "Application.h"
+#include "HeadlessContext.h"
+#include "Profiler.h"
+#include "QualityGovernor.h"
+#include "Logger.h"
+#include "file.h"
+#include "parallel.h"
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <numeric>
+#include <vector>
 
-int main(int, char**)
+/**
+* Renders presets to images and/or runs the frame rate benchmark without a window.
+* Every thread renders with its own context, presets are split between them.
+* Offscreen frames do not adapt the quality, "auto" renders at the initial profile.
+*/
+static int runHeadless(HeadlessContext::Backend backend, int width, int height, uint32_t canvasSize,
+                       const std::string& quality, const std::string& renderDir, uint32_t benchmarkFrames, size_t numThreads)
 {
-    std::unique_ptr<Application> application = std::make_unique<Application>("Hairstylist", 1000, 500);
-    application->run();
+    if (!renderDir.empty() && !file::createDirectory(renderDir))
+    {
+        ERROR("Could not create " << renderDir);
+        return 1;
+    }
+
+    std::vector<char> valid(numThreads, 0);
+    std::vector<size_t> written(numThreads, 0);
+    std::vector<float> fps(numThreads, 0.f);
+    parallel::forEach(numThreads, [&](size_t t)
+    {
+        Application application(backend, width, height, canvasSize);
+        if (!application.isValid())
+            return;
+
+        valid[t] = 1;
+        application.setQuality(quality);
+        if (!renderDir.empty())
+            written[t] = application.renderPresets(t, numThreads, renderDir);
+        if (benchmarkFrames > 0)
+            fps[t] = application.benchmark(benchmarkFrames);
+    }, numThreads);
+
+    if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+        return 1;
+
+    if (!renderDir.empty())
+        LOG("Rendered " << std::accumulate(written.begin(), written.end(), size_t(0)) << " presets to " << renderDir);
+
+    if (benchmarkFrames > 0)
+    {
+        for (size_t t = 0; t < numThreads; ++t)
+            LOG("Context " << t << ": " << fps[t] << " FPS");
+        LOG(width << "x" << height << " with " << numThreads << " contexts: "
+            << std::accumulate(fps.begin(), fps.end(), 0.f) << " FPS");
+    }
 
     return 0;
 }
+
+int main(int argc, char** argv)
+{
+    uint32_t canvasSize = 1024;
+    bool headless = false;
+    HeadlessContext::Backend backend = HeadlessContext::Backend::EGL;
+    int width = 1024;
+    int height = 1024;
+    std::string renderDir;
+    uint32_t benchmarkFrames = 0;
+    size_t numThreads = 1;
+    bool continuous = false;
+    std::string quality = "auto";
+    std::string tracePath;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--continuous") == 0)
+            continuous = true;
+        else if (i + 1 == argc)
+            break; // the other options take a value
+        else if (strcmp(argv[i], "--canvas-size") == 0)
+            canvasSize = std::max(64, std::min(8192, atoi(argv[++i])));
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+            if (!HeadlessContext::parseBackend(argv[++i], backend))
+            {
+                ERROR("Unknown headless backend " << argv[i] << ", use egl or osmesa.");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--size") == 0)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                ERROR("Invalid size " << argv[i] << ", use <width>x<height>.");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--render-presets") == 0)
+            renderDir = argv[++i];
+        else if (strcmp(argv[i], "--benchmark") == 0)
+            benchmarkFrames = uint32_t(std::max(1, atoi(argv[++i])));
+        else if (strcmp(argv[i], "--threads") == 0)
+            numThreads = size_t(std::max(1, atoi(argv[++i])));
+        else if (strcmp(argv[i], "--quality") == 0)
+            quality = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0)
+            tracePath = argv[++i];
+    }
+
+    // Checked before any window or context is created
+    if (quality != "auto" && QualityGovernor::findProfile(quality) < 0)
+    {
+        ERROR("Unknown quality " << quality << ", use auto or a profile such as High or Low.");
+        return 1;
+    }
+
+    // The trace covers the whole run, it is written at the end
+    if (!tracePath.empty())
+        Profiler::enable();
+
+    int result = 0;
+    if (headless)
+        result = runHeadless(backend, width, height, canvasSize, quality, renderDir, benchmarkFrames, numThreads);
+    else
+    {
+        std::unique_ptr<Application> application = std::make_unique<Application>("Hairstylist", 1000, 500, canvasSize);
+        application->setContinuousRendering(continuous);
+        application->setQuality(quality);
+        application->run();
+    }
+
+    if (!tracePath.empty() && !Profiler::writeTrace(tracePath))
+        result = 1;
+
+    return result;
+}
@@ -0,0 +1,1017 @@
+#include "meshimport.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "RawMesh.h"
+#include "Logger.h"
+#include "parallel.h"
+
+namespace
+{
+    const uint32_t NONE = ~0u;
+
+    /**
+    * A triangle corner: indices into the position, texture coordinate and normal arrays (NONE if not specified).
+    */
+    struct Corner
+    {
+        uint32_t position;
+        uint32_t texCoord;
+        uint32_t normal;
+
+        bool operator==(const Corner& other) const
+        {
+            return position == other.position && texCoord == other.texCoord && normal == other.normal;
+        }
+    };
+
+    /**
+    * Separately indexed attributes as read from the file, triangulated.
+    */
+    struct Geometry
+    {
+        std::vector<float> positions;
+        std::vector<float> texCoords;
+        std::vector<float> normals;
+        std::vector<Corner> corners;
+    };
+
+    /**
+    * Triangles adjacent to every key (e.g. vertex) in compressed row form:
+    * the triangles of key k are triangles[offsets[k]] .. triangles[offsets[k + 1] - 1].
+    */
+    struct Adjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+    };
+
+    void buildAdjacency(const uint32_t* cornerKeys, size_t cornerCount, size_t keyCount, Adjacency& outAdjacency)
+    {
+        outAdjacency.offsets.assign(keyCount + 1, 0);
+        for (size_t i = 0; i < cornerCount; ++i)
+            ++outAdjacency.offsets[cornerKeys[i] + 1];
+
+        for (size_t k = 0; k < keyCount; ++k)
+            outAdjacency.offsets[k + 1] += outAdjacency.offsets[k];
+
+        outAdjacency.triangles.resize(cornerCount);
+        std::vector<uint32_t> fill(outAdjacency.offsets.begin(), outAdjacency.offsets.end() - 1);
+        for (size_t i = 0; i < cornerCount; ++i)
+            outAdjacency.triangles[fill[cornerKeys[i]]++] = uint32_t(i / 3);
+    }
+
+    glm::vec3 perpendicular(const glm::vec3& n)
+    {
+        return glm::normalize(std::abs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+
+    /**
+    * Deduplicates the corners into vertices, generates missing normals and the tangent frames.
+    */
+    bool build(const Geometry& geometry, bool generateNormals, meshimport::ImportedMesh& outMesh, size_t numThreads)
+    {
+        const std::vector<Corner>& corners = geometry.corners;
+        if (corners.empty())
+        {
+            ERROR("The mesh has no triangles.");
+            return false;
+        }
+
+        // Open addressing hash table from corner to vertex index
+        size_t capacity = 16;
+        while (capacity < corners.size() * 2)
+            capacity *= 2;
+
+        std::vector<uint32_t> table(capacity, NONE);
+        std::vector<Corner> unique;
+        std::vector<uint32_t> indices(corners.size());
+        for (size_t i = 0; i < corners.size(); ++i)
+        {
+            const Corner& corner = corners[i];
+            uint64_t h = uint64_t(corner.position) * 0x9E3779B97F4A7C15ULL ^ uint64_t(corner.texCoord) * 0xC2B2AE3D27D4EB4FULL ^
+                         uint64_t(corner.normal) * 0x165667B19E3779F9ULL;
+            size_t slot = size_t(h ^ (h >> 29)) & (capacity - 1);
+            while (table[slot] != NONE && !(unique[table[slot]] == corner))
+                slot = (slot + 1) & (capacity - 1);
+
+            if (table[slot] == NONE)
+            {
+                table[slot] = uint32_t(unique.size());
+                unique.push_back(corner);
+            }
+            indices[i] = table[slot];
+        }
+
+        // Smooth normals per position, so texture seams do not show up in the shading
+        std::vector<glm::vec3> positionNormals;
+        size_t positionCount = geometry.positions.size() / 3;
+        if (generateNormals)
+        {
+            size_t triangleCount = corners.size() / 3;
+            std::vector<glm::vec3> faceNormals(triangleCount);
+            parallel::forRange(triangleCount, [&](size_t begin, size_t end)
+            {
+                for (size_t t = begin; t < end; ++t)
+                {
+                    const float* p0 = &geometry.positions[corners[t * 3 + 0].position * 3];
+                    const float* p1 = &geometry.positions[corners[t * 3 + 1].position * 3];
+                    const float* p2 = &geometry.positions[corners[t * 3 + 2].position * 3];
+                    glm::vec3 e1(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+                    glm::vec3 e2(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+
+                    // Length is twice the area
+                    faceNormals[t] = glm::cross(e1, e2);
+                }
+            }, numThreads);
+
+            std::vector<uint32_t> cornerPositions(corners.size());
+            for (size_t i = 0; i < corners.size(); ++i)
+                cornerPositions[i] = corners[i].position;
+
+            Adjacency adjacency;
+            buildAdjacency(cornerPositions.data(), cornerPositions.size(), positionCount, adjacency);
+
+            positionNormals.resize(positionCount);
+            parallel::forRange(positionCount, [&](size_t begin, size_t end)
+            {
+                for (size_t p = begin; p < end; ++p)
+                {
+                    glm::vec3 normal(0.0f);
+                    for (uint32_t a = adjacency.offsets[p]; a < adjacency.offsets[p + 1]; ++a)
+                        normal += faceNormals[adjacency.triangles[a]];
+
+                    float length = glm::length(normal);
+                    positionNormals[p] = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+                }
+            }, numThreads);
+        }
+
+        outMesh.vertices.assign(unique.size() * RawMesh::VERTEX_FLOATS, 0.0f);
+        outMesh.indices.swap(indices);
+        outMesh.generatedNormals = generateNormals;
+        outMesh.hasTexCoords = false;
+        for (const Corner& corner : unique)
+            outMesh.hasTexCoords |= corner.texCoord != NONE;
+
+        parallel::forRange(unique.size(), [&](size_t begin, size_t end)
+        {
+            for (size_t v = begin; v < end; ++v)
+            {
+                const Corner& corner = unique[v];
+                float* out = &outMesh.vertices[v * RawMesh::VERTEX_FLOATS];
+                memcpy(out, &geometry.positions[corner.position * 3], 3 * sizeof(float));
+
+                if (corner.texCoord != NONE)
+                    memcpy(out + 3, &geometry.texCoords[corner.texCoord * 2], 2 * sizeof(float));
+
+                glm::vec3 normal = generateNormals ? positionNormals[corner.position] :
+                                   glm::vec3(geometry.normals[corner.normal * 3], geometry.normals[corner.normal * 3 + 1], geometry.normals[corner.normal * 3 + 2]);
+                float length = glm::length(normal);
+                normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+                out[5] = normal.x;
+                out[6] = normal.y;
+                out[7] = normal.z;
+            }
+        }, numThreads);
+
+        meshimport::generateTangents(outMesh, numThreads);
+        return true;
+    }
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char* skipSpaces(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    /**
+    * Parses a decimal number like "-1.5e-3". Unlike strtof it does not depend on the locale and needs no terminator.
+    * Returns nullptr if there is no number.
+    */
+    const char* parseFloat(const char* p, const char* end, float& outValue)
+    {
+        static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+        p = skipSpaces(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        // 18 significant digits are more than a float can hold
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        bool hasDigits = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        {
+            if (mantissa < 100000000000000000ULL)
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+            else
+                ++exponent;
+            hasDigits = true;
+        }
+
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p)
+            {
+                if (mantissa < 100000000000000000ULL)
+                {
+                    mantissa = mantissa * 10 + uint64_t(*p - '0');
+                    --exponent;
+                }
+                hasDigits = true;
+            }
+        }
+
+        if (!hasDigits)
+            return nullptr;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* e = p + 1;
+            bool negativeExponent = false;
+            if (e < end && (*e == '-' || *e == '+'))
+                negativeExponent = *e++ == '-';
+
+            int value = 0;
+            const char* digits = e;
+            for (; e < end && *e >= '0' && *e <= '9'; ++e)
+                value = std::min(value * 10 + (*e - '0'), 1000);
+
+            if (e > digits)
+            {
+                exponent += negativeExponent ? -value : value;
+                p = e;
+            }
+        }
+
+        double value = double(mantissa);
+        if (exponent >= 0 && exponent <= 22)
+            value *= POWERS_OF_TEN[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            value /= POWERS_OF_TEN[-exponent];
+        else
+            value *= std::pow(10.0, exponent);
+
+        outValue = float(negative ? -value : value);
+        return p;
+    }
+
+    const char* parseInt(const char* p, const char* end, int64_t& outValue)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        if (p >= end || *p < '0' || *p > '9')
+            return nullptr;
+
+        int64_t value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            value = std::min(value * 10 + (*p - '0'), int64_t(1) << 40);
+
+        outValue = negative ? -value : value;
+        return p;
+    }
+
+    /**
+    * A face corner as written in an OBJ file. Relative (negative) indices are stored relative to the start
+    * of the chunk because the number of attributes in earlier chunks is only known after parsing.
+    */
+    struct ObjCorner
+    {
+        // Position, texture coordinate, normal: 0-based, -1 if not specified
+        int64_t index[3];
+        uint8_t relativeMask;
+    };
+
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+
+        std::vector<float> positions;
+        std::vector<float> texCoords;
+        std::vector<float> normals;
+        std::vector<ObjCorner> corners;
+
+        // Offset of the first invalid statement, if any
+        const char* error{ nullptr };
+    };
+
+    void parseObjChunk(ObjChunk& chunk)
+    {
+        std::vector<ObjCorner> face;
+        const char* end = chunk.end;
+
+        for (const char* line = chunk.begin; line < end && !chunk.error;)
+        {
+            const char* newline = static_cast<const char*>(memchr(line, '\n', size_t(end - line)));
+            const char* lineEnd = newline ? newline : end;
+            const char* p = skipSpaces(line, lineEnd);
+            line = newline ? newline + 1 : end;
+
+            if (lineEnd - p < 2 || !isSpace(p[p[0] == 'v' && (p[1] == 't' || p[1] == 'n') ? 2 : 1]))
+                continue;
+
+            if (p[0] == 'v')
+            {
+                // v x y z [w], vt u [v [w]], vn x y z
+                size_t count = p[1] == 't' ? 2 : 3;
+                std::vector<float>& target = p[1] == 't' ? chunk.texCoords : p[1] == 'n' ? chunk.normals : chunk.positions;
+                p += p[1] == ' ' || p[1] == '\t' ? 1 : 2;
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    float value = 0.0f;
+                    const char* next = parseFloat(p, lineEnd, value);
+                    if (!next && !(i == 1 && count == 2))
+                    {
+                        chunk.error = p;
+                        break;
+                    }
+                    target.push_back(value);
+                    p = next ? next : p;
+                }
+            }
+            else if (p[0] == 'f')
+            {
+                face.clear();
+                size_t counts[3] = { chunk.positions.size() / 3, chunk.texCoords.size() / 2, chunk.normals.size() / 3 };
+
+                for (p = skipSpaces(p + 1, lineEnd); p < lineEnd && *p != '#'; p = skipSpaces(p, lineEnd))
+                {
+                    ObjCorner corner = { { -1, -1, -1 }, 0 };
+                    for (size_t a = 0; a < 3 && !chunk.error; ++a)
+                    {
+                        // Texture coordinates may be omitted: "1//1"
+                        if (a > 0 && (p >= lineEnd || *p != '/'))
+                            break;
+                        if (a > 0)
+                            ++p;
+                        if (a == 1 && p < lineEnd && *p == '/')
+                            continue;
+
+                        int64_t index = 0;
+                        const char* next = parseInt(p, lineEnd, index);
+                        if (!next || index == 0)
+                            chunk.error = p;
+                        else if (index > 0)
+                            corner.index[a] = index - 1;
+                        else
+                        {
+                            corner.index[a] = int64_t(counts[a]) + index;
+                            corner.relativeMask |= uint8_t(1 << a);
+                        }
+                        p = next ? next : p;
+                    }
+
+                    if (chunk.error || (p < lineEnd && !isSpace(*p)))
+                    {
+                        chunk.error = chunk.error ? chunk.error : p;
+                        break;
+                    }
+                    face.push_back(corner);
+                }
+
+                if (!chunk.error && face.size() < 3)
+                    chunk.error = p;
+
+                // Triangle fan
+                for (size_t i = 1; !chunk.error && i + 1 < face.size(); ++i)
+                {
+                    chunk.corners.push_back(face[0]);
+                    chunk.corners.push_back(face[i]);
+                    chunk.corners.push_back(face[i + 1]);
+                }
+            }
+        }
+    }
+
+    enum class PlyType
+    {
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Float32,
+        Float64,
+        None
+    };
+
+    PlyType parsePlyType(const std::string& name)
+    {
+        if (name == "char" || name == "int8")
+            return PlyType::Int8;
+        if (name == "uchar" || name == "uint8")
+            return PlyType::UInt8;
+        if (name == "short" || name == "int16")
+            return PlyType::Int16;
+        if (name == "ushort" || name == "uint16")
+            return PlyType::UInt16;
+        if (name == "int" || name == "int32")
+            return PlyType::Int32;
+        if (name == "uint" || name == "uint32")
+            return PlyType::UInt32;
+        if (name == "float" || name == "float32")
+            return PlyType::Float32;
+        if (name == "double" || name == "float64")
+            return PlyType::Float64;
+        return PlyType::None;
+    }
+
+    size_t getSize(PlyType type)
+    {
+        switch (type)
+        {
+        case PlyType::Int8:
+        case PlyType::UInt8:
+            return 1;
+        case PlyType::Int16:
+        case PlyType::UInt16:
+            return 2;
+        case PlyType::Int32:
+        case PlyType::UInt32:
+        case PlyType::Float32:
+            return 4;
+        case PlyType::Float64:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    double readPlyValue(const uint8_t* data, PlyType type, bool bigEndian)
+    {
+        uint8_t bytes[8];
+        size_t size = getSize(type);
+        for (size_t i = 0; i < size; ++i)
+            bytes[i] = data[bigEndian ? size - 1 - i : i];
+
+        int8_t i8;
+        int16_t i16;
+        uint16_t u16;
+        int32_t i32;
+        uint32_t u32;
+        float f32;
+        double f64;
+        switch (type)
+        {
+        case PlyType::Int8:
+            memcpy(&i8, bytes, 1);
+            return i8;
+        case PlyType::UInt8:
+            return bytes[0];
+        case PlyType::Int16:
+            memcpy(&i16, bytes, 2);
+            return i16;
+        case PlyType::UInt16:
+            memcpy(&u16, bytes, 2);
+            return u16;
+        case PlyType::Int32:
+            memcpy(&i32, bytes, 4);
+            return i32;
+        case PlyType::UInt32:
+            memcpy(&u32, bytes, 4);
+            return u32;
+        case PlyType::Float32:
+            memcpy(&f32, bytes, 4);
+            return f32;
+        case PlyType::Float64:
+            memcpy(&f64, bytes, 8);
+            return f64;
+        default:
+            return 0.0;
+        }
+    }
+
+    struct PlyProperty
+    {
+        std::string name;
+        PlyType type;
+
+        // None for scalar properties
+        PlyType countType;
+    };
+
+    struct PlyElement
+    {
+        std::string name;
+        size_t count;
+        std::vector<PlyProperty> properties;
+
+        bool hasLists() const
+        {
+            for (auto& property : properties)
+                if (property.countType != PlyType::None)
+                    return true;
+            return false;
+        }
+
+        size_t getScalarSize() const
+        {
+            size_t size = 0;
+            for (auto& property : properties)
+                size += getSize(property.type);
+            return size;
+        }
+
+        int find(const char* name) const
+        {
+            for (size_t i = 0; i < properties.size(); ++i)
+                if (properties[i].name == name)
+                    return int(i);
+            return -1;
+        }
+    };
+
+    /**
+    * Walks the records of an element with list properties. Calls fn(recordOffset, listOffsets, listCounts)
+    * for every record. Returns the offset after the element or 0 if the data is truncated.
+    */
+    template <class Fn>
+    size_t walkPlyRecords(const uint8_t* data, size_t size, size_t offset, const PlyElement& element, bool bigEndian, Fn fn)
+    {
+        std::vector<size_t> listOffsets(element.properties.size());
+        std::vector<uint32_t> listCounts(element.properties.size());
+        for (size_t r = 0; r < element.count; ++r)
+        {
+            size_t recordOffset = offset;
+            for (size_t i = 0; i < element.properties.size(); ++i)
+            {
+                const PlyProperty& property = element.properties[i];
+                size_t count = 1;
+                if (property.countType != PlyType::None)
+                {
+                    if (offset + getSize(property.countType) > size)
+                        return 0;
+                    count = size_t(readPlyValue(data + offset, property.countType, bigEndian));
+                    offset += getSize(property.countType);
+                }
+
+                listOffsets[i] = offset;
+                listCounts[i] = uint32_t(count);
+                offset += count * getSize(property.type);
+                if (offset > size)
+                    return 0;
+            }
+            fn(recordOffset, listOffsets, listCounts);
+        }
+        return offset;
+    }
+}
+
+size_t meshimport::ImportedMesh::getVertexCount() const
+{
+    return vertices.size() / RawMesh::VERTEX_FLOATS;
+}
+
+bool meshimport::load(const std::string& path, ImportedMesh& outMesh, size_t numThreads)
+{
+    std::string extension = path.substr(std::min(path.size(), path.find_last_of('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension == ".obj")
+        return loadOBJ(path, outMesh, numThreads);
+    if (extension == ".ply")
+        return loadPLY(path, outMesh, numThreads);
+
+    ERROR("Cannot import " << path << ": only .obj and .ply files are supported.");
+    return false;
+}
+
+bool meshimport::loadOBJ(const std::string& path, ImportedMesh& outMesh, size_t numThreads)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    if (numThreads == 0)
+        numThreads = parallel::threadCount();
+
+    // Chunks of at least 1 MB that end at line boundaries
+    const char* data = reinterpret_cast<const char*>(file.data());
+    const char* end = data + file.size();
+    size_t chunkSize = std::max(size_t(1) << 20, file.size() / (numThreads * 4) + 1);
+    std::vector<ObjChunk> chunks;
+    for (const char* begin = data; begin < end;)
+    {
+        const char* chunkEnd = begin + std::min(chunkSize, size_t(end - begin));
+        const char* newline = chunkEnd < end ? static_cast<const char*>(memchr(chunkEnd, '\n', size_t(end - chunkEnd))) : nullptr;
+        chunkEnd = newline ? newline + 1 : end;
+
+        ObjChunk chunk;
+        chunk.begin = begin;
+        chunk.end = chunkEnd;
+        chunks.push_back(chunk);
+        begin = chunkEnd;
+    }
+
+    parallel::forEach(chunks.size(), [&](size_t i) { parseObjChunk(chunks[i]); }, numThreads);
+
+    // Attribute counts before every chunk to resolve relative indices
+    Geometry geometry;
+    std::vector<size_t> firstCorner(chunks.size() + 1, 0);
+    std::vector<int64_t> firstAttribute(chunks.size() * 3);
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        if (chunks[i].error)
+        {
+            ERROR(path << " has an invalid statement at byte " << (chunks[i].error - data));
+            return false;
+        }
+
+        firstAttribute[i * 3 + 0] = int64_t(geometry.positions.size() / 3);
+        firstAttribute[i * 3 + 1] = int64_t(geometry.texCoords.size() / 2);
+        firstAttribute[i * 3 + 2] = int64_t(geometry.normals.size() / 3);
+        geometry.positions.insert(geometry.positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+        geometry.texCoords.insert(geometry.texCoords.end(), chunks[i].texCoords.begin(), chunks[i].texCoords.end());
+        geometry.normals.insert(geometry.normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+        firstCorner[i + 1] = firstCorner[i] + chunks[i].corners.size();
+    }
+
+    int64_t attributeCounts[3] = { int64_t(geometry.positions.size() / 3), int64_t(geometry.texCoords.size() / 2),
+                                   int64_t(geometry.normals.size() / 3) };
+    geometry.corners.resize(firstCorner.back());
+    std::atomic<bool> valid(true);
+    std::atomic<bool> missingNormals(false);
+
+    parallel::forEach(chunks.size(), [&](size_t i)
+    {
+        for (size_t c = 0; c < chunks[i].corners.size(); ++c)
+        {
+            const ObjCorner& objCorner = chunks[i].corners[c];
+            uint32_t resolved[3];
+            for (size_t a = 0; a < 3; ++a)
+            {
+                int64_t index = objCorner.index[a];
+                if (objCorner.relativeMask & (1 << a))
+                    index += firstAttribute[i * 3 + a];
+                else if (index < 0)
+                {
+                    resolved[a] = NONE;
+                    continue;
+                }
+
+                if (index < 0 || index >= attributeCounts[a])
+                {
+                    valid = false;
+                    index = 0;
+                }
+                resolved[a] = uint32_t(index);
+            }
+
+            if (resolved[0] == NONE)
+                valid = false;
+            if (resolved[2] == NONE)
+                missingNormals = true;
+
+            Corner corner = { resolved[0], resolved[1], resolved[2] };
+            geometry.corners[firstCorner[i] + c] = corner;
+        }
+    }, numThreads);
+
+    if (!valid)
+    {
+        ERROR(path << " references vertex attributes that do not exist.");
+        return false;
+    }
+
+    return build(geometry, missingNormals, outMesh, numThreads);
+}
+
+bool meshimport::loadPLY(const std::string& path, ImportedMesh& outMesh, size_t numThreads)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+    const char* text = reinterpret_cast<const char*>(data);
+    const char* headerEnd = nullptr;
+    for (const char* p = text; p + 10 <= text + size && !headerEnd; p = static_cast<const char*>(memchr(p, '\n', size_t(text + size - p))) + 1)
+    {
+        if (memcmp(p, "end_header", 10) == 0)
+            headerEnd = static_cast<const char*>(memchr(p, '\n', size_t(text + size - p)));
+        if (!memchr(p, '\n', size_t(text + size - p)))
+            break;
+    }
+
+    if (size < 4 || memcmp(text, "ply", 3) != 0 || !headerEnd)
+    {
+        ERROR(path << " is not a PLY file.");
+        return false;
+    }
+
+    std::istringstream header(std::string(text, headerEnd));
+    std::vector<PlyElement> elements;
+    std::string line;
+    bool bigEndian = false;
+    bool binary = false;
+    while (std::getline(header, line))
+    {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+
+        if (keyword == "format")
+        {
+            std::string format;
+            words >> format;
+            binary = format == "binary_little_endian" || format == "binary_big_endian";
+            bigEndian = format == "binary_big_endian";
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            std::string type;
+            words >> type;
+            if (type == "list")
+            {
+                std::string countType;
+                words >> countType >> type;
+                property.countType = parsePlyType(countType);
+                if (property.countType == PlyType::None)
+                {
+                    ERROR(path << " has an unknown property type " << countType);
+                    return false;
+                }
+            }
+            else
+                property.countType = PlyType::None;
+
+            words >> property.name;
+            property.type = parsePlyType(type);
+            if (property.type == PlyType::None)
+            {
+                ERROR(path << " has an unknown property type " << type);
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    if (!binary)
+    {
+        ERROR(path << " is not a binary PLY file. ASCII PLY files are not supported.");
+        return false;
+    }
+
+    Geometry geometry;
+    bool hasNormals = false;
+    bool hasTexCoords = false;
+    size_t vertexCount = 0;
+    std::vector<size_t> faceOffsets;
+    std::vector<uint32_t> faceCounts;
+    PlyType indexType = PlyType::None;
+
+    size_t offset = size_t(headerEnd - text) + 1;
+    for (auto& element : elements)
+    {
+        if (element.name == "vertex")
+        {
+            int x = element.find("x"), y = element.find("y"), z = element.find("z");
+            int nx = element.find("nx"), ny = element.find("ny"), nz = element.find("nz");
+            int u = std::max(element.find("u"), std::max(element.find("s"), element.find("texture_u")));
+            int v = std::max(element.find("v"), std::max(element.find("t"), element.find("texture_v")));
+            size_t stride = element.getScalarSize();
+            if (x < 0 || y < 0 || z < 0 || element.hasLists() || offset + element.count * stride > size)
+            {
+                ERROR(path << " has no x, y, z vertex properties or a truncated vertex element.");
+                return false;
+            }
+
+            std::vector<size_t> propertyOffsets(element.properties.size(), 0);
+            for (size_t i = 1; i < element.properties.size(); ++i)
+                propertyOffsets[i] = propertyOffsets[i - 1] + getSize(element.properties[i - 1].type);
+
+            vertexCount = element.count;
+            hasNormals = nx >= 0 && ny >= 0 && nz >= 0;
+            hasTexCoords = u >= 0 && v >= 0;
+            geometry.positions.resize(vertexCount * 3);
+            geometry.normals.resize(hasNormals ? vertexCount * 3 : 0);
+            geometry.texCoords.resize(hasTexCoords ? vertexCount * 2 : 0);
+
+            auto read = [&](size_t vertex, int property)
+            {
+                return float(readPlyValue(data + offset + vertex * stride + propertyOffsets[property], element.properties[property].type, bigEndian));
+            };
+
+            parallel::forRange(vertexCount, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    geometry.positions[i * 3 + 0] = read(i, x);
+                    geometry.positions[i * 3 + 1] = read(i, y);
+                    geometry.positions[i * 3 + 2] = read(i, z);
+                    if (hasNormals)
+                    {
+                        geometry.normals[i * 3 + 0] = read(i, nx);
+                        geometry.normals[i * 3 + 1] = read(i, ny);
+                        geometry.normals[i * 3 + 2] = read(i, nz);
+                    }
+                    if (hasTexCoords)
+                    {
+                        geometry.texCoords[i * 2 + 0] = read(i, u);
+                        geometry.texCoords[i * 2 + 1] = read(i, v);
+                    }
+                }
+            }, numThreads);
+
+            offset += element.count * stride;
+        }
+        else if (element.hasLists())
+        {
+            // Face lists have variable length, so finding the records is sequential. Decoding them is not.
+            int indicesProperty = element.name == "face" ? std::max(element.find("vertex_indices"), element.find("vertex_index")) : -1;
+            if (indicesProperty >= 0)
+            {
+                indexType = element.properties[indicesProperty].type;
+                faceOffsets.reserve(element.count);
+                faceCounts.reserve(element.count);
+            }
+
+            offset = walkPlyRecords(data, size, offset, element, bigEndian,
+                                    [&](size_t, const std::vector<size_t>& listOffsets, const std::vector<uint32_t>& listCounts)
+            {
+                if (indicesProperty >= 0)
+                {
+                    faceOffsets.push_back(listOffsets[indicesProperty]);
+                    faceCounts.push_back(listCounts[indicesProperty]);
+                }
+            });
+
+            if (offset == 0)
+            {
+                ERROR(path << " is truncated in element " << element.name);
+                return false;
+            }
+        }
+        else
+            offset += element.count * element.getScalarSize();
+    }
+
+    if (offset > size || faceOffsets.empty())
+    {
+        ERROR(path << " is truncated or has no faces.");
+        return false;
+    }
+
+    // Triangle fans of every face
+    std::vector<size_t> firstCorner(faceCounts.size() + 1, 0);
+    for (size_t f = 0; f < faceCounts.size(); ++f)
+        firstCorner[f + 1] = firstCorner[f] + (faceCounts[f] >= 3 ? (faceCounts[f] - 2) * 3 : 0);
+
+    geometry.corners.resize(firstCorner.back());
+    std::atomic<bool> valid(true);
+    size_t indexSize = getSize(indexType);
+    parallel::forRange(faceCounts.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t f = begin; f < end; ++f)
+        {
+            Corner* out = &geometry.corners[firstCorner[f]];
+            auto corner = [&](size_t i)
+            {
+                uint32_t vertex = uint32_t(readPlyValue(data + faceOffsets[f] + i * indexSize, indexType, bigEndian));
+                if (vertex >= vertexCount)
+                {
+                    valid = false;
+                    vertex = 0;
+                }
+
+                Corner result = { vertex, hasTexCoords ? vertex : NONE, hasNormals ? vertex : NONE };
+                return result;
+            };
+
+            for (size_t i = 1; i + 1 < faceCounts[f]; ++i)
+            {
+                *out++ = corner(0);
+                *out++ = corner(i);
+                *out++ = corner(i + 1);
+            }
+        }
+    }, numThreads);
+
+    if (!valid)
+    {
+        ERROR(path << " references vertices that do not exist.");
+        return false;
+    }
+
+    return build(geometry, !hasNormals, outMesh, numThreads);
+}
+
+void meshimport::generateTangents(ImportedMesh& mesh, size_t numThreads)
+{
+    const size_t stride = RawMesh::VERTEX_FLOATS;
+    size_t vertexCount = mesh.getVertexCount();
+    size_t triangleCount = mesh.indices.size() / 3;
+    float* vertices = mesh.vertices.data();
+    const uint32_t* indices = mesh.indices.data();
+
+    // Tangent and bitangent directions per triangle, weighted by the triangle area
+    std::vector<glm::vec3> triangleFrames(triangleCount * 2, glm::vec3(0.0f));
+    parallel::forRange(triangleCount, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            const float* v0 = vertices + indices[t * 3 + 0] * stride;
+            const float* v1 = vertices + indices[t * 3 + 1] * stride;
+            const float* v2 = vertices + indices[t * 3 + 2] * stride;
+
+            glm::vec3 e1(v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]);
+            glm::vec3 e2(v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]);
+            float du1 = v1[3] - v0[3], dv1 = v1[4] - v0[4];
+            float du2 = v2[3] - v0[3], dv2 = v2[4] - v0[4];
+
+            float determinant = du1 * dv2 - du2 * dv1;
+            if (std::abs(determinant) < 1e-20f)
+                continue;
+
+            glm::vec3 tangent = (e1 * dv2 - e2 * dv1) / determinant;
+            glm::vec3 bitangent = (e2 * du1 - e1 * du2) / determinant;
+            float area = glm::length(glm::cross(e1, e2));
+            if (glm::length(tangent) > 0.0f && glm::length(bitangent) > 0.0f)
+            {
+                triangleFrames[t * 2 + 0] = glm::normalize(tangent) * area;
+                triangleFrames[t * 2 + 1] = glm::normalize(bitangent) * area;
+            }
+        }
+    }, numThreads);
+
+    Adjacency adjacency;
+    buildAdjacency(indices, mesh.indices.size(), vertexCount, adjacency);
+
+    parallel::forRange(vertexCount, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            glm::vec3 tangent(0.0f);
+            glm::vec3 bitangent(0.0f);
+            for (uint32_t a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a)
+            {
+                tangent += triangleFrames[adjacency.triangles[a] * 2 + 0];
+                bitangent += triangleFrames[adjacency.triangles[a] * 2 + 1];
+            }
+
+            float* out = vertices + v * stride;
+            glm::vec3 normal(out[5], out[6], out[7]);
+            tangent -= normal * glm::dot(normal, tangent);
+            tangent = glm::length(tangent) > 1e-6f ? glm::normalize(tangent) : perpendicular(normal);
+
+            float sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            bitangent = glm::cross(normal, tangent) * sign;
+
+            out[8] = tangent.x;
+            out[9] = tangent.y;
+            out[10] = tangent.z;
+            out[11] = bitangent.x;
+            out[12] = bitangent.y;
+            out[13] = bitangent.z;
+        }
+    }, numThreads);
+}
+
+bool meshimport::write(const ImportedMesh& mesh, const std::string& vbPath, const std::string& ibPath)
+{
+    uint32_t floatCount = uint32_t(mesh.vertices.size());
+    uint32_t indexCount = uint32_t(mesh.indices.size());
+
+    std::ofstream vb(vbPath, std::ios::binary);
+    vb.write(reinterpret_cast<const char*>(&floatCount), sizeof(uint32_t));
+    vb.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(float));
+
+    std::ofstream ib(ibPath, std::ios::binary);
+    ib.write(reinterpret_cast<const char*>(&indexCount), sizeof(uint32_t));
+    ib.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+
+    if (!vb || !ib)
+    {
+        ERROR("Could not write " << vbPath << " and " << ibPath);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cstddef>
+
+/**
+* Imports meshes from Wavefront OBJ and binary PLY files into the interleaved layout of RawMesh / Mesh::load().
+* Parsing, normal and tangent generation run in parallel on numThreads threads (0 = all cores).
+*/
+namespace meshimport
+{
+    struct ImportedMesh
+    {
+        // RawMesh::VERTEX_FLOATS floats per vertex: position, texture coordinates, normal, tangent, bitangent
+        std::vector<float> vertices;
+        std::vector<uint32_t> indices;
+
+        bool hasTexCoords{ false };
+        bool generatedNormals{ false };
+
+        size_t getVertexCount() const;
+    };
+
+    /**
+    * Loads an .obj or .ply file depending on the extension.
+    * Faces with more than three vertices are triangulated as fans. Missing normals are generated
+    * (area weighted and smooth across texture seams), tangent frames are always generated (see generateTangents()).
+    */
+    bool load(const std::string& path, ImportedMesh& outMesh, size_t numThreads = 0);
+
+    /**
+    * OBJ: v, vt, vn and f statements, including negative (relative) indices. Other statements are ignored.
+    * The file is split into chunks at line boundaries which are parsed in parallel.
+    * Vertices are the unique position / texture coordinate / normal combinations, deduplicated with a hash table.
+    */
+    bool loadOBJ(const std::string& path, ImportedMesh& outMesh, size_t numThreads = 0);
+
+    /**
+    * Binary PLY (little or big endian): x, y, z and optional nx, ny, nz and u, v (or s, t) vertex properties
+    * and the vertex_indices list of the face element. Other elements and properties are skipped.
+    */
+    bool loadPLY(const std::string& path, ImportedMesh& outMesh, size_t numThreads = 0);
+
+    /**
+    * Computes per-vertex tangents from the texture coordinates of the adjacent triangles, orthogonalized
+    * against the normal. The bitangent is cross(normal, tangent) with the handedness of the texture mapping.
+    * Vertices without usable texture coordinates get an arbitrary tangent perpendicular to the normal.
+    */
+    void generateTangents(ImportedMesh& mesh, size_t numThreads = 0);
+
+    /**
+    * Writes the mesh as .raw vertex and index buffer pair (see RawMesh).
+    */
+    bool write(const ImportedMesh& mesh, const std::string& vbPath, const std::string& ibPath);
+}
@@ -0,0 +1,863 @@
+#include "meshops.h"
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <cfloat>
+
+namespace
+{
+    /**
+    * FIFO cache simulation with timestamps: a vertex is cached if it was added less than cacheSize misses ago.
+    * Advancing the timestamp by cacheSize + 1 flushes the cache.
+    */
+    struct CacheSimulator
+    {
+        CacheSimulator(size_t vertexCount, uint32_t cacheSize)
+            :timestamps(vertexCount, 0), cacheSize(cacheSize), timestamp(cacheSize + 1) {}
+
+        uint32_t add(uint32_t v)
+        {
+            if (timestamp - timestamps[v] <= cacheSize)
+                return 0;
+
+            timestamps[v] = timestamp++;
+            return 1;
+        }
+
+        uint32_t addTriangle(const uint32_t* triangle)
+        {
+            return add(triangle[0]) + add(triangle[1]) + add(triangle[2]);
+        }
+
+        void flush()
+        {
+            timestamp += cacheSize + 1;
+        }
+
+        std::vector<uint32_t> timestamps;
+        uint32_t cacheSize;
+        uint32_t timestamp;
+    };
+
+    /**
+    * Tipsify: picks the next fanning vertex among the vertices of the last emitted triangles.
+    * Prefers vertices that are still in the cache and whose remaining triangles fit before they get evicted.
+    */
+    int64_t getNextVertex(const std::vector<uint32_t>& candidates, const std::vector<uint32_t>& liveTriangles,
+                          const std::vector<uint32_t>& timestamps, uint32_t timestamp, uint32_t cacheSize)
+    {
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+
+            int64_t priority = 0;
+            if (timestamp - timestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = timestamp - timestamps[v];
+
+            if (priority > bestPriority)
+            {
+                best = v;
+                bestPriority = priority;
+            }
+        }
+
+        return best;
+    }
+
+    /**
+    * Tipsify: continues with a recently used vertex that has live triangles or the next one in input order.
+    */
+    int64_t skipDeadEnd(std::vector<uint32_t>& deadEnds, const std::vector<uint32_t>& liveTriangles, size_t& inputCursor)
+    {
+        while (!deadEnds.empty())
+        {
+            uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0)
+                return v;
+        }
+
+        for (; inputCursor < liveTriangles.size(); ++inputCursor)
+            if (liveTriangles[inputCursor] > 0)
+                return int64_t(inputCursor);
+
+        return -1;
+    }
+
+    struct Cluster
+    {
+        size_t begin;
+        size_t end;
+        float sortKey;
+    };
+}
+
+meshops::VertexCacheStats meshops::analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    CacheSimulator cache(vertexCount, cacheSize);
+
+    VertexCacheStats stats;
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+        stats.misses += cache.addTriangle(indices + i);
+
+    stats.acmr = indexCount >= 3 ? float(stats.misses) / (indexCount / 3) : 0.0f;
+    stats.atvr = vertexCount > 0 ? float(stats.misses) / vertexCount : 0.0f;
+    return stats;
+}
+
+void meshops::optimizeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& outIndices,
+                                  uint32_t cacheSize)
+{
+    size_t triangleCount = indexCount / 3;
+    outIndices.clear();
+    outIndices.reserve(triangleCount * 3);
+
+    // Vertex to triangle adjacency in compressed row form
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        ++liveTriangles[indices[i]];
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+        for (size_t k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = uint32_t(t);
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = cacheSize + 1;
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    size_t inputCursor = 0;
+
+    int64_t fanning = skipDeadEnd(deadEnds, liveTriangles, inputCursor);
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        // Emit all remaining triangles around the fanning vertex
+        for (uint32_t a = adjacencyOffsets[size_t(fanning)]; a < adjacencyOffsets[size_t(fanning) + 1]; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[t * 3 + k];
+                outIndices.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+
+                if (timestamp - timestamps[v] > cacheSize)
+                    timestamps[v] = timestamp++;
+            }
+            emitted[t] = 1;
+        }
+
+        fanning = getNextVertex(candidates, liveTriangles, timestamps, timestamp, cacheSize);
+        if (fanning < 0)
+            fanning = skipDeadEnd(deadEnds, liveTriangles, inputCursor);
+    }
+
+    assert(outIndices.size() == triangleCount * 3);
+}
+
+size_t meshops::optimizeOverdraw(std::vector<uint32_t>& indices, const float* vertices, size_t vertexCount, size_t vertexStride,
+                                 float threshold, uint32_t cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return 0;
+
+    // Hard boundaries: a triangle without any cached vertex usually starts a new, disjoint patch
+    std::vector<size_t> hardBoundaries;
+    {
+        CacheSimulator cache(vertexCount, cacheSize);
+        for (size_t t = 0; t < triangleCount; ++t)
+            if (cache.addTriangle(&indices[t * 3]) == 3 || t == 0)
+                hardBoundaries.push_back(t);
+    }
+
+    // Soft boundaries: split a patch whenever the ACMR so far reaches the patch ACMR times the threshold
+    std::vector<Cluster> clusters;
+    CacheSimulator cache(vertexCount, cacheSize);
+    for (size_t h = 0; h < hardBoundaries.size(); ++h)
+    {
+        size_t begin = hardBoundaries[h];
+        size_t end = h + 1 < hardBoundaries.size() ? hardBoundaries[h + 1] : triangleCount;
+
+        cache.flush();
+        uint32_t patchMisses = 0;
+        for (size_t t = begin; t < end; ++t)
+            patchMisses += cache.addTriangle(&indices[t * 3]);
+        float patchThreshold = threshold * float(patchMisses) / float(end - begin);
+
+        cache.flush();
+        size_t firstCluster = clusters.size();
+        size_t clusterBegin = begin;
+        uint32_t misses = 0;
+        for (size_t t = begin; t < end; ++t)
+        {
+            misses += cache.addTriangle(&indices[t * 3]);
+            if (float(misses) / float(t + 1 - clusterBegin) <= patchThreshold)
+            {
+                Cluster cluster = { clusterBegin, t + 1, 0.0f };
+                clusters.push_back(cluster);
+                clusterBegin = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+
+        // The rest did not reach the threshold on its own, so it stays with the previous cluster of the patch
+        if (clusterBegin < end)
+        {
+            if (clusters.size() > firstCluster)
+                clusters.back().end = end;
+            else
+            {
+                Cluster cluster = { clusterBegin, end, 0.0f };
+                clusters.push_back(cluster);
+            }
+        }
+    }
+
+    // Sort key: how far a cluster lies outside of the mesh center along its normal
+    float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t v : indices)
+        for (size_t k = 0; k < 3; ++k)
+            meshCenter[k] += vertices[v * vertexStride + k] / indices.size();
+
+    for (auto& cluster : clusters)
+    {
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        float area = 0.0f;
+        for (size_t t = cluster.begin; t < cluster.end; ++t)
+        {
+            const float* p0 = vertices + indices[t * 3 + 0] * vertexStride;
+            const float* p1 = vertices + indices[t * 3 + 1] * vertexStride;
+            const float* p2 = vertices + indices[t * 3 + 2] * vertexStride;
+
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            // Area weighted center and normal (the cross product is already scaled by the area)
+            for (size_t k = 0; k < 3; ++k)
+            {
+                center[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * triangleArea;
+                normal[k] += n[k];
+            }
+            area += triangleArea;
+        }
+
+        float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area > 0.0f && normalLength > 0.0f)
+        {
+            for (size_t k = 0; k < 3; ++k)
+                cluster.sortKey += (center[k] / area - meshCenter[k]) * normal[k] / normalLength;
+        }
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(triangleCount * 3);
+    for (auto& cluster : clusters)
+        sorted.insert(sorted.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+
+    indices.swap(sorted);
+    return clusters.size();
+}
+
+size_t meshops::optimizeVertexFetch(std::vector<uint32_t>& indices, const float* vertices, size_t vertexCount, size_t vertexStride,
+                                    std::vector<float>& outVertices)
+{
+    const uint32_t UNUSED = ~0u;
+    std::vector<uint32_t> remap(vertexCount, UNUSED);
+
+    uint32_t nextVertex = 0;
+    for (uint32_t& index : indices)
+    {
+        if (remap[index] == UNUSED)
+            remap[index] = nextVertex++;
+        index = remap[index];
+    }
+
+    outVertices.resize(size_t(nextVertex) * vertexStride);
+    for (size_t v = 0; v < vertexCount; ++v)
+        if (remap[v] != UNUSED)
+            std::copy(vertices + v * vertexStride, vertices + (v + 1) * vertexStride, outVertices.begin() + remap[v] * vertexStride);
+
+    return nextVertex;
+}
+
+namespace
+{
+    const uint32_t NONE = ~0u;
+
+    // Weight of the planes through border and seam edges relative to the triangle planes
+    const double BORDER_WEIGHT = 10.0;
+
+    enum VertexKind
+    {
+        Manifold,
+        Border,
+        Seam,
+        Locked,
+        KindCount
+    };
+
+    // Whether a vertex of the first kind may be collapsed into a vertex of the second kind
+    const bool CAN_COLLAPSE[KindCount][KindCount] =
+    {
+        { true,  true,  true,  true  }, // Manifold
+        { false, true,  false, false }, // Border
+        { false, false, true,  false }, // Seam
+        { false, false, false, false }  // Locked
+    };
+
+    /**
+    * Sum of weighted squared distances to a set of planes: v^T A v + 2 b^T v + c with the symmetric A stored as upper triangle.
+    */
+    struct Quadric
+    {
+        void addPlane(const double* n, double d, double w)
+        {
+            a00 += w * n[0] * n[0];
+            a01 += w * n[0] * n[1];
+            a02 += w * n[0] * n[2];
+            a11 += w * n[1] * n[1];
+            a12 += w * n[1] * n[2];
+            a22 += w * n[2] * n[2];
+            b0 += w * n[0] * d;
+            b1 += w * n[1] * d;
+            b2 += w * n[2] * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        Quadric operator+(const Quadric& q) const
+        {
+            Quadric sum = *this;
+            sum.a00 += q.a00;
+            sum.a01 += q.a01;
+            sum.a02 += q.a02;
+            sum.a11 += q.a11;
+            sum.a12 += q.a12;
+            sum.a22 += q.a22;
+            sum.b0 += q.b0;
+            sum.b1 += q.b1;
+            sum.b2 += q.b2;
+            sum.c += q.c;
+            sum.weight += q.weight;
+            return sum;
+        }
+
+        /**
+        * Mean squared distance of p to the planes.
+        */
+        double error(const float* p) const
+        {
+            double x = p[0], y = p[1], z = p[2];
+            double r = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                       2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0.0 ? std::abs(r) / weight : 0.0;
+        }
+
+        double a00{ 0.0 }, a01{ 0.0 }, a02{ 0.0 }, a11{ 0.0 }, a12{ 0.0 }, a22{ 0.0 };
+        double b0{ 0.0 }, b1{ 0.0 }, b2{ 0.0 };
+        double c{ 0.0 };
+        double weight{ 0.0 };
+    };
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double error;
+    };
+
+    /**
+    * Triangles around every vertex: the triangles of vertex v are triangles[offsets[v]] .. triangles[offsets[v + 1] - 1].
+    */
+    struct TriangleAdjacency
+    {
+        TriangleAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+            :offsets(vertexCount + 1, 0), triangles(indices.size())
+        {
+            for (uint32_t v : indices)
+                ++offsets[v + 1];
+            for (size_t v = 0; v < vertexCount; ++v)
+                offsets[v + 1] += offsets[v];
+
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+                triangles[fill[indices[i]]++] = uint32_t(i / 3);
+        }
+
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+    };
+
+    void cross(const double* a, const double* b, double* out)
+    {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    double dot(const double* a, const double* b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    /**
+    * Unnormalized normal, its length is twice the area of the triangle.
+    */
+    void triangleNormal(const float* p0, const float* p1, const float* p2, double* out)
+    {
+        double e1[3] = { double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2] };
+        double e2[3] = { double(p2[0]) - p0[0], double(p2[1]) - p0[1], double(p2[2]) - p0[2] };
+        cross(e1, e2, out);
+    }
+}
+
+float meshops::simplify(const uint32_t* indices, size_t indexCount, const float* vertices, size_t vertexCount, size_t vertexStride,
+                        size_t targetIndexCount, float targetError, std::vector<uint32_t>& outIndices)
+{
+    outIndices.assign(indices, indices + indexCount);
+    auto position = [vertices, vertexStride](uint32_t v) { return vertices + size_t(v) * vertexStride; };
+
+    // Vertices with the same position are remapped to the first of them and linked in a cycle of wedges
+    std::vector<uint32_t> sorted(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        sorted[v] = uint32_t(v);
+
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b)
+    {
+        return std::lexicographical_compare(position(a), position(a) + 3, position(b), position(b) + 3);
+    });
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint32_t> wedge(vertexCount);
+    for (size_t i = 0; i < vertexCount;)
+    {
+        size_t end = i + 1;
+        while (end < vertexCount && std::equal(position(sorted[i]), position(sorted[i]) + 3, position(sorted[end])))
+            ++end;
+
+        uint32_t first = *std::min_element(sorted.begin() + i, sorted.begin() + end);
+        for (size_t k = i; k < end; ++k)
+        {
+            remap[sorted[k]] = first;
+            wedge[sorted[k]] = sorted[k + 1 < end ? k + 1 : i];
+        }
+        i = end;
+    }
+
+    // Open edges have no opposite half-edge. loop and loopBack follow them forward and backward.
+    std::vector<uint32_t> loop(vertexCount, NONE);
+    std::vector<uint32_t> loopBack(vertexCount, NONE);
+    std::vector<uint32_t> openOut(vertexCount, 0);
+    std::vector<uint32_t> openIn(vertexCount, 0);
+    {
+        TriangleAdjacency adjacency(outIndices, vertexCount);
+        auto hasEdge = [&](uint32_t a, uint32_t b)
+        {
+            for (uint32_t i = adjacency.offsets[a]; i < adjacency.offsets[a + 1]; ++i)
+            {
+                const uint32_t* triangle = &outIndices[adjacency.triangles[i] * 3];
+                for (size_t k = 0; k < 3; ++k)
+                    if (triangle[k] == a && triangle[(k + 1) % 3] == b)
+                        return true;
+            }
+            return false;
+        };
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            uint32_t a = outIndices[i];
+            uint32_t b = outIndices[i % 3 == 2 ? i - 2 : i + 1];
+            if (!hasEdge(b, a))
+            {
+                ++openOut[a];
+                ++openIn[b];
+                loop[a] = b;
+                loopBack[b] = a;
+            }
+        }
+    }
+
+    std::vector<uint8_t> kinds(vertexCount, Locked);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        uint32_t s = wedge[v];
+        bool singleOpening = openOut[v] == 1 && openIn[v] == 1;
+        if (s == v)
+            kinds[v] = openOut[v] == 0 && openIn[v] == 0 ? Manifold : singleOpening ? Border : Locked;
+        else if (wedge[s] == v && singleOpening && openOut[s] == 1 && openIn[s] == 1 &&
+                 remap[loop[v]] == remap[loopBack[s]] && remap[loopBack[v]] == remap[loop[s]])
+            kinds[v] = Seam;
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        const uint32_t* triangle = &outIndices[i];
+        double normal[3];
+        triangleNormal(position(triangle[0]), position(triangle[1]), position(triangle[2]), normal);
+        double length = std::sqrt(dot(normal, normal));
+        if (length == 0.0)
+            continue;
+
+        for (size_t k = 0; k < 3; ++k)
+            normal[k] /= length;
+
+        const float* p0 = position(triangle[0]);
+        double d = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+        for (size_t k = 0; k < 3; ++k)
+            quadrics[remap[triangle[k]]].addPlane(normal, d, length * 0.5);
+
+        // Planes perpendicular to the triangle through its open edges keep borders and seams in place
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t a = triangle[k];
+            uint32_t b = triangle[(k + 1) % 3];
+            if (kinds[a] == Manifold || loop[a] != b)
+                continue;
+
+            const float* pa = position(a);
+            const float* pb = position(b);
+            double edge[3] = { double(pb[0]) - pa[0], double(pb[1]) - pa[1], double(pb[2]) - pa[2] };
+            double edgeNormal[3];
+            cross(edge, normal, edgeNormal);
+            double edgeNormalLength = std::sqrt(dot(edgeNormal, edgeNormal));
+            if (edgeNormalLength == 0.0)
+                continue;
+
+            for (size_t j = 0; j < 3; ++j)
+                edgeNormal[j] /= edgeNormalLength;
+
+            double edgeD = -(edgeNormal[0] * pa[0] + edgeNormal[1] * pa[1] + edgeNormal[2] * pa[2]);
+            double weight = dot(edge, edge) * BORDER_WEIGHT;
+            quadrics[remap[a]].addPlane(edgeNormal, edgeD, weight);
+            quadrics[remap[b]].addPlane(edgeNormal, edgeD, weight);
+        }
+    }
+
+    // The vertex that a seam vertex's twin collapses into, NONE if the collapse is not allowed
+    auto getCollapseTarget = [&](uint32_t from, uint32_t to) -> uint32_t
+    {
+        uint8_t kind = kinds[from];
+        if (remap[from] == remap[to] || !CAN_COLLAPSE[kind][kinds[to]])
+            return NONE;
+        if (kind == Manifold)
+            return to;
+        if (to != loop[from] && to != loopBack[from])
+            return NONE;
+        if (kind == Border)
+            return to;
+
+        // The twin runs along the seam in the opposite direction
+        uint32_t twin = wedge[from];
+        uint32_t twinTo = to == loop[from] ? loopBack[twin] : loop[twin];
+        return twinTo != NONE && remap[twinTo] == remap[to] && twinTo != to ? twinTo : NONE;
+    };
+
+    std::vector<uint32_t> collapseRemap(vertexCount);
+    std::vector<uint8_t> locked(vertexCount);
+    double maxError = double(targetError) * targetError;
+    double resultError = 0.0;
+
+    while (outIndices.size() > targetIndexCount)
+    {
+        TriangleAdjacency adjacency(outIndices, vertexCount);
+
+        // The cheaper direction of every edge
+        std::vector<Collapse> collapses;
+        for (size_t i = 0; i < outIndices.size(); ++i)
+        {
+            uint32_t a = outIndices[i];
+            uint32_t b = outIndices[i % 3 == 2 ? i - 2 : i + 1];
+            Collapse best = { NONE, NONE, 0.0 };
+            for (size_t direction = 0; direction < 2; ++direction)
+            {
+                uint32_t from = direction == 0 ? a : b;
+                uint32_t to = direction == 0 ? b : a;
+                if (getCollapseTarget(from, to) == NONE)
+                    continue;
+
+                double error = (quadrics[remap[from]] + quadrics[remap[to]]).error(position(to));
+                if (best.from == NONE || error < best.error)
+                {
+                    Collapse collapse = { from, to, error };
+                    best = collapse;
+                }
+            }
+
+            if (best.from != NONE)
+                collapses.push_back(best);
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        for (size_t v = 0; v < vertexCount; ++v)
+            collapseRemap[v] = uint32_t(v);
+        std::fill(locked.begin(), locked.end(), 0);
+
+        // A collapse flips a triangle around from if its normal turns by more than about 75 degrees
+        auto hasFlips = [&](uint32_t from, uint32_t to)
+        {
+            for (uint32_t i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; ++i)
+            {
+                const uint32_t* triangle = &outIndices[adjacency.triangles[i] * 3];
+                const float* before[3];
+                const float* after[3];
+                bool degenerate = false;
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    uint32_t v = collapseRemap[triangle[k]];
+                    degenerate |= remap[v] == remap[to];
+                    before[k] = position(v);
+                    after[k] = triangle[k] == from ? position(to) : before[k];
+                }
+
+                if (degenerate)
+                    continue;
+
+                double n0[3], n1[3];
+                triangleNormal(before[0], before[1], before[2], n0);
+                triangleNormal(after[0], after[1], after[2], n1);
+                if (dot(n0, n1) <= 0.25 * std::sqrt(dot(n0, n0) * dot(n1, n1)))
+                    return true;
+            }
+            return false;
+        };
+
+        size_t triangleCount = outIndices.size() / 3;
+        size_t removedTriangles = 0;
+        size_t collapseCount = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.error > maxError || triangleCount - removedTriangles <= targetIndexCount / 3)
+                break;
+
+            uint32_t from = collapse.from;
+            uint32_t to = collapse.to;
+            if (locked[remap[from]] || locked[remap[to]])
+                continue;
+
+            uint32_t twin = kinds[from] == Seam ? wedge[from] : NONE;
+            uint32_t twinTo = twin != NONE ? getCollapseTarget(from, to) : NONE;
+            if (hasFlips(from, to) || (twin != NONE && hasFlips(twin, twinTo)))
+                continue;
+
+            collapseRemap[from] = to;
+            if (twin != NONE)
+                collapseRemap[twin] = twinTo;
+
+            quadrics[remap[to]] = quadrics[remap[to]] + quadrics[remap[from]];
+            locked[remap[from]] = 1;
+            locked[remap[to]] = 1;
+            removedTriangles += kinds[from] == Border ? 1 : 2;
+            resultError = std::max(resultError, collapse.error);
+            ++collapseCount;
+        }
+
+        if (collapseCount == 0)
+            break;
+
+        // Drop the triangles that collapsed to a line
+        size_t writeIndex = 0;
+        for (size_t i = 0; i < outIndices.size(); i += 3)
+        {
+            uint32_t a = collapseRemap[outIndices[i + 0]];
+            uint32_t b = collapseRemap[outIndices[i + 1]];
+            uint32_t c = collapseRemap[outIndices[i + 2]];
+            if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+                continue;
+
+            outIndices[writeIndex++] = a;
+            outIndices[writeIndex++] = b;
+            outIndices[writeIndex++] = c;
+        }
+        outIndices.resize(writeIndex);
+
+        // Open edges to a collapsed vertex now end at its target, or continue past it if it collapsed into this vertex
+        std::vector<uint32_t> previousLoop = loop;
+        std::vector<uint32_t> previousLoopBack = loopBack;
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            uint32_t next = previousLoop[v];
+            uint32_t previous = previousLoopBack[v];
+            if (next != NONE)
+                loop[v] = collapseRemap[next] == v ? previousLoop[next] : collapseRemap[next];
+            if (previous != NONE)
+                loopBack[v] = collapseRemap[previous] == v ? previousLoopBack[previous] : collapseRemap[previous];
+        }
+    }
+
+    return float(std::sqrt(resultError));
+}
+
+void meshops::buildMeshlets(std::vector<uint32_t>& indices, const float* vertices, size_t vertexCount, size_t vertexStride,
+                            std::vector<Meshlet>& outMeshlets, size_t maxTriangles)
+{
+    size_t triangleCount = indices.size() / 3;
+    TriangleAdjacency adjacency(indices, vertexCount);
+
+    std::vector<float> normals(triangleCount * 3, 0.0f);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        double normal[3];
+        triangleNormal(vertices + indices[t * 3 + 0] * vertexStride, vertices + indices[t * 3 + 1] * vertexStride,
+                       vertices + indices[t * 3 + 2] * vertexStride, normal);
+        double length = std::sqrt(dot(normal, normal));
+        for (size_t k = 0; k < 3 && length > 0.0; ++k)
+            normals[t * 3 + k] = float(normal[k] / length);
+    }
+
+    // Stamps: the meshlet a vertex or frontier triangle was last added to
+    std::vector<uint32_t> vertexStamps(vertexCount, NONE);
+    std::vector<uint32_t> frontierStamps(triangleCount, NONE);
+    std::vector<uint8_t> used(triangleCount, 0);
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    outMeshlets.clear();
+
+    std::vector<uint32_t> frontier;
+    std::vector<uint32_t> triangles;
+    size_t seedCursor = 0;
+    while (true)
+    {
+        while (seedCursor < triangleCount && used[seedCursor])
+            ++seedCursor;
+        if (seedCursor == triangleCount)
+            break;
+
+        uint32_t stamp = uint32_t(outMeshlets.size());
+        float normalSum[3] = { 0.0f, 0.0f, 0.0f };
+        triangles.clear();
+        frontier.clear();
+
+        uint32_t next = uint32_t(seedCursor);
+        while (next != NONE)
+        {
+            used[next] = 1;
+            triangles.push_back(next);
+            for (size_t k = 0; k < 3; ++k)
+            {
+                normalSum[k] += normals[next * 3 + k];
+                uint32_t v = indices[next * 3 + k];
+                vertexStamps[v] = stamp;
+                for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+                {
+                    uint32_t neighbour = adjacency.triangles[i];
+                    if (!used[neighbour] && frontierStamps[neighbour] != stamp)
+                    {
+                        frontierStamps[neighbour] = stamp;
+                        frontier.push_back(neighbour);
+                    }
+                }
+            }
+
+            if (triangles.size() == maxTriangles)
+                break;
+
+            // Prefer triangles that add few vertices and keep the normal cone narrow, never one that faces backwards
+            float normalLength = std::sqrt(normalSum[0] * normalSum[0] + normalSum[1] * normalSum[1] + normalSum[2] * normalSum[2]);
+            float bestScore = 0.0f;
+            next = NONE;
+            for (size_t i = 0; i < frontier.size();)
+            {
+                uint32_t t = frontier[i];
+                if (used[t])
+                {
+                    frontier[i] = frontier.back();
+                    frontier.pop_back();
+                    continue;
+                }
+
+                // Degenerate triangles have no normal and fit anywhere
+                const float* normal = &normals[t * 3];
+                bool degenerate = normal[0] == 0.0f && normal[1] == 0.0f && normal[2] == 0.0f;
+                float alignment = normalLength > 0.0f && !degenerate ?
+                                  (normal[0] * normalSum[0] + normal[1] * normalSum[1] + normal[2] * normalSum[2]) / normalLength : 1.0f;
+                size_t newVertices = 0;
+                for (size_t k = 0; k < 3; ++k)
+                    newVertices += vertexStamps[indices[t * 3 + k]] != stamp;
+
+                float score = float(newVertices) + 4.0f * (1.0f - alignment);
+                if (alignment > 0.7f && (next == NONE || score < bestScore))
+                {
+                    next = t;
+                    bestScore = score;
+                }
+                ++i;
+            }
+        }
+
+        Meshlet meshlet;
+        meshlet.firstIndex = uint32_t(sorted.size());
+        meshlet.indexCount = uint32_t(triangles.size() * 3);
+
+        std::vector<uint32_t> meshletIndices;
+        for (uint32_t t : triangles)
+            meshletIndices.insert(meshletIndices.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+
+        std::vector<uint32_t> optimized;
+        optimizeVertexCache(meshletIndices.data(), meshletIndices.size(), vertexCount, optimized);
+        sorted.insert(sorted.end(), optimized.begin(), optimized.end());
+
+        // Bounding sphere around the center of the bounding box
+        float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint32_t v : meshletIndices)
+            for (size_t k = 0; k < 3; ++k)
+            {
+                minimum[k] = std::min(minimum[k], vertices[v * vertexStride + k]);
+                maximum[k] = std::max(maximum[k], vertices[v * vertexStride + k]);
+            }
+
+        float radiusSquared = 0.0f;
+        for (size_t k = 0; k < 3; ++k)
+            meshlet.center[k] = (minimum[k] + maximum[k]) * 0.5f;
+        for (uint32_t v : meshletIndices)
+        {
+            const float* p = vertices + v * vertexStride;
+            float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+            radiusSquared = std::max(radiusSquared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+        meshlet.radius = std::sqrt(radiusSquared);
+
+        // Normal cone around the average normal. Cones wider than about 84 degrees are not worth testing.
+        float axisLength = std::sqrt(normalSum[0] * normalSum[0] + normalSum[1] * normalSum[1] + normalSum[2] * normalSum[2]);
+        float minimumAlignment = axisLength > 0.0f ? 1.0f : -1.0f;
+        for (size_t k = 0; k < 3; ++k)
+            meshlet.coneAxis[k] = axisLength > 0.0f ? normalSum[k] / axisLength : 0.0f;
+        for (uint32_t t : triangles)
+        {
+            const float* normal = &normals[t * 3];
+            if (normal[0] != 0.0f || normal[1] != 0.0f || normal[2] != 0.0f)
+                minimumAlignment = std::min(minimumAlignment, normal[0] * meshlet.coneAxis[0] + normal[1] * meshlet.coneAxis[1] +
+                                                              normal[2] * meshlet.coneAxis[2]);
+        }
+
+        meshlet.coneCutoff = minimumAlignment > 0.1f ? std::sqrt(1.0f - minimumAlignment * minimumAlignment) : 1.0f;
+        outMeshlets.push_back(meshlet);
+    }
+
+    indices.swap(sorted);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/**
+* CPU operations on indexed triangle lists.
+* Vertices are interleaved floats with the position in the first three floats of every vertex.
+*/
+namespace meshops
+{
+    // Post-transform cache size assumed by the optimizations and the analysis (FIFO)
+    const uint32_t CACHE_SIZE = 16;
+
+    // Triangles per meshlet, small enough for tight normal cones
+    const size_t MESHLET_TRIANGLES = 96;
+
+    /**
+    * A cluster of neighbouring triangles: a range of the index buffer with its bounds for culling.
+    * Stored as is in mesh caches, so it has a fixed layout.
+    */
+    struct Meshlet
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+
+        // Bounding sphere
+        float center[3];
+        float radius;
+
+        // Normal cone: all triangles face away from a viewer at p if
+        // dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius. A cutoff of 1 never culls.
+        float coneAxis[3];
+        float coneCutoff;
+    };
+
+    struct VertexCacheStats
+    {
+        size_t misses{ 0 };
+
+        // Average cache miss ratio: vertex shader invocations per triangle (0.5 is optimal for large grids, 3 the worst case)
+        float acmr{ 0.0f };
+
+        // Average transformed vertex ratio: vertex shader invocations per vertex (1 is optimal)
+        float atvr{ 0.0f };
+    };
+
+    /**
+    * Simulates a FIFO post-transform vertex cache.
+    */
+    VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+    /**
+    * Reorders triangles for post-transform vertex cache efficiency (Tipsify, Sander et al. 2007).
+    * Runs in linear time.
+    */
+    void optimizeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& outIndices,
+                             uint32_t cacheSize = CACHE_SIZE);
+
+    /**
+    * Reorders clusters of cache optimized triangles to reduce overdraw: clusters that face away from the mesh center
+    * are drawn first so they occlude the inner ones. Clusters are split where the ACMR of a cluster stays within
+    * threshold times the ACMR of the input, so the vertex cache efficiency degrades by at most the threshold.
+    * Returns the number of clusters.
+    */
+    size_t optimizeOverdraw(std::vector<uint32_t>& indices, const float* vertices, size_t vertexCount, size_t vertexStride,
+                            float threshold = 1.05f, uint32_t cacheSize = CACHE_SIZE);
+
+    /**
+    * Reorders vertices in the order of their first use by the index buffer and remaps the indices,
+    * so vertex fetches walk through memory linearly. Unreferenced vertices are dropped.
+    * Returns the new vertex count.
+    */
+    size_t optimizeVertexFetch(std::vector<uint32_t>& indices, const float* vertices, size_t vertexCount, size_t vertexStride,
+                               std::vector<float>& outVertices);
+
+    /**
+    * Simplifies a mesh with quadric error metrics (Garland & Heckbert 1997) until it has at most targetIndexCount indices
+    * or no edge can be collapsed with an error below targetError (a distance in model units).
+    * Edges are collapsed into one of their vertices, so the result indexes the same vertex buffer.
+    * Vertices that share a position but not their other attributes (UV seams) only move along the seam, together with
+    * their twin on the other side, and border vertices only move along the border, so the texture mapping is preserved.
+    * Returns the error of the result: the root mean square distance to the planes of the collapsed triangles.
+    */
+    float simplify(const uint32_t* indices, size_t indexCount, const float* vertices, size_t vertexCount, size_t vertexStride,
+                   size_t targetIndexCount, float targetError, std::vector<uint32_t>& outIndices);
+
+    /**
+    * Reorders the triangles into meshlets of at most maxTriangles connected triangles with similar normals.
+    * Meshlets are grown from seeds in input order, so the overall order of the input (e.g. from optimizeOverdraw())
+    * is roughly kept, and every meshlet is optimized for the vertex cache.
+    */
+    void buildMeshlets(std::vector<uint32_t>& indices, const float* vertices, size_t vertexCount, size_t vertexStride,
+                       std::vector<Meshlet>& outMeshlets, size_t maxTriangles = MESHLET_TRIANGLES);
+}
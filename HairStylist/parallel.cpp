@@ -0,0 +1,105 @@
+#include "parallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    struct Job
+    {
+        Job(parallel::detail::ItemFn item, void* context, size_t count, size_t helpers)
+            :item(item), context(context), count(count), next(0), helpersWanted(helpers), helpersRunning(0)
+        {
+        }
+
+        parallel::detail::ItemFn item;
+        void* context;
+        size_t count;
+        std::atomic<size_t> next;
+
+        // Guarded by the pool mutex
+        size_t helpersWanted;
+        size_t helpersRunning;
+    };
+
+    /**
+    * Threads waiting for jobs. Workers are added when a call asks for more threads than exist so far
+    * and are kept until the process exits.
+    */
+    class WorkerPool
+    {
+    public:
+        void run(Job& job)
+        {
+            size_t helpers = job.helpersWanted;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                while (m_workers.size() < helpers)
+                    m_workers.push_back(std::thread(&WorkerPool::work, this));
+
+                m_jobs.push_back(&job);
+            }
+
+            if (helpers == 1)
+                m_wake.notify_one();
+            else
+                m_wake.notify_all();
+
+            process(job);
+
+            // All items are taken, workers that did not pick the job up yet are not needed any more
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto it = std::find(m_jobs.begin(), m_jobs.end(), &job);
+            if (it != m_jobs.end())
+                m_jobs.erase(it);
+
+            m_done.wait(lock, [&job]() { return job.helpersRunning == 0; });
+        }
+
+    private:
+        static void process(Job& job)
+        {
+            for (size_t i = job.next++; i < job.count; i = job.next++)
+                job.item(job.context, i);
+        }
+
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (;;)
+            {
+                m_wake.wait(lock, [this]() { return !m_jobs.empty(); });
+
+                Job& job = *m_jobs.front();
+                if (--job.helpersWanted == 0)
+                    m_jobs.pop_front();
+                ++job.helpersRunning;
+
+                lock.unlock();
+                process(job);
+                lock.lock();
+
+                if (--job.helpersRunning == 0)
+                    m_done.notify_all();
+            }
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        std::deque<Job*> m_jobs;
+        std::vector<std::thread> m_workers;
+    };
+
+    // Created before main() and never destroyed, joining threads during static destruction can deadlock
+    WorkerPool* const g_pool = new WorkerPool();
+}
+
+void parallel::detail::run(size_t count, ItemFn item, void* context, size_t numThreads)
+{
+    Job job(item, context, count, numThreads - 1);
+    g_pool->run(job);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <thread>
+#include <algorithm>
+
+namespace parallel
+{
+    /**
+    * Returns the number of hardware threads (at least 1).
+    */
+    inline size_t threadCount()
+    {
+        return std::max(size_t(1), size_t(std::thread::hardware_concurrency()));
+    }
+
+    namespace detail
+    {
+        typedef void (*ItemFn)(void* context, size_t i);
+
+        /**
+        * Runs item(context, i) for every i in [0, count) on the calling thread and up to numThreads - 1
+        * threads of the shared worker pool. The pool is started at the first call and kept for the lifetime
+        * of the process, so a call costs a wake-up instead of creating and joining threads.
+        */
+        void run(size_t count, ItemFn item, void* context, size_t numThreads);
+    }
+
+    /**
+    * Calls fn(i) for every i in [0, count) distributed over numThreads threads (0 = all cores).
+    * Items are handed out dynamically so uneven workloads are balanced. Blocks until all items are done.
+    * The calling thread works on the items as well, so nested calls cannot deadlock the pool.
+    */
+    template <class Fn>
+    void forEach(size_t count, Fn fn, size_t numThreads = 0)
+    {
+        if (numThreads == 0)
+            numThreads = threadCount();
+
+        numThreads = std::min(numThreads, count);
+        if (numThreads <= 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+                fn(i);
+            return;
+        }
+
+        detail::run(count, [](void* context, size_t i) { (*static_cast<Fn*>(context))(i); }, &fn, numThreads);
+    }
+
+    /**
+    * Splits [0, count) into contiguous ranges and calls fn(begin, end) for each range in parallel.
+    * Use for cheap per-item work (e.g. image rows) where per-item dispatch would dominate.
+    */
+    template <class Fn>
+    void forRange(size_t count, Fn fn, size_t numThreads = 0)
+    {
+        if (numThreads == 0)
+            numThreads = threadCount();
+
+        size_t numRanges = std::max(size_t(1), std::min(numThreads * 4, count));
+        size_t rangeSize = (count + numRanges - 1) / numRanges;
+        forEach(numRanges, [&](size_t r)
+        {
+            size_t begin = r * rangeSize;
+            size_t end = std::min(count, begin + rangeSize);
+            if (begin < end)
+                fn(begin, end);
+        }, numThreads);
+    }
+}
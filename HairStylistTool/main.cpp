@@ -0,0 +1,1190 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "HairstyleManager.h"
+#include "TileStore.h"
+#include "StyleFile.h"
+#include "Canvas.h"
+#include "canvasops.h"
+#include "parallel.h"
+#include "file.h"
+#include "hash.h"
+#include "SimilarityIndex.h"
+#include "StylePack.h"
+#include "RawMesh.h"
+#include "CompactMesh.h"
+#include "meshops.h"
+#include "meshimport.h"
+#include "MeshletCuller.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include "Logger.h"
+
+/**
+* Headless batch processing of style libraries (directories of .style files).
+* Links the same style code as the application but does not need a window or GL context.
+*/
+namespace
+{
+    /**
+    * A directory of styles. If the directory contains an info file (e.g. preset.info)
+    * the styles and their parameters are taken from it via HairstyleManager,
+    * otherwise all .style files in the directory are used.
+    */
+    struct Library
+    {
+        std::string path;
+        std::string infoFilename;
+        std::vector<std::string> filenames;
+        std::unique_ptr<HairstyleManager> manager;
+        std::unique_ptr<TileStore> ownTileStore;
+
+        TileStore& tileStore() { return manager ? manager->getTileStore() : *ownTileStore; }
+        std::string stylePath(size_t idx) const { return path + "/" + filenames[idx]; }
+    };
+
+    struct Options
+    {
+        size_t numThreads{ 0 };
+        bool tiled{ false };
+        canvasops::Filter filter{ canvasops::Filter::Bilinear };
+        std::string maskPath;
+        std::vector<std::string> arguments;
+    };
+
+    /**
+    * Measures the throughput of a batch command.
+    */
+    class Throughput
+    {
+    public:
+        Throughput() :m_start(std::chrono::high_resolution_clock::now()) {}
+
+        void add(size_t bytes) { m_bytes += bytes; ++m_items; }
+
+        void report(const std::string& what, size_t numThreads) const
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - m_start).count();
+            double megabytes = m_bytes / (1024.0 * 1024.0);
+            fprintf(stdout, "%s %zu styles (%.1f MB) in %.3f s on %zu threads: %.1f styles/s, %.1f MB/s\n",
+                    what.c_str(), size_t(m_items), megabytes, seconds, numThreads,
+                    seconds > 0.0 ? m_items / seconds : 0.0, seconds > 0.0 ? megabytes / seconds : 0.0);
+        }
+
+    private:
+        std::chrono::high_resolution_clock::time_point m_start;
+        std::atomic<size_t> m_bytes{ 0 };
+        std::atomic<size_t> m_items{ 0 };
+    };
+
+    bool openLibrary(const std::string& path, Library& outLibrary)
+    {
+        if (!file::isDirectory(path))
+        {
+            ERROR(path << " is not a directory.");
+            return false;
+        }
+
+        outLibrary.path = path;
+
+        auto infoFiles = file::listFiles(path, ".info");
+        if (!infoFiles.empty())
+        {
+            outLibrary.infoFilename = infoFiles[0];
+            outLibrary.manager = std::make_unique<HairstyleManager>("hairstyle", path, infoFiles[0]);
+            for (size_t i = 0; i < outLibrary.manager->getCount(); ++i)
+                outLibrary.filenames.push_back(outLibrary.manager->getFilename(i));
+        }
+        else
+        {
+            outLibrary.ownTileStore = std::make_unique<TileStore>(path + "/Tiles");
+            outLibrary.filenames = file::listFiles(path, ".style");
+        }
+
+        return true;
+    }
+
+    void copyInfo(const Library& library, const std::string& outDir)
+    {
+        if (!library.infoFilename.empty())
+            std::ofstream(outDir + "/" + library.infoFilename) << std::ifstream(library.path + "/" + library.infoFilename).rdbuf();
+    }
+
+    /**
+    * Prints per-style output in library order after the parallel loop finished.
+    */
+    void printLines(const std::vector<std::string>& lines)
+    {
+        for (auto& line : lines)
+            if (!line.empty())
+                fprintf(stdout, "%s", line.c_str());
+    }
+
+    int validate(Library& library, const Options& options)
+    {
+        Throughput throughput;
+        std::vector<std::string> lines(library.filenames.size());
+        std::atomic<size_t> numInvalid(0);
+
+        parallel::forEach(library.filenames.size(), [&](size_t i)
+        {
+            std::string path = library.stylePath(i);
+            style::Header header;
+            std::vector<style::MipLevel> mipLevels;
+            Canvas canvas;
+
+            std::stringstream ss;
+            if (!style::readHeader(path, header) || !style::readMipLevels(path, mipLevels) ||
+                !style::read(path, canvas, &library.tileStore()))
+            {
+                ss << "INVALID " << path << "\n";
+                ++numInvalid;
+            }
+            else
+                ss << "ok      " << path << " " << header.width << "x" << header.height << "x" << header.channels
+                   << (header.version == 0 ? " raw" : header.storage == style::Storage::Tiled ? " tiled" : " inline")
+                   << " " << mipLevels.size() << " mips\n";
+
+            lines[i] = ss.str();
+            throughput.add(canvas.getSize());
+        }, options.numThreads);
+
+        printLines(lines);
+        throughput.report("Validated", options.numThreads);
+        fprintf(stdout, "%zu of %zu styles are invalid.\n", size_t(numInvalid), library.filenames.size());
+        return numInvalid == 0 ? 0 : 1;
+    }
+
+    int stats(Library& library, const Options& options)
+    {
+        Throughput throughput;
+        std::vector<std::string> lines(library.filenames.size());
+        std::vector<std::vector<uint64_t>> tileHashes(library.filenames.size());
+        std::atomic<size_t> numUnreadable(0);
+
+        parallel::forEach(library.filenames.size(), [&](size_t i)
+        {
+            Canvas canvas;
+            if (!style::read(library.stylePath(i), canvas, &library.tileStore()))
+            {
+                lines[i] = "UNREADABLE " + library.stylePath(i) + "\n";
+                ++numUnreadable;
+                return;
+            }
+
+            canvasops::Stats stats;
+            canvasops::computeStats(canvas, stats);
+
+            std::stringstream ss;
+            ss.precision(3);
+            ss << library.filenames[i] << " " << canvas.getWidth() << "x" << canvas.getHeight()
+               << " hair coverage " << stats.channel[0].coverage * 100.0 << "%";
+            for (uint32_t c = 0; c < stats.channels; ++c)
+                ss << " | ch" << c << " mean " << stats.channel[c].mean << " [" << int(stats.channel[c].min) << ", " << int(stats.channel[c].max) << "]";
+
+            if (library.manager)
+            {
+                const Hairstyle& hs = library.manager->getHairstyle(i);
+                ss << " | color " << hs.color.r << " " << hs.color.g << " " << hs.color.b << " length " << hs.length << " width " << hs.width;
+            }
+            ss << "\n";
+            lines[i] = ss.str();
+
+            // Tile hashes to estimate how well the library deduplicates
+            std::vector<uint8_t> tile(TileStore::TILE_SIZE * TileStore::TILE_SIZE * canvas.getChannels());
+            for (uint32_t y = 0; y < canvas.getHeight(); y += TileStore::TILE_SIZE)
+            {
+                for (uint32_t x = 0; x < canvas.getWidth(); x += TileStore::TILE_SIZE)
+                {
+                    uint32_t w = std::min(TileStore::TILE_SIZE, canvas.getWidth() - x);
+                    uint32_t h = std::min(TileStore::TILE_SIZE, canvas.getHeight() - y);
+                    canvas.readRect(x, y, w, h, tile.data());
+                    tileHashes[i].push_back(hash::compute(tile.data(), size_t(w) * h * canvas.getChannels()));
+                }
+            }
+
+            throughput.add(canvas.getSize());
+        }, options.numThreads);
+
+        printLines(lines);
+
+        size_t numTiles = 0;
+        std::unordered_set<uint64_t> uniqueTiles;
+        for (auto& hashes : tileHashes)
+        {
+            numTiles += hashes.size();
+            uniqueTiles.insert(hashes.begin(), hashes.end());
+        }
+
+        fprintf(stdout, "%zu tiles, %zu unique (%.1f%%)\n", numTiles, uniqueTiles.size(),
+                numTiles > 0 ? 100.0 * uniqueTiles.size() / numTiles : 0.0);
+        throughput.report("Analyzed", options.numThreads);
+        fprintf(stdout, "%zu of %zu styles could not be read.\n", size_t(numUnreadable), library.filenames.size());
+        return numUnreadable == 0 ? 0 : 1;
+    }
+
+    int convert(Library& library, const std::string& outDir, const Options& options)
+    {
+        if (!file::createDirectory(outDir))
+        {
+            ERROR("Could not create " << outDir);
+            return 1;
+        }
+
+        Throughput throughput;
+        TileStore outStore(outDir + "/Tiles");
+        std::atomic<size_t> numFailed(0);
+
+        parallel::forEach(library.filenames.size(), [&](size_t i)
+        {
+            Canvas canvas;
+            std::string outPath = outDir + "/" + library.filenames[i];
+            bool written = style::read(library.stylePath(i), canvas, &library.tileStore()) &&
+                           (options.tiled ? style::writeTiled(outPath, canvas, outStore) : style::write(outPath, canvas));
+
+            if (written)
+                throughput.add(canvas.getSize());
+            else
+                ++numFailed;
+        }, options.numThreads);
+
+        bool refsSaved = outStore.saveRefs();
+        copyInfo(library, outDir);
+        throughput.report("Converted", options.numThreads);
+        return numFailed == 0 && refsSaved ? 0 : 1;
+    }
+
+    int recompress(Library& library, const Options& options)
+    {
+        Throughput throughput;
+        TileStore& store = library.tileStore();
+        std::atomic<size_t> numFailed(0);
+
+        parallel::forEach(library.filenames.size(), [&](size_t i)
+        {
+            std::string path = library.stylePath(i);
+            std::string tmpPath = path + ".tmp";
+
+            Canvas canvas;
+            std::vector<uint64_t> oldHashes;
+            if (!style::readTileHashes(path, oldHashes) || !style::read(path, canvas, &store) ||
+                !style::writeTiled(tmpPath, canvas, store))
+            {
+                ++numFailed;
+                return;
+            }
+
+            if (!file::replace(tmpPath, path))
+            {
+                ERROR("Could not replace " << path);
+                ++numFailed;
+                return;
+            }
+
+            for (uint64_t hash : oldHashes)
+                store.release(hash);
+
+            throughput.add(canvas.getSize());
+        }, options.numThreads);
+
+        size_t numDeleted = store.collectGarbage();
+        bool refsSaved = store.saveRefs();
+
+        fprintf(stdout, "Tile store holds %zu tiles, %zu unreferenced tiles were deleted.\n", store.getTileCount(), numDeleted);
+        throughput.report("Recompressed", options.numThreads);
+        return numFailed == 0 && refsSaved ? 0 : 1;
+    }
+
+    int resample(Library& library, const std::string& outDir, uint32_t size, const Options& options)
+    {
+        if (size == 0 || !file::createDirectory(outDir))
+        {
+            ERROR("Invalid size or output directory " << outDir);
+            return 1;
+        }
+
+        Throughput throughput;
+        std::atomic<size_t> numFailed(0);
+
+        parallel::forEach(library.filenames.size(), [&](size_t i)
+        {
+            Canvas canvas;
+            if (!style::read(library.stylePath(i), canvas, &library.tileStore()))
+            {
+                ++numFailed;
+                return;
+            }
+
+            // Styles are already processed in parallel
+            Canvas resampled(size, size, canvas.getChannels());
+            canvasops::resample(canvas, resampled, options.filter, 1);
+
+            if (style::write(outDir + "/" + library.filenames[i], resampled))
+                throughput.add(canvas.getSize());
+            else
+                ++numFailed;
+        }, options.numThreads);
+
+        copyInfo(library, outDir);
+        throughput.report("Resampled", options.numThreads);
+        return numFailed == 0 ? 0 : 1;
+    }
+
+    /**
+    * Writes a binary PPM preview of every style, read from the embedded mip levels where possible.
+    */
+    int thumbnails(Library& library, const std::string& outDir, uint32_t size, const Options& options)
+    {
+        if (size == 0 || !file::createDirectory(outDir))
+        {
+            ERROR("Invalid size or output directory " << outDir);
+            return 1;
+        }
+
+        Throughput throughput;
+        std::atomic<size_t> numFailed(0);
+
+        parallel::forEach(library.filenames.size(), [&](size_t i)
+        {
+            Canvas canvas;
+            if (!style::readMip(library.stylePath(i), size, canvas, &library.tileStore()) || canvas.getChannels() < 3)
+            {
+                ++numFailed;
+                return;
+            }
+
+            std::string name = library.filenames[i].substr(0, library.filenames[i].find_last_of('.'));
+            std::ofstream output(outDir + "/" + name + ".ppm", std::ios::binary);
+            output << "P6\n" << canvas.getWidth() << " " << canvas.getHeight() << "\n255\n";
+            for (size_t p = 0; p < size_t(canvas.getWidth()) * canvas.getHeight(); ++p)
+                output.write(reinterpret_cast<const char*>(canvas.data() + p * canvas.getChannels()), 3);
+
+            if (output)
+                throughput.add(canvas.getSize());
+            else
+                ++numFailed;
+        }, options.numThreads);
+
+        throughput.report("Previewed", options.numThreads);
+        return numFailed == 0 ? 0 : 1;
+    }
+
+    int diff(Library& a, Library& b, const Options& options)
+    {
+        Throughput throughput;
+        std::vector<std::string> lines(a.filenames.size());
+        std::atomic<size_t> numDifferent(0);
+
+        parallel::forEach(a.filenames.size(), [&](size_t i)
+        {
+            auto it = std::find(b.filenames.begin(), b.filenames.end(), a.filenames[i]);
+            if (it == b.filenames.end())
+            {
+                lines[i] = "only in " + a.path + ": " + a.filenames[i] + "\n";
+                ++numDifferent;
+                return;
+            }
+
+            Canvas canvasA, canvasB;
+            if (!style::read(a.stylePath(i), canvasA, &a.tileStore()) ||
+                !style::read(b.stylePath(it - b.filenames.begin()), canvasB, &b.tileStore()))
+            {
+                lines[i] = "unreadable " + a.filenames[i] + "\n";
+                ++numDifferent;
+                return;
+            }
+
+            std::stringstream ss;
+            ss.precision(3);
+            canvasops::DiffResult result;
+            if (!canvasops::diff(canvasA, canvasB, result))
+            {
+                ss << "size mismatch " << a.filenames[i] << " " << canvasA.getWidth() << "x" << canvasA.getHeight()
+                   << " vs " << canvasB.getWidth() << "x" << canvasB.getHeight() << "\n";
+                ++numDifferent;
+            }
+            else if (result.differentPixels > 0)
+            {
+                size_t numPixels = size_t(canvasA.getWidth()) * canvasA.getHeight();
+                ss << "differs " << a.filenames[i] << " " << 100.0 * result.differentPixels / numPixels << "% pixels";
+                for (uint32_t c = 0; c < canvasA.getChannels() && c < canvasops::MAX_CHANNELS; ++c)
+                    ss << " | ch" << c << " max " << int(result.maxAbsDiff[c]) << " mean " << result.meanAbsDiff[c];
+                ss << "\n";
+                ++numDifferent;
+            }
+
+            lines[i] = ss.str();
+            throughput.add(canvasA.getSize() + canvasB.getSize());
+        }, options.numThreads);
+
+        printLines(lines);
+        fprintf(stdout, "%zu of %zu styles differ.\n", size_t(numDifferent), a.filenames.size());
+        throughput.report("Compared", options.numThreads);
+        return numDifferent == 0 ? 0 : 1;
+    }
+
+    /**
+    * Writes steps in-between styles for every pair of neighbouring styles in the library.
+    * The output is a library with an info file so it can be browsed like the presets.
+    */
+    int variations(Library& library, const std::string& outDir, uint32_t steps, const Options& options)
+    {
+        if (steps == 0 || library.filenames.size() < 2 || !file::createDirectory(outDir))
+        {
+            ERROR("Need at least two styles, one step and a valid output directory " << outDir);
+            return 1;
+        }
+
+        Canvas mask;
+        if (!options.maskPath.empty() && !style::read(options.maskPath, mask))
+        {
+            ERROR("Could not read mask " << options.maskPath);
+            return 1;
+        }
+
+        Throughput throughput;
+        HairstyleManager output("variation", outDir, "variations.info");
+        std::atomic<size_t> numFailed(0);
+
+        // Names are handed out up front and the results registered in order afterwards, so the info file is
+        // written once and lists the variations pair by pair whatever thread finished first
+        size_t count = (library.filenames.size() - 1) * steps;
+        std::vector<std::string> filenames(count);
+        for (auto& filename : filenames)
+            filename = output.reserveFilename();
+
+        std::vector<Hairstyle> hairstyles(count);
+        std::vector<SimilarityIndex::Signature> signatures(count);
+        std::vector<char> written(count, 0);
+
+        parallel::forEach(library.filenames.size() - 1, [&](size_t i)
+        {
+            Canvas from, to;
+            if (!style::read(library.stylePath(i), from, &library.tileStore()) ||
+                !style::read(library.stylePath(i + 1), to, &library.tileStore()))
+            {
+                ++numFailed;
+                return;
+            }
+
+            Hairstyle fromHairstyle = library.manager ? library.manager->getHairstyle(i) : Hairstyle();
+            Hairstyle toHairstyle = library.manager ? library.manager->getHairstyle(i + 1) : Hairstyle();
+
+            Canvas blended;
+            for (uint32_t step = 1; step <= steps; ++step)
+            {
+                float t = float(step) / (steps + 1);
+                std::vector<canvasops::BlendLayer> layers(1, canvasops::BlendLayer(&to, t, mask.empty() ? nullptr : &mask));
+
+                // The pair loop is already parallel
+                if (!canvasops::blend(from, layers, blended, 1))
+                {
+                    ++numFailed;
+                    return;
+                }
+
+                size_t index = i * steps + step - 1;
+                if (!output.writeStyle(filenames[index], blended, signatures[index]))
+                {
+                    ++numFailed;
+                    continue;
+                }
+
+                hairstyles[index] = mix(fromHairstyle, toHairstyle, t);
+                written[index] = 1;
+                throughput.add(blended.getSize());
+            }
+        }, options.numThreads);
+
+        for (size_t index = 0; index < count; ++index)
+            if (written[index])
+                output.addSaved(filenames[index], hairstyles[index], signatures[index]);
+
+        if (!output.saveLibrary())
+            ++numFailed;
+
+        fprintf(stdout, "Wrote %zu variations to %s\n", output.getCount(), outDir.c_str());
+        throughput.report("Blended", options.numThreads);
+        return numFailed == 0 ? 0 : 1;
+    }
+
+    /**
+    * Times canvasops::blend on synthetic size x size canvases.
+    */
+    int benchBlend(uint32_t size, const Options& options)
+    {
+        if (size == 0)
+            return 1;
+
+        Canvas a(size, size), b(size, size), mask(size, size), out;
+        for (size_t i = 0; i < a.getSize(); ++i)
+        {
+            a.data()[i] = uint8_t(i * 7);
+            b.data()[i] = uint8_t(i * 13 + 5);
+            mask.data()[i] = uint8_t(i * 3);
+        }
+
+        const int repeats = 50;
+        double megapixels = double(size) * size / (1000.0 * 1000.0);
+        for (int masked = 0; masked < 2; ++masked)
+        {
+            for (size_t numThreads = 1; numThreads <= options.numThreads; numThreads *= 2)
+            {
+                std::vector<canvasops::BlendLayer> layers(1, canvasops::BlendLayer(&b, 0.5f, masked ? &mask : nullptr));
+                canvasops::blend(a, layers, out, numThreads);
+
+                // The median is robust against other processes taking the cores for a moment
+                std::vector<double> times;
+                for (int r = 0; r < repeats; ++r)
+                {
+                    auto start = std::chrono::high_resolution_clock::now();
+                    canvasops::blend(a, layers, out, numThreads);
+                    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+                }
+                std::sort(times.begin(), times.end());
+                double ms = times[repeats / 2];
+
+                fprintf(stdout, "blend %ux%u %s on %zu threads: %.3f ms, %.3f ms/MP\n",
+                        size, size, masked ? "masked  " : "unmasked", numThreads, ms, ms / megapixels);
+            }
+        }
+
+        return 0;
+    }
+
+    /**
+    * Adds the signatures of all styles that are not in the similarity index yet.
+    * Plain style directories get an index next to the styles as well.
+    */
+    int index(Library& library, const Options& options)
+    {
+        size_t numAdded = 0;
+        size_t count = 0;
+
+        if (library.manager)
+        {
+            numAdded = library.manager->updateSimilarityIndex(options.numThreads);
+            count = library.manager->getSimilarityIndex().getCount();
+        }
+        else
+        {
+            SimilarityIndex index(library.path + "/similarity.index");
+            std::vector<SimilarityIndex::Signature> signatures(library.filenames.size());
+            std::vector<char> valid(library.filenames.size(), 0);
+
+            parallel::forEach(library.filenames.size(), [&](size_t i)
+            {
+                Canvas canvas;
+                if (index.contains(library.filenames[i]) ||
+                    !style::readMip(library.stylePath(i), SimilarityIndex::SOURCE_SIZE, canvas, &library.tileStore()))
+                    return;
+
+                SimilarityIndex::computeSignature(canvas, signatures[i]);
+                valid[i] = 1;
+            }, options.numThreads);
+
+            for (size_t i = 0; i < library.filenames.size(); ++i)
+            {
+                if (valid[i])
+                {
+                    index.add(library.filenames[i], signatures[i]);
+                    ++numAdded;
+                }
+            }
+
+            count = index.getCount();
+        }
+
+        fprintf(stdout, "Added %zu signatures, the index holds %zu styles.\n", numAdded, count);
+        return 0;
+    }
+
+    int similar(Library& library, const std::string& stylePath, size_t k, const Options& options)
+    {
+        Canvas canvas;
+        if (!style::read(stylePath, canvas, &library.tileStore()) && !style::read(stylePath, canvas))
+        {
+            ERROR("Could not read " << stylePath);
+            return 1;
+        }
+
+        if (library.manager)
+            library.manager->updateSimilarityIndex(options.numThreads);
+
+        SimilarityIndex ownIndex(library.path + "/similarity.index");
+        SimilarityIndex& index = library.manager ? library.manager->getSimilarityIndex() : ownIndex;
+
+        SimilarityIndex::Signature signature;
+        SimilarityIndex::computeSignature(canvas, signature);
+
+        std::vector<SimilarityIndex::Result> results;
+        auto start = std::chrono::high_resolution_clock::now();
+        index.query(signature, k, results, options.numThreads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        for (auto& result : results)
+            fprintf(stdout, "%8u %s\n", result.distance, result.filename.c_str());
+        fprintf(stdout, "Queried %zu styles in %.3f ms\n", index.getCount(), ms);
+        return 0;
+    }
+
+    /**
+    * Times similarity queries over count synthetic signatures. The index file is written to dir.
+    */
+    int benchSimilar(const std::string& dir, size_t count, const Options& options)
+    {
+        std::string path = dir + "/bench.index";
+        file::remove(path);
+
+        // Smooth random canvases so the signatures are not uniformly distributed noise
+        SimilarityIndex index(path);
+        std::vector<SimilarityIndex::Signature> signatures(16);
+        uint32_t seed = 1;
+        for (auto& signature : signatures)
+        {
+            Canvas canvas(64, 64);
+            for (size_t i = 0; i < canvas.getSize(); ++i)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                canvas.data()[i] = uint8_t((i / 3 % 64 + (i / 192) + (seed >> 28)) * (seed % 7 + 1));
+            }
+            SimilarityIndex::computeSignature(canvas, signature);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            SimilarityIndex::Signature signature = signatures[i % signatures.size()];
+            for (size_t b = 0; b < SimilarityIndex::SIGNATURE_SIZE; ++b)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                signature.data[b] = uint8_t(std::min(255, std::max(0, int(signature.data[b]) + int(seed >> 29) - 4)));
+            }
+            index.add("bench" + std::to_string(i) + ".style", signature);
+        }
+
+        const int repeats = 20;
+        std::vector<SimilarityIndex::Result> results;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; ++r)
+            index.query(signatures[r % signatures.size()], 10, results, options.numThreads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+
+        fprintf(stdout, "Top 10 query over %zu signatures on %zu threads: %.3f ms\n", index.getCount(), options.numThreads, ms);
+        file::remove(path);
+        return 0;
+    }
+
+    /**
+    * Bundles all styles of a library into a single style pack. Styles are read and serialized
+    * in parallel batches and appended in library order.
+    */
+    int pack(Library& library, const std::string& packPath, const Options& options)
+    {
+        StylePackWriter writer;
+        if (!writer.open(packPath))
+            return 1;
+
+        Throughput throughput;
+        size_t batchSize = options.numThreads * 4;
+        std::vector<std::string> styles(batchSize);
+        std::vector<char> valid(batchSize);
+        size_t numFailed = 0;
+
+        for (size_t begin = 0; begin < library.filenames.size(); begin += batchSize)
+        {
+            size_t end = std::min(begin + batchSize, library.filenames.size());
+            parallel::forEach(end - begin, [&](size_t i)
+            {
+                Canvas canvas;
+                std::ostringstream output;
+                valid[i] = style::read(library.stylePath(begin + i), canvas, &library.tileStore()) && style::write(output, canvas);
+                styles[i] = output.str();
+                if (valid[i])
+                    throughput.add(canvas.getSize());
+            }, options.numThreads);
+
+            for (size_t i = 0; i < end - begin; ++i)
+            {
+                Hairstyle hairstyle = library.manager ? library.manager->getHairstyle(begin + i) : Hairstyle();
+                if (!valid[i] || !writer.add(library.filenames[begin + i], hairstyle, styles[i]))
+                {
+                    ERROR("Could not pack " << library.stylePath(begin + i));
+                    ++numFailed;
+                }
+            }
+        }
+
+        if (!writer.finish())
+            return 1;
+
+        throughput.report("Packed", options.numThreads);
+        return numFailed == 0 ? 0 : 1;
+    }
+
+    /**
+    * Times opening a style pack and the first load of count styles spread over the pack.
+    * Run it on a cold page cache to measure cold-start browsing.
+    */
+    int benchPack(const std::string& packPath, size_t count)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        HairstyleManager manager(packPath);
+        double openMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if (manager.getCount() == 0)
+        {
+            ERROR(packPath << " contains no styles.");
+            return 1;
+        }
+
+        count = std::min(count, manager.getCount());
+        double maxMs = 0.0;
+        start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto loadStart = std::chrono::high_resolution_clock::now();
+            Canvas canvas;
+            Hairstyle hairstyle;
+            if (!manager.load(i * manager.getCount() / count, canvas, hairstyle))
+                return 1;
+            maxMs = std::max(maxMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count());
+        }
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        fprintf(stdout, "Opened %zu styles in %.3f ms, loaded %zu styles in %.3f ms (%.3f ms average, %.3f ms max)\n",
+                manager.getCount(), openMs, count, loadMs, loadMs / count, maxMs);
+        return 0;
+    }
+
+    /**
+    * Writes a synthetic mesh (a vertex grid) with the given vertex buffer size in the .raw format.
+    */
+    bool writeRawMesh(const std::string& vbPath, const std::string& ibPath, size_t vbBytes)
+    {
+        uint32_t side = std::max(2u, uint32_t(std::sqrt(double(vbBytes) / (RawMesh::VERTEX_FLOATS * sizeof(float)))));
+
+        std::vector<float> vertices;
+        vertices.reserve(size_t(side) * side * RawMesh::VERTEX_FLOATS);
+        for (uint32_t y = 0; y < side; ++y)
+        {
+            for (uint32_t x = 0; x < side; ++x)
+            {
+                float u = float(x) / (side - 1);
+                float v = float(y) / (side - 1);
+                float vertex[RawMesh::VERTEX_FLOATS] = { u, v, 0.f, u, v, 0.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f };
+                vertices.insert(vertices.end(), vertex, vertex + RawMesh::VERTEX_FLOATS);
+            }
+        }
+
+        std::vector<uint32_t> indices;
+        indices.reserve(size_t(side - 1) * (side - 1) * 6);
+        for (uint32_t y = 0; y + 1 < side; ++y)
+        {
+            for (uint32_t x = 0; x + 1 < side; ++x)
+            {
+                uint32_t i = y * side + x;
+                uint32_t quad[6] = { i, i + 1, i + side, i + 1, i + side + 1, i + side };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+
+        std::ofstream vb(vbPath, std::ios::binary);
+        std::ofstream ib(ibPath, std::ios::binary);
+        uint32_t floatCount = uint32_t(vertices.size());
+        uint32_t indexCount = uint32_t(indices.size());
+        vb.write(reinterpret_cast<const char*>(&floatCount), sizeof(uint32_t));
+        vb.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(float));
+        ib.write(reinterpret_cast<const char*>(&indexCount), sizeof(uint32_t));
+        ib.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+        return bool(vb) && bool(ib);
+    }
+
+    /**
+    * Compares the old stream copy mesh loading (istreambuf_iterator into a vector) with RawMesh
+    * for vertex buffers from 1 MB up to maxMegabytes. The final copy into a destination buffer stands in
+    * for glBufferData, which both loaders end with. Files are read from the page cache after writing them.
+    */
+    int benchMesh(const std::string& dir, size_t maxMegabytes)
+    {
+        std::string vbPath = dir + "/benchVB.raw";
+        std::string ibPath = dir + "/benchIB.raw";
+        typedef std::chrono::high_resolution_clock Clock;
+
+        fprintf(stdout, "%10s %10s %12s %12s %8s\n", "VB MB", "IB MB", "stream ms", "mapped ms", "speedup");
+        for (size_t megabytes = 1; megabytes <= maxMegabytes; megabytes *= 4)
+        {
+            if (!writeRawMesh(vbPath, ibPath, megabytes * 1024 * 1024))
+            {
+                ERROR("Could not write the benchmark mesh to " << dir);
+                return 1;
+            }
+
+            std::vector<char> upload(file::getSize(vbPath) + file::getSize(ibPath));
+
+            auto start = Clock::now();
+            {
+                std::ifstream vbInput(vbPath, std::ios::binary);
+                std::vector<char> vertices{ std::istreambuf_iterator<char>(vbInput), std::istreambuf_iterator<char>() };
+                std::ifstream ibInput(ibPath, std::ios::binary);
+                std::vector<char> indices{ std::istreambuf_iterator<char>(ibInput), std::istreambuf_iterator<char>() };
+                memcpy(upload.data(), vertices.data() + 4, vertices.size() - 4);
+                memcpy(upload.data() + vertices.size(), indices.data() + 4, indices.size() - 4);
+            }
+            double streamMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            start = Clock::now();
+            {
+                RawMesh mesh;
+                if (!mesh.open(vbPath, ibPath))
+                    return 1;
+                memcpy(upload.data(), mesh.getVertices(), mesh.getFloatCount() * sizeof(float));
+                memcpy(upload.data() + mesh.getFloatCount() * sizeof(float), mesh.getIndices(), mesh.getIndexCount() * sizeof(uint32_t));
+            }
+            double mappedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            fprintf(stdout, "%10.1f %10.1f %12.2f %12.2f %7.1fx\n",
+                    file::getSize(vbPath) / (1024.0 * 1024.0), file::getSize(ibPath) / (1024.0 * 1024.0),
+                    streamMs, mappedMs, streamMs / mappedMs);
+        }
+
+        file::remove(vbPath);
+        file::remove(ibPath);
+        return 0;
+    }
+
+    /**
+    * Prints the buffer sizes of the float and compact vertex formats and the quantization error of the compact one.
+    */
+    int meshInfo(const std::string& vbPath, const std::string& ibPath)
+    {
+        RawMesh mesh;
+        CompactMesh compactMesh;
+        if (!mesh.open(vbPath, ibPath))
+            return 1;
+        if (!compactMesh.build(mesh))
+        {
+            ERROR(vbPath << " has texture coordinates outside of [0, 1] and has no compact format.");
+            return 1;
+        }
+
+        auto angle = [](const glm::vec3& a, const glm::vec3& b)
+        {
+            return std::acos(std::min(1.0f, std::max(-1.0f, glm::dot(glm::normalize(a), glm::normalize(b))))) * 180.0f / 3.14159265f;
+        };
+
+        float maxPositionError = 0.0f;
+        float maxUVError = 0.0f;
+        float maxNormalAngle = 0.0f;
+        std::vector<float> bitangentAngles;
+        for (size_t i = 0; i < mesh.getVertexCount(); ++i)
+        {
+            const float* v = mesh.getVertices() + i * RawMesh::VERTEX_FLOATS;
+            const CompactVertex& compact = compactMesh.getVertices()[i];
+            maxPositionError = std::max(maxPositionError, glm::length(compactMesh.decodePosition(compact) - glm::vec3(v[0], v[1], v[2])));
+            maxUVError = std::max(maxUVError, std::max(std::abs(compact.uv[0] / 65535.0f - v[3]), std::abs(compact.uv[1] / 65535.0f - v[4])));
+            maxNormalAngle = std::max(maxNormalAngle, angle(CompactMesh::decodeOctahedral(compact.normal), glm::vec3(v[5], v[6], v[7])));
+            bitangentAngles.push_back(angle(CompactMesh::decodeOctahedral(compact.bitangent), glm::vec3(v[11], v[12], v[13])));
+        }
+        std::sort(bitangentAngles.begin(), bitangentAngles.end());
+
+        size_t floatBytes = mesh.getFloatCount() * sizeof(float) + mesh.getIndexCount() * sizeof(uint32_t);
+        size_t compactBytes = compactMesh.getVertices().size() * sizeof(CompactVertex) +
+                              mesh.getIndexCount() * (compactMesh.getShortIndices().empty() ? sizeof(uint32_t) : sizeof(uint16_t));
+
+        fprintf(stdout, "%zu vertices, %zu triangles\n", mesh.getVertexCount(), mesh.getIndexCount() / 3);
+        fprintf(stdout, "Float:   %zu bytes per vertex, 32 bit indices, %zu bytes\n", RawMesh::VERTEX_FLOATS * sizeof(float), floatBytes);
+        fprintf(stdout, "Compact: %zu bytes per vertex, %s bit indices, %zu bytes (%.1fx smaller)\n",
+                sizeof(CompactVertex), compactMesh.getShortIndices().empty() ? "32" : "16", compactBytes, double(floatBytes) / compactBytes);
+        fprintf(stdout, "Max position error %g, max UV error %g, max normal error %.3f degrees\n", maxPositionError, maxUVError, maxNormalAngle);
+        fprintf(stdout, "Bitangent error: median %.2f, max %.2f degrees\n",
+                bitangentAngles[bitangentAngles.size() / 2], bitangentAngles.back());
+        return 0;
+    }
+
+    /**
+    * Optimizes the triangle and vertex order of a mesh, builds its levels of detail and writes its mesh cache,
+    * which Mesh::load() prefers.
+    */
+    int meshCache(const std::string& vbPath, const std::string& ibPath, float overdrawThreshold, size_t numThreads)
+    {
+        RawMesh mesh;
+        if (!mesh.open(vbPath, ibPath))
+            return 1;
+
+        auto report = [&mesh](const char* stage, const std::vector<uint32_t>& indices)
+        {
+            for (uint32_t cacheSize : { 16u, 32u })
+            {
+                meshops::VertexCacheStats stats = meshops::analyzeVertexCache(indices.data(), indices.size(), mesh.getVertexCount(), cacheSize);
+                fprintf(stdout, "%-14s cache %2u: ACMR %.3f ATVR %.3f\n", stage, cacheSize, stats.acmr, stats.atvr);
+            }
+        };
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<uint32_t> indices(mesh.getIndices(), mesh.getIndices() + mesh.getIndexCount());
+        report("Original", indices);
+
+        std::vector<uint32_t> optimized;
+        meshops::optimizeVertexCache(indices.data(), indices.size(), mesh.getVertexCount(), optimized);
+        report("Vertex cache", optimized);
+
+        size_t clusters = meshops::optimizeOverdraw(optimized, mesh.getVertices(), mesh.getVertexCount(), RawMesh::VERTEX_FLOATS, overdrawThreshold);
+        report("Overdraw", optimized);
+
+        // Every level halves the triangle count of the previous one. They are simplified from the full mesh independently.
+        const size_t MAX_LODS = 6;
+        const size_t MIN_LOD_TRIANGLES = 256;
+        std::vector<std::vector<uint32_t>> lodIndices(MAX_LODS);
+        std::vector<float> lodErrors(MAX_LODS, 0.0f);
+        std::vector<meshops::Meshlet> meshlets;
+        meshops::buildMeshlets(optimized, mesh.getVertices(), mesh.getVertexCount(), RawMesh::VERTEX_FLOATS, meshlets);
+        report("Meshlets", optimized);
+        lodIndices[0] = optimized;
+        parallel::forEach(MAX_LODS - 1, [&](size_t i)
+        {
+            size_t lod = i + 1;
+            size_t targetIndexCount = (optimized.size() / 3 >> lod) * 3;
+            if (targetIndexCount / 3 < MIN_LOD_TRIANGLES)
+                return;
+
+            std::vector<uint32_t> simplified;
+            lodErrors[lod] = meshops::simplify(optimized.data(), optimized.size(), mesh.getVertices(), mesh.getVertexCount(),
+                                               RawMesh::VERTEX_FLOATS, targetIndexCount, 1e30f, simplified);
+            meshops::optimizeVertexCache(simplified.data(), simplified.size(), mesh.getVertexCount(), lodIndices[lod]);
+        }, numThreads);
+
+        // Levels that are not much smaller than the previous one (e.g. locked by seams) are dropped
+        std::vector<uint32_t> allIndices;
+        std::vector<RawMesh::Lod> lods;
+        for (size_t lod = 0; lod < MAX_LODS; ++lod)
+        {
+            if (lodIndices[lod].empty() || (!lods.empty() && lodIndices[lod].size() > lods.back().indexCount * 8 / 10))
+                continue;
+
+            RawMesh::Lod range;
+            range.firstIndex = uint32_t(allIndices.size());
+            range.indexCount = uint32_t(lodIndices[lod].size());
+            range.error = lodErrors[lod];
+            lods.push_back(range);
+            allIndices.insert(allIndices.end(), lodIndices[lod].begin(), lodIndices[lod].end());
+        }
+
+        std::vector<float> vertices;
+        size_t vertexCount = meshops::optimizeVertexFetch(allIndices, mesh.getVertices(), mesh.getVertexCount(), RawMesh::VERTEX_FLOATS, vertices);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::string cachePath = RawMesh::getCachePath(vbPath);
+        if (!RawMesh::writeCache(cachePath, vertices.data(), vertices.size(), allIndices.data(), allIndices.size(),
+                                 lods.data(), lods.size(), meshlets.data(), meshlets.size(), mesh.computeHash()))
+            return 1;
+
+        for (size_t lod = 0; lod < lods.size(); ++lod)
+        {
+            meshops::VertexCacheStats stats = meshops::analyzeVertexCache(allIndices.data() + lods[lod].firstIndex, lods[lod].indexCount, vertexCount);
+            fprintf(stdout, "LOD %zu: %6u triangles, error %.4f, ACMR %.3f\n", lod, lods[lod].indexCount / 3, lods[lod].error, stats.acmr);
+        }
+
+        fprintf(stdout, "%zu overdraw clusters, %zu meshlets, %zu of %zu vertices used, optimized in %.1f ms\n",
+                clusters, meshlets.size(), vertexCount, mesh.getVertexCount(), ms);
+        fprintf(stdout, "Wrote %s\n", cachePath.c_str());
+        return 0;
+    }
+
+    /**
+    * Culls the meshlets of a mesh cache from random directions around the mesh, like the model view does.
+    */
+    int benchCull(const std::string& vbPath, const std::string& ibPath, float distance, float padding)
+    {
+        RawMesh sourceMesh;
+        RawMesh mesh;
+        if (!sourceMesh.open(vbPath, ibPath))
+            return 1;
+
+        if (!mesh.openCache(RawMesh::getCachePath(vbPath), sourceMesh.computeHash()) || mesh.getMeshlets().empty())
+        {
+            ERROR("There is no up to date mesh cache with meshlets for " << vbPath << ", run meshcache first.");
+            return 1;
+        }
+
+        const size_t VIEWS = 1000;
+        MeshletCuller culler;
+        culler.setMeshlets(mesh.getMeshlets().data(), mesh.getMeshlets().size());
+        glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+
+        std::vector<glm::mat4> modelViews(VIEWS);
+        srand(1);
+        for (auto& modelView : modelViews)
+        {
+            glm::vec3 axis = glm::normalize(glm::vec3(rand() / float(RAND_MAX) - 0.5f, rand() / float(RAND_MAX) - 0.5f, rand() / float(RAND_MAX) - 0.5f));
+            float angle = rand() / float(RAND_MAX) * 2.0f * glm::pi<float>();
+            modelView = glm::lookAt(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(glm::mat4(1.0f), angle, axis);
+        }
+
+        std::vector<uint32_t> firstIndices;
+        std::vector<uint32_t> indexCounts;
+        size_t visibleIndices = 0;
+        size_t draws = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto& modelView : modelViews)
+        {
+            visibleIndices += culler.cull(modelView, proj, padding, firstIndices, indexCounts);
+            draws += indexCounts.size();
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / VIEWS;
+
+        const RawMesh::Lod& fullMesh = mesh.getLod(0);
+        fprintf(stdout, "%zu meshlets, %.1f triangles per meshlet\n", mesh.getMeshlets().size(), fullMesh.indexCount / 3.0 / mesh.getMeshlets().size());
+        fprintf(stdout, "Visible: %.1f%% of %u triangles in %.1f draws on average, culling takes %.2f us\n",
+                100.0 * visibleIndices / VIEWS / fullMesh.indexCount, fullMesh.indexCount / 3, double(draws) / VIEWS, us);
+        return 0;
+    }
+
+    /**
+    * Converts an .obj or .ply file to a .raw vertex and index buffer pair and writes its mesh cache.
+    */
+    int importMesh(const std::string& meshPath, const std::string& vbPath, const std::string& ibPath, const Options& options)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        meshimport::ImportedMesh mesh;
+        if (!meshimport::load(meshPath, mesh, options.numThreads))
+            return 1;
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        fprintf(stdout, "Imported %zu vertices, %zu triangles in %.1f ms on %zu threads%s%s\n", mesh.getVertexCount(), mesh.indices.size() / 3,
+                ms, options.numThreads, mesh.generatedNormals ? ", generated normals" : "", mesh.hasTexCoords ? "" : ", no texture coordinates");
+
+        if (!meshimport::write(mesh, vbPath, ibPath))
+            return 1;
+
+        fprintf(stdout, "Wrote %s and %s\n", vbPath.c_str(), ibPath.c_str());
+        return meshCache(vbPath, ibPath, 1.05f, options.numThreads);
+    }
+
+    void printUsage()
+    {
+        fprintf(stdout,
+            "Usage: hairstylist-tool <command> [--threads N] [--tiled] [--bicubic] [--mask <style>] <arguments>\n"
+            "  validate   <dir>                   Checks that every style can be read\n"
+            "  stats      <dir>                   Prints channel statistics and tile deduplication potential\n"
+            "  convert    <dir> <outDir>          Rewrites all styles as inline styles (--tiled: deduplicated tiles)\n"
+            "  recompress <dir>                   Rewrites all styles in place as deduplicated tiled styles\n"
+            "  resample   <dir> <outDir> <size>   Resamples all styles to size x size (--bicubic: bicubic filter)\n"
+            "  thumbnails <dir> <outDir> <size>   Writes PPM previews of at least size x size from the embedded mips\n"
+            "  diff       <dirA> <dirB>           Compares styles with the same name\n"
+            "  variations <dir> <outDir> <steps>  Blends steps in-between styles for neighbouring styles (--mask <style>)\n"
+            "  bench-blend <size>                 Times the blend kernel on size x size canvases\n"
+            "  index      <dir>                   Adds missing styles to the similarity index\n"
+            "  similar    <dir> <style> [k]       Lists the k styles most similar to the given style file\n"
+            "  bench-similar <dir> <count>        Times similarity queries over count synthetic signatures\n"
+            "  bench-mesh <dir> <maxMB>           Times mesh loading for vertex buffers of 1 MB up to maxMB\n"
+            "  meshinfo   <vb.raw> <ib.raw>       Compares the float and compact vertex formats of a mesh\n"
+            "  meshcache  <vb.raw> <ib.raw> [t]   Optimizes triangle and vertex order, builds LODs and writes the mesh cache\n"
+            "                                     (t: overdraw ACMR threshold, default 1.05)\n"
+            "  bench-cull <vb.raw> <ib.raw> [d] [p] Times meshlet culling from distance d (default 10) with padding p\n"
+            "  import     <mesh> <vb.raw> <ib.raw> Converts an .obj or binary .ply mesh and writes its mesh cache\n"
+            "  pack       <dir> <out.hspack>      Bundles all styles into a single memory-mapped style pack\n"
+            "  bench-pack <pack> [count]          Times opening a style pack and loading count styles from it\n"
+            "Directories with an info file (e.g. preset.info) are read through HairstyleManager.\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::string command = argv[1];
+    Options options;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            options.numThreads = size_t(std::atoi(argv[++i]));
+        else if (arg == "--tiled")
+            options.tiled = true;
+        else if (arg == "--bicubic")
+            options.filter = canvasops::Filter::Bicubic;
+        else if (arg == "--mask" && i + 1 < argc)
+            options.maskPath = argv[++i];
+        else
+            options.arguments.push_back(arg);
+    }
+
+    if (options.numThreads == 0)
+        options.numThreads = parallel::threadCount();
+
+    auto& args = options.arguments;
+    if (command == "bench-blend" && !args.empty())
+        return benchBlend(uint32_t(std::atoi(args[0].c_str())), options);
+
+    if (command == "bench-similar" && args.size() >= 2)
+        return benchSimilar(args[0], size_t(std::atoll(args[1].c_str())), options);
+
+    if (command == "bench-mesh" && args.size() >= 2)
+        return benchMesh(args[0], size_t(std::atoll(args[1].c_str())));
+
+    if (command == "meshinfo" && args.size() >= 2)
+        return meshInfo(args[0], args[1]);
+
+    if (command == "meshcache" && args.size() >= 2)
+        return meshCache(args[0], args[1], args.size() >= 3 ? float(std::atof(args[2].c_str())) : 1.05f, options.numThreads);
+
+    if (command == "bench-cull" && args.size() >= 2)
+        return benchCull(args[0], args[1], args.size() >= 3 ? float(std::atof(args[2].c_str())) : 10.0f,
+                         args.size() >= 4 ? float(std::atof(args[3].c_str())) : 0.0f);
+
+    if (command == "import" && args.size() >= 3)
+        return importMesh(args[0], args[1], args[2], options);
+
+    if (command == "bench-pack" && !args.empty())
+        return benchPack(args[0], args.size() >= 2 ? size_t(std::atoll(args[1].c_str())) : 10);
+
+    Library library;
+    if (args.empty() || !openLibrary(args[0], library))
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (command == "validate")
+        return validate(library, options);
+    if (command == "stats")
+        return stats(library, options);
+    if (command == "recompress")
+        return recompress(library, options);
+    if (command == "index")
+        return index(library, options);
+    if (command == "similar" && args.size() >= 2)
+        return similar(library, args[1], args.size() >= 3 ? size_t(std::atoi(args[2].c_str())) : 10, options);
+    if (command == "convert" && args.size() >= 2)
+        return convert(library, args[1], options);
+    if (command == "resample" && args.size() >= 3)
+        return resample(library, args[1], uint32_t(std::atoi(args[2].c_str())), options);
+    if (command == "thumbnails" && args.size() >= 3)
+        return thumbnails(library, args[1], uint32_t(std::atoi(args[2].c_str())), options);
+    if (command == "pack" && args.size() >= 2)
+        return pack(library, args[1], options);
+    if (command == "variations" && args.size() >= 3)
+        return variations(library, args[1], uint32_t(std::atoi(args[2].c_str())), options);
+
+    Library other;
+    if (command == "diff" && args.size() >= 2 && openLibrary(args[1], other))
+        return diff(library, other, options);
+
+    printUsage();
+    return 1;
+}